@@ -31,6 +31,57 @@ static inline void write_ttbr0(uint32_t val) {
     asm volatile("dmb");
 }
 
+/**
+ * write the 64 bit TTBR0 of the long descriptor format, the asid lives in bits [55:48] next to the table base,
+ * so the table and its asid change in a single write
+ */
+static inline void write_ttbr0_asid(uint32_t pageTable, uint32_t asid) {
+    asm volatile("mcrr p15, 0, %0, %1, c2\n\t"
+                 "isb"
+                 :
+                 : "r"(pageTable), "r"(asid << 16)
+                 : "memory");
+}
+
+/**
+ * write context id register (CONTEXTIDR), only a process id for debug and trace in the long descriptor format
+ */
+static inline void write_contextidr(uint32_t val) {
+    asm volatile("mcr p15, 0, %0, c13, c0, 1\n\t"
+                 "isb"
+                 :
+                 : "r"(val));
+}
+
+/**
+ * invalidate the whole tlb of this cpu (TLBIALL)
+ */
+static inline void tlb_invalidate_all(void) {
+    asm volatile("dsb\n\t"
+                 "mcr p15, 0, %0, c8, c7, 0\n\t"
+                 "dsb\n\t"
+                 "isb"
+                 :
+                 : "r"(0)
+                 : "memory");
+}
+
+/**
+ * read memory attribute indirection register 0 (MAIR0), attributes 0-3 of the long descriptor format
+ */
+static inline uint32_t read_mair0(void) {
+    uint32_t val;
+    asm volatile("mrc p15, 0, %0, c10, c2, 0"
+                 : "=r"(val));
+    return val;
+}
+
+static inline void write_mair0(uint32_t val) {
+    asm volatile("mcr p15, 0, %0, c10, c2, 0"
+                 :
+                 : "r"(val));
+}
+
 /**
  * read translation table base control register (TTBCR)
  * @return
@@ -0,0 +1,40 @@
+//
+// Created by XingfengYang on 2021/1/30.
+//
+
+#ifndef SYNESTIAOS_PMU_H
+#define SYNESTIAOS_PMU_H
+
+#include "libc/stdint.h"
+
+#define PMCR_ENABLE (1u << 0)
+#define PMCR_CYCLE_RESET (1u << 2)
+#define PMCNTEN_CYCLE (1u << 31)
+
+/**
+ * start the cycle counter (PMCCNTR) of the calling cpu, every cpu has its own and counts at the core clock
+ */
+static inline void pmu_enable_cycle_counter(void) {
+    uint32_t pmcr;
+    asm volatile("mrc p15, 0, %0, c9, c12, 0"
+                 : "=r"(pmcr));
+    asm volatile("mcr p15, 0, %0, c9, c12, 0"
+                 :
+                 : "r"(pmcr | PMCR_ENABLE | PMCR_CYCLE_RESET));
+    asm volatile("mcr p15, 0, %0, c9, c12, 1"
+                 :
+                 : "r"(PMCNTEN_CYCLE));
+    asm volatile("isb");
+}
+
+/**
+ * the 32 bit cycle counter wraps every few seconds, differences of two reads are right as long as they are shorter
+ */
+static inline uint32_t read_pmccntr(void) {
+    uint32_t value;
+    asm volatile("mrc p15, 0, %0, c9, c13, 0"
+                 : "=r"(value));
+    return value;
+}
+
+#endif//SYNESTIAOS_PMU_H
@@ -16,6 +16,38 @@ static inline uint32_t read_cpuid(void) {
     return cpuid;
 }
 
+/**
+ * read the virtual count of the generic timer (CNTVCT), it is a 64 bit counter
+ * running at the frequency of CNTFRQ
+ */
+static inline uint64_t read_cntvct(void) {
+    uint32_t low, high;
+    asm volatile("isb\n\t"
+                 "mrrc p15, 1, %0, %1, c14"
+                 : "=r"(low), "=r"(high));
+    return ((uint64_t) high << 32) | low;
+}
+
+/**
+ * read the frequency of the generic timer (CNTFRQ)
+ */
+static inline uint32_t read_cntfrq(void) {
+    uint32_t value;
+    asm volatile("mrc p15, 0, %0, c14, c0, 0"
+                 : "=r"(value));
+    return value;
+}
+
+/**
+ * TPIDRPRW, the thread id register only privileged modes can access. the kernel keeps the offset of the
+ * current cpu's per-cpu area in it, boot.S sets it on every cpu
+ */
+static inline uint32_t read_tpidrprw(void) {
+    uint32_t value;
+    asm volatile("mrc p15, 0, %0, c13, c0, 4"
+                 : "=r"(value));
+    return value;
+}
 
 typedef struct RegisterCPSR {
     union {
@@ -0,0 +1,64 @@
+//
+// Created by XingfengYang on 2021/1/22.
+//
+
+#ifndef SYNESTIAOS_VFP_H
+#define SYNESTIAOS_VFP_H
+
+#include "libc/stdbool.h"
+#include "libc/stdint.h"
+
+#define VFP_REGISTERS 32
+#define FPEXC_EN (1u << 30)
+
+/**
+ * the whole vfp/neon register file, d0-d31 alias q0-q15
+ */
+typedef struct VfpContext {
+    uint64_t d[VFP_REGISTERS];
+    uint32_t fpscr;
+} VfpContext;
+
+static inline uint32_t read_fpexc(void) {
+    uint32_t value;
+    asm volatile("vmrs %0, fpexc"
+                 : "=r"(value));
+    return value;
+}
+
+static inline void write_fpexc(uint32_t value) {
+    asm volatile("vmsr fpexc, %0\n\t"
+                 "isb"
+                 :
+                 : "r"(value)
+                 : "memory");
+}
+
+static inline bool vfp_is_enabled(void) {
+    return (read_fpexc() & FPEXC_EN) != 0;
+}
+
+static inline void vfp_enable(void) {
+    write_fpexc(read_fpexc() | FPEXC_EN);
+}
+
+static inline void vfp_disable(void) {
+    write_fpexc(read_fpexc() & ~FPEXC_EN);
+}
+
+/**
+ * grant cp10 and cp11 access through CPACR and leave FPEXC.EN cleared,
+ * so the first vfp or neon instruction raises an undefined instruction exception
+ */
+void vfp_init(void);
+
+void vfp_save(VfpContext *context);
+
+void vfp_restore(VfpContext *context);
+
+/**
+ * whether an arm state instruction is a vfp or advanced simd one, which undefines while FPEXC.EN is cleared
+ */
+bool vfp_is_vfp_instruction(uint32_t instruction);
+
+#endif //SYNESTIAOS_VFP_H
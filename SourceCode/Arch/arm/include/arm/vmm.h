@@ -7,6 +7,11 @@
 
 #include "page.h"
 
+// asids of the long descriptor format, 0 is never handed out
+#define VMM_ASID_BITS 8
+#define VMM_ASID_COUNT (1u << VMM_ASID_BITS)
+#define VMM_ASID_MASK (VMM_ASID_COUNT - 1)
+
 typedef struct PageTableEntry {
     /* These are used in all kinds of entry. */
     uint64_t valid : 1; /* Valid mapping */
@@ -72,12 +77,22 @@ typedef struct VirtualMemoryOperations {
 
 typedef struct VirtualMemory {
     PageTableEntry *pageTable;
+    // allocator generation in the upper bits and the asid in the low VMM_ASID_BITS, 0 before the first switch
+    uint32_t asidContext;
     VirtualMemoryOperations operations;
     PhysicalPageAllocator *physicalPageAllocator;
 } VirtualMemory;
 
+static inline uint32_t vmm_asid(uint32_t asidContext) {
+    return asidContext & VMM_ASID_MASK;
+}
+
+void vmm_set_ops(VirtualMemory *virtualMemory);
+
 KernelStatus vmm_create(VirtualMemory *virtualMemory, struct PhysicalPageAllocator *physicalPageAllocator);
 
+uint32_t vmm_asid_rollovers(void);
+
 void do_page_fault(uint32_t address);
 
 #endif//__KERNEL_VMM_H__
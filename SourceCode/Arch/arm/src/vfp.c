@@ -0,0 +1,56 @@
+//
+// Created by XingfengYang on 2021/1/22.
+//
+
+#include "arm/vfp.h"
+
+#define CPACR_CP10_CP11_FULL_ACCESS (0xFu << 20)
+
+void vfp_init(void) {
+    uint32_t cpacr;
+    asm volatile("mrc p15, 0, %0, c1, c0, 2"
+                 : "=r"(cpacr));
+    cpacr |= CPACR_CP10_CP11_FULL_ACCESS;
+    asm volatile("mcr p15, 0, %0, c1, c0, 2\n\t"
+                 "isb"
+                 :
+                 : "r"(cpacr));
+    write_fpexc(0);
+}
+
+void vfp_save(VfpContext *context) {
+    uint64_t *d = context->d;
+    asm volatile("vstmia %0!, {d0-d15}\n\t"
+                 "vstmia %0, {d16-d31}"
+                 : "+r"(d)
+                 :
+                 : "memory");
+    asm volatile("vmrs %0, fpscr"
+                 : "=r"(context->fpscr));
+}
+
+void vfp_restore(VfpContext *context) {
+    uint64_t *d = context->d;
+    asm volatile("vldmia %0!, {d0-d15}\n\t"
+                 "vldmia %0, {d16-d31}"
+                 : "+r"(d)
+                 :
+                 : "memory");
+    asm volatile("vmsr fpscr, %0"
+                 :
+                 : "r"(context->fpscr));
+}
+
+bool vfp_is_vfp_instruction(uint32_t instruction) {
+    // advanced simd data processing
+    if ((instruction & 0xFE000000) == 0xF2000000) {
+        return true;
+    }
+    // advanced simd element and structure load/store
+    if ((instruction & 0xFF100000) == 0xF4000000) {
+        return true;
+    }
+    // coprocessor instructions on cp10 and cp11, but not svc which shares the top bits
+    return (instruction & 0x0C000000) == 0x0C000000 && (instruction & 0x0F000000) != 0x0F000000 &&
+           (instruction & 0x00000E00) == 0x00000A00;
+}
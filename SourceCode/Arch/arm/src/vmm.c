@@ -7,13 +7,31 @@
 #include "arm/kernel_vmm.h"
 #include "arm/mmu.h"
 #include "arm/page.h"
+#include "arm/register.h"
+#include "kernel/atomic.h"
+#include "kernel/cpu.h"
 #include "kernel/log.h"
 #include "kernel/scheduler.h"
+#include "kernel/spinlock.h"
 #include "kernel/type.h"
 #include "libc/stdlib.h"
+#include "libc/string.h"
 
 extern Scheduler cfsScheduler;
 
+// the asid context each cpu runs with, cleared by a rollover so the cpu's next switch takes the slow path
+Atomic vmmActiveAsids[SMP_MAX_CPUS];
+// the asid context each cpu ran with at the last rollover, it stays valid until the cpu switches again
+uint32_t vmmReservedAsids[SMP_MAX_CPUS];
+// asids handed out in the current generation
+uint32_t vmmAsidMap[VMM_ASID_COUNT / 32];
+volatile uint32_t vmmAsidGeneration = VMM_ASID_COUNT;
+uint32_t vmmAsidCursor = 1;
+uint32_t vmmAsidRollovers = 0;
+// cpus that still hold tlb entries of the previous generation
+CpuMask vmmTlbFlushPending = 0;
+SpinLock vmmAsidLock = SpinLockCreate();
+
 void virtual_memory_default_allocate_page(VirtualMemory *virtualMemory, uint32_t virtualAddress) {
     uint32_t l1Offset = (virtualAddress >> 30) & 0b11;
     uint32_t l2Offset = (virtualAddress >> 21) & 0b111111111;
@@ -53,6 +71,7 @@ void virtual_memory_default_allocate_page(VirtualMemory *virtualMemory, uint32_t
         pt[0].valid = 1;
         pt[0].table = 1;
         pt[0].af = 1;
+        pt[0].ng = 1;
         pt[0].base = (uint64_t) (virtualMemory->physicalPageAllocator->operations.allocPage4K(
                 virtualMemory->physicalPageAllocator, USAGE_NORMAL));
 
@@ -74,6 +93,7 @@ void virtual_memory_default_allocate_page(VirtualMemory *virtualMemory, uint32_t
             pt[0].valid = 1;
             pt[0].table = 1;
             pt[0].af = 1;
+            pt[0].ng = 1;
             pt[0].base = (uint64_t) (virtualMemory->physicalPageAllocator->operations.allocPage4K(
                     virtualMemory->physicalPageAllocator, USAGE_NORMAL));
         } else {
@@ -84,6 +104,7 @@ void virtual_memory_default_allocate_page(VirtualMemory *virtualMemory, uint32_t
                 pageTableEntry.valid = 1;
                 pageTableEntry.table = 1;
                 pageTableEntry.af = 1;
+                pageTableEntry.ng = 1;
                 pageTableEntry.base = (uint64_t) (virtualMemory->physicalPageAllocator->operations.allocPage4K(
                         virtualMemory->physicalPageAllocator, USAGE_NORMAL));
 
@@ -119,8 +140,126 @@ void virtual_memory_default_release(VirtualMemory *virtualMemory) {
     // TODO: release physical pages for page table when thread was fucking killed.
 }
 
+static bool vmm_asid_test_and_set(uint32_t asid) {
+    uint32_t bit = 1u << (asid % 32);
+    bool used = (vmmAsidMap[asid / 32] & bit) != 0;
+    vmmAsidMap[asid / 32] |= bit;
+    return used;
+}
+
+static uint32_t vmm_asid_find_free(uint32_t from) {
+    for (uint32_t asid = from; asid < VMM_ASID_COUNT; asid++) {
+        if (!(vmmAsidMap[asid / 32] & (1u << (asid % 32)))) {
+            return asid;
+        }
+    }
+    return 0;
+}
+
+/**
+ * start a new generation. only the asids running right now survive, every cpu flushes its tlb
+ * before it runs with an asid of the new generation, so no entry of a reused asid can hit.
+ */
+static void vmm_asid_rollover(void) {
+    // after 2^24 rollovers the generation wraps, 0 stays reserved for an address space never switched to
+    vmmAsidGeneration += VMM_ASID_COUNT;
+    if (vmmAsidGeneration == 0) {
+        vmmAsidGeneration = VMM_ASID_COUNT;
+    }
+    memset(vmmAsidMap, 0, sizeof(vmmAsidMap));
+    vmm_asid_test_and_set(0);
+    for (CpuNum cpuId = 0; cpuId < SMP_MAX_CPUS; cpuId++) {
+        uint32_t asidContext = atomic_xchg(&vmmActiveAsids[cpuId], 0);
+        // the cpu did not switch since the last rollover, it still runs with its reserved asid
+        if (asidContext == 0) {
+            asidContext = vmmReservedAsids[cpuId];
+        }
+        vmm_asid_test_and_set(vmm_asid(asidContext));
+        vmmReservedAsids[cpuId] = asidContext;
+    }
+    vmmTlbFlushPending = CPU_MASK_ALL;
+    vmmAsidCursor = 1;
+    vmmAsidRollovers++;
+}
+
+static bool vmm_asid_update_reserved(uint32_t asidContext, uint32_t newAsidContext) {
+    bool reserved = false;
+    for (CpuNum cpuId = 0; cpuId < SMP_MAX_CPUS; cpuId++) {
+        if (vmmReservedAsids[cpuId] == asidContext) {
+            vmmReservedAsids[cpuId] = newAsidContext;
+            reserved = true;
+        }
+    }
+    return reserved;
+}
+
+/**
+ * called with vmmAsidLock held, an address space keeps its asid across generations whenever it can
+ */
+static uint32_t vmm_asid_new_context(VirtualMemory *virtualMemory) {
+    uint32_t asidContext = virtualMemory->asidContext;
+    if (asidContext != 0) {
+        uint32_t newAsidContext = vmmAsidGeneration | vmm_asid(asidContext);
+        // it was running somewhere during the rollover
+        if (vmm_asid_update_reserved(asidContext, newAsidContext)) {
+            return newAsidContext;
+        }
+        if (!vmm_asid_test_and_set(vmm_asid(asidContext))) {
+            return newAsidContext;
+        }
+    }
+    uint32_t asid = vmm_asid_find_free(vmmAsidCursor);
+    if (asid == 0) {
+        vmm_asid_rollover();
+        asid = vmm_asid_find_free(vmmAsidCursor);
+    }
+    vmm_asid_test_and_set(asid);
+    vmmAsidCursor = asid;
+    return vmmAsidGeneration | asid;
+}
+
+/**
+ * make sure the address space has an asid of the current generation before this cpu runs with it
+ */
+static uint32_t vmm_asid_check(VirtualMemory *virtualMemory, CpuNum cpuId) {
+    uint32_t asidContext = virtualMemory->asidContext;
+    // a rollover clears the active asid of every cpu, a non zero old value means none came in between
+    if (asidContext != 0 && ((asidContext ^ vmmAsidGeneration) >> VMM_ASID_BITS) == 0 &&
+        atomic_xchg(&vmmActiveAsids[cpuId], asidContext) != 0) {
+        return asidContext;
+    }
+
+    vmmAsidLock.operations.acquire(&vmmAsidLock);
+    asidContext = virtualMemory->asidContext;
+    if (asidContext == 0 || ((asidContext ^ vmmAsidGeneration) >> VMM_ASID_BITS) != 0) {
+        asidContext = vmm_asid_new_context(virtualMemory);
+        virtualMemory->asidContext = asidContext;
+    }
+    CpuMask cpuMask = cpu_number_to_mask(cpuId);
+    if (vmmTlbFlushPending & cpuMask) {
+        vmmTlbFlushPending &= ~cpuMask;
+        tlb_invalidate_all();
+    }
+    atomic_set(&vmmActiveAsids[cpuId], asidContext);
+    vmmAsidLock.operations.release(&vmmAsidLock);
+    return asidContext;
+}
+
+/**
+ * switch this cpu to another address space, called with interrupts disabled.
+ * user mappings are not global, so with a per address space asid the tlb entries of the old one can stay.
+ */
 void virtual_memory_default_context_switch(VirtualMemory *old, VirtualMemory *new) {
-    // TODO: switch page table when thread switch
+    if (old == new) {
+        return;
+    }
+    uint32_t asidContext = vmm_asid_check(new, read_cpuid());
+    write_ttbr0_asid((uint32_t) new->pageTable, vmm_asid(asidContext));
+    write_contextidr(asidContext);
+}
+
+uint32_t vmm_asid_rollovers(void) {
+    return vmmAsidRollovers;
 }
 
 uint32_t virtual_memory_default_translate_to_physical(struct VirtualMemory *virtualMemory, uint32_t address) {
@@ -136,7 +275,7 @@ uint32_t virtual_memory_default_translate_to_physical(struct VirtualMemory *virt
     PageTableEntry *pageTable = (PageTableEntry *) (l2pte.base << VA_OFFSET);
     PageTableEntry pageTableEntry = pageTable[l3Offset];
 
-    uint32_t physicalPageAddress = pageTableEntry.base;
+    uint32_t physicalPageAddress = pageTableEntry.base << VA_OFFSET;
 
     return physicalPageAddress + pageOffset;
 }
@@ -159,7 +298,7 @@ void *virtual_memory_default_copy_to_kernel(struct VirtualMemory *virtualMemory,
     }
 }
 
-KernelStatus vmm_create(VirtualMemory *virtualMemory, PhysicalPageAllocator *physicalPageAllocator) {
+void vmm_set_ops(VirtualMemory *virtualMemory) {
     virtualMemory->operations.mappingPage = (VirtualMemoryOperationMappingPage) virtual_memory_default_mapping_page;
     virtualMemory->operations.contextSwitch = (VirtualMemoryOperationContextSwitch) virtual_memory_default_context_switch;
     virtualMemory->operations.allocatePage = (VirtualMemoryOperationAllocatePage) virtual_memory_default_allocate_page;
@@ -169,8 +308,12 @@ KernelStatus vmm_create(VirtualMemory *virtualMemory, PhysicalPageAllocator *phy
     virtualMemory->operations.copyToKernel = (VirtualMemoryOperationCopyToKernel) virtual_memory_default_copy_to_kernel;
     virtualMemory->operations.translateToPhysical = (VirtualMemoryOperationTranslateToPhysical) virtual_memory_default_translate_to_physical;
     virtualMemory->operations.getUserStrLen = (VirtualMemoryOperationGetUserStrLen) virtual_memory_default_get_user_str_len;
+}
 
+KernelStatus vmm_create(VirtualMemory *virtualMemory, PhysicalPageAllocator *physicalPageAllocator) {
+    vmm_set_ops(virtualMemory);
     virtualMemory->physicalPageAllocator = physicalPageAllocator;
+    virtualMemory->asidContext = 0;
 
     uint64_t ptPage = virtualMemory->physicalPageAllocator->operations.allocPage4K(virtualMemory->physicalPageAllocator,
                                                                                    USAGE_PAGE_TABLE);
@@ -190,6 +333,7 @@ KernelStatus vmm_create(VirtualMemory *virtualMemory, PhysicalPageAllocator *phy
     pt[0].valid = 1;
     pt[0].table = 1;
     pt[0].af = 1;
+    pt[0].ng = 1;
     pt[0].base = (uint64_t) (
             virtualMemory->physicalPageAllocator->operations.allocPage4K(virtualMemory->physicalPageAllocator,
                                                                          USAGE_NORMAL));
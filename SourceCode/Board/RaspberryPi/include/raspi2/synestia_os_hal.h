@@ -2,6 +2,7 @@
 #define __OS_HAL_H__
 
 #include "libc/stdbool.h"
+#include "libc/stdint.h"
 
 /**
  * bsp
@@ -13,6 +14,11 @@ void synestia_init_bsp(void);
 
 void synestia_init_timer(void);
 
+/**
+ * fire the timer interrupt after ms milliseconds, TICK_NO_EVENT stops the timer until it is programmed again
+ */
+void synestia_timer_set_next_event(uint32_t ms);
+
 void synestia_interrupt_enable(uint32_t no);
 bool synestia_interrupt_pending(uint32_t no);
 bool synestia_interrupt_clear(uint32_t no);
@@ -20,6 +26,22 @@ void synestia_interrupt_disable(uint32_t no);
 
 void synestia_init_interrupt(void);
 
+/**
+ * release a secondary cpu from the boot stub, it starts running at entry
+ */
+void synestia_cpu_start(uint32_t cpuId, uint32_t entry);
+
+/**
+ * raise an interrupt on cpuId, which runs its registered handlers and ticks like any other interrupt.
+ * a cpu whose timer is stopped looks at work queued for it this way
+ */
+void synestia_cpu_kick(uint32_t cpuId);
+
+/**
+ * acknowledge the kicks of the current cpu, returns whether there were any
+ */
+bool synestia_cpu_kick_clear(void);
+
 
 
 #endif// __OS_HAL_H__
@@ -8,4 +8,6 @@ extern void io_writel(uint32_t val, void *addr);
 
 void generic_timer_init(void);
 
+void generic_timer_set_next_event(uint32_t ms);
+
 #endif// __BOARD_RASP_TIMER_H__
@@ -1,11 +1,27 @@
 #include "raspi2/interrupt_controller.h"
 #include "raspi2/synestia_os_hal.h"
+#include "arm/register.h"
 #include "kernel/log.h"
 #include "libc/stdlib.h"
 #include "raspi2/timer.h"
 #include "raspi2/uart.h"
 #include "raspi2/gic400.h"
 
+// the boot stub of every secondary cpu spins on its core mailbox 3 until an entry address is written there
+#define CORE_MAILBOX3_SET 0x4000008C
+#define CORE_MAILBOX_STRIDE 0x10
+// core mailbox 0 kicks a core, any bit written to its set register raises an irq there until the core clears it
+#define CORE_MAILBOX0_SET 0x40000080
+#define CORE_MAILBOX0_CLEAR 0x400000C0
+#define CORE_MAILBOX_INTERRUPT_CONTROL 0x40000050
+#define CORE_MAILBOX0_IRQ_ENABLE 0x1
+#define CORE_COUNT 4
+
+#define GIC400_BASE 0xFF840000
+#define GIC400_DISTRIBUTOR_OFFSET 0x1000
+// the software generated interrupt a cpu is kicked with on the gic
+#define CPU_KICK_SGI 1
+
 void synestia_init_bsp(void) {
     uart_init();
     int mmioBase = PERIPHERAL_BASE;
@@ -21,6 +37,10 @@ void synestia_init_timer(void) {
     LogInfo("[HAL]: generic_timer_init complete.\n");
 }
 
+void synestia_timer_set_next_event(uint32_t ms) {
+    generic_timer_set_next_event(ms);
+}
+
 
 void synestia_interrupt_enable(uint32_t no) {
     interrupt_controller_enable(no);
@@ -41,8 +61,50 @@ void synestia_interrupt_disable(uint32_t no) {
 void synestia_init_interrupt(void) {
     LogInfo("[HAL] interrupt init\n")
 #if defined(RASPI4)
-    gic400_init(0xFF840000);
+    gic400_init((void *) GIC400_BASE);
 #else
     interrupt_controller_init();
+    for (uint32_t cpuId = 0; cpuId < CORE_COUNT; cpuId++) {
+        *(volatile uint32_t *) (CORE_MAILBOX_INTERRUPT_CONTROL + 4 * cpuId) = CORE_MAILBOX0_IRQ_ENABLE;
+    }
+#endif
+}
+
+void synestia_cpu_start(uint32_t cpuId, uint32_t entry) {
+#if !defined(RASPI4)
+    *(volatile uint32_t *) (CORE_MAILBOX3_SET + CORE_MAILBOX_STRIDE * cpuId) = entry;
+#endif
+    // cpus already parked in boot.S wait for an event instead
+    asm volatile("dsb");
+    asm volatile("sev");
+}
+
+void synestia_cpu_kick(uint32_t cpuId) {
+    // the work queued for the cpu has to be visible before the interrupt arrives there
+    asm volatile("dsb");
+#if defined(RASPI4)
+    GIC400Distributor *distributor = (GIC400Distributor *) (GIC400_BASE + GIC400_DISTRIBUTOR_OFFSET);
+    distributor->sgi = (1 << (16 + cpuId)) | CPU_KICK_SGI;
+#else
+    *(volatile uint32_t *) (CORE_MAILBOX0_SET + CORE_MAILBOX_STRIDE * cpuId) = 1;
+#endif
+}
+
+bool synestia_cpu_kick_clear(void) {
+#if defined(RASPI4)
+    // one pending bit per sending cpu in the byte of the sgi, the register is banked for every cpu
+    GIC400Distributor *distributor = (GIC400Distributor *) (GIC400_BASE + GIC400_DISTRIBUTOR_OFFSET);
+    uint32_t shift = (CPU_KICK_SGI % 4) * 8;
+    uint32_t pending = (distributor->spendsgi[CPU_KICK_SGI / 4] >> shift) & 0xFF;
+    if (pending != 0) {
+        distributor->cpendsgi[CPU_KICK_SGI / 4] = pending << shift;
+    }
+#else
+    volatile uint32_t *clear = (volatile uint32_t *) (CORE_MAILBOX0_CLEAR + CORE_MAILBOX_STRIDE * read_cpuid());
+    uint32_t pending = *clear;
+    if (pending != 0) {
+        *clear = pending;
+    }
 #endif
+    return pending != 0;
 }
@@ -28,20 +28,36 @@ void enable_cntv(void) {
     asm volatile("mcr p15, 0, %0, c14, c3, 1"::"r"(value));
 }
 
+void disable_cntv(void) {
+    uint32_t value = 0;
+    asm volatile("mcr p15, 0, %0, c14, c3, 1"::"r"(value));
+}
+
+void generic_timer_set_next_event(uint32_t ms) {
+    if (ms == TICK_NO_EVENT) {
+        disable_cntv();
+        return;
+    }
+    uint32_t countPerMs = read_cntfrq() / 1000;
+    uint32_t maxMs = 0x7FFFFFFF / countPerMs;
+    if (ms > maxMs) {
+        ms = maxMs;
+    }
+    write_cntvtval(countPerMs * ms);
+    enable_cntv();
+}
+
 void generic_timer_irq_clear(void) {
     // DO Nothing
 }
 
 void generic_timer_irq_handler(void) {
-    LogInfo("[Timer]: generic timer interrupted\n");
-    write_cntvtval(read_cntfrq() / 10);
-
+    // the interrupt manager reprograms the timer for the next event after running the ticks
     genericInterruptManager.operation.tick(&genericInterruptManager);
 }
 
 void generic_timer_init(void) {
-    write_cntvtval(read_cntfrq() / 10);
-    enable_cntv();
+    generic_timer_set_next_event(TICK_DEFAULT_INTERVAL_MS);
     enable_core0_irq();
 
     Interrupt timerInterrupt;
@@ -11,12 +11,50 @@ typedef struct Atomic {
     volatile uint32_t counter;
 } Atomic;
 
+/**
+ * ldrexd and strexd need a doubleword aligned address
+ */
+typedef struct Atomic64 {
+    volatile uint64_t counter __attribute__((aligned(8)));
+} Atomic64;
+
+/**
+ * ordering of the operations below:
+ *   - set and get are plain stores and loads, they order nothing
+ *   - operations returning a value without a suffix are fully ordered, no memory access moves across them
+ *   - _acquire: no later memory access moves before the operation
+ *   - _release: no earlier memory access moves after the operation
+ *   - _relaxed: atomic, but not ordered against other memory accesses
+ */
+static inline void compiler_barrier(void) {
+    asm volatile("" ::: "memory");
+}
+
+static inline void memory_barrier(void) {
+    asm volatile("dmb" ::: "memory");
+}
+
+/**
+ * armv7 has no barrier for loads only, it takes a full one
+ */
+static inline void read_barrier(void) {
+    asm volatile("dmb" ::: "memory");
+}
+
+static inline void write_barrier(void) {
+    asm volatile("dmb st" ::: "memory");
+}
+
 void atomic_create(Atomic *atomic);
 
 void atomic_set(Atomic *atomic, uint32_t val);
 
+void atomic_set_release(Atomic *atomic, uint32_t val);
+
 uint32_t atomic_get(Atomic *atomic);
 
+uint32_t atomic_get_acquire(Atomic *atomic);
+
 uint32_t atomic_inc(Atomic *atomic);
 
 uint32_t atomic_dec(Atomic *atomic);
@@ -25,4 +63,85 @@ uint32_t atomic_add(Atomic *atomic, uint32_t val);
 
 uint32_t atomic_sub(Atomic *atomic, uint32_t val);
 
+uint32_t atomic_xchg(Atomic *atomic, uint32_t val);
+
+uint32_t atomic_xchg_relaxed(Atomic *atomic, uint32_t val);
+
+uint32_t atomic_xchg_acquire(Atomic *atomic, uint32_t val);
+
+uint32_t atomic_xchg_release(Atomic *atomic, uint32_t val);
+
+/**
+ * stores val only if the counter equals expected, returns the counter found. it was stored if that equals expected
+ */
+uint32_t atomic_cmpxchg(Atomic *atomic, uint32_t expected, uint32_t val);
+
+uint32_t atomic_cmpxchg_relaxed(Atomic *atomic, uint32_t expected, uint32_t val);
+
+uint32_t atomic_cmpxchg_acquire(Atomic *atomic, uint32_t expected, uint32_t val);
+
+uint32_t atomic_cmpxchg_release(Atomic *atomic, uint32_t expected, uint32_t val);
+
+/**
+ * the fetch operations return the counter from before the operation
+ */
+uint32_t atomic_fetch_add(Atomic *atomic, uint32_t val);
+
+uint32_t atomic_fetch_add_relaxed(Atomic *atomic, uint32_t val);
+
+uint32_t atomic_fetch_add_acquire(Atomic *atomic, uint32_t val);
+
+uint32_t atomic_fetch_add_release(Atomic *atomic, uint32_t val);
+
+uint32_t atomic_fetch_sub(Atomic *atomic, uint32_t val);
+
+uint32_t atomic_fetch_sub_relaxed(Atomic *atomic, uint32_t val);
+
+uint32_t atomic_fetch_sub_acquire(Atomic *atomic, uint32_t val);
+
+uint32_t atomic_fetch_sub_release(Atomic *atomic, uint32_t val);
+
+uint32_t atomic_fetch_or(Atomic *atomic, uint32_t val);
+
+uint32_t atomic_fetch_or_relaxed(Atomic *atomic, uint32_t val);
+
+uint32_t atomic_fetch_or_acquire(Atomic *atomic, uint32_t val);
+
+uint32_t atomic_fetch_or_release(Atomic *atomic, uint32_t val);
+
+uint32_t atomic_fetch_and(Atomic *atomic, uint32_t val);
+
+uint32_t atomic_fetch_and_relaxed(Atomic *atomic, uint32_t val);
+
+uint32_t atomic_fetch_and_acquire(Atomic *atomic, uint32_t val);
+
+uint32_t atomic_fetch_and_release(Atomic *atomic, uint32_t val);
+
+void atomic64_create(Atomic64 *atomic);
+
+/**
+ * ldrd and strd are not single copy atomic on armv7, even set and get go through the exclusive monitor
+ */
+void atomic64_set(Atomic64 *atomic, uint64_t val);
+
+uint64_t atomic64_get(Atomic64 *atomic);
+
+uint64_t atomic64_add(Atomic64 *atomic, uint64_t val);
+
+uint64_t atomic64_sub(Atomic64 *atomic, uint64_t val);
+
+uint64_t atomic64_inc(Atomic64 *atomic);
+
+uint64_t atomic64_dec(Atomic64 *atomic);
+
+uint64_t atomic64_fetch_add(Atomic64 *atomic, uint64_t val);
+
+uint64_t atomic64_fetch_add_relaxed(Atomic64 *atomic, uint64_t val);
+
+uint64_t atomic64_xchg(Atomic64 *atomic, uint64_t val);
+
+uint64_t atomic64_cmpxchg(Atomic64 *atomic, uint64_t expected, uint64_t val);
+
+uint64_t atomic64_cmpxchg_relaxed(Atomic64 *atomic, uint64_t expected, uint64_t val);
+
 #endif// __KERNEL_ATOMIC_H__
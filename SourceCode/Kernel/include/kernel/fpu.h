@@ -0,0 +1,35 @@
+//
+// Created by XingfengYang on 2021/1/22.
+//
+
+#ifndef __KERNEL_FPU_H__
+#define __KERNEL_FPU_H__
+
+#include "kernel/percpu.h"
+#include "kernel/thread.h"
+
+/**
+ * lazy vfp/neon context switching. FPEXC.EN is cleared on every switch, so a thread pays for its fp state only
+ * after its first fp instruction traps. each cpu remembers whose state its registers hold, and a thread coming
+ * back to a cpu nobody else used fp on since finds its registers untouched.
+ */
+void fpu_init(void);
+
+/**
+ * called with the run queue lock held when the cpu switches away from its current thread.
+ * the state of a thread that used fp in its slice is saved right away, it may continue on another cpu.
+ */
+void fpu_switch(PerCpu *perCpu);
+
+/**
+ * called from the undefined instruction exception, returns true if it was the first fp instruction
+ * of the current thread and the instruction has to be executed again
+ */
+bool fpu_handle_undefined(uint32_t instructionAddress, uint32_t spsr);
+
+/**
+ * the thread goes away, its state must not be saved into freed memory
+ */
+void fpu_release_thread(Thread *thread);
+
+#endif//__KERNEL_FPU_H__
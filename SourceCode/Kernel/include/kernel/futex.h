@@ -0,0 +1,48 @@
+//
+// Created by XingfengYang on 2021/1/28.
+//
+
+#ifndef __KERNEL_FUTEX_H__
+#define __KERNEL_FUTEX_H__
+
+#include "kernel/kqueue.h"
+#include "kernel/spinlock.h"
+#include "kernel/thread.h"
+#include "libc/stdint.h"
+
+#define FUTEX_WAIT 0
+#define FUTEX_WAKE 1
+
+#define FUTEX_HASH_BITS 6
+#define FUTEX_HASH_BUCKETS (1 << FUTEX_HASH_BITS)
+
+/**
+ * threads waiting on any futex whose key hashes here, each one remembers its own key in futexKey
+ */
+typedef struct FutexBucket {
+    SpinLock lock;
+    KernelQueue waitQueue;
+} FutexBucket;
+
+void futex_init(void);
+
+/**
+ * the physical address of a user futex, so threads of different address spaces sharing the page meet on one key.
+ * kernel threads and callers without a thread use the kernel address as it is.
+ */
+uint32_t futex_key(Thread *thread, uint32_t *address);
+
+FutexBucket *futex_bucket(uint32_t key);
+
+/**
+ * sleep until a futex_wake on the same futex, unless it no longer holds expected.
+ * returns ERROR right away if the value changed or there is no thread that could sleep.
+ */
+KernelStatus futex_wait(uint32_t *address, uint32_t expected);
+
+/**
+ * wake up to count threads waiting on the futex, returns how many were woken
+ */
+uint32_t futex_wake(uint32_t *address, uint32_t count);
+
+#endif//__KERNEL_FUTEX_H__
@@ -5,11 +5,27 @@
 #include "libc/stdbool.h"
 #include "kernel/list.h"
 
+/**
+ * a tick owner returns this from nextEvent when it does not need the timer at all
+ */
+#define TICK_NO_EVENT 0xFFFFFFFF
+
+/**
+ * ticks without a nextEvent callback keep firing at this fixed interval
+ */
+#define TICK_DEFAULT_INTERVAL_MS 50
+
 typedef void (*TickHandler)(void);
 
+/**
+ * milliseconds until the tick owner needs its handler to run again, or TICK_NO_EVENT
+ */
+typedef uint32_t (*TickNextEvent)(void);
+
 typedef struct Tick {
     char name[NAME_LENGTH];
     TickHandler handler;
+    TickNextEvent nextEvent;
     ListNode node;
 } Tick;
 
@@ -44,6 +60,15 @@ typedef void (*InterruptManagerOperationTick)(struct InterruptManager *manager);
 
 typedef void (*InterruptManagerOperationInterrupt)(struct InterruptManager *manager);
 
+typedef uint32_t (*InterruptManagerOperationNextEvent)(struct InterruptManager *manager);
+
+typedef void (*InterruptManagerOperationProgramTick)(struct InterruptManager *manager);
+
+/**
+ * make cpuId run its ticks soon, so it notices work queued for it. the current cpu just reprograms its timer
+ */
+typedef void (*InterruptManagerOperationKickCpu)(struct InterruptManager *manager, uint32_t cpuId);
+
 typedef struct InterruptManagerOperation {
     InterruptManagerOperationInit init;
     InterruptManagerOperationRegister registerInterrupt;
@@ -54,6 +79,9 @@ typedef struct InterruptManagerOperation {
     InterruptManagerOperationDisableInterrupt disableInterrupt;
     InterruptManagerOperationTick tick;
     InterruptManagerOperationInterrupt interrupt;
+    InterruptManagerOperationNextEvent nextEvent;
+    InterruptManagerOperationProgramTick programTick;
+    InterruptManagerOperationKickCpu kickCpu;
 } InterruptManagerOperation;
 
 #define IRQ_NUMS 96
@@ -6,12 +6,23 @@
 #define __KERNEL_KHEAP_H__
 
 #include "kernel/list.h"
+#include "kernel/percpu_var.h"
+#include "kernel/spinlock.h"
 #include "kernel/type.h"
 #include "libc/stdint.h"
 
 
 #define HEAP_AREA_MAGIC 0x48454150
 
+// requests are rounded up to a multiple of this, it keeps every block aligned to it
+#define HEAP_ALIGNMENT 8
+// one exact size class for every multiple of HEAP_ALIGNMENT up to this, every size in it fits every block of it
+#define HEAP_SMALL_SIZE_MAX 256
+#define HEAP_SMALL_BINS (HEAP_SMALL_SIZE_MAX / HEAP_ALIGNMENT)
+// above the small sizes one bin for every power of two, [2^n, 2^(n+1)) for n from 8 to 31
+#define HEAP_BIN_COUNT (HEAP_SMALL_BINS + 24)
+#define HEAP_BIN_MAP_WORDS ((HEAP_BIN_COUNT + BITS_IN_UINT32 - 1) / BITS_IN_UINT32)
+
 typedef void (*HeapAllocCallback)(struct Heap *heap, void *ptr, uint32_t size);
 
 typedef void (*HeapFreeCallback)(struct Heap *heap, void *ptr);
@@ -44,31 +55,67 @@ typedef struct HeapOperations {
 
 } HeapOperations;
 
+/**
+ * the header in front of every block, size is the size of the block after it.
+ * list links a used block into the using list and a free block into its bin.
+ * prevSize is the boundary tag of the block right before this one in memory, the footer of that block kept in
+ * this header. with it free finds both neighbours without a search. the heap is framed by two empty used blocks,
+ * so every block has both neighbours
+ */
 typedef struct HeapArea {
     uint32_t magic;
     uint32_t size;
+    uint32_t prevSize;
+    uint32_t used;
     ListNode list;
 } HeapArea;
 
+/**
+ * the counters of one heap on one cpu, a block freed on another cpu than it was allocated on is counted down there.
+ * only the sums of heap_statistics mean anything. a cache line each, so cpus counting on the same heap do not
+ * bounce lines
+ */
+typedef struct HeapCounters {
+    uint32_t allocatedBlockCount;
+    uint32_t allocatedSize;
+    uint32_t mergeCounts;
+} __attribute__((aligned(64))) HeapCounters;
+
+/**
+ * the summed counters and the free sizes of the heap asked for, fragmentation is the percentage of free memory
+ * outside the largest free block, 0 while all free memory is one block
+ */
 typedef struct HeapStatistics {
     uint32_t allocatedBlockCount;
     uint32_t allocatedSize;
     uint32_t mergeCounts;
+    uint32_t freeSize;
+    uint32_t largestFreeSize;
+    uint32_t fragmentation;
 } HeapStatistics;
 
 typedef struct Heap {
+    // guards the blocks, the bins and the using list. taken with interrupts off, rcu callbacks free from the tick
+    SpinLock lock;
     uint32_t address;
     uint32_t size;
     uint32_t maxSizeLimit;
+    // newest first, blocks are put in front and unlinked in place
     HeapArea *usingListHead;
-    HeapArea *freeListHead;
+    // free blocks by size class, binMap has a bit set for every bin that is not empty
+    HeapArea *freeBins[HEAP_BIN_COUNT];
+    uint32_t binMap[HEAP_BIN_MAP_WORDS];
+    // bytes in free blocks, without their headers
+    uint32_t freeSize;
+    // indexed by cpu, each cpu writes only its own with interrupts off
+    HeapCounters counters[SMP_MAX_CPUS];
     HeapAllocCallback allocCallback;
     HeapFreeCallback freeCallback;
     HeapOperations operations;
-
-    HeapStatistics statistics;
 } Heap;
 
 KernelStatus heap_create(Heap *heap, uint32_t addr, uint32_t size);
 
+void heap_statistics(Heap *heap, HeapStatistics *statistics);
+
 #endif//__KERNEL_KHEAP_H__
@@ -12,6 +12,8 @@ typedef KernelStatus (*KernelQueueOperationEnQueue)(struct KernelQueue *queue, K
 
 typedef KQueueNode *(*KernelQueueOperationDeQueue)(struct KernelQueue *queue);
 
+typedef KernelStatus (*KernelQueueOperationRemove)(struct KernelQueue *queue, KQueueNode *node);
+
 typedef uint32_t (*KernelQueueOperationSize)(struct KernelQueue *queue);
 
 typedef bool (*KernelQueueOperationIsEmpty)(struct KernelQueue *queue);
@@ -19,6 +21,7 @@ typedef bool (*KernelQueueOperationIsEmpty)(struct KernelQueue *queue);
 typedef struct KernelQueueOperations {
     KernelQueueOperationEnQueue enqueue;
     KernelQueueOperationDeQueue dequeue;
+    KernelQueueOperationRemove remove;
     KernelQueueOperationSize size;
     KernelQueueOperationIsEmpty isEmpty;
 } KernelQueueOperations;
@@ -36,6 +39,8 @@ KernelStatus kqueue_default_operation_enqueue(struct KernelQueue *queue, KQueueN
 
 KQueueNode *kqueue_default_operation_dequeue(struct KernelQueue *queue);
 
+KernelStatus kqueue_default_operation_remove(struct KernelQueue *queue, KQueueNode *node);
+
 uint32_t kqueue_default_operation_size(struct KernelQueue *queue);
 
 bool kqueue_default_operation_is_empty(struct KernelQueue *queue);
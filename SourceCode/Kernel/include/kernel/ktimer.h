@@ -6,22 +6,46 @@
 #define __KERNEL_KTIMER_H__
 
 #include "libc/stdint.h"
+#include "libc/stdbool.h"
 #include "kernel/list.h"
 #include "kernel/kqueue.h"
 #include "kernel/interrupt.h"
+#include "kernel/spinlock.h"
+
+// a timeout that never runs out, the wait is not timed
+#define KERNEL_TIMER_FOREVER 0xFFFFFFFF
 
 typedef KernelStatus (*KernelTimerOperationSet)(struct KernelTimer *timer, uint32_t timeout);
 
 typedef KernelStatus (*KernelTimerOperationCancel)(struct KernelTimer *timer);
 
+typedef void (*KernelTimerCallback)(void *arg);
+
+typedef KernelStatus (*KernelTimerOperationSetPeriodic)(struct KernelTimer *timer, uint32_t period,
+                                                        KernelTimerCallback callback, void *arg);
+
+typedef KernelStatus (*KernelTimerOperationSetOneShot)(struct KernelTimer *timer, uint32_t timeout,
+                                                       KernelTimerCallback callback, void *arg);
+
 typedef struct KernelTimerOperation {
     KernelTimerOperationSet set;
     KernelTimerOperationCancel cancel;
+    KernelTimerOperationSetPeriodic setPeriodic;
+    KernelTimerOperationSetOneShot setOneShot;
 } KernelTimerOperation;
 
 typedef struct KernelTimer {
     uint32_t deadline;
     int32_t remainTime;
+    // a periodic timer is rearmed instead of released when it expires, 0 for a one shot timer
+    uint32_t period;
+    // called from the timer tick every time a periodic timer expires, and once when a one shot timer does.
+    // it runs after the manager lock is dropped, it may wake up threads and add or release timers
+    KernelTimerCallback callback;
+    void *arg;
+    // set while the expired timer waits for or runs its callback, the tick chains such timers through firedNext
+    volatile bool firing;
+    struct KernelTimer *firedNext;
     ListNode list;
     KernelQueue waitQueue;
     KernelTimerOperation operation;
@@ -33,6 +57,9 @@ typedef KernelTimer (*KernelTimerManagerOperationInit)(struct KernelTimerManager
 typedef KernelTimer *(*KernelTimerManagerOperationCreateTimer)(struct KernelTimerManager *kernelTimerManager,
                                                                uint32_t deadline);
 
+typedef KernelStatus (*KernelTimerManagerOperationAddTimer)(struct KernelTimerManager *kernelTimerManager,
+                                                            KernelTimer *timer);
+
 typedef KernelStatus (*KernelTimerManagerOperationReleaseTimer)(struct KernelTimerManager *kernelTimerManager,
                                                                 KernelTimer *timer);
 
@@ -43,22 +70,63 @@ typedef KernelStatus (*KernelTimerManagerOperationGetSysRuntimeMs)(struct Kernel
 
 typedef void (*KernelTimerManagerOperationOnTick)();
 
+typedef uint32_t (*KernelTimerManagerOperationNextEvent)();
+
 typedef struct KernelTimerMangerOperation {
     KernelTimerManagerOperationInit init;
     KernelTimerManagerOperationOnTick onTick;
+    KernelTimerManagerOperationNextEvent nextEvent;
     KernelTimerManagerOperationGetSysRuntimeMs getSysRuntimeMs;
     KernelTimerManagerOperationCreateTimer createTimer;
+    KernelTimerManagerOperationAddTimer addTimer;
     KernelTimerManagerOperationReleaseTimer releaseTimer;
     KernelTimerManagerOperationFreeTimer freeTimer;
 } KernelTimerMangerOperation;
 
 typedef struct KernelTimerManager {
+    // guards the timer list and the time accounting below
+    SpinLock lock;
     uint32_t sysRuntimeMs;
+    // generic counter value sysRuntimeMs was last advanced to
+    uint64_t lastCounter;
     KernelTimer *timerNodes;
     Tick timerManagerTick;
     KernelTimerMangerOperation operation;
 } KernelTimerManager;
 
+/**
+ * init a timer the caller owns, it starts counting once it is added to the manager
+ */
+KernelTimer *kernel_timer_init(KernelTimer *timer, uint32_t deadline);
+
 KernelTimerManager *kernel_timer_manager_create(KernelTimerManager *kernelTimerManager);
 
+/**
+ * bounds a wait of a thread on a wait queue, the waiter lives on the waiting thread's stack:
+ *
+ *     lock; enqueue the current thread; set THREAD_BLOCKED; unlock;
+ *     kernel_timed_wait_arm(&wait, lock, queue, currentThread, timeoutMs);
+ *     block;
+ *     status = kernel_timed_wait_finish(&wait);
+ *
+ * when the timer runs out while the thread still waits, it is taken off the queue under lock and woken up,
+ * finish then returns TIMEOUT. the thread is queued before the timer is armed, so whoever wakes it up first wins.
+ * a sleep without a queue passes nullptr for lock and queue, KERNEL_TIMER_FOREVER arms no timer at all.
+ */
+typedef struct KernelTimedWait {
+    KernelTimer timer;
+    struct Thread *thread;
+    SpinLock *lock;
+    KernelQueue *queue;
+    volatile bool timedOut;
+} KernelTimedWait;
+
+KernelStatus kernel_timed_wait_arm(KernelTimedWait *wait, SpinLock *lock, KernelQueue *queue, struct Thread *thread,
+                                   uint32_t timeoutMs);
+
+/**
+ * disarm the timer, once this returns its callback is done or will never run, the waiter may go out of scope
+ */
+KernelStatus kernel_timed_wait_finish(KernelTimedWait *wait);
+
 #endif// __KERNEL_KTIMER_H__
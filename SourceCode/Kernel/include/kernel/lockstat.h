@@ -0,0 +1,94 @@
+//
+// Created by XingfengYang on 2021/1/30.
+//
+
+#ifndef __KERNEL_LOCKSTAT_H__
+#define __KERNEL_LOCKSTAT_H__
+
+#include "kernel/cpu.h"
+#include "kernel/type.h"
+#include "libc/stdbool.h"
+#include "libc/stdint.h"
+
+// named locks that get their own statistics. unnamed locks, like the ones in every thread, and the named ones used
+// after the table is full share the last slot
+#define LOCKSTAT_MAX_LOCKS 128
+#define LOCKSTAT_OVERFLOW_ID (LOCKSTAT_MAX_LOCKS - 1)
+// longer names are cut, the copy is kept with the slot
+#define LOCKSTAT_NAME_LENGTH 32
+
+#define LockStatKeyCreate() \
+    { .name = nullptr, .id = 0, .acquiredAt = 0 }
+
+/**
+ * embedded in every SpinLock, Mutex and Semaphore. a named lock gets a slot in the statistics tables
+ * on its first acquisition while lockstat is enabled, locks never acquired with it on cost nothing.
+ * the tables keep a copy of the name and never point back to the key, the lock may be freed any time.
+ */
+typedef struct LockStatKey {
+    const char *name;
+    // slot in the statistics tables, 0 for none yet
+    volatile uint32_t id;
+    // cycle counter of the cpu holding the lock when it got it
+    uint32_t acquiredAt;
+} LockStatKey;
+
+/**
+ * one row per cpu of the statistics tables. a cpu bumps only its own rows and turns interrupts off for it, so a
+ * lock taken by an interrupt handler can not interleave with the update. lockstat_top sums the rows without
+ * stopping anybody, a total may miss an acquisition being recorded at that moment
+ */
+typedef struct LockStatEntry {
+    uint32_t acquisitions;
+    uint32_t contentions;
+    uint64_t waitCycles;
+    uint32_t maxWaitCycles;
+    uint64_t holdCycles;
+    uint32_t maxHoldCycles;
+    // caller of the acquisition that waited longest
+    void *maxWaitSite;
+} LockStatEntry;
+
+/**
+ * the statistics of one lock summed over all cpus
+ */
+typedef struct LockStatSummary {
+    // the copy taken when the lock got its slot, nullptr for the locks sharing the last one
+    const char *name;
+    // where the key was when it got the slot, only to tell locks of the same name apart
+    uint32_t address;
+    LockStatEntry total;
+} LockStatSummary;
+
+extern volatile bool lockStatEnabled;
+
+void lockstat_enable(bool enable);
+
+void lockstat_reset(void);
+
+/**
+ * name the lock before it is first acquired with lockstat on, a lock that got the shared slot keeps it
+ */
+static inline void lockstat_set_name(LockStatKey *key, const char *name) {
+    key->name = name;
+}
+
+/**
+ * record an acquisition that started waiting at the cycle count start, contended if it could not get the lock at once
+ */
+void lockstat_acquired(LockStatKey *key, uint32_t start, bool contended, void *site);
+
+/**
+ * lockstat_acquired for locks that put the caller to sleep, start was read on startCpu. a waiter woken up on another
+ * cpu gets a wait of 0 cycles, the cycle counters of two cpus can not be compared
+ */
+void lockstat_acquired_sleeping(LockStatKey *key, CpuNum startCpu, uint32_t start, bool contended, void *site);
+
+void lockstat_released(LockStatKey *key);
+
+/**
+ * fill summaries with the count most contended locks, most contended first, returns how many there were
+ */
+uint32_t lockstat_top(LockStatSummary *summaries, uint32_t count);
+
+#endif//__KERNEL_LOCKSTAT_H__
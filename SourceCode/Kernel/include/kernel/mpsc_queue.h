@@ -0,0 +1,51 @@
+//
+// Created by XingfengYang on 2021/1/31.
+//
+
+#ifndef __KERNEL_MPSC_QUEUE_H__
+#define __KERNEL_MPSC_QUEUE_H__
+
+#include "kernel/atomic.h"
+#include "kernel/kqueue.h"
+#include "kernel/type.h"
+#include "libc/stdbool.h"
+#include "libc/stdint.h"
+
+typedef KernelStatus (*MpscQueueOperationEnqueue)(struct MpscQueue *queue, KQueueNode *node);
+
+typedef KQueueNode *(*MpscQueueOperationDequeue)(struct MpscQueue *queue);
+
+typedef bool (*MpscQueueOperationIsEmpty)(struct MpscQueue *queue);
+
+typedef struct MpscQueueOperations {
+    MpscQueueOperationEnqueue enqueue;
+    MpscQueueOperationDequeue dequeue;
+    MpscQueueOperationIsEmpty isEmpty;
+} MpscQueueOperations;
+
+/**
+ * a lock-free queue with any number of producers and a single consumer, on the same nodes as KernelQueue.
+ * producers swap themselves into head and link the previous head to them, the consumer follows next from tail.
+ * the stub node keeps the queue from ever being empty, so neither side has to touch both ends.
+ *
+ * only next of a node is used. there is no size and no removal from the middle, for that take a KernelQueue
+ * and a lock. dequeue and isEmpty must only be called by one consumer at a time.
+ */
+typedef struct MpscQueue {
+    // the node enqueued last, swapped by the producers
+    Atomic head;
+    // the node dequeued next, only touched by the consumer
+    KQueueNode *tail;
+    KQueueNode stub;
+    MpscQueueOperations operations;
+} MpscQueue;
+
+MpscQueue *mpsc_queue_create(MpscQueue *queue);
+
+KernelStatus mpsc_queue_default_operation_enqueue(struct MpscQueue *queue, KQueueNode *node);
+
+KQueueNode *mpsc_queue_default_operation_dequeue(struct MpscQueue *queue);
+
+bool mpsc_queue_default_operation_is_empty(struct MpscQueue *queue);
+
+#endif//__KERNEL_MPSC_QUEUE_H__
@@ -14,11 +14,16 @@
 #define STATE_FREE 0u
 #define STATE_CONTESTED 1u
 
+// how long a contender spins on an owner running on another cpu before it goes to sleep
+#define MUTEX_SPIN_MAX_US 50
+
 #define MutexCreate()                                                                               \
     {                                                                                               \
         .val = {                                                                                    \
                 .counter = 0,                                                                       \
         },                                                                                          \
+        .owner = nullptr,                                                                           \
+        .stat = LockStatKeyCreate(),                                                                \
         .spinLock = SpinLockCreate(), .waitQueue = {                                                \
                                               .size = 0,                                            \
                                               .head = nullptr,                                      \
@@ -26,35 +31,62 @@
                                               .operations = {                                       \
                                                       .enqueue = kqueue_default_operation_enqueue,  \
                                                       .dequeue = kqueue_default_operation_dequeue,  \
+                                                      .remove = kqueue_default_operation_remove,    \
                                                       .size = kqueue_default_operation_size,        \
                                                       .isEmpty = kqueue_default_operation_is_empty, \
                                               },                                                    \
                                       },                                                            \
         .operations = {                                                                             \
                 .acquire = mutex_default_acquire,                                                   \
+                .acquireTimeout = mutex_default_acquire_timeout,                                    \
                 .release = mutex_default_release,                                                   \
         },                                                                                          \
     }
 
 typedef void (*MutexAcquire)(struct Mutex *mutex);
 
+typedef KernelStatus (*MutexAcquireTimeout)(struct Mutex *mutex, uint32_t timeoutMs);
+
 typedef void (*MutexRelease)(struct Mutex *mutex);
 
 typedef struct MutexOperations {
     MutexAcquire acquire;
+    MutexAcquireTimeout acquireTimeout;
     MutexRelease release;
 } MutexOperations;
 
 typedef struct Mutex {
     Atomic val;
+    // the thread holding the mutex, nullptr when it is free or held outside of any thread
+    struct Thread *volatile owner;
     SpinLock spinLock;
     KernelQueue waitQueue;
+    LockStatKey stat;
     KernelObject object;
     MutexOperations operations;
 } Mutex;
 
+Mutex *mutex_create(Mutex *mutex);
+
 void mutex_default_acquire(Mutex *mutex);
 
+/**
+ * like acquire, but gives up after timeoutMs and returns TIMEOUT without holding the mutex.
+ * a timeout of 0 only tries, KERNEL_TIMER_FOREVER waits like acquire
+ */
+KernelStatus mutex_default_acquire_timeout(Mutex *mutex, uint32_t timeoutMs);
+
 void mutex_default_release(Mutex *mutex);
 
+/**
+ * whether the owner is on another cpu right now, so the mutex is likely released before a sleep would pay off
+ */
+bool mutex_owner_running(struct Thread *owner);
+
+/**
+ * called with the spin lock held when waiter goes to sleep on the mutex,
+ * the owner runs with the waiter's policy and priority until it releases the mutex if the waiter is more urgent
+ */
+void mutex_inherit_priority(Mutex *mutex, struct Thread *waiter);
+
 #endif// __KERNEL_MUTEX_H__
@@ -6,9 +6,13 @@
 #define __KERNEL_PRECPU_H__
 
 #include "kernel/kqueue.h"
+#include "kernel/mpsc_queue.h"
+#include "kernel/percpu_var.h"
 #include "kernel/rbtree.h"
+#include "kernel/rtqueue.h"
 #include "kernel/thread.h"
 #include "kernel/cpu.h"
+#include "kernel/spinlock.h"
 
 typedef enum CPU {
     CPU_0 = 0,
@@ -30,10 +34,50 @@ typedef enum CPU {
     INVALID_CPU = 255,
 } CPU;
 
+/**
+ * how many nodes of the busiest sibling's run queue an idle cpu walks when looking for a thread to steal
+ */
+#define PERCPU_STEAL_SCAN_LIMIT 8
+
+/**
+ * load average decays by (1 - 1 / 2^PERCPU_LOAD_AVG_SHIFT) every PERCPU_LOAD_AVG_PERIOD_MS, however often the
+ * cpu ticks
+ */
+#define PERCPU_LOAD_AVG_SHIFT 3
+#define PERCPU_LOAD_AVG_PERIOD_MS 4
+
+/**
+ * each cpu runs the load balancer on every PERCPU_BALANCE_INTERVAL-th of its own scheduler ticks
+ */
+#define PERCPU_BALANCE_INTERVAL 4
+
+/**
+ * migrate only when the busiest cpu carries this percent more load than the idlest one
+ */
+#define PERCPU_IMBALANCE_PERCENT 25
+
+/**
+ * a woken thread goes back to its last cpu while that cpu carries at most the load of one default priority thread,
+ * its cache lines are likely still there
+ */
+#define PERCPU_WAKEUP_LIGHT_LOAD 1024
+
 typedef struct CpuStatus {
     uint32_t idleTime;
+    uint32_t stealAttempts;
+    uint32_t stealSuccesses;
+    // threads the load balancer moved while running on this cpu
+    uint32_t migrations;
+    uint32_t fpuTraps;
+    uint32_t fpuRestores;
 } CpuStatus;
 
+/**
+ * scheduler statistics of each cpu, indexed by the cpu they describe. kept out of PerCpu,
+ * whose run queue fields the other cpus read while this cpu keeps counting
+ */
+DECLARE_PER_CPU(CpuStatus, cpuStatus);
+
 typedef KernelStatus (*PerCpuInit)(struct PerCpu *perCpu, CpuNum num, Thread *idleThread);
 
 typedef KernelStatus (*PerCpuInsertThread)(struct PerCpu *perCpu, Thread *thread);
@@ -42,23 +86,51 @@ typedef Thread *(*PerCpuRemoveThread)(struct PerCpu *perCpu, Thread *thread);
 
 typedef Thread *(*PerCpuGetNextThread)(struct PerCpu *perCpu);
 
+typedef Thread *(*PerCpuStealThread)(struct PerCpu *perCpu);
+
 typedef struct PerCpuOperations {
     PerCpuInit init;
     PerCpuInsertThread insertThread;
     PerCpuRemoveThread removeThread;
     PerCpuGetNextThread getNextThread;
+    PerCpuStealThread stealThread;
 } PerCpuOperations;
 
 typedef struct PerCpu {
     CpuNum cpuId;
-    uint32_t priority;
+    // guards the run queue and everything below, only ever taken with interrupts disabled
+    SpinLock lock;
+    // sum of the weights of all cfs threads in the run queue
+    uint32_t weight;
+    // decaying average of weight, only this cpu updates it, on its scheduler tick
+    uint32_t loadAvg;
+    // generic counter value loadAvg is decayed up to, 0 before the first update
+    uint64_t loadAvgUpdated;
+    // scheduler ticks of this cpu, counting towards the next balance pass
+    uint32_t balanceTicks;
+    // generic counter value when the current thread was switched in
+    uint64_t sliceStart;
+    // never decreasing lower bound of the queued vruntimes, woken threads are placed relative to it
+    uint64_t minVruntime;
+    // switch away from the current thread on the next timer interrupt
+    bool needResched;
+    // depth of rcu read-side sections, the current thread is not switched away while it is above 0
+    uint32_t rcuNesting;
+    // the slice ended inside a read-side section, rcu_read_unlock asks for the switch
+    bool rcuDeferredResched;
 
     RBTree rbTree;
+    // real-time threads, always picked before anything in rbTree
+    RtQueue rtQueue;
     KQueueNode waitThreadQueue;
+    // threads woken up by other cpus, which post them here without taking the lock. moved to the run queue by
+    // this cpu only, on its next tick or switch
+    MpscQueue wakeupInbox;
 
     Thread *idleThread;
     Thread *currentThread;
-    CpuStatus status;
+    // the thread whose fp state is in this cpu's vfp registers
+    Thread *fpuOwner;
 
     struct ListNode node;
 
@@ -67,8 +139,20 @@ typedef struct PerCpu {
 
 KernelStatus percpu_create(CpuNum cpuNum);
 
+void percpu_set_ops(PerCpu *cpu);
+
 PerCpu *percpu_get(CpuNum cpuNum);
 
-PerCpu *percpu_min_priority(CpuNum cpuMask);
+uint32_t percpu_load(PerCpu *cpu);
+
+PerCpu *percpu_min_load(CpuMask cpuMask);
+
+PerCpu *percpu_select_wakeup_cpu(Thread *thread);
+
+void percpu_balance_tick(void);
+
+void percpu_double_lock(PerCpu *cpu1, PerCpu *cpu2);
+
+void percpu_double_unlock(PerCpu *cpu1, PerCpu *cpu2);
 
 #endif//__KERNEL_PRECPU_H__
@@ -0,0 +1,76 @@
+//
+// Created by XingfengYang on 2021/2/1.
+//
+
+#ifndef __KERNEL_PERCPU_VAR_H__
+#define __KERNEL_PERCPU_VAR_H__
+
+#include "arm/register.h"
+#include "kernel/cpu.h"
+#include "libc/stdint.h"
+
+/**
+ * per-cpu variables live in the .bss.percpu section. the linker script lays out one copy of the section for
+ * every cpu, each copy cache line aligned, so a cpu writing its own copy never bounces a line of another cpu.
+ * the variable's own address is cpu 0's copy, the copy of cpu n lies n areas past it.
+ * like other bss variables they start zeroed and take no initializer.
+ */
+#define DEFINE_PER_CPU(type, name) __attribute__((section(".bss.percpu"))) type name
+
+#define DECLARE_PER_CPU(type, name) extern type name
+
+extern char __percpu_start[];
+extern char __percpu_end[];
+
+static inline uint32_t percpu_offset(CpuNum cpuId) {
+    return cpuId * (uint32_t) (__percpu_end - __percpu_start);
+}
+
+#define per_cpu_ptr(var, cpuId) ((__typeof__(&(var))) ((char *) &(var) + percpu_offset(cpuId)))
+
+#define per_cpu(var, cpuId) (*per_cpu_ptr(var, cpuId))
+
+/**
+ * the copy of the current cpu. the thread may be switched to another cpu right after, see this_cpu_add
+ */
+#define this_cpu_ptr(var) ((__typeof__(&(var))) ((char *) &(var) + read_tpidrprw()))
+
+static inline uint32_t percpu_irq_save(void) {
+    uint32_t cpsr;
+    asm volatile("mrs %0, cpsr\n\t"
+                 "cpsid i"
+                 : "=r"(cpsr)
+                 :
+                 : "memory");
+    return cpsr;
+}
+
+static inline void percpu_irq_restore(uint32_t cpsr) {
+    asm volatile("msr cpsr_c, %0"
+                 :
+                 : "r"(cpsr)
+                 : "memory");
+}
+
+/**
+ * add to a counter of the current cpu. threads are only switched from the timer interrupt, with interrupts off
+ * the thread neither moves to another cpu nor races an interrupt handler counting on the same cpu
+ */
+#define this_cpu_add(var, val)                                                                                         \
+    do {                                                                                                               \
+        uint32_t __cpsr = percpu_irq_save();                                                                           \
+        *this_cpu_ptr(var) += (val);                                                                                   \
+        percpu_irq_restore(__cpsr);                                                                                    \
+    } while (0)
+
+#define this_cpu_inc(var) this_cpu_add(var, 1)
+
+/**
+ * a counter is summed over all cpus on read. a cpu may count down what another one counted up,
+ * its own copy wraps around and the sum still comes out right
+ */
+uint32_t percpu_sum(uint32_t *var);
+
+#define per_cpu_sum(var) percpu_sum(&(var))
+
+#endif//__KERNEL_PERCPU_VAR_H__
@@ -30,15 +30,24 @@ typedef RBNode *(*RbTreeGetMaxNode)(struct RBTree *tree);
 
 typedef RBNode *(*RbTreeRemoveNode)(struct RBTree *tree, RBNode *node);
 
+typedef RBNode *(*RbTreeNextNode)(struct RBTree *tree, RBNode *node);
+
 typedef struct RBTreeOperations {
     RBTreeInsertNode insert;
     RbTreeGetMinNode getMin;
     RbTreeGetMaxNode getMax;
     RbTreeRemoveNode remove;
+    RbTreeNextNode next;
 } RBTreeOperations;
 
 typedef struct RBTree {
     RBNode *root;
+    /**
+     * cached leftmost node, the run queue always picks the min node,
+     * so getMin is O(1) and only insert/remove need to maintain it.
+     */
+    RBNode *leftmost;
+    uint32_t size;
     RBTreeOperations operations;
 } RBTree;
 
@@ -0,0 +1,130 @@
+//
+// Created by XingfengYang on 2021/1/29.
+//
+
+#ifndef __KERNEL_RCU_H__
+#define __KERNEL_RCU_H__
+
+#include "arm/interrupt.h"
+#include "arm/register.h"
+#include "kernel/percpu.h"
+#include "kernel/rcu_head.h"
+#include "kernel/spinlock.h"
+#include "libc/stdbool.h"
+#include "libc/stdint.h"
+
+/**
+ * while a grace period waits for a cpu, that cpu ticks at least this often to report its quiescent state
+ */
+#define RCU_TICK_MS 4
+
+/**
+ * publish a pointer to an initialized object, readers that see the pointer also see what it points to
+ */
+#define rcu_assign_pointer(pointer, value)          \
+    do {                                            \
+        asm volatile("dmb" ::: "memory");           \
+        (pointer) = (value);                        \
+    } while (0)
+
+/**
+ * read a pointer published by rcu_assign_pointer once, arm orders the dependent loads by itself
+ */
+#define rcu_dereference(pointer) (*(__typeof__(pointer) volatile *) &(pointer))
+
+typedef struct RcuStatus {
+    uint32_t gracePeriods;
+    uint32_t callbacks;
+} RcuStatus;
+
+/**
+ * readers never take a lock, they only keep their cpu from being switched away while they walk a list.
+ * a cpu that ticks, switches threads or leaves its outermost read-side section has passed a quiescent state.
+ * a grace period ends once every cpu that could have been reading when it started has passed one,
+ * then every object unlinked before it started can be freed.
+ *
+ * callbacks queued while a grace period runs are batched and wait for the next one together.
+ * a cpu whose tick is stopped while it runs a lone thread is kicked when a grace period starts waiting for it.
+ */
+typedef struct RcuState {
+    SpinLock lock;
+    volatile CpuMask pendingCpus;
+    bool gracePeriodRunning;
+    // wait for the running grace period
+    RcuHead *currentBatch;
+    // wait for the next grace period
+    RcuHead *nextBatch;
+    RcuHead **nextTail;
+    // grace period is over, run on the next quiescent state of any cpu
+    RcuHead *doneBatch;
+    RcuStatus status;
+} RcuState;
+
+extern RcuState rcuState;
+extern PerCpu *perCpu;
+
+void rcu_init(void);
+
+/**
+ * called from the outermost rcu_read_unlock when a grace period or a switch waits for this cpu
+ */
+void rcu_read_unlock_special(PerCpu *cpu);
+
+/**
+ * report a quiescent state of cpu if it is outside any read-side section, and run finished callbacks.
+ * called by the scheduler tick and after a context switch on the cpu itself.
+ */
+void rcu_quiescent(PerCpu *cpu);
+
+bool rcu_needs_tick(PerCpu *cpu);
+
+/**
+ * func runs once every reader that could still see the object is gone, from tick or switch context.
+ * it never runs before call_rcu returns.
+ */
+void call_rcu(RcuHead *head, RcuCallback func);
+
+/**
+ * wait until every read-side section running now has ended. must not be called from a read-side section.
+ */
+void synchronize_rcu(void);
+
+static inline void rcu_read_lock(void) {
+    if (perCpu == nullptr) {
+        // no scheduler yet, nothing switches and nothing waits for grace periods
+        return;
+    }
+    // no switch between picking the cpu and marking it, afterwards the thread stays on it
+    uint32_t interruptEnabled = arch_is_interrupt_enabled();
+    arch_disable_interrupt();
+    percpu_get(read_cpuid())->rcuNesting++;
+    if (interruptEnabled) {
+        arch_enable_interrupt();
+    }
+    // a grace period started after this sees the mark, or this reader sees what was unlinked before it
+    asm volatile("dmb" ::: "memory");
+}
+
+static inline void rcu_read_unlock(void) {
+    if (perCpu == nullptr) {
+        return;
+    }
+    asm volatile("dmb" ::: "memory");
+    uint32_t interruptEnabled = arch_is_interrupt_enabled();
+    arch_disable_interrupt();
+    PerCpu *cpu = percpu_get(read_cpuid());
+    cpu->rcuNesting--;
+    if (cpu->rcuNesting == 0 &&
+        (cpu->rcuDeferredResched || (rcuState.pendingCpus & cpu_number_to_mask(cpu->cpuId)) != 0)) {
+        rcu_read_unlock_special(cpu);
+    }
+    if (interruptEnabled) {
+        arch_enable_interrupt();
+    }
+}
+
+static inline bool rcu_read_lock_held(PerCpu *cpu) {
+    return cpu->rcuNesting > 0;
+}
+
+#endif//__KERNEL_RCU_H__
@@ -0,0 +1,20 @@
+//
+// Created by XingfengYang on 2021/1/29.
+//
+
+#ifndef __KERNEL_RCU_HEAD_H__
+#define __KERNEL_RCU_HEAD_H__
+
+struct RcuHead;
+
+typedef void (*RcuCallback)(struct RcuHead *head);
+
+/**
+ * embedded in objects that are freed through call_rcu, kept apart from rcu.h so low level structures can embed it
+ */
+typedef struct RcuHead {
+    struct RcuHead *next;
+    RcuCallback func;
+} RcuHead;
+
+#endif//__KERNEL_RCU_HEAD_H__
@@ -0,0 +1,54 @@
+//
+// Created by XingfengYang on 2021/1/18.
+//
+
+#ifndef __KERNEL_RTQUEUE_H__
+#define __KERNEL_RTQUEUE_H__
+
+#include "kernel/kqueue.h"
+#include "kernel/thread.h"
+#include "libc/stdint.h"
+
+// one fifo list per priority level, a set bit in the bitmap means the list of that level is not empty
+#define RT_PRIORITY_LEVELS NUM_PRIORITIES
+
+// time slice of a SCHED_RR thread before it goes behind the other threads of its level
+#define SCHED_RR_TIMESLICE_MS 10
+
+typedef KernelStatus (*RtQueueEnqueue)(struct RtQueue *queue, Thread *thread);
+
+typedef KernelStatus (*RtQueueRequeue)(struct RtQueue *queue, Thread *thread);
+
+typedef KernelStatus (*RtQueueRemove)(struct RtQueue *queue, Thread *thread);
+
+typedef Thread *(*RtQueueGetHighest)(struct RtQueue *queue);
+
+typedef struct RtQueueOperations {
+    RtQueueEnqueue enqueue;
+    RtQueueRequeue requeue;
+    RtQueueRemove remove;
+    RtQueueGetHighest getHighest;
+} RtQueueOperations;
+
+typedef struct RtQueue {
+    uint32_t bitmap;
+    uint32_t size;
+    KernelQueue levels[RT_PRIORITY_LEVELS];
+    RtQueueOperations operations;
+} RtQueue;
+
+RtQueue *rt_queue_create(RtQueue *queue);
+
+/**
+ * the highest level with a ready thread, the bitmap must not be empty
+ */
+static inline uint32_t rt_queue_highest_level(uint32_t bitmap) {
+    // __builtin_clz is a single clz instruction on armv7
+    return 31 - __builtin_clz(bitmap);
+}
+
+static inline uint32_t rt_queue_level(Thread *thread) {
+    return thread->priority > HIGHEST_PRIORITY ? HIGHEST_PRIORITY : thread->priority;
+}
+
+#endif//__KERNEL_RTQUEUE_H__
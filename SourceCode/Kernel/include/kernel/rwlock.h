@@ -0,0 +1,54 @@
+//
+// Created by XingfengYang on 2021/1/26.
+//
+
+#ifndef __KERNEL_RWLOCK_H__
+#define __KERNEL_RWLOCK_H__
+
+#include "kernel/kobject.h"
+#include "kernel/kqueue.h"
+#include "kernel/spinlock.h"
+#include "libc/stdbool.h"
+#include "libc/stdint.h"
+
+typedef void (*RwLockAcquireRead)(struct RwLock *rwLock);
+
+typedef void (*RwLockReleaseRead)(struct RwLock *rwLock);
+
+typedef void (*RwLockAcquireWrite)(struct RwLock *rwLock);
+
+typedef void (*RwLockReleaseWrite)(struct RwLock *rwLock);
+
+typedef bool (*RwLockTryAcquireRead)(struct RwLock *rwLock);
+
+typedef bool (*RwLockTryAcquireWrite)(struct RwLock *rwLock);
+
+typedef struct RwLockOperations {
+    RwLockAcquireRead acquireRead;
+    RwLockReleaseRead releaseRead;
+    RwLockAcquireWrite acquireWrite;
+    RwLockReleaseWrite releaseWrite;
+    RwLockTryAcquireRead tryAcquireRead;
+    RwLockTryAcquireWrite tryAcquireWrite;
+} RwLockOperations;
+
+/**
+ * a sleeping reader-writer lock that prefers writers: new readers wait as soon as a writer waits.
+ * release hands the lock straight to the waiters it wakes, either the first writer or every waiting reader,
+ * so a woken thread already holds the lock when it runs.
+ */
+typedef struct RwLock {
+    // readers inside the lock
+    uint32_t readers;
+    bool writer;
+    SpinLock spinLock;
+    // waiting readers sleep with THREAD_BLOCKED_READ_LOCK, writers with THREAD_BLOCKED
+    KernelQueue readerQueue;
+    KernelQueue writerQueue;
+    KernelObject object;
+    RwLockOperations operations;
+} RwLock;
+
+RwLock *rwlock_create(RwLock *rwLock);
+
+#endif//__KERNEL_RWLOCK_H__
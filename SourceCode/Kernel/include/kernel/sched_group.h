@@ -0,0 +1,85 @@
+//
+// Created by XingfengYang on 2021/1/24.
+//
+
+#ifndef __KERNEL_SCHED_GROUP_H__
+#define __KERNEL_SCHED_GROUP_H__
+
+#include "kernel/kqueue.h"
+#include "kernel/ktimer.h"
+#include "kernel/spinlock.h"
+#include "kernel/thread.h"
+#include "libc/stdbool.h"
+#include "libc/stdint.h"
+
+#define SCHED_GROUP_DEFAULT_PERIOD_MS 100
+
+// quota of a group without a cpu limit
+#define SCHED_GROUP_UNLIMITED 0
+
+typedef KernelStatus (*SchedGroupOperationAttach)(struct SchedGroup *group, Thread *thread);
+
+typedef KernelStatus (*SchedGroupOperationDetach)(struct SchedGroup *group, Thread *thread);
+
+typedef KernelStatus (*SchedGroupOperationSetQuota)(struct SchedGroup *group, uint32_t quotaUs);
+
+typedef bool (*SchedGroupOperationCharge)(struct SchedGroup *group, uint64_t deltaNs);
+
+typedef KernelStatus (*SchedGroupOperationPark)(struct SchedGroup *group, Thread *thread);
+
+typedef void (*SchedGroupOperationRefill)(struct SchedGroup *group);
+
+typedef struct SchedGroupOperations {
+    SchedGroupOperationAttach attach;
+    SchedGroupOperationDetach detach;
+    SchedGroupOperationSetQuota setQuota;
+    SchedGroupOperationCharge charge;
+    SchedGroupOperationPark park;
+    SchedGroupOperationRefill refill;
+} SchedGroupOperations;
+
+typedef struct SchedGroupStatus {
+    // cpu time charged to the group since it was created, over all cpus
+    uint64_t usageNs;
+    // time the group spent throttled
+    uint64_t throttledNs;
+    // periods elapsed and periods in which the quota ran out
+    uint32_t periods;
+    uint32_t throttleCount;
+    // threads taken out of a run queue because the group was throttled
+    uint32_t parkCount;
+} SchedGroupStatus;
+
+/**
+ * threads of a group share quotaNs of cpu time per period, summed over all cpus.
+ * once it is used up the group is throttled, its threads leave the run queues on their cpu's next switch
+ * and wait on throttledThreads until the periodic refill timer wakes them up again.
+ * lock is taken inside a run queue lock, never the other way round.
+ */
+typedef struct SchedGroup {
+    uint64_t quotaNs;
+    uint32_t periodMs;
+    // charged in the current period
+    uint64_t runtimeNs;
+    volatile bool throttled;
+    // generic counter value the group got throttled at
+    uint64_t throttledAt;
+    uint32_t memberCount;
+    SpinLock lock;
+    // parked threads, linked through threadReadyQueue
+    KernelQueue throttledThreads;
+    KernelTimer refillTimer;
+    SchedGroupStatus status;
+    SchedGroupOperations operations;
+} SchedGroup;
+
+/**
+ * the refill timer is added to kernelTimerManager, which has to be created before
+ */
+SchedGroup *sched_group_create(SchedGroup *group, uint32_t quotaUs, uint32_t periodMs);
+
+static inline bool sched_group_is_throttled(Thread *thread) {
+    return thread->schedGroup != nullptr && thread->schedGroup->throttled;
+}
+
+#endif//__KERNEL_SCHED_GROUP_H__
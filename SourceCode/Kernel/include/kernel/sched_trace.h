@@ -0,0 +1,61 @@
+//
+// Created by XingfengYang on 2021/1/20.
+//
+
+#ifndef __KERNEL_SCHED_TRACE_H__
+#define __KERNEL_SCHED_TRACE_H__
+
+#include "kernel/cpu.h"
+#include "libc/stdbool.h"
+#include "libc/stdint.h"
+
+// entries per cpu, a power of two so the ring index is a mask
+#define SCHED_TRACE_ENTRIES 256
+
+typedef enum SchedTraceEvent {
+    SCHED_TRACE_NONE = 0,
+    // prev pid, next pid, prev status
+    SCHED_TRACE_SWITCH,
+    // pid, target cpu, preempt requested
+    SCHED_TRACE_WAKEUP,
+    // pid, from cpu, to cpu
+    SCHED_TRACE_MIGRATE,
+    // next event in ms
+    SCHED_TRACE_TICK,
+} SchedTraceEvent;
+
+typedef struct SchedTraceEntry {
+    // generic counter value, the same clock on every cpu so buffers of different cpus can be compared
+    uint64_t timestamp;
+    uint32_t event;
+    uint32_t arg0;
+    uint32_t arg1;
+    uint32_t arg2;
+} SchedTraceEntry;
+
+/**
+ * written only by its own cpu with interrupts disabled, so recording needs neither a lock nor an atomic.
+ * head counts every record ever written, readers detect entries overwritten under them by comparing it.
+ */
+typedef struct SchedTraceBuffer {
+    volatile uint32_t head;
+    SchedTraceEntry entries[SCHED_TRACE_ENTRIES];
+} SchedTraceBuffer;
+
+void sched_trace_record(SchedTraceEvent event, uint32_t arg0, uint32_t arg1, uint32_t arg2);
+
+void sched_trace_enable(bool enable);
+
+void sched_trace_reset(void);
+
+uint32_t sched_trace_head(CpuNum cpuId);
+
+/**
+ * copy the entry with sequence number index out of a cpu's buffer,
+ * returns false if it has not been written yet or was already overwritten
+ */
+bool sched_trace_read(CpuNum cpuId, uint32_t index, SchedTraceEntry *entry);
+
+const char *sched_trace_event_name(uint32_t event);
+
+#endif//__KERNEL_SCHED_TRACE_H__
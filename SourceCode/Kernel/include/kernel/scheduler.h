@@ -5,10 +5,61 @@
 #ifndef __KERNEL_SCHEDULER_H__
 #define __KERNEL_SCHEDULER_H__
 
+#include "kernel/percpu.h"
 #include "kernel/thread.h"
 #include "libc/stdint.h"
 #include "interrupt.h"
 
+#define PRIORITY_WEIGHT_NUM 40
+
+/**
+ * every runnable thread on a cpu gets a turn within this period, split by weight
+ */
+#define SCHED_LATENCY_MS 20
+
+/**
+ * a slice never gets shorter than this, however many threads share the cpu
+ */
+#define SCHED_MIN_GRANULARITY_MS 4
+
+/**
+ * an idle cpu still switches this often, to steal from busy siblings. work placed on it kicks it at once
+ */
+#define SCHED_IDLE_TICK_MS 100
+
+/**
+ * a woken thread preempts the current one only if it is behind by more than this much weighted vruntime
+ */
+#define SCHED_WAKEUP_GRANULARITY_NS 1000000
+
+/**
+ * the weight of a thread at DEFAULT_PRIORITY, equal to nice 0 in CFS
+ */
+#define PRIORITY_DEFAULT_WEIGHT 1024
+
+/**
+ * PRIORITY_2_WMULT[i] is 2^PRIORITY_WMULT_SHIFT / PRIORITY_2_WEIGHT[i]
+ */
+#define PRIORITY_WMULT_SHIFT 32
+
+extern uint32_t PRIORITY_2_WEIGHT[PRIORITY_WEIGHT_NUM];
+extern uint32_t PRIORITY_2_WMULT[PRIORITY_WEIGHT_NUM];
+
+/**
+ * thread priorities grow towards HIGHEST_PRIORITY while the weight table is indexed by nice + 20,
+ * so DEFAULT_PRIORITY maps to nice 0 and every priority step above it is one nice level heavier.
+ */
+static inline uint32_t priority_to_weight_index(uint32_t priority) {
+    if (priority > HIGHEST_PRIORITY) {
+        priority = HIGHEST_PRIORITY;
+    }
+    return PRIORITY_WEIGHT_NUM / 2 + DEFAULT_PRIORITY - priority;
+}
+
+static inline uint32_t priority_to_weight(uint32_t priority) {
+    return PRIORITY_2_WEIGHT[priority_to_weight_index(priority)];
+}
+
 typedef KernelStatus (*SchedulerOperationInit)(struct Scheduler *scheduler);
 
 typedef KernelStatus (*SchedulerOperationAddThread)(struct Scheduler *scheduler,Thread *thread, uint32_t priority);
@@ -21,10 +72,15 @@ typedef KernelStatus (*SchedulerOperationYield)(struct Scheduler *scheduler);
 
 typedef KernelStatus (*SchedulerOperationPreempt)(struct Scheduler *scheduler);
 
+typedef KernelStatus (*SchedulerOperationWakeup)(struct Scheduler *scheduler, Thread *thread);
+
 typedef KernelStatus (*SchedulerOperationSwitchTo)(struct Scheduler *scheduler,Thread *thread);
 
 typedef KernelStatus (*SchedulerOperationSwitchNext)(struct Scheduler *scheduler);
 
+typedef KernelStatus (*SchedulerOperationSetPolicy)(struct Scheduler *scheduler, Thread *thread,
+                                                    SchedPolicy schedPolicy, uint32_t priority);
+
 typedef uint32_t (*SchedulerOperationGetCurrentPid)(struct Scheduler *scheduler);
 
 typedef Thread *(*SchedulerOperationGetCurrentThread)(struct Scheduler *scheduler);
@@ -36,21 +92,43 @@ typedef struct SchedulerOperation {
     SchedulerOperationBlock block;
     SchedulerOperationYield yield;
     SchedulerOperationPreempt preempt;
+    SchedulerOperationWakeup wakeup;
     SchedulerOperationSwitchTo switchTo;
     SchedulerOperationSwitchNext switchNext;
+    SchedulerOperationSetPolicy setPolicy;
     SchedulerOperationGetCurrentPid getCurrentPid;
     SchedulerOperationGetCurrentThread getCurrentThread;
 } SchedulerOperation;
 
 typedef struct Scheduler {
-    Thread *prevThread;
-    Thread *currentThread;
     Tick schedulerTick;
     SchedulerOperation operation;
 } Scheduler;
 
 Scheduler *scheduler_create(Scheduler *scheduler);
 
+uint32_t scheduler_slice_ms(PerCpu *perCpu, Thread *thread);
+
+uint64_t scheduler_counter_to_ns(uint64_t counter);
+
+uint64_t scheduler_calc_delta_vruntime(uint64_t deltaNs, uint32_t priority);
+
+void scheduler_update_runtime(PerCpu *perCpu, Thread *thread, uint64_t now);
+
+bool scheduler_wakeup_should_preempt(Thread *currentThread, Thread *thread);
+
+uint32_t scheduler_next_event(PerCpu *perCpu);
+
+/**
+ * move the threads other cpus woke up for perCpu into its run queue. only called on perCpu itself, with its lock held
+ */
+void scheduler_drain_wakeups(PerCpu *perCpu);
+
+/**
+ * when this cpu's scheduler tick has to fire next, also accounting for rcu
+ */
+uint32_t tick_next_event(void);
+
 KernelStatus schd_init(void);
 
 KernelStatus schd_add_thread(Thread *thread, uint32_t priority);
@@ -19,31 +19,51 @@
         .operations = {                                                                                                  \
                 .post = semaphore_default_post,                                                                          \
                 .wait = semaphore_default_wait,                                                                          \
+                .waitTimeout = semaphore_default_wait_timeout,                                                           \
         },                                                                                                               \
         .waitQueue = {.size = 0, .head = nullptr, .tail = nullptr, .operations = {                                       \
                                                                            .enqueue = kqueue_default_operation_enqueue,  \
                                                                            .dequeue = kqueue_default_operation_dequeue,  \
+                                                                           .remove = kqueue_default_operation_remove,    \
                                                                            .size = kqueue_default_operation_size,        \
                                                                            .isEmpty = kqueue_default_operation_is_empty, \
                                                                    }},                                                   \
-        .spinLock = SpinLockCreate(), .waitQueue = nunllptr,                                                             \
+        .spinLock = SpinLockCreate(),                                                                                    \
+        .stat = LockStatKeyCreate(),                                                                                     \
     }
 
 typedef void (*SemaphorePost)(struct Semaphore *semaphore);
 
 typedef void (*SemaphoreWait)(struct Semaphore *semaphore);
 
+typedef KernelStatus (*SemaphoreWaitTimeout)(struct Semaphore *semaphore, uint32_t timeoutMs);
+
 typedef struct SemaphoreOperations {
     SemaphorePost post;
     SemaphoreWait wait;
+    SemaphoreWaitTimeout waitTimeout;
 } SemaphoreOperations;
 
 typedef struct Semaphore {
     Atomic count;
     SpinLock spinLock;
     KernelQueue waitQueue;
+    // waits are recorded, a semaphore has no holder to take a hold time from
+    LockStatKey stat;
     KernelObject object;
     SemaphoreOperations operations;
 } Semaphore;
 
+Semaphore *semaphore_create(Semaphore *semaphore, uint32_t count);
+
+void semaphore_default_post(Semaphore *semaphore);
+
+void semaphore_default_wait(Semaphore *semaphore);
+
+/**
+ * like wait, but gives up after timeoutMs and returns TIMEOUT without taking a count.
+ * a timeout of 0 only tries, KERNEL_TIMER_FOREVER waits like wait
+ */
+KernelStatus semaphore_default_wait_timeout(Semaphore *semaphore, uint32_t timeoutMs);
+
 #endif// __KERNEL_SEMAPHORE_H__
@@ -0,0 +1,68 @@
+//
+// Created by XingfengYang on 2021/1/26.
+//
+
+#ifndef __KERNEL_SEQLOCK_H__
+#define __KERNEL_SEQLOCK_H__
+
+#include "kernel/spinlock.h"
+#include "libc/stdbool.h"
+#include "libc/stdint.h"
+
+#define SeqLockCreate()                    \
+    {                                      \
+        .sequence = 0,                     \
+        .writeLock = SpinLockCreate(),     \
+    }
+
+/**
+ * for small data that is read far more often than written, like a 64 bit time or a few counters.
+ * readers take no lock and never make the writer wait, they copy the data and retry if a write ran meanwhile:
+ *
+ *     uint32_t sequence;
+ *     do {
+ *         sequence = seqlock_read_begin(&lock);
+ *         copy = data;
+ *     } while (seqlock_read_retry(&lock, sequence));
+ *
+ * the sequence is odd while a write is in progress. writers are serialized by writeLock.
+ */
+typedef struct SeqLock {
+    volatile uint32_t sequence;
+    SpinLock writeLock;
+} SeqLock;
+
+static inline SeqLock *seqlock_create(SeqLock *seqLock) {
+    seqLock->sequence = 0;
+    spinlock_create(&seqLock->writeLock);
+    return seqLock;
+}
+
+static inline uint32_t seqlock_read_begin(SeqLock *seqLock) {
+    uint32_t sequence;
+    while ((sequence = seqLock->sequence) & 1) {
+    }
+    // the data must not be read before the sequence
+    asm volatile("dmb" ::: "memory");
+    return sequence;
+}
+
+static inline bool seqlock_read_retry(SeqLock *seqLock, uint32_t sequence) {
+    asm volatile("dmb" ::: "memory");
+    return seqLock->sequence != sequence;
+}
+
+static inline void seqlock_write_begin(SeqLock *seqLock) {
+    seqLock->writeLock.operations.acquire(&seqLock->writeLock);
+    seqLock->sequence++;
+    // readers have to see the odd sequence before any of the new data
+    asm volatile("dmb" ::: "memory");
+}
+
+static inline void seqlock_write_end(SeqLock *seqLock) {
+    asm volatile("dmb" ::: "memory");
+    seqLock->sequence++;
+    seqLock->writeLock.operations.release(&seqLock->writeLock);
+}
+
+#endif//__KERNEL_SEQLOCK_H__
@@ -6,34 +6,63 @@
 #define __KERNEL_SPINLOCK_H__
 
 #include "kernel/atomic.h"
+#include "kernel/lockstat.h"
 
-#define SpinLockCreate()                             \
-    {                                                \
-        .lock = {                                    \
-                .counter = 0,                        \
-        },                                           \
-        .operations = {                              \
-                .acquire = spinlock_default_acquire, \
-                .release = spinlock_default_release, \
-        },                                           \
+#define SpinLockCreate()                                                   \
+    {                                                                      \
+        .lock = {                                                          \
+                .counter = 0,                                              \
+        },                                                                 \
+        .interruptEnabled = 0,                                             \
+        .stat = LockStatKeyCreate(),                                       \
+        .operations = {                                                    \
+                .acquire = spinlock_default_acquire,                       \
+                .release = spinlock_default_release,                       \
+                .acquireIrqSave = spinlock_default_acquire_irq_save,       \
+                .releaseIrqRestore = spinlock_default_release_irq_restore, \
+        },                                                                 \
     }
 
+// the lock word holds the ticket being served in its low half and the next free ticket in its high half
+#define SPINLOCK_TICKET_SHIFT 16
+
 typedef void (*SpinLockAcquire)(struct SpinLock *spinLock);
 
 typedef void (*SpinLockRelease)(struct SpinLock *spinLock);
 
+typedef uint32_t (*SpinLockAcquireIrqSave)(struct SpinLock *spinLock);
+
+typedef void (*SpinLockReleaseIrqRestore)(struct SpinLock *spinLock, uint32_t interruptEnabled);
+
+/**
+ * acquire and release keep the interrupt state from before acquire in the lock itself,
+ * acquireIrqSave hands it to the caller, who passes it back to releaseIrqRestore.
+ * both disable interrupts while the lock is held, nested locks have to be released in reverse order.
+ */
 typedef struct SpinLockOperations {
     SpinLockAcquire acquire;
     SpinLockRelease release;
+    SpinLockAcquireIrqSave acquireIrqSave;
+    SpinLockReleaseIrqRestore releaseIrqRestore;
 } SpinLockOperations;
 
 typedef struct SpinLock {
+    // a fair ticket lock, cpus get the lock in the order they drew their tickets
     Atomic lock;
+    // interrupt state of the holder before acquire, restored on release
+    uint32_t interruptEnabled;
+    LockStatKey stat;
     SpinLockOperations operations;
 } SpinLock;
 
+SpinLock *spinlock_create(SpinLock *spinLock);
+
 void spinlock_default_acquire(SpinLock *spinLock);
 
 void spinlock_default_release(SpinLock *spinLock);
 
+uint32_t spinlock_default_acquire_irq_save(SpinLock *spinLock);
+
+void spinlock_default_release_irq_restore(SpinLock *spinLock, uint32_t interruptEnabled);
+
 #endif// __KERNEL_SPINLOCK_H__
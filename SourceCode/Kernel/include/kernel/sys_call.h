@@ -41,6 +41,10 @@ uint32_t sys_mkdir(const char *pathname, uint32_t mode);
 
 uint32_t sys_rmdir(const char *pathname);
 
+uint32_t sys_sched_setscheduler(uint32_t pid, uint32_t policy, uint32_t priority);
+
+uint32_t sys_futex(uint32_t *uaddr, uint32_t op, uint32_t val);
+
 SysCall sys_call_table[] = {
         sys_restart_syscall,
         sys_exit,
@@ -59,6 +63,8 @@ SysCall sys_call_table[] = {
         sys_rename,
         sys_mkdir,
         sys_rmdir,
+        sys_sched_setscheduler,
+        sys_futex,
 };
 
 const char* sys_call_name_table[] = {
@@ -79,5 +85,7 @@ const char* sys_call_name_table[] = {
         "sys_rename",
         "sys_mkdir",
         "sys_rmdir",
+        "sys_sched_setscheduler",
+        "sys_futex",
 };
 #endif// __KERNEL_SYSCALL_H__
@@ -6,6 +6,7 @@
 #define __KERNEL_THREAD_H__
 
 #include "arm/register.h"
+#include "arm/vfp.h"
 #include "arm/vmm.h"
 #include "kernel/kheap.h"
 #include "kernel/kobject.h"
@@ -13,6 +14,7 @@
 #include "kernel/stack.h"
 #include "kernel/list.h"
 #include "kernel/rbtree.h"
+#include "kernel/spinlock.h"
 #include "kernel/vfs_dentry.h"
 #include "libc/stdint.h"
 #include "kernel/cpu.h"
@@ -31,6 +33,16 @@
 #define DEFAULT_PRIORITY (NUM_PRIORITIES / 2)
 #define HIGH_PRIORITY ((NUM_PRIORITIES / 4) * 3)
 
+/**
+ * SCHED_OTHER threads share the cpu through cfs. SCHED_FIFO and SCHED_RR threads are real-time, they always run
+ * before any cfs thread and the highest priority one runs first, FIFO until it blocks, RR for a time slice.
+ */
+typedef enum SchedPolicy {
+    SCHED_OTHER = 0,
+    SCHED_FIFO,
+    SCHED_RR,
+} SchedPolicy;
+
 typedef enum CloneFlags {
     CLONE_VM = 0x1,
     CLONE_FS = 0x1 << 1,
@@ -45,6 +57,10 @@ typedef enum ThreadStatus {
     THREAD_BLOCKED_READ_LOCK,
     THREAD_SLEEPING,
     THREAD_SUSPENDED,
+    // runnable, but parked on its group until the group's quota is refilled
+    THREAD_THROTTLED,
+    // woken up by another cpu, waiting in the wakeup inbox of the cpu it is going to run on
+    THREAD_WAKING,
     THREAD_DEATH,
 } ThreadStatus;
 
@@ -114,11 +130,14 @@ typedef KernelStatus (*ThreadOperationSuspend)(struct Thread *thread);
 
 typedef KernelStatus (*ThreadOperationResume)(struct Thread *thread);
 
-typedef KernelStatus (*ThreadOperationSleep)(struct Thread *thread, uint32_t deadline);
+/**
+ * the timeouts are relative, in ms. sleep is for the current thread only
+ */
+typedef KernelStatus (*ThreadOperationSleep)(struct Thread *thread, uint32_t timeoutMs);
 
 typedef KernelStatus (*ThreadOperationDetach)(struct Thread *thread);
 
-typedef KernelStatus (*ThreadOperationJoin)(struct Thread *thread, int *returnCode, uint32_t deadline);
+typedef KernelStatus (*ThreadOperationJoin)(struct Thread *thread, int *returnCode, uint32_t timeoutMs);
 
 typedef KernelStatus (*ThreadOperationExit)(struct Thread *thread, uint32_t returnCode);
 
@@ -130,6 +149,8 @@ typedef struct Thread *(*ThreadOperationCopy)(struct Thread *thread, CloneFlags
 
 typedef uint32_t (*ThreadOperationIsKernelThread)(struct Thread *thread);
 
+typedef uint64_t (*ThreadOperationGetRuntimeNs)(struct Thread *thread);
+
 typedef struct ThreadOperations {
     ThreadOperationSuspend suspend;
     ThreadOperationResume resume;
@@ -141,6 +162,7 @@ typedef struct ThreadOperations {
     ThreadOperationCopy copy;
     ThreadOperationExecute execute;
     ThreadOperationIsKernelThread isKernelThread;
+    ThreadOperationGetRuntimeNs getRuntimeNs;
 } ThreadOperations;
 
 typedef struct Thread {
@@ -157,22 +179,46 @@ typedef struct Thread {
     uint32_t signals;
 
     ThreadStatus threadStatus;
+    // taken by wakeup to move the thread off its waiting status, of concurrent wakeups only one gets to enqueue it
+    SpinLock wakeupLock;
     ListNode threadList;
     KQueueNode threadReadyQueue;
 
     uint32_t priority;
+    SchedPolicy schedPolicy;
+    // policy and priority of its own while the thread runs with those inherited from a mutex waiter
+    SchedPolicy basePolicy;
+    uint32_t basePriority;
+    bool priorityBoosted;
 
     RBNode rbNode;
+    // links a real-time thread into the run queue list of its priority level
+    KQueueNode rtNode;
+    // round robin slice time used so far, reset when the thread goes to the tail of its level
+    uint64_t rtSliceUsedNs;
     uint64_t startTime;
-    uint32_t runtimeNs;
-    uint32_t runtimeVirtualNs;
+    uint64_t runtimeNs;
+    uint64_t runtimeVirtualNs;
 
 
     CpuNum lastCpu;
     CpuNum currCpu;
     CpuMask cpuAffinity;
+    // bandwidth group the thread is charged to, nullptr for no cpu limit
+    struct SchedGroup *schedGroup;
+    // key of the futex the thread sleeps on
+    uint32_t futexKey;
+
+    // saved when the thread is switched out after using fp, restored lazily on its next fp instruction
+    VfpContext vfpContext;
+    bool fpuUsed;
+    // the cpu whose registers held this thread's fp state last
+    CpuNum fpuCpu;
 
     uint32_t returnCode;
+    // threads waiting in join for this one to exit, and the lock that orders them against exit
+    SpinLock joinLock;
+    KernelQueue joinQueue;
 
     ThreadOperations operations;
 
@@ -186,8 +232,28 @@ typedef struct Thread {
 
 } Thread;
 
-Thread *thread_create(const char *name, ThreadStartRoutine entry, void *arg, uint32_t priority, RegisterCPSR cpsr);
+/**
+ * initial, ready and running threads sit in a run queue, every other status means the thread is waiting
+ */
+static inline bool thread_is_runnable(Thread *thread) {
+    return thread->threadStatus <= THREAD_RUNNING;
+}
+
+static inline bool thread_is_realtime(Thread *thread) {
+    return thread->schedPolicy != SCHED_OTHER;
+}
+
+/**
+ * how urgent a thread is, every real-time priority ranks above every cfs priority
+ */
+static inline uint32_t thread_sched_rank(Thread *thread) {
+    return thread_is_realtime(thread) ? NUM_PRIORITIES + thread->priority : thread->priority;
+}
+
+Thread *thread_create(const char *name, ThreadStartRoutine entry, void *arg, uint32_t priority, SchedPolicy schedPolicy,
+                      RegisterCPSR cpsr);
 void thread_release(Thread *thread);
+void thread_set_ops(Thread *thread);
 Thread *thread_create_idle_thread(uint32_t cpuNum);
 
 #endif//__KERNEL_THREAD_H__
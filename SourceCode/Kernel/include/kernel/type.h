@@ -22,6 +22,8 @@ typedef int (*SysCall)(int arg1, int arg2, int arg3, int arg4, int arg5);
 typedef enum KernelStatus {
     OK = 0,
     ERROR,
+    // a timed wait ran out before what it waited for happened
+    TIMEOUT,
 } KernelStatus;
 
 #endif//__KERNEL_TYPE_H__
@@ -8,6 +8,7 @@
 #include "kernel/atomic.h"
 #include "kernel/list.h"
 #include "kernel/mutex.h"
+#include "kernel/rcu_head.h"
 #include "kernel/spinlock.h"
 
 typedef uint64_t (*DirectoryEntryHashOperation)(struct DirectoryEntry *directoryEntry);
@@ -35,8 +36,11 @@ typedef struct DirectoryEntry {
     struct IndexNode *indexNode;
     struct SuperBlock *superBlock;
 
+    // siblings, readers walk them towards prev under rcu_read_lock
     ListNode list;
+    RcuHead rcuHead;
 
+    // one for the tree, one per lookup result not released yet
     Atomic refCount;
     SpinLock parallelLock;
 
@@ -51,9 +55,17 @@ char *vfs_directory_entry_default_get_name(DirectoryEntry *directoryEntry);
 
 KernelStatus vfs_directory_entry_default_delete(DirectoryEntry *directory);
 
+/**
+ * drop the reference a lookup took, the entry is destroyed here if it was deleted meanwhile
+ */
 KernelStatus vfs_directory_entry_default_release(DirectoryEntry *directory);
 
 KernelStatus vfs_directory_entry_default_init(DirectoryEntry *directory, DirectoryEntry *parent,
                                               struct IndexNode *inode);
 
+/**
+ * the child of directory named name, or nullptr. the caller holds rcu_read_lock.
+ */
+DirectoryEntry *vfs_directory_entry_find_child(DirectoryEntry *directory, const char *name);
+
 #endif// __KERNEL_VFS_DIRECTORY_ENTRY_H__
@@ -3,59 +3,228 @@
 //
 #include "kernel/atomic.h"
 
+/**
+ * the ordered variants of an operation are built from its relaxed one, with a dmb on the side that has to be ordered
+ */
+#define ATOMIC_FULLY_ORDERED(type, name, params, args)                                                                 \
+    type name params {                                                                                                 \
+        memory_barrier();                                                                                              \
+        type result = name##_relaxed args;                                                                             \
+        memory_barrier();                                                                                              \
+        return result;                                                                                                 \
+    }
+
+#define ATOMIC_ORDERED(type, name, params, args)                                                                       \
+    ATOMIC_FULLY_ORDERED(type, name, params, args)                                                                     \
+                                                                                                                       \
+    type name##_acquire params {                                                                                       \
+        type result = name##_relaxed args;                                                                             \
+        memory_barrier();                                                                                              \
+        return result;                                                                                                 \
+    }                                                                                                                  \
+                                                                                                                       \
+    type name##_release params {                                                                                       \
+        memory_barrier();                                                                                              \
+        return name##_relaxed args;                                                                                    \
+    }
+
+#define ATOMIC_FETCH_OP(name, instruction)                                                                             \
+    uint32_t atomic_fetch_##name##_relaxed(Atomic *atomic, uint32_t val) {                                             \
+        uint32_t result;                                                                                               \
+        uint32_t tmp;                                                                                                  \
+        uint32_t failed;                                                                                               \
+        __asm__ __volatile__("@ atomic_fetch_" #name "\n\t"                                                            \
+                             "1:  ldrex    %0, [%3]\n\t"                                                               \
+                             "    " #instruction "      %1, %0, %4\n\t"                                                \
+                             "    strex    %2, %1, [%3]\n\t"                                                           \
+                             "    teq      %2, #0\n\t"                                                                 \
+                             "    bne      1b"                                                                         \
+                             : "=&r"(result), "=&r"(tmp), "=&r"(failed)                                                \
+                             : "r"(&atomic->counter), "r"(val)                                                         \
+                             : "cc", "memory");                                                                        \
+        return result;                                                                                                 \
+    }                                                                                                                  \
+                                                                                                                       \
+    ATOMIC_ORDERED(uint32_t, atomic_fetch_##name, (Atomic * atomic, uint32_t val), (atomic, val))
+
+#define ATOMIC64_FETCH_OP(name, lowInstruction, highInstruction)                                                       \
+    uint64_t atomic64_fetch_##name##_relaxed(Atomic64 *atomic, uint64_t val) {                                         \
+        uint64_t result;                                                                                               \
+        uint64_t tmp;                                                                                                  \
+        uint32_t failed;                                                                                               \
+        __asm__ __volatile__("@ atomic64_fetch_" #name "\n\t"                                                          \
+                             "1:  ldrexd   %0, %H0, [%3]\n\t"                                                          \
+                             "    " #lowInstruction "     %Q1, %Q0, %Q4\n\t"                                           \
+                             "    " #highInstruction "      %R1, %R0, %R4\n\t"                                         \
+                             "    strexd   %2, %1, %H1, [%3]\n\t"                                                      \
+                             "    teq      %2, #0\n\t"                                                                 \
+                             "    bne      1b"                                                                         \
+                             : "=&r"(result), "=&r"(tmp), "=&r"(failed)                                                \
+                             : "r"(&atomic->counter), "r"(val)                                                         \
+                             : "cc", "memory");                                                                        \
+        return result;                                                                                                 \
+    }                                                                                                                  \
+                                                                                                                       \
+    ATOMIC_FULLY_ORDERED(uint64_t, atomic64_fetch_##name, (Atomic64 * atomic, uint64_t val), (atomic, val))
+
 void atomic_create(Atomic *atomic) { atomic_set(atomic, 0); }
 
+/**
+ * a plain store clears the exclusive monitors of other cpus for the address, no strex is needed
+ */
 void atomic_set(Atomic *atomic, uint32_t val) {
-    volatile uint32_t tmp;
-    __asm__ __volatile__("@ atomic_set\n\t"
-                         "1:  ldrex    %0, [%1]\n\t"    // ldrex : arm的
-                         "    strex    %0, %2, [%1]\n\t"// strex
-                         "    teq      %0, #0\n\t"
-                         "    bne      1b"
-                         : "=&r"(tmp)
-                         : "r"(&atomic->counter), "r"(val)
-                         : "cc");
+    atomic->counter = val;
+}
+
+void atomic_set_release(Atomic *atomic, uint32_t val) {
+    memory_barrier();
+    atomic->counter = val;
 }
 
 uint32_t atomic_get(Atomic *atomic) {
-    volatile uint32_t result;
-    __asm__ __volatile__("@ atomic_get\n\t"
-                         "	ldrex	%0, [%1]"
-                         : "=&r"(result)
-                         : "r"(&atomic->counter));
+    return atomic->counter;
+}
+
+uint32_t atomic_get_acquire(Atomic *atomic) {
+    uint32_t result = atomic->counter;
+    memory_barrier();
     return result;
 }
 
+ATOMIC_FETCH_OP(add, add)
+ATOMIC_FETCH_OP(sub, sub)
+ATOMIC_FETCH_OP(or, orr)
+ATOMIC_FETCH_OP(and, and)
+
 uint32_t atomic_inc(Atomic *atomic) { return atomic_add(atomic, 1); }
 
 uint32_t atomic_dec(Atomic *atomic) { return atomic_sub(atomic, 1); }
 
 uint32_t atomic_add(Atomic *atomic, uint32_t val) {
+    return atomic_fetch_add(atomic, val) + val;
+}
+
+uint32_t atomic_sub(Atomic *atomic, uint32_t val) {
+    return atomic_fetch_sub(atomic, val) - val;
+}
+
+uint32_t atomic_xchg_relaxed(Atomic *atomic, uint32_t val) {
     volatile uint32_t tmp;
     uint32_t result;
-    __asm__ __volatile__("@ atomic_add\n\t"
-                         "1:  ldrex    %0, [%2]\n\t"
-                         "    add      %1, %0, %3\n\t"
-                         "    strex    %0, %1, [%2]\n\t"
+    __asm__ __volatile__("@ atomic_xchg\n\t"
+                         "1:  ldrex    %1, [%2]\n\t"
+                         "    strex    %0, %3, [%2]\n\t"
                          "    teq      %0, #0\n\t"
                          "    bne      1b"
                          : "=&r"(tmp), "=&r"(result)
                          : "r"(&atomic->counter), "r"(val)
-                         : "cc");
+                         : "cc", "memory");
     return result;
 }
 
-uint32_t atomic_sub(Atomic *atomic, uint32_t val) {
-    volatile uint32_t tmp;
+ATOMIC_ORDERED(uint32_t, atomic_xchg, (Atomic * atomic, uint32_t val), (atomic, val))
+
+/**
+ * when the compare fails clrex closes the exclusive access the ldrex opened, nothing is stored
+ */
+uint32_t atomic_cmpxchg_relaxed(Atomic *atomic, uint32_t expected, uint32_t val) {
     uint32_t result;
-    __asm__ __volatile__("@ atomic_sub\n\t"
+    uint32_t failed;
+    __asm__ __volatile__("@ atomic_cmpxchg\n\t"
                          "1:  ldrex    %0, [%2]\n\t"
-                         "    sub      %1, %0, %3\n\t"
-                         "    strex    %0, %1, [%2]\n\t"
-                         "    teq      %0, #0\n\t"
+                         "    teq      %0, %3\n\t"
+                         "    bne      2f\n\t"
+                         "    strex    %1, %4, [%2]\n\t"
+                         "    teq      %1, #0\n\t"
+                         "    bne      1b\n\t"
+                         "    b        3f\n\t"
+                         "2:  clrex\n\t"
+                         "3:"
+                         : "=&r"(result), "=&r"(failed)
+                         : "r"(&atomic->counter), "r"(expected), "r"(val)
+                         : "cc", "memory");
+    return result;
+}
+
+ATOMIC_ORDERED(uint32_t, atomic_cmpxchg, (Atomic * atomic, uint32_t expected, uint32_t val),
+               (atomic, expected, val))
+
+void atomic64_create(Atomic64 *atomic) { atomic64_set(atomic, 0); }
+
+void atomic64_set(Atomic64 *atomic, uint64_t val) {
+    uint64_t tmp;
+    uint32_t failed;
+    __asm__ __volatile__("@ atomic64_set\n\t"
+                         "1:  ldrexd   %0, %H0, [%2]\n\t"
+                         "    strexd   %1, %3, %H3, [%2]\n\t"
+                         "    teq      %1, #0\n\t"
                          "    bne      1b"
-                         : "=&r"(tmp), "=&r"(result)
+                         : "=&r"(tmp), "=&r"(failed)
                          : "r"(&atomic->counter), "r"(val)
-                         : "cc");
+                         : "cc", "memory");
+}
+
+uint64_t atomic64_get(Atomic64 *atomic) {
+    uint64_t result;
+    __asm__ __volatile__("@ atomic64_get\n\t"
+                         "    ldrexd   %0, %H0, [%1]\n\t"
+                         "    clrex"
+                         : "=&r"(result)
+                         : "r"(&atomic->counter)
+                         : "memory");
     return result;
 }
+
+ATOMIC64_FETCH_OP(add, adds, adc)
+ATOMIC64_FETCH_OP(sub, subs, sbc)
+
+uint64_t atomic64_add(Atomic64 *atomic, uint64_t val) {
+    return atomic64_fetch_add(atomic, val) + val;
+}
+
+uint64_t atomic64_sub(Atomic64 *atomic, uint64_t val) {
+    return atomic64_fetch_sub(atomic, val) - val;
+}
+
+uint64_t atomic64_inc(Atomic64 *atomic) { return atomic64_add(atomic, 1); }
+
+uint64_t atomic64_dec(Atomic64 *atomic) { return atomic64_sub(atomic, 1); }
+
+uint64_t atomic64_xchg_relaxed(Atomic64 *atomic, uint64_t val) {
+    uint64_t result;
+    uint32_t failed;
+    __asm__ __volatile__("@ atomic64_xchg\n\t"
+                         "1:  ldrexd   %0, %H0, [%2]\n\t"
+                         "    strexd   %1, %3, %H3, [%2]\n\t"
+                         "    teq      %1, #0\n\t"
+                         "    bne      1b"
+                         : "=&r"(result), "=&r"(failed)
+                         : "r"(&atomic->counter), "r"(val)
+                         : "cc", "memory");
+    return result;
+}
+
+ATOMIC_FULLY_ORDERED(uint64_t, atomic64_xchg, (Atomic64 * atomic, uint64_t val), (atomic, val))
+
+uint64_t atomic64_cmpxchg_relaxed(Atomic64 *atomic, uint64_t expected, uint64_t val) {
+    uint64_t result;
+    uint32_t failed;
+    __asm__ __volatile__("@ atomic64_cmpxchg\n\t"
+                         "1:  ldrexd   %0, %H0, [%2]\n\t"
+                         "    teq      %Q0, %Q3\n\t"
+                         "    teqeq    %R0, %R3\n\t"
+                         "    bne      2f\n\t"
+                         "    strexd   %1, %4, %H4, [%2]\n\t"
+                         "    teq      %1, #0\n\t"
+                         "    bne      1b\n\t"
+                         "    b        3f\n\t"
+                         "2:  clrex\n\t"
+                         "3:"
+                         : "=&r"(result), "=&r"(failed)
+                         : "r"(&atomic->counter), "r"(expected), "r"(val)
+                         : "cc", "memory");
+    return result;
+}
+
+ATOMIC_FULLY_ORDERED(uint64_t, atomic64_cmpxchg, (Atomic64 * atomic, uint64_t expected, uint64_t val),
+                     (atomic, expected, val))
@@ -2,6 +2,8 @@
 #include "kernel/console.h"
 #include "kernel/thread.h"
 #include "kernel/scheduler.h"
+#include "kernel/sched_trace.h"
+#include "kernel/lockstat.h"
 
 struct ConsoleCmd *cmd_manager_match_cmd(struct ConsoleCmdManager *manager, const uint8_t *name) {
     struct ConsoleCmd *nextCmd = nullptr;
@@ -457,12 +459,97 @@ void MeminfoCmdHandle (struct ConsoleDevice *console) {
     console->operation.resposeOutput(console, (uint8_t *)"meminfo: \n");   
 }
 
+/* usage: schedtrace [count], dump the last count scheduler events of every cpu, oldest first */
+void SchedTraceCmdHandle (struct ConsoleDevice *console) {
+    uint8_t result[96] = {0};
+    uint32_t count = SCHED_TRACE_ENTRIES;
+
+    if (console->cmdParam.paramNum == 2) {
+        count = console_atoi((char *)console->cmdParam.cmdGetParam(&console->cmdParam, 1));
+    }
+
+    for (CpuNum cpuId = 0; cpuId < SMP_MAX_CPUS; cpuId++) {
+        uint32_t head = sched_trace_head(cpuId);
+        uint32_t index = head > count ? head - count : 0;
+        SchedTraceEntry entry;
+        uint64_t start = 0;
+
+        sprintf((char *)result, "cpu %d: %d events\n", cpuId, head);
+        console->operation.resposeOutput(console, result);
+        for (; index < head; index++) {
+            /* entries the cpu overwrote while dumping are skipped */
+            if (!sched_trace_read(cpuId, index, &entry)) {
+                continue;
+            }
+            if (start == 0) {
+                start = entry.timestamp;
+            }
+            sprintf((char *)result, "  +%dus %s %d %d %d\n",
+                    (uint32_t)(scheduler_counter_to_ns(entry.timestamp - start) / 1000),
+                    sched_trace_event_name(entry.event), entry.arg0, entry.arg1, entry.arg2);
+            console->operation.resposeOutput(console, result);
+        }
+    }
+}
+
+#define LOCKSTAT_CMD_DEFAULT_COUNT 10
+#define LOCKSTAT_CMD_MAX_COUNT 32
+
+/* usage: lockstat [on|off|reset|count], print the count most contended locks, wait and hold times in cycles */
+void LockStatCmdHandle (struct ConsoleDevice *console) {
+    uint8_t result[128] = {0};
+    LockStatSummary summaries[LOCKSTAT_CMD_MAX_COUNT];
+    uint32_t count = LOCKSTAT_CMD_DEFAULT_COUNT;
+
+    if (console->cmdParam.paramNum == 2) {
+        char *param = (char *)console->cmdParam.cmdGetParam(&console->cmdParam, 1);
+        if (strcmp(param, "on")) {
+            lockstat_enable(true);
+            return;
+        }
+        if (strcmp(param, "off")) {
+            lockstat_enable(false);
+            return;
+        }
+        if (strcmp(param, "reset")) {
+            lockstat_reset();
+            return;
+        }
+        count = console_atoi(param);
+        if (count > LOCKSTAT_CMD_MAX_COUNT) {
+            count = LOCKSTAT_CMD_MAX_COUNT;
+        }
+    }
+
+    sprintf((char *)result, "lockstat %s\n", lockStatEnabled ? "on" : "off");
+    console->operation.resposeOutput(console, result);
+    uint32_t found = lockstat_top(summaries, count);
+    for (uint32_t i = 0; i < found; i++) {
+        LockStatSummary *summary = &summaries[i];
+        LockStatEntry *total = &summary->total;
+        uint32_t avgWait = total->contentions != 0 ? (uint32_t)(total->waitCycles / total->contentions) : 0;
+        uint32_t avgHold = (uint32_t)(total->holdCycles / total->acquisitions);
+        if (summary->name == nullptr) {
+            sprintf((char *)result, "%s", "(other locks)");
+        } else {
+            sprintf((char *)result, "%s@0x%x", summary->name, summary->address);
+        }
+        console->operation.resposeOutput(console, result);
+        sprintf((char *)result, " site 0x%x: %d acquired, %d contended, wait avg %d max %d, hold avg %d max %d\n",
+                (uint32_t) total->maxWaitSite, total->acquisitions, total->contentions, avgWait,
+                total->maxWaitCycles, avgHold, total->maxHoldCycles);
+        console->operation.resposeOutput(console, result);
+    }
+}
+
 /* you can to add command here */
 ConsoleCmd basicCmdTable[] = {
     {"add", AddCmdHandle},
     {"version", VersionCmdHandle},
     {"help", HelpCmdHandle},
-    {"meminfo", MeminfoCmdHandle}
+    {"meminfo", MeminfoCmdHandle},
+    {"schedtrace", SchedTraceCmdHandle},
+    {"lockstat", LockStatCmdHandle}
 };
 
 extern Scheduler cfsScheduler;
@@ -487,7 +574,7 @@ void create_synestia_console()
     create_console(&console);
     create_basic_cmd(&console, basicCmdTable, sizeof(basicCmdTable)/sizeof(ConsoleCmd));
 
-    Thread *consoleThread = thread_create("console", (ThreadStartRoutine) &console_run, 0, 0,
+    Thread *consoleThread = thread_create("console", (ThreadStartRoutine) &console_run, 0, 0, SCHED_OTHER,
                                                    sysModeCPSR());
     consoleThread->cpuAffinity = cpu_number_to_mask(0);
     cfsScheduler.operation.addThread(&cfsScheduler, consoleThread, 1);   
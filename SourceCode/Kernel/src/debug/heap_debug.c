@@ -25,12 +25,17 @@ static void dump_user_space_page_alloc_status()
 
 static void dump_heap_statistics()
 {
+    HeapStatistics statistics;
+    heap_statistics(&kernelHeap, &statistics);
     LogInfo("********** Heap Statistics **********\n")
     LogInfo("heap begin at address: 0x%x\n", kernelHeap.address)
     LogInfo("max size: 0x%x\n", kernelHeap.maxSizeLimit)
-    LogInfo("allocatedBlockCount: 0x%x\n", kernelHeap.statistics.allocatedBlockCount)
-    LogInfo("allocatedSize: 0x%x\n", kernelHeap.statistics.allocatedSize)
-    LogInfo("mergeCounts: 0x%x\n", kernelHeap.statistics.mergeCounts)
+    LogInfo("allocatedBlockCount: 0x%x\n", statistics.allocatedBlockCount)
+    LogInfo("allocatedSize: 0x%x\n", statistics.allocatedSize)
+    LogInfo("mergeCounts: 0x%x\n", statistics.mergeCounts)
+    LogInfo("freeSize: 0x%x\n", statistics.freeSize)
+    LogInfo("largestFreeSize: 0x%x\n", statistics.largestFreeSize)
+    LogInfo("fragmentation: %d%%\n", statistics.fragmentation)
     return;
 }
 
@@ -49,8 +54,7 @@ static void dump_heap_using_list()
         LogInfo("heap 0x%x: next : 0x%x  pre : 0x%x, size = 0x%x\n",
                 count++, area_ptr->list.next, area_ptr->list.prev, area_ptr->size);
         for (; node.next != nullptr; node = *(node.next) , count++) {
-            /* according to the structure of HeapArea, node->next should make a u32 of magic + u32 of size */
-            HeapArea *info = (HeapArea *)((uint32_t)node.next - 2 * sizeof(uint32_t));
+            HeapArea *info = getNode(node.next, HeapArea, list);
             LogInfo("heap 0x%x: next : 0x%x  pre : 0x%x, size = 0x%x\n",
                     count, info->list.next, info->list.prev, info->size);
         }
@@ -60,23 +64,18 @@ static void dump_heap_using_list()
 
 static void dump_heap_free_list()
 {
-    HeapArea *free_ptr = kernelHeap.freeListHead;
     LogInfo("********** Heap Free List **********\n")
-    LogInfo("free_ptr = 0x%x\n", free_ptr)
-//    for(uint32_t i = 0; i < 64; i++) {
-//        LogInfo("0x%x : 0x%x\n", (u32)free_ptr + i * 4, *(u32*)((u32)free_ptr + i * 4))
-//    }
-    if (free_ptr) {
+    for (uint32_t bin = 0; bin < HEAP_BIN_COUNT; bin++) {
+        HeapArea *free_ptr = kernelHeap.freeBins[bin];
+        if (free_ptr == nullptr) {
+            continue;
+        }
+        LogInfo("bin 0x%x: free_ptr = 0x%x\n", bin, free_ptr)
         uint32_t count = 0;
-        ListNode node = free_ptr->list;
-        HeapArea *area_ptr = (HeapArea *)free_ptr;
-        LogInfo("heap 0x%x: next : 0x%x  pre : 0x%x, size = 0x%x\n",
-                count++, area_ptr->list.next, area_ptr->list.prev, area_ptr->size);
-        for (; node.next != nullptr; node = *(node.next) , count++) {
-            /* according to the structure of HeapArea, node->next should make a u32 of magic + u32 of size */
-            HeapArea *info = (HeapArea *)((uint32_t)node.next - 2 * sizeof(uint32_t));
+        while (free_ptr != nullptr) {
             LogInfo("heap 0x%x: next : 0x%x  pre : 0x%x, size = 0x%x\n",
-                    count, info->list.next, info->list.prev, info->size);
+                    count++, free_ptr->list.next, free_ptr->list.prev, free_ptr->size);
+            free_ptr = free_ptr->list.next != nullptr ? getNode(free_ptr->list.next, HeapArea, list) : nullptr;
         }
     }
     return;
@@ -34,7 +34,6 @@ void ext2_recursively_fill_superblock(Ext2FileSystem *ext2FileSystem, Ext2IndexN
 
         directoryEntry->operations.init(directoryEntry, vfsDirectoryEntry, indexNode);
 
-        // atomic_set(&directoryEntry->refCount,1);
         directoryEntry->operations.hash(directoryEntry);
         directoryEntry->indexNode->type = INDEX_NODE_DIRECTORY;
 
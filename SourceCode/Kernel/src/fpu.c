@@ -0,0 +1,71 @@
+//
+// Created by XingfengYang on 2021/1/22.
+//
+
+#include "kernel/fpu.h"
+#include "arm/interrupt.h"
+#include "arm/register.h"
+#include "arm/vfp.h"
+
+#define SPSR_THUMB (1u << 5)
+
+// the state a thread starts with: zeroed registers, round to nearest and no fp exceptions trapped
+static VfpContext fpuInitialContext;
+
+void fpu_init(void) {
+    vfp_init();
+}
+
+void fpu_switch(PerCpu *perCpu) {
+    if (!vfp_is_enabled()) {
+        return;
+    }
+    vfp_save(&perCpu->fpuOwner->vfpContext);
+    vfp_disable();
+}
+
+bool fpu_handle_undefined(uint32_t instructionAddress, uint32_t spsr) {
+    // the kernel is built for arm state, a thumb instruction is never a lazy fp trap
+    if ((spsr & SPSR_THUMB) || vfp_is_enabled()) {
+        return false;
+    }
+    if (!vfp_is_vfp_instruction(*(uint32_t *) instructionAddress)) {
+        return false;
+    }
+    PerCpu *perCpu = percpu_get(read_cpuid());
+    Thread *thread = perCpu->currentThread;
+    if (thread == nullptr) {
+        return false;
+    }
+
+    vfp_enable();
+    this_cpu_ptr(cpuStatus)->fpuTraps++;
+    // the registers still hold this thread's state unless another thread used fp here, or it did on another cpu
+    if (perCpu->fpuOwner != thread || thread->fpuCpu != perCpu->cpuId) {
+        vfp_restore(thread->fpuUsed ? &thread->vfpContext : &fpuInitialContext);
+        perCpu->fpuOwner = thread;
+        thread->fpuCpu = perCpu->cpuId;
+        this_cpu_ptr(cpuStatus)->fpuRestores++;
+    }
+    thread->fpuUsed = true;
+    return true;
+}
+
+void fpu_release_thread(Thread *thread) {
+    uint32_t interruptEnabled = arch_is_interrupt_enabled();
+    arch_disable_interrupt();
+
+    PerCpu *perCpu = percpu_get(read_cpuid());
+    if (perCpu->fpuOwner == thread) {
+        if (vfp_is_enabled()) {
+            vfp_disable();
+        }
+        perCpu->fpuOwner = nullptr;
+    }
+    // a stale owner pointer on another cpu never matches, a new thread at this address starts without a cpu
+    thread->fpuCpu = INVALID_CPU;
+
+    if (interruptEnabled) {
+        arch_enable_interrupt();
+    }
+}
@@ -0,0 +1,79 @@
+//
+// Created by XingfengYang on 2021/1/28.
+//
+
+#include "kernel/futex.h"
+#include "arm/register.h"
+#include "kernel/percpu.h"
+#include "kernel/scheduler.h"
+
+extern Scheduler cfsScheduler;
+
+FutexBucket futexBuckets[FUTEX_HASH_BUCKETS];
+
+void futex_init(void) {
+    for (uint32_t i = 0; i < FUTEX_HASH_BUCKETS; i++) {
+        spinlock_create(&futexBuckets[i].lock);
+        lockstat_set_name(&futexBuckets[i].lock.stat, "futex bucket");
+        kqueue_create(&futexBuckets[i].waitQueue);
+    }
+}
+
+uint32_t futex_key(Thread *thread, uint32_t *address) {
+    if (thread == nullptr || thread->operations.isKernelThread(thread)) {
+        return (uint32_t) address;
+    }
+    VirtualMemory *virtualMemory = &thread->memoryStruct.virtualMemory;
+    return virtualMemory->operations.translateToPhysical(virtualMemory, (uint32_t) address);
+}
+
+FutexBucket *futex_bucket(uint32_t key) {
+    // futexes are words, the low two bits carry nothing. multiplicative hash by the golden ratio
+    return &futexBuckets[((key >> 2) * 0x9E3779B9) >> (32 - FUTEX_HASH_BITS)];
+}
+
+KernelStatus futex_wait(uint32_t *address, uint32_t expected) {
+    PerCpu *perCpu = percpu_get(read_cpuid());
+    Thread *currentThread = perCpu->currentThread;
+    if (currentThread == nullptr || currentThread == perCpu->idleThread) {
+        return ERROR;
+    }
+    uint32_t key = futex_key(currentThread, address);
+    FutexBucket *bucket = futex_bucket(key);
+
+    bucket->lock.operations.acquire(&bucket->lock);
+    // a waker changes the value before it takes the bucket lock, so a wake can not get lost between check and sleep
+    if (*(volatile uint32_t *) key != expected) {
+        bucket->lock.operations.release(&bucket->lock);
+        return ERROR;
+    }
+    currentThread->futexKey = key;
+    bucket->waitQueue.operations.enqueue(&bucket->waitQueue, &currentThread->threadReadyQueue);
+    currentThread->threadStatus = THREAD_BLOCKED;
+    bucket->lock.operations.release(&bucket->lock);
+
+    cfsScheduler.operation.block(&cfsScheduler);
+    return OK;
+}
+
+uint32_t futex_wake(uint32_t *address, uint32_t count) {
+    Thread *currentThread = percpu_get(read_cpuid())->currentThread;
+    uint32_t key = futex_key(currentThread, address);
+    FutexBucket *bucket = futex_bucket(key);
+
+    uint32_t woken = 0;
+    bucket->lock.operations.acquire(&bucket->lock);
+    KQueueNode *node = bucket->waitQueue.head;
+    while (node != nullptr && woken < count) {
+        KQueueNode *next = node->next;
+        Thread *thread = getNode(node, Thread, threadReadyQueue);
+        if (thread->futexKey == key) {
+            bucket->waitQueue.operations.remove(&bucket->waitQueue, node);
+            cfsScheduler.operation.wakeup(&cfsScheduler, thread);
+            woken++;
+        }
+        node = next;
+    }
+    bucket->lock.operations.release(&bucket->lock);
+    return woken;
+}
@@ -3,10 +3,14 @@
 #include "arm/register.h"
 #include "arm/kernel_vmm.h"
 #include "arm/page.h"
+#include "arm/pmu.h"
 #include "kernel/ext2.h"
+#include "kernel/fpu.h"
+#include "kernel/futex.h"
 #include "kernel/interrupt.h"
 #include "kernel/kheap.h"
 #include "kernel/percpu.h"
+#include "kernel/rcu.h"
 #include "kernel/scheduler.h"
 #include "kernel/slab.h"
 #include "kernel/vfs.h"
@@ -106,6 +110,8 @@ void print_memory_map() {
 }
 
 void kernel_main(void) {
+    fpu_init();
+    pmu_enable_cycle_counter();
     if (read_cpuid() == 0) {
         led_init();
         print_splash();
@@ -135,6 +141,8 @@ void kernel_main(void) {
         return;
 
         scheduler_create(&cfsScheduler);
+        futex_init();
+        rcu_init();
 
         // create kernel heap
         heap_create(&kernelHeap, (uint32_t) &__KERNEL_END + PAGE_SIZE,
@@ -183,7 +191,7 @@ void kernel_main(void) {
 
         cfsScheduler.operation.init(&cfsScheduler);
 
-        Thread *gpuProcess = thread_create("gpu", (ThreadStartRoutine) &GPU_FLUSH, 0, 0, sysModeCPSR());
+        Thread *gpuProcess = thread_create("gpu", (ThreadStartRoutine) &GPU_FLUSH, 0, 0, SCHED_OTHER, sysModeCPSR());
         gpuProcess->cpuAffinity = cpu_number_to_mask(0);
         cfsScheduler.operation.addThread(&cfsScheduler, gpuProcess, 1);
 
@@ -1,4 +1,5 @@
 #include "arm/interrupt.h"
+#include "arm/register.h"
 #include "raspi2/synestia_os_hal.h"
 #include "kernel/interrupt.h"
 #include "arm/vmm.h"
@@ -9,6 +10,7 @@
 
 Tick *tick_init(Tick *tick, TickHandler handler, const char *name) {
     tick->handler = handler;
+    tick->nextEvent = nullptr;
     memset(tick->name, 0, sizeof(tick->name));
     memcpy(tick->name, name, sizeof(tick->name) - 1);
     tick->node.next = nullptr;
@@ -75,24 +77,49 @@ void interrupt_manager_default_init(InterruptManager *manager) {
 void interrupt_manager_default_tick(InterruptManager *manager) {
     Tick *tick = manager->ticks;
     if (tick != nullptr) {
-        LogInfo("[InterruptManager]: tick '%s' triggered\n", tick->name);
         tick->handler();
         while (tick->node.next != nullptr) {
             Tick *next = getNode(tick->node.next, Tick, node);
-            LogInfo("[InterruptManager]: tick '%s' triggered\n", tick->name);
             next->handler();
             tick = next;
         }
     } else {
         LogError("[InterruptManager]: no tick registered\n");
     }
+    manager->operation.programTick(manager);
+}
+
+uint32_t interrupt_manager_default_next_event(InterruptManager *manager) {
+    uint32_t nextEvent = TICK_NO_EVENT;
+    Tick *tick = manager->ticks;
+    while (tick != nullptr) {
+        uint32_t tickEvent = tick->nextEvent != nullptr ? tick->nextEvent() : TICK_DEFAULT_INTERVAL_MS;
+        if (tickEvent < nextEvent) {
+            nextEvent = tickEvent;
+        }
+        tick = tick->node.next != nullptr ? getNode(tick->node.next, Tick, node) : nullptr;
+    }
+    return nextEvent;
+}
+
+void interrupt_manager_default_program_tick(InterruptManager *manager) {
+    synestia_timer_set_next_event(manager->operation.nextEvent(manager));
+}
+
+void interrupt_manager_default_kick_cpu(InterruptManager *manager, uint32_t cpuId) {
+    if (cpuId == read_cpuid()) {
+        manager->operation.programTick(manager);
+        return;
+    }
+    synestia_cpu_kick(cpuId);
 }
 
 
 void interrupt_manager_default_interrupt(InterruptManager *manager) {
+    // a kick needs no handler of its own, the timer handler below runs the ticks on every interrupt
+    synestia_cpu_kick_clear();
     for (uint32_t interrupt_no = 0; interrupt_no < IRQ_NUMS; interrupt_no++) {
         if (manager->registed[interrupt_no] == 1 /* && synestia_interrupt_pending(interrupt_no)*/) {
-            LogInfo("[Interrupt]: interrupt '%s' triggered.\n", manager->interrupts[interrupt_no].name);
             if (manager->interrupts[interrupt_no].clearHandler != nullptr) {
                 manager->interrupts[interrupt_no].clearHandler();
             }
@@ -112,6 +139,9 @@ InterruptManager *interrupt_manager_create(InterruptManager *manger) {
     manger->operation.unRegisterTick = (InterruptManagerOperationUnRegisterTick) interrupt_manager_default_un_register_tick;
     manger->operation.interrupt = (InterruptManagerOperationInterrupt) interrupt_manager_default_interrupt;
     manger->operation.tick = (InterruptManagerOperationTick) interrupt_manager_default_tick;
+    manger->operation.nextEvent = (InterruptManagerOperationNextEvent) interrupt_manager_default_next_event;
+    manger->operation.programTick = (InterruptManagerOperationProgramTick) interrupt_manager_default_program_tick;
+    manger->operation.kickCpu = (InterruptManagerOperationKickCpu) interrupt_manager_default_kick_cpu;
 
     manger->ticks = nullptr;
     memset((char *) manger->registed, 0, IRQ_NUMS * sizeof(uint32_t));
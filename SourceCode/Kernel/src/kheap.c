@@ -12,79 +12,146 @@
 extern PhysicalPageAllocator kernelPageAllocator;
 extern Scheduler cfsScheduler;
 
+/**
+ * add to a counter of heap on the current cpu, interrupts are off for the same reasons as in this_cpu_add
+ */
+#define heap_counter_add(heap, counter, val)                                                                           \
+    do {                                                                                                               \
+        uint32_t __cpsr = percpu_irq_save();                                                                           \
+        (heap)->counters[read_cpuid()].counter += (val);                                                               \
+        percpu_irq_restore(__cpsr);                                                                                    \
+    } while (0)
+
 void heap_default_alloc_callback(struct Heap *heap, void *ptr, uint32_t size) {
-    heap->statistics.allocatedSize += size;
-    heap->statistics.allocatedBlockCount += 1;
-    LogInfo("[KHeap]: alloc %d bytes at 0x%x.\n", size, (uint32_t) ptr);
+    (void) ptr;
+    heap_counter_add(heap, allocatedSize, size);
+    heap_counter_add(heap, allocatedBlockCount, 1);
 }
 
 void heap_default_free_callback(struct Heap *heap, void *ptr) {
     HeapArea *heapArea = (HeapArea *) (ptr - sizeof(HeapArea));
-    if (heap->statistics.allocatedSize >= heapArea->size) {
-        heap->statistics.allocatedSize -= heapArea->size;
+    heap_counter_add(heap, allocatedSize, -heapArea->size);
+    heap_counter_add(heap, allocatedBlockCount, -1);
+}
+
+/**
+ * the bin a free block of size goes to, size is a multiple of HEAP_ALIGNMENT
+ */
+static uint32_t heap_bin(uint32_t size) {
+    if (size <= HEAP_SMALL_SIZE_MAX) {
+        return size / HEAP_ALIGNMENT - 1;
     }
+    // 31 - clz is the power of two below size, 256 itself is the last small size
+    return HEAP_SMALL_BINS + (31 - __builtin_clz(size)) - 8;
+}
 
-    if (heap->statistics.allocatedBlockCount > 0) {
-        heap->statistics.allocatedBlockCount -= 1;
+/**
+ * the first bin from start on that holds a free block, or HEAP_BIN_COUNT
+ */
+static uint32_t heap_find_bin(Heap *heap, uint32_t start) {
+    for (uint32_t word = start / BITS_IN_UINT32; word < HEAP_BIN_MAP_WORDS; word++) {
+        uint32_t bits = heap->binMap[word];
+        if (word == start / BITS_IN_UINT32) {
+            bits &= ~0u << (start % BITS_IN_UINT32);
+        }
+        if (bits != 0) {
+            return word * BITS_IN_UINT32 + __builtin_ctz(bits);
+        }
     }
-    LogInfo("[KHeap]: free %d bytes at 0x%x.\n", heapArea->size, (uint32_t) ptr);
+    return HEAP_BIN_COUNT;
 }
 
-void *heap_default_alloc(struct Heap *heap, uint32_t size) {
-    uint32_t allocSize = size + sizeof(HeapArea);
-    uint32_t offset = sizeof(void *) - (size % sizeof(void *));
+static HeapArea *heap_area_next(HeapArea *area) {
+    return (HeapArea *) ((void *) area + sizeof(HeapArea) + area->size);
+}
 
-    if (heap->freeListHead == nullptr) {
-        LogError("[KHeap]: failed to get freeListHead.\n");
-        return nullptr;
+static HeapArea *heap_area_prev(HeapArea *area) {
+    return (HeapArea *) ((void *) area - area->prevSize - sizeof(HeapArea));
+}
+
+static void heap_bin_insert(Heap *heap, HeapArea *area) {
+    area->used = false;
+    heap->freeSize += area->size;
+    uint32_t bin = heap_bin(area->size);
+    HeapArea *head = heap->freeBins[bin];
+    area->list.prev = nullptr;
+    area->list.next = head != nullptr ? &head->list : nullptr;
+    if (head != nullptr) {
+        head->list.prev = &area->list;
     }
+    heap->freeBins[bin] = area;
+    heap->binMap[bin / BITS_IN_UINT32] |= 1u << (bin % BITS_IN_UINT32);
+}
 
-    HeapArea *currentFreeArea = heap->freeListHead;
-    while (currentFreeArea != nullptr) {
-        // if the size of the free block can contain the request size and a rest HeapArea,
-        // then just use it, and split a new block
-        if (currentFreeArea->size >= (allocSize + offset)) {
-            // 1. split a rest free HeapArea
-            uint32_t newFreeHeapAreaAddress = (uint32_t) (void *) currentFreeArea + sizeof(HeapArea) + size + offset;
-            uint32_t restSize = currentFreeArea->size - allocSize - offset;
-
-            HeapArea *newFreeArea = (HeapArea *) newFreeHeapAreaAddress;
-            newFreeArea->magic = HEAP_AREA_MAGIC;
-            newFreeArea->size = restSize;
-
-            // 2.link new free heap area to free list
-            newFreeArea->list.prev = currentFreeArea->list.prev;
-            newFreeArea->list.next = currentFreeArea->list.next;
-            currentFreeArea->list.prev->next = &newFreeArea->list;
-            if (currentFreeArea->list.next != nullptr) {
-                currentFreeArea->list.next->prev = &newFreeArea->list;
-            }
-
-            // 3. link this to using list
-            currentFreeArea->list.prev = nullptr;
-            currentFreeArea->list.next = nullptr;
-            currentFreeArea->size = size;
-            HeapArea *usingArea = heap->usingListHead;
-            if (usingArea == nullptr) {
-                heap->usingListHead = currentFreeArea;
-            } else {
-                while (usingArea->list.next != nullptr) {
-                    usingArea = getNode(usingArea->list.next, HeapArea, list);
-                }
-                usingArea->list.next = &currentFreeArea->list;
-                currentFreeArea->list.prev = &usingArea->list;
-            }
-
-            // 4. return the ptr of the using block
-            void *ptr = (void *) currentFreeArea + sizeof(HeapArea);
-            heap->allocCallback(heap, ptr, size);
-            return ptr;
+static void heap_bin_remove(Heap *heap, HeapArea *area) {
+    heap->freeSize -= area->size;
+    uint32_t bin = heap_bin(area->size);
+    if (area->list.prev != nullptr) {
+        area->list.prev->next = area->list.next;
+    } else {
+        heap->freeBins[bin] = area->list.next != nullptr ? getNode(area->list.next, HeapArea, list) : nullptr;
+        if (heap->freeBins[bin] == nullptr) {
+            heap->binMap[bin / BITS_IN_UINT32] &= ~(1u << (bin % BITS_IN_UINT32));
         }
-        currentFreeArea = getNode(currentFreeArea->list.next, HeapArea, list);
-        // no free block found ,it's means we must do some memory defragmentation
-        // TODO: defragmentation
     }
-    return nullptr;
+    if (area->list.next != nullptr) {
+        area->list.next->prev = area->list.prev;
+    }
+    area->list.prev = nullptr;
+    area->list.next = nullptr;
+}
+
+/**
+ * a small request fits every block of its own bin and above. a block of a power of two bin may be smaller
+ * than a request of the same bin, only the first one is tried before going to the bins above, which all fit
+ */
+static void *heap_alloc_locked(Heap *heap, uint32_t size) {
+    if (size > heap->maxSizeLimit) {
+        return nullptr;
+    }
+    size = size == 0 ? HEAP_ALIGNMENT : (size + HEAP_ALIGNMENT - 1) & ~(HEAP_ALIGNMENT - 1);
+
+    uint32_t bin = heap_bin(size);
+    HeapArea *area = heap->freeBins[bin];
+    if (area == nullptr || area->size < size) {
+        uint32_t fitBin = heap_find_bin(heap, bin < HEAP_SMALL_BINS ? bin : bin + 1);
+        if (fitBin == HEAP_BIN_COUNT) {
+            LogError("[KHeap]: no free block for %d bytes.\n", size);
+            return nullptr;
+        }
+        area = heap->freeBins[fitBin];
+    }
+    heap_bin_remove(heap, area);
+
+    // split the rest off, unless it is too small to hold a block of its own
+    if (area->size - size >= sizeof(HeapArea) + HEAP_ALIGNMENT) {
+        HeapArea *restArea = (HeapArea *) ((void *) area + sizeof(HeapArea) + size);
+        restArea->magic = HEAP_AREA_MAGIC;
+        restArea->size = area->size - size - sizeof(HeapArea);
+        restArea->prevSize = size;
+        heap_area_next(restArea)->prevSize = restArea->size;
+        heap_bin_insert(heap, restArea);
+        area->size = size;
+    }
+    area->used = true;
+
+    area->list.prev = nullptr;
+    area->list.next = heap->usingListHead != nullptr ? &heap->usingListHead->list : nullptr;
+    if (heap->usingListHead != nullptr) {
+        heap->usingListHead->list.prev = &area->list;
+    }
+    heap->usingListHead = area;
+
+    void *ptr = (void *) area + sizeof(HeapArea);
+    heap->allocCallback(heap, ptr, area->size);
+    return ptr;
+}
+
+void *heap_default_alloc(struct Heap *heap, uint32_t size) {
+    uint32_t interruptEnabled = heap->lock.operations.acquireIrqSave(&heap->lock);
+    void *ptr = heap_alloc_locked(heap, size);
+    heap->lock.operations.releaseIrqRestore(&heap->lock, interruptEnabled);
+    return ptr;
 }
 
 void *heap_default_alloc_aligned(struct Heap *heap, uint32_t size, uint32_t alignment) {
@@ -112,7 +179,7 @@ void *heap_default_realloc(struct Heap *heap, void *ptr, uint32_t size) {
 
     // 2. copy the data from old heap area to new heap area
     HeapArea *oldHeapArea = ptr - sizeof(HeapArea);
-    uint32_t dataSize = oldHeapArea->size;
+    uint32_t dataSize = oldHeapArea->size < size ? oldHeapArea->size : size;
     memcpy(newHeapArea, ptr, dataSize);
 
     // 3. free old heap area
@@ -123,13 +190,11 @@ void *heap_default_realloc(struct Heap *heap, void *ptr, uint32_t size) {
     return newHeapArea;
 }
 
-KernelStatus heap_default_free(struct Heap *heap, void *ptr) {
-    LogInfo("[KHeap] want free: 0x%x. \n", ptr);
+static KernelStatus heap_free_locked(Heap *heap, void *ptr) {
     // 1. get HeapArea address
-    uint32_t address = (uint32_t) (ptr - sizeof(HeapArea));
-    HeapArea *currentArea = (HeapArea *) address;
+    HeapArea *currentArea = (HeapArea *) (ptr - sizeof(HeapArea));
 
-    if (currentArea->magic != HEAP_AREA_MAGIC) {
+    if (currentArea->magic != HEAP_AREA_MAGIC || !currentArea->used) {
         LogError("[KHeap] not a heap area: 0x%x. \n", ptr);
         return ERROR;
     }
@@ -138,60 +203,47 @@ KernelStatus heap_default_free(struct Heap *heap, void *ptr) {
     if (currentArea->list.prev != nullptr) {
         currentArea->list.prev->next = currentArea->list.next;
     } else {
-        // if this block is the head of using list, then make using list point to next block.
-        if (currentArea->list.next != nullptr) {
-            heap->usingListHead = getNode(currentArea->list.next, HeapArea, list);
-            currentArea->list.next->prev = nullptr;
-        } else {
-            heap->usingListHead = nullptr;
-        }
+        heap->usingListHead =
+                currentArea->list.next != nullptr ? getNode(currentArea->list.next, HeapArea, list) : nullptr;
     }
-
-    if (currentArea->list.next != nullptr && currentArea->list.prev != nullptr) {
+    if (currentArea->list.next != nullptr) {
         currentArea->list.next->prev = currentArea->list.prev;
     }
 
-    // 3. link this to free list
-    HeapArea *freeArea = heap->freeListHead;
-    while (freeArea->list.next != nullptr) {
-        freeArea = getNode(freeArea->list.next, HeapArea, list);
-    }
-    currentArea->list.prev = &freeArea->list;
-    currentArea->list.next = freeArea->list.next;
-    freeArea->list.next = &currentArea->list;
-
-    // do some merge stuff between two adjacent free heap area
-    HeapArea *firstFreeArea = heap->freeListHead;
-    while (firstFreeArea->list.next != nullptr) {
-        firstFreeArea = getNode(firstFreeArea->list.next, HeapArea, list);
-        HeapArea *secondFreeArea = firstFreeArea;
-        while (secondFreeArea->list.next != nullptr) {
-            secondFreeArea = getNode(secondFreeArea->list.next, HeapArea, list);
-
-            // check is adjacent free heap area
-            if (firstFreeArea + sizeof(HeapArea) + firstFreeArea->size == secondFreeArea) {
-
-                // resize the first heap area
-                firstFreeArea->size = firstFreeArea->size + sizeof(HeapArea) + secondFreeArea->size;
-                firstFreeArea->list.next = secondFreeArea->list.next;
-                secondFreeArea->list.next->prev->next = &firstFreeArea->list;
-
-                // delink the second heap area
-                secondFreeArea->list.prev = nullptr;
-                secondFreeArea->list.next = nullptr;
-                secondFreeArea->size = 0;
-
-                heap->statistics.mergeCounts++;
-            }
-        }
-    }
     heap->freeCallback(heap, ptr);
+    // calloc counts on free memory being zeroed
     memset(ptr, 0, currentArea->size);
-    ptr = nullptr;
 
+    // 3. merge with the free neighbours, their headers in between become free memory and are zeroed too
+    HeapArea *nextArea = heap_area_next(currentArea);
+    if (!nextArea->used) {
+        heap_bin_remove(heap, nextArea);
+        currentArea->size += sizeof(HeapArea) + nextArea->size;
+        memset(nextArea, 0, sizeof(HeapArea));
+        heap_counter_add(heap, mergeCounts, 1);
+    }
+    HeapArea *prevArea = heap_area_prev(currentArea);
+    if (!prevArea->used) {
+        heap_bin_remove(heap, prevArea);
+        prevArea->size += sizeof(HeapArea) + currentArea->size;
+        memset(currentArea, 0, sizeof(HeapArea));
+        currentArea = prevArea;
+        heap_counter_add(heap, mergeCounts, 1);
+    }
+    heap_area_next(currentArea)->prevSize = currentArea->size;
+
+    // 4. link this to the free bin of its size
+    heap_bin_insert(heap, currentArea);
     return OK;
 }
 
+KernelStatus heap_default_free(struct Heap *heap, void *ptr) {
+    uint32_t interruptEnabled = heap->lock.operations.acquireIrqSave(&heap->lock);
+    KernelStatus status = heap_free_locked(heap, ptr);
+    heap->lock.operations.releaseIrqRestore(&heap->lock, interruptEnabled);
+    return status;
+}
+
 void heap_default_release(struct Heap *heap) {
     // TODO: release heap when threadd killed
 }
@@ -200,6 +252,47 @@ void heap_default_set_alloc_callback(struct Heap *heap, HeapAllocCallback callba
 
 void heap_default_set_free_callback(struct Heap *heap, HeapFreeCallback callback) { heap->freeCallback = callback; }
 
+/**
+ * the largest free block is in the highest bin that is not empty, only that bin is searched
+ */
+static uint32_t heap_largest_free_size(Heap *heap) {
+    for (uint32_t bin = HEAP_BIN_COUNT; bin > 0; bin--) {
+        if ((heap->binMap[(bin - 1) / BITS_IN_UINT32] & (1u << ((bin - 1) % BITS_IN_UINT32))) == 0) {
+            continue;
+        }
+        uint32_t largest = 0;
+        ListNode *node = &heap->freeBins[bin - 1]->list;
+        while (node != nullptr) {
+            HeapArea *area = getNode(node, HeapArea, list);
+            largest = area->size > largest ? area->size : largest;
+            node = node->next;
+        }
+        return largest;
+    }
+    return 0;
+}
+
+void heap_statistics(Heap *heap, HeapStatistics *statistics) {
+    statistics->allocatedBlockCount = 0;
+    statistics->allocatedSize = 0;
+    statistics->mergeCounts = 0;
+    for (CpuNum cpuId = 0; cpuId < SMP_MAX_CPUS; cpuId++) {
+        // each cpu's own copy may have wrapped around, the sum still comes out right
+        statistics->allocatedBlockCount += heap->counters[cpuId].allocatedBlockCount;
+        statistics->allocatedSize += heap->counters[cpuId].allocatedSize;
+        statistics->mergeCounts += heap->counters[cpuId].mergeCounts;
+    }
+    uint32_t interruptEnabled = heap->lock.operations.acquireIrqSave(&heap->lock);
+    statistics->freeSize = heap->freeSize;
+    statistics->largestFreeSize = heap_largest_free_size(heap);
+    heap->lock.operations.releaseIrqRestore(&heap->lock, interruptEnabled);
+    // from the sizes taken together under the lock, the heap may have changed since
+    statistics->fragmentation =
+            statistics->freeSize == 0
+                    ? 0
+                    : 100 - (uint32_t) ((uint64_t) statistics->largestFreeSize * 100 / statistics->freeSize);
+}
+
 KernelStatus heap_create(Heap *heap, uint32_t addr, uint32_t size) {
     heap->address = addr;
     LogInfo("[KHeap]: at: %d. \n", heap->address);
@@ -219,23 +312,40 @@ KernelStatus heap_create(Heap *heap, uint32_t addr, uint32_t size) {
     heap->address = KERNEL_PHYSICAL_START + heapPhysicalPage * PAGE_SIZE;
     LogInfo("[KHeap]: kheap at: %d. \n", heap->address);
 
-    HeapArea *freeHead = (HeapArea *) heap->address;
-    freeHead->magic = HEAP_AREA_MAGIC;
-    freeHead->size = 0;
-    freeHead->list.prev = nullptr;
-
-    HeapArea *freeArea = (HeapArea *) (heap->address + sizeof(HeapArea));
-    freeArea->size = (size - (uint32_t) (char *) heap->address -
-                      2 * sizeof(HeapArea));// all memory
-    freeHead->list.next = &freeArea->list;
-    freeArea->list.next = nullptr;
-    freeArea->list.prev = &freeHead->list;
-    freeArea->magic = HEAP_AREA_MAGIC;
+    spinlock_create(&heap->lock);
+    lockstat_set_name(&heap->lock.stat, "kheap");
+    for (uint32_t bin = 0; bin < HEAP_BIN_COUNT; bin++) {
+        heap->freeBins[bin] = nullptr;
+    }
+    for (uint32_t word = 0; word < HEAP_BIN_MAP_WORDS; word++) {
+        heap->binMap[word] = 0;
+    }
+    heap->usingListHead = nullptr;
+    heap->freeSize = 0;
+    for (CpuNum cpuId = 0; cpuId < SMP_MAX_CPUS; cpuId++) {
+        heap->counters[cpuId].allocatedBlockCount = 0;
+        heap->counters[cpuId].allocatedSize = 0;
+        heap->counters[cpuId].mergeCounts = 0;
+    }
 
-    HeapArea *usingHead = nullptr;
+    // all memory between two empty used blocks, the length is the one the pages were allocated for
+    HeapArea *startArea = (HeapArea *) heap->address;
+    startArea->magic = HEAP_AREA_MAGIC;
+    startArea->size = 0;
+    startArea->prevSize = 0;
+    startArea->used = true;
 
-    heap->freeListHead = freeHead;
-    heap->usingListHead = usingHead;
+    HeapArea *freeArea = heap_area_next(startArea);
+    freeArea->magic = HEAP_AREA_MAGIC;
+    freeArea->size = (size - addr - 3 * sizeof(HeapArea)) & ~(HEAP_ALIGNMENT - 1);
+    freeArea->prevSize = 0;
+    heap_bin_insert(heap, freeArea);
+
+    HeapArea *endArea = heap_area_next(freeArea);
+    endArea->magic = HEAP_AREA_MAGIC;
+    endArea->size = 0;
+    endArea->prevSize = freeArea->size;
+    endArea->used = true;
 
     heap->size = size;
 
@@ -254,10 +364,6 @@ KernelStatus heap_create(Heap *heap, uint32_t addr, uint32_t size) {
     heap->operations.free = (HeapOperationFree) heap_default_free;
     heap->operations.release = (HeapOperationRelease) heap_default_release;
 
-    heap->statistics.allocatedBlockCount = 0;
-    heap->statistics.allocatedSize = 0;
-    heap->statistics.mergeCounts = 0;
-
     LogInfo("[KHeap]: kheap created. \n");
     return OK;
 }
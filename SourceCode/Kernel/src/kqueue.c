@@ -6,13 +6,14 @@
 #include "kernel/assert.h"
 
 KernelStatus kqueue_default_operation_enqueue(struct KernelQueue *queue, KQueueNode *node) {
+    if (node == queue->head) {
+        return OK;
+    }
+    node->next = nullptr;
     if (queue->operations.isEmpty(queue)) {
+        node->prev = nullptr;
         queue->head = node;
         queue->tail = node;
-    } else if (queue->size == 1) {
-        if (node == queue->head) {
-            return OK;
-        }
     } else {
         node->prev = queue->tail;
         queue->tail->next = node;
@@ -27,10 +28,14 @@ KQueueNode *kqueue_default_operation_dequeue(struct KernelQueue *queue) {
 
         KQueueNode *head = queue->head;
         queue->head = head->next;
+        if (queue->head != nullptr) {
+            queue->head->prev = nullptr;
+        } else {
+            queue->tail = nullptr;
+        }
 
         queue->size--;
 
-        head->next->prev = nullptr;
         head->next = nullptr;
         head->prev = nullptr;
         return head;
@@ -38,12 +43,36 @@ KQueueNode *kqueue_default_operation_dequeue(struct KernelQueue *queue) {
     return nullptr;
 }
 
+/**
+ * unlink a node from anywhere in the queue, the node must be in this queue
+ */
+KernelStatus kqueue_default_operation_remove(struct KernelQueue *queue, KQueueNode *node) {
+    if (queue->operations.isEmpty(queue)) {
+        return ERROR;
+    }
+    if (node->prev != nullptr) {
+        node->prev->next = node->next;
+    } else {
+        queue->head = node->next;
+    }
+    if (node->next != nullptr) {
+        node->next->prev = node->prev;
+    } else {
+        queue->tail = node->prev;
+    }
+    queue->size--;
+
+    node->next = nullptr;
+    node->prev = nullptr;
+    return OK;
+}
+
 uint32_t kqueue_default_operation_size(struct KernelQueue *queue) {
     return queue->size;
 }
 
 bool kqueue_default_operation_is_empty(struct KernelQueue *queue) {
-    return queue->size == 0 && queue->head == queue->tail;
+    return queue->size == 0;
 }
 
 
@@ -53,6 +82,7 @@ KernelQueue *kqueue_create(KernelQueue *queue) {
     queue->tail = nullptr;
     queue->operations.enqueue = (KernelQueueOperationEnQueue) kqueue_default_operation_enqueue;
     queue->operations.dequeue = (KernelQueueOperationDeQueue) kqueue_default_operation_dequeue;
+    queue->operations.remove = (KernelQueueOperationRemove) kqueue_default_operation_remove;
     queue->operations.size = (KernelQueueOperationSize) kqueue_default_operation_size;
     queue->operations.isEmpty = (KernelQueueOperationIsEmpty) kqueue_default_operation_is_empty;
     return queue;
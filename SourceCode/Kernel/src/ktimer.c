@@ -3,6 +3,7 @@
 //
 
 #include <debug/timer_debug.h>
+#include "arm/register.h"
 #include "kernel/log.h"
 #include "kernel/scheduler.h"
 #include "kernel/interrupt.h"
@@ -12,9 +13,6 @@
 #include "kernel/assert.h"
 #include "kernel/thread.h"
 
-// TODO: this value should read from global config
-#define TICK_INTERVAL 50
-
 extern InterruptManager genericInterruptManager;
 extern Heap kernelHeap;
 extern Scheduler cfsScheduler;
@@ -22,6 +20,8 @@ extern KernelTimerManager kernelTimerManager;
 
 KernelTimer kernel_timer_manger_default_init(struct KernelTimerManager *kernelTimerManager) {
     tick_init(&kernelTimerManager->timerManagerTick, kernelTimerManager->operation.onTick, "timer manager tick");
+    kernelTimerManager->timerManagerTick.nextEvent = kernelTimerManager->operation.nextEvent;
+    kernelTimerManager->lastCounter = read_cntvct();
     genericInterruptManager.operation.registerTick(&genericInterruptManager, &kernelTimerManager->timerManagerTick);
 }
 
@@ -37,61 +37,152 @@ KernelStatus kernel_timer_default_cancel(struct KernelTimer *timer) {
 }
 
 
-KernelTimer *kernel_timer_manger_default_create_timer(KernelTimerManager *kernelTimerManager, uint32_t deadline) {
-    KernelTimer *timer = kernelHeap.operations.alloc(&kernelHeap, sizeof(struct KernelTimer));
-    DEBUG_ASSERT(timer != nullptr);
-    if (timer == nullptr) {
-        return nullptr;
+KernelStatus kernel_timer_default_set_periodic(struct KernelTimer *timer, uint32_t period,
+                                               KernelTimerCallback callback, void *arg) {
+    if (period == 0) {
+        return ERROR;
     }
+    timer->deadline = period;
+    timer->remainTime = period;
+    timer->period = period;
+    timer->callback = callback;
+    timer->arg = arg;
+    return OK;
+}
+
+KernelStatus kernel_timer_default_set_one_shot(struct KernelTimer *timer, uint32_t timeout,
+                                               KernelTimerCallback callback, void *arg) {
+    timer->deadline = timeout;
+    timer->remainTime = timeout;
+    timer->period = 0;
+    timer->callback = callback;
+    timer->arg = arg;
+    return OK;
+}
+
+KernelTimer *kernel_timer_init(KernelTimer *timer, uint32_t deadline) {
     kqueue_create(&timer->waitQueue);
     timer->list.prev = nullptr;
     timer->list.next = nullptr;
     timer->deadline = deadline;
     timer->remainTime = deadline;
+    timer->period = 0;
+    timer->callback = nullptr;
+    timer->arg = nullptr;
+    timer->firing = false;
+    timer->firedNext = nullptr;
     timer->operation.set = (KernelTimerOperationSet) kernel_timer_default_set;
     timer->operation.cancel = (KernelTimerOperationCancel) kernel_timer_default_cancel;
+    timer->operation.setPeriodic = (KernelTimerOperationSetPeriodic) kernel_timer_default_set_periodic;
+    timer->operation.setOneShot = (KernelTimerOperationSetOneShot) kernel_timer_default_set_one_shot;
+    return timer;
+}
+
+/**
+ * whole milliseconds passed since lastCounter, the ticks are no longer periodic so time comes from the generic counter
+ */
+static uint32_t kernel_timer_manager_elapsed_ms(KernelTimerManager *kernelTimerManager) {
+    uint32_t countPerMs = read_cntfrq() / 1000;
+    return (uint32_t) ((read_cntvct() - kernelTimerManager->lastCounter) / countPerMs);
+}
+
+/**
+ * charge the time since the last advance to every timer, the lock is held.
+ * advance by whole milliseconds only, so the remainder is carried into the next call instead of lost
+ */
+static void kernel_timer_manager_advance(KernelTimerManager *kernelTimerManager) {
+    uint32_t elapsedMs = kernel_timer_manager_elapsed_ms(kernelTimerManager);
+    if (elapsedMs == 0) {
+        return;
+    }
+    kernelTimerManager->lastCounter += (uint64_t) elapsedMs * (read_cntfrq() / 1000);
+    kernelTimerManager->sysRuntimeMs += elapsedMs;
+    if (kernelTimerManager->timerNodes == nullptr) {
+        return;
+    }
+    ListNode *node = klist_get_head(&kernelTimerManager->timerNodes->list);
+    while (node != nullptr) {
+        getNode(node, KernelTimer, list)->remainTime -= (int32_t) elapsedMs;
+        node = node->next;
+    }
+}
+
+/**
+ * only the first timer has no prev, so a timer is in the list when it is the first one or has a prev
+ */
+static bool kernel_timer_manager_remove(KernelTimerManager *kernelTimerManager, KernelTimer *timer) {
+    if (timer == kernelTimerManager->timerNodes) {
+        kernelTimerManager->timerNodes =
+                timer->list.next != nullptr ? getNode(timer->list.next, KernelTimer, list) : nullptr;
+    } else if (timer->list.prev == nullptr) {
+        return false;
+    }
+    klist_remove_node(&timer->list);
+    return true;
+}
+
+/**
+ * wake up the threads sleeping on an expired or released timer, without the manager lock since wakeup programs the tick
+ */
+static KernelStatus kernel_timer_wake_waiters(KernelTimer *timer) {
+    while (timer->waitQueue.size != 0) {
+        KQueueNode *node = timer->waitQueue.operations.dequeue(&timer->waitQueue);
+        Thread *thread = getNode(node, Thread, threadReadyQueue);
+        KernelStatus status = cfsScheduler.operation.wakeup(&cfsScheduler, thread);
+        DEBUG_ASSERT(status == OK);
+        if (status != OK) {
+            LogError("[KernelTimer] add thread to scheduler failed.\n");
+            timer->waitQueue.operations.enqueue(&timer->waitQueue, &thread->threadReadyQueue);
+            return ERROR;
+        }
+    }
+    return OK;
+}
 
+/**
+ * the timer counts from now on, not from the last tick of a cpu that may have been idle for long
+ */
+KernelStatus kernel_timer_manger_default_add_timer(KernelTimerManager *kernelTimerManager, KernelTimer *timer) {
+    kernelTimerManager->lock.operations.acquire(&kernelTimerManager->lock);
+    kernel_timer_manager_advance(kernelTimerManager);
     if (kernelTimerManager->timerNodes == nullptr) {
         kernelTimerManager->timerNodes = timer;
     } else {
         KernelStatus addToManager = klist_append(&kernelTimerManager->timerNodes->list, &timer->list);
         if (addToManager == ERROR) {
-            kernelHeap.operations.free(&kernelHeap, timer);
-            return nullptr;
+            kernelTimerManager->lock.operations.release(&kernelTimerManager->lock);
+            return ERROR;
         }
     }
+    kernelTimerManager->lock.operations.release(&kernelTimerManager->lock);
+    // the new deadline may come before the event the timer is currently programmed for
+    genericInterruptManager.operation.programTick(&genericInterruptManager);
+    return OK;
+}
+
+KernelTimer *kernel_timer_manger_default_create_timer(KernelTimerManager *kernelTimerManager, uint32_t deadline) {
+    KernelTimer *timer = kernelHeap.operations.alloc(&kernelHeap, sizeof(struct KernelTimer));
+    DEBUG_ASSERT(timer != nullptr);
+    if (timer == nullptr) {
+        return nullptr;
+    }
+    kernel_timer_init(timer, deadline);
+    if (kernelTimerManager->operation.addTimer(kernelTimerManager, timer) != OK) {
+        kernelHeap.operations.free(&kernelHeap, timer);
+        return nullptr;
+    }
     return timer;
 }
 
+/**
+ * take the timer out of the manager and wake up the threads sleeping on it, a timer that already expired is left alone
+ */
 KernelStatus
 kernel_timer_manger_default_release_timer(KernelTimerManager *kernelTimerManager, KernelTimer *timer) {
-    LogInfo("[TimerManager] release timer 0x%x\n", timer->waitQueue.size);
-    if (timer->waitQueue.size == 0) {
-        if (timer == kernelTimerManager->timerNodes) {
-            if (timer->list.next != nullptr) {
-                kernelTimerManager->timerNodes = getNode(timer->list.next, KernelTimer, list);
-                klist_remove_node(&timer->list);
-            } else {
-                kernelTimerManager->timerNodes = nullptr;
-            }
-        } else {
-            klist_remove_node(&timer->list);
-        }
-    } else {
-        while (timer->waitQueue.size != 0) {
-            KQueueNode *node = timer->waitQueue.operations.dequeue(&timer->waitQueue);
-            Thread *thread = getNode(node, Thread, threadReadyQueue);
-            KernelStatus status = cfsScheduler.operation.addThread(&cfsScheduler, thread, thread->priority);
-            DEBUG_ASSERT(status == OK);
-            if (status != OK) {
-                LogError("[KernelTimer] add thread to scheduler failed.\n");
-                timer->waitQueue.operations.enqueue(&timer->waitQueue, &thread->threadReadyQueue);
-                return ERROR;
-            }
-        }
-        klist_remove_node(&timer->list);
-    }
-    return OK;
+    kernelTimerManager->lock.operations.acquire(&kernelTimerManager->lock);
+    kernel_timer_manager_remove(kernelTimerManager, timer);
+    kernelTimerManager->lock.operations.release(&kernelTimerManager->lock);
+    return kernel_timer_wake_waiters(timer);
 }
 
 KernelStatus
@@ -101,6 +192,8 @@ kernel_timer_manger_default_free_timer(KernelTimerManager *kernelTimerManager, K
     if (releaseStatus != OK) {
         return ERROR;
     }
+    while (timer->firing) {
+    }
     kernelHeap.operations.free(&kernelHeap, timer);
     return OK;
 }
@@ -110,33 +203,136 @@ KernelStatus kernel_timer_manger_default_get_sys_runtime_ms(KernelTimerManager *
     return kernelTimerManager->sysRuntimeMs;
 }
 
-void kernel_timer_manger_tick_on_each_timer(struct ListNode *node) {
-    struct KernelTimer *timer = getNode(node, struct KernelTimer, list);
-    LogInfo("[TimerManager] timer tick, remainTime: %d\n", timer->remainTime);
-    timer->remainTime -= TICK_INTERVAL;
-    if (timer->remainTime <= 0) {
-        kernelTimerManager.operation.releaseTimer(&kernelTimerManager, timer);
+/**
+ * expired timers are collected under the lock and fired after it is dropped, their callbacks wake up threads
+ * and wakeup programs the tick, which asks nextEvent and so the manager lock again
+ */
+KernelStatus kernel_timer_manger_default_on_tick() {
+    KernelTimer *fired = nullptr;
+    kernelTimerManager.lock.operations.acquire(&kernelTimerManager.lock);
+    kernel_timer_manager_advance(&kernelTimerManager);
+    ListNode *node = kernelTimerManager.timerNodes != nullptr ? klist_get_head(&kernelTimerManager.timerNodes->list)
+                                                               : nullptr;
+    while (node != nullptr) {
+        // the expired timer leaves the list, take its next first
+        ListNode *next = node->next;
+        KernelTimer *timer = getNode(node, KernelTimer, list);
+        // a timer still firing on another cpu is left expired, it fires again on the next tick
+        if (timer->remainTime <= 0 && !timer->firing) {
+            if (timer->period != 0) {
+                // keep the phase of the period, unless the tick came so late that whole periods were missed
+                timer->remainTime += timer->period;
+                if (timer->remainTime <= 0) {
+                    timer->remainTime = timer->period;
+                }
+            } else {
+                kernel_timer_manager_remove(&kernelTimerManager, timer);
+            }
+            timer->firing = true;
+            timer->firedNext = fired;
+            fired = timer;
+        }
+        node = next;
     }
-}
+    kernelTimerManager.lock.operations.release(&kernelTimerManager.lock);
 
-KernelStatus kernel_timer_manger_default_on_tick() {
-    kernelTimerManager.sysRuntimeMs += TICK_INTERVAL;
-    LogInfo("[TimerManager] tick\n");
-    if (kernelTimerManager.timerNodes != nullptr && klist_size(&kernelTimerManager.timerNodes->list) != 0) {
-        klist_iter(&kernelTimerManager.timerNodes->list, kernel_timer_manger_tick_on_each_timer);
+    while (fired != nullptr) {
+        KernelTimer *timer = fired;
+        fired = timer->firedNext;
+        if (timer->period == 0) {
+            kernel_timer_wake_waiters(timer);
+        }
+        if (timer->callback != nullptr) {
+            timer->callback(timer->arg);
+        }
+        // the last access, the owner of a one shot timer may free it right after
+        memory_barrier();
+        timer->firing = false;
     }
     return OK;
 }
 
+uint32_t kernel_timer_manger_default_next_event() {
+    kernelTimerManager.lock.operations.acquire(&kernelTimerManager.lock);
+    if (kernelTimerManager.timerNodes == nullptr) {
+        kernelTimerManager.lock.operations.release(&kernelTimerManager.lock);
+        return TICK_NO_EVENT;
+    }
+    int32_t minRemainTime = kernelTimerManager.timerNodes->remainTime;
+    ListNode *node = klist_get_head(&kernelTimerManager.timerNodes->list);
+    while (node != nullptr) {
+        KernelTimer *timer = getNode(node, KernelTimer, list);
+        if (timer->remainTime < minRemainTime) {
+            minRemainTime = timer->remainTime;
+        }
+        node = node->next;
+    }
+    int32_t elapsedMs = (int32_t) kernel_timer_manager_elapsed_ms(&kernelTimerManager);
+    kernelTimerManager.lock.operations.release(&kernelTimerManager.lock);
+    if (minRemainTime <= elapsedMs) {
+        return 0;
+    }
+    return (uint32_t) (minRemainTime - elapsedMs);
+}
+
+/**
+ * the waiting thread is still on the queue as long as it has its waiting status, whoever woke it up changed that
+ */
+static void kernel_timed_wait_expired(void *arg) {
+    KernelTimedWait *wait = (KernelTimedWait *) arg;
+    Thread *thread = wait->thread;
+    if (wait->lock != nullptr) {
+        wait->lock->operations.acquire(wait->lock);
+    }
+    if (thread->threadStatus == THREAD_BLOCKED || thread->threadStatus == THREAD_SLEEPING) {
+        if (wait->queue != nullptr) {
+            wait->queue->operations.remove(wait->queue, &thread->threadReadyQueue);
+        }
+        wait->timedOut = true;
+        cfsScheduler.operation.wakeup(&cfsScheduler, thread);
+    }
+    if (wait->lock != nullptr) {
+        wait->lock->operations.release(wait->lock);
+    }
+}
+
+KernelStatus kernel_timed_wait_arm(KernelTimedWait *wait, SpinLock *lock, KernelQueue *queue, Thread *thread,
+                                   uint32_t timeoutMs) {
+    wait->thread = thread;
+    wait->lock = lock;
+    wait->queue = queue;
+    wait->timedOut = false;
+    kernel_timer_init(&wait->timer, timeoutMs);
+    wait->timer.operation.setOneShot(&wait->timer, timeoutMs, kernel_timed_wait_expired, wait);
+    if (timeoutMs == KERNEL_TIMER_FOREVER) {
+        // not added, releasing it in finish finds nothing to take off the list
+        return OK;
+    }
+    return kernelTimerManager.operation.addTimer(&kernelTimerManager, &wait->timer);
+}
+
+KernelStatus kernel_timed_wait_finish(KernelTimedWait *wait) {
+    kernelTimerManager.operation.releaseTimer(&kernelTimerManager, &wait->timer);
+    // taken off the list after it expired, the callback may still be running on another cpu
+    while (wait->timer.firing) {
+    }
+    return wait->timedOut ? TIMEOUT : OK;
+}
+
 KernelTimerManager *kernel_timer_manager_create(KernelTimerManager *kernelTimerManager) {
+    spinlock_create(&kernelTimerManager->lock);
+    lockstat_set_name(&kernelTimerManager->lock.stat, "timer manager");
     kernelTimerManager->sysRuntimeMs = 0;
+    kernelTimerManager->lastCounter = 0;
     kernelTimerManager->timerNodes = nullptr;
     kernelTimerManager->operation.init = (KernelTimerManagerOperationInit) kernel_timer_manger_default_init;
     kernelTimerManager->operation.getSysRuntimeMs = (KernelTimerManagerOperationGetSysRuntimeMs) kernel_timer_manger_default_get_sys_runtime_ms;
     kernelTimerManager->operation.createTimer = (KernelTimerManagerOperationCreateTimer) kernel_timer_manger_default_create_timer;
+    kernelTimerManager->operation.addTimer = (KernelTimerManagerOperationAddTimer) kernel_timer_manger_default_add_timer;
     kernelTimerManager->operation.releaseTimer = (KernelTimerManagerOperationReleaseTimer) kernel_timer_manger_default_release_timer;
     kernelTimerManager->operation.freeTimer = (KernelTimerManagerOperationFreeTimer) kernel_timer_manger_default_free_timer;
     kernelTimerManager->operation.onTick = (KernelTimerManagerOperationOnTick) kernel_timer_manger_default_on_tick;
+    kernelTimerManager->operation.nextEvent = (KernelTimerManagerOperationNextEvent) kernel_timer_manger_default_next_event;
 
     return kernelTimerManager;
 }
@@ -0,0 +1,192 @@
+//
+// Created by XingfengYang on 2021/1/30.
+//
+
+#include "kernel/lockstat.h"
+#include "arm/interrupt.h"
+#include "arm/pmu.h"
+#include "arm/register.h"
+
+volatile bool lockStatEnabled = false;
+LockStatEntry lockStatEntries[SMP_MAX_CPUS][LOCKSTAT_MAX_LOCKS];
+char lockStatNames[LOCKSTAT_MAX_LOCKS][LOCKSTAT_NAME_LENGTH];
+uint32_t lockStatAddresses[LOCKSTAT_MAX_LOCKS];
+// slot 0 means no slot, so the first lock gets 1
+volatile uint32_t lockStatNextId = 1;
+
+static void lockstat_copy_name(uint32_t id, const char *name) {
+    uint32_t i = 0;
+    for (; i < LOCKSTAT_NAME_LENGTH - 1 && name[i] != '\0'; i++) {
+        lockStatNames[id][i] = name[i];
+    }
+    lockStatNames[id][i] = '\0';
+}
+
+/**
+ * claim the next free slot for key, only one of the cpus acquiring a new lock at the same time gets to set its id.
+ * unnamed locks are mostly per thread and come and go, they go to the shared slot instead of using up the table
+ */
+static uint32_t lockstat_key_id(LockStatKey *key) {
+    uint32_t id = key->id;
+    if (id != 0) {
+        return id;
+    }
+    if (key->name == nullptr) {
+        key->id = LOCKSTAT_OVERFLOW_ID;
+        return LOCKSTAT_OVERFLOW_ID;
+    }
+    uint32_t claimed;
+    uint32_t next;
+    uint32_t failed;
+    do {
+        __asm__ volatile("ldrex %0, [%3]\n"
+                         "add %1, %0, #1\n"
+                         "strex %2, %1, [%3]\n"
+                         : "=&r"(claimed), "=&r"(next), "=&r"(failed)
+                         : "r"(&lockStatNextId)
+                         : "memory");
+    } while (failed);
+    if (claimed >= LOCKSTAT_OVERFLOW_ID) {
+        claimed = LOCKSTAT_OVERFLOW_ID;
+    } else {
+        // written before the first acquisition is counted, lockstat_top skips slots without any
+        lockstat_copy_name(claimed, key->name);
+        lockStatAddresses[claimed] = (uint32_t) key;
+        asm volatile("dmb" ::: "memory");
+    }
+    uint32_t old;
+    do {
+        __asm__ volatile("ldrex %0, [%2]\n"
+                         "mov %1, #0\n"
+                         "teq %0, #0\n"
+                         "strexeq %1, %3, [%2]\n"
+                         : "=&r"(old), "=&r"(failed)
+                         : "r"(&key->id), "r"(claimed)
+                         : "cc", "memory");
+    } while (failed);
+    // another cpu was first, the slot claimed here stays empty
+    return old != 0 ? old : claimed;
+}
+
+void lockstat_acquired(LockStatKey *key, uint32_t start, bool contended, void *site) {
+    uint32_t interruptEnabled = arch_is_interrupt_enabled();
+    arch_disable_interrupt();
+
+    uint32_t now = read_pmccntr();
+    uint32_t waitCycles = now - start;
+    LockStatEntry *entry = &lockStatEntries[read_cpuid()][lockstat_key_id(key)];
+    entry->acquisitions++;
+    if (contended) {
+        entry->contentions++;
+        entry->waitCycles += waitCycles;
+        if (waitCycles > entry->maxWaitCycles) {
+            entry->maxWaitCycles = waitCycles;
+            entry->maxWaitSite = site;
+        }
+    }
+    key->acquiredAt = now;
+
+    if (interruptEnabled) {
+        arch_enable_interrupt();
+    }
+}
+
+void lockstat_acquired_sleeping(LockStatKey *key, CpuNum startCpu, uint32_t start, bool contended, void *site) {
+    if (read_cpuid() != startCpu) {
+        start = read_pmccntr();
+    }
+    lockstat_acquired(key, start, contended, site);
+}
+
+void lockstat_released(LockStatKey *key) {
+    if (key->id == 0) {
+        // acquired before lockstat was enabled
+        return;
+    }
+    uint32_t interruptEnabled = arch_is_interrupt_enabled();
+    arch_disable_interrupt();
+
+    // a mutex may be released on another cpu than it was acquired, the cycle counters then differ a little
+    uint32_t holdCycles = read_pmccntr() - key->acquiredAt;
+    LockStatEntry *entry = &lockStatEntries[read_cpuid()][key->id];
+    entry->holdCycles += holdCycles;
+    if (holdCycles > entry->maxHoldCycles) {
+        entry->maxHoldCycles = holdCycles;
+    }
+
+    if (interruptEnabled) {
+        arch_enable_interrupt();
+    }
+}
+
+void lockstat_enable(bool enable) {
+    lockStatEnabled = enable;
+}
+
+void lockstat_reset(void) {
+    for (CpuNum cpuId = 0; cpuId < SMP_MAX_CPUS; cpuId++) {
+        for (uint32_t id = 0; id < LOCKSTAT_MAX_LOCKS; id++) {
+            LockStatEntry *entry = &lockStatEntries[cpuId][id];
+            entry->acquisitions = 0;
+            entry->contentions = 0;
+            entry->waitCycles = 0;
+            entry->maxWaitCycles = 0;
+            entry->holdCycles = 0;
+            entry->maxHoldCycles = 0;
+            entry->maxWaitSite = nullptr;
+        }
+    }
+}
+
+static void lockstat_sum(uint32_t id, LockStatEntry *total) {
+    total->acquisitions = 0;
+    total->contentions = 0;
+    total->waitCycles = 0;
+    total->maxWaitCycles = 0;
+    total->holdCycles = 0;
+    total->maxHoldCycles = 0;
+    total->maxWaitSite = nullptr;
+    for (CpuNum cpuId = 0; cpuId < SMP_MAX_CPUS; cpuId++) {
+        LockStatEntry *entry = &lockStatEntries[cpuId][id];
+        total->acquisitions += entry->acquisitions;
+        total->contentions += entry->contentions;
+        total->waitCycles += entry->waitCycles;
+        total->holdCycles += entry->holdCycles;
+        if (entry->maxWaitCycles > total->maxWaitCycles) {
+            total->maxWaitCycles = entry->maxWaitCycles;
+            total->maxWaitSite = entry->maxWaitSite;
+        }
+        if (entry->maxHoldCycles > total->maxHoldCycles) {
+            total->maxHoldCycles = entry->maxHoldCycles;
+        }
+    }
+}
+
+uint32_t lockstat_top(LockStatSummary *summaries, uint32_t count) {
+    uint32_t found = 0;
+    // the shared slot fills up long before the others are handed out, slots never used have no acquisitions
+    for (uint32_t id = 1; id < LOCKSTAT_MAX_LOCKS; id++) {
+        LockStatSummary summary;
+        summary.name = id == LOCKSTAT_OVERFLOW_ID ? nullptr : lockStatNames[id];
+        summary.address = id == LOCKSTAT_OVERFLOW_ID ? 0 : lockStatAddresses[id];
+        lockstat_sum(id, &summary.total);
+        if (summary.total.acquisitions == 0) {
+            continue;
+        }
+        // insertion into the sorted prefix, count is a handful of lines for the console
+        uint32_t position = found < count ? found : count;
+        while (position > 0 && summaries[position - 1].total.contentions < summary.total.contentions) {
+            if (position < count) {
+                summaries[position] = summaries[position - 1];
+            }
+            position--;
+        }
+        if (position < count) {
+            summaries[position] = summary;
+            if (found < count) {
+                found++;
+            }
+        }
+    }
+    return found;
+}
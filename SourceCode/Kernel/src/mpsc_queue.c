@@ -0,0 +1,65 @@
+//
+// Created by XingfengYang on 2021/1/31.
+//
+
+#include "kernel/mpsc_queue.h"
+
+static inline KQueueNode *mpsc_queue_next(KQueueNode *node) {
+    return *(KQueueNode *volatile *) &node->next;
+}
+
+/**
+ * the swap is fully ordered, the node's contents are visible before the previous head links to it.
+ * between the swap and the link the consumer can not get past the previous head, it tries again later.
+ */
+KernelStatus mpsc_queue_default_operation_enqueue(struct MpscQueue *queue, KQueueNode *node) {
+    node->next = nullptr;
+    KQueueNode *prev = (KQueueNode *) atomic_xchg(&queue->head, (uint32_t) node);
+    *(KQueueNode *volatile *) &prev->next = node;
+    return OK;
+}
+
+KQueueNode *mpsc_queue_default_operation_dequeue(struct MpscQueue *queue) {
+    KQueueNode *tail = queue->tail;
+    KQueueNode *next = mpsc_queue_next(tail);
+    if (tail == &queue->stub) {
+        if (next == nullptr) {
+            return nullptr;
+        }
+        // step over the stub, it is put back behind the last node
+        queue->tail = next;
+        tail = next;
+        next = mpsc_queue_next(next);
+    }
+    if (next != nullptr) {
+        queue->tail = next;
+        return tail;
+    }
+    if (tail != (KQueueNode *) atomic_get_acquire(&queue->head)) {
+        // a producer swapped head but did not link it to tail yet
+        return nullptr;
+    }
+    // tail is the last node, it can only be taken with another node behind it
+    mpsc_queue_default_operation_enqueue(queue, &queue->stub);
+    next = mpsc_queue_next(tail);
+    if (next != nullptr) {
+        queue->tail = next;
+        return tail;
+    }
+    return nullptr;
+}
+
+bool mpsc_queue_default_operation_is_empty(struct MpscQueue *queue) {
+    return queue->tail == &queue->stub && mpsc_queue_next(&queue->stub) == nullptr;
+}
+
+MpscQueue *mpsc_queue_create(MpscQueue *queue) {
+    queue->stub.next = nullptr;
+    queue->stub.prev = nullptr;
+    atomic_set(&queue->head, (uint32_t) &queue->stub);
+    queue->tail = &queue->stub;
+    queue->operations.enqueue = (MpscQueueOperationEnqueue) mpsc_queue_default_operation_enqueue;
+    queue->operations.dequeue = (MpscQueueOperationDequeue) mpsc_queue_default_operation_dequeue;
+    queue->operations.isEmpty = (MpscQueueOperationIsEmpty) mpsc_queue_default_operation_is_empty;
+    return queue;
+}
@@ -3,60 +3,254 @@
 //
 
 #include "kernel/mutex.h"
+#include "arm/pmu.h"
 #include "arm/register.h"
 #include "kernel/assert.h"
 #include "kernel/kqueue.h"
+#include "kernel/ktimer.h"
 #include "kernel/percpu.h"
 #include "kernel/scheduler.h"
 #include "kernel/thread.h"
 
 extern Scheduler cfsScheduler;
 
-void mutex_default_acquire(Mutex *mutex) {
+/**
+ * the owner field is read without the spin lock, a thread that is freed meanwhile only makes the spinner stop early
+ */
+bool mutex_owner_running(Thread *owner) {
+    CpuNum ownerCpu = owner->currCpu;
+    if (owner->threadStatus != THREAD_RUNNING || ownerCpu == INVALID_CPU || ownerCpu == read_cpuid()) {
+        return false;
+    }
+    return percpu_get(ownerCpu)->currentThread == owner;
+}
+
+void mutex_inherit_priority(Mutex *mutex, Thread *waiter) {
+    Thread *owner = mutex->owner;
+    if (owner == nullptr || thread_sched_rank(waiter) <= thread_sched_rank(owner)) {
+        return;
+    }
+    if (!owner->priorityBoosted) {
+        owner->basePolicy = owner->schedPolicy;
+        owner->basePriority = owner->priority;
+        owner->priorityBoosted = true;
+    }
+    cfsScheduler.operation.setPolicy(&cfsScheduler, owner, waiter->schedPolicy, waiter->priority);
+}
+
+/**
+ * drop an inherited priority. a thread holding several contended mutexes goes back to its own priority
+ * on the first release, the remaining waiters boost it again only when another one blocks
+ */
+static void mutex_restore_priority(Thread *owner) {
+    if (owner == nullptr || !owner->priorityBoosted) {
+        return;
+    }
+    owner->priorityBoosted = false;
+    cfsScheduler.operation.setPolicy(&cfsScheduler, owner, owner->basePolicy, owner->basePriority);
+}
+
+/**
+ * the most urgent waiter, the first one queued among equally urgent ones
+ */
+static Thread *mutex_dequeue_waiter(Mutex *mutex) {
+    Thread *best = nullptr;
+    KQueueNode *node = mutex->waitQueue.head;
+    while (node != nullptr) {
+        Thread *thread = getNode(node, Thread, threadReadyQueue);
+        if (best == nullptr || thread_sched_rank(thread) > thread_sched_rank(best)) {
+            best = thread;
+        }
+        node = node->next;
+    }
+    if (best != nullptr) {
+        mutex->waitQueue.operations.remove(&mutex->waitQueue, &best->threadReadyQueue);
+    }
+    return best;
+}
+
+static bool mutex_try_acquire(Mutex *mutex, Thread *currentThread) {
     mutex->spinLock.operations.acquire(&mutex->spinLock);
+    bool acquired = atomic_get(&mutex->val) == 0;
+    if (acquired) {
+        atomic_set(&mutex->val, 1);
+        mutex->owner = currentThread;
+    }
+    mutex->spinLock.operations.release(&mutex->spinLock);
+    return acquired;
+}
+
+/**
+ * spin while the owner runs on another cpu, it will likely release the mutex before a sleep and wakeup is done.
+ * a mutex handed over to a sleeping waiter has that waiter as owner, so spinners never take it from the queue.
+ */
+static bool mutex_spin_on_owner(Mutex *mutex, Thread *currentThread) {
+    uint64_t deadline = read_cntvct() + (uint64_t) read_cntfrq() / 1000000 * MUTEX_SPIN_MAX_US;
+    while (read_cntvct() < deadline) {
+        if (atomic_get(&mutex->val) == 0 && mutex_try_acquire(mutex, currentThread)) {
+            return true;
+        }
+        Thread *owner = mutex->owner;
+        if (owner != nullptr && !mutex_owner_running(owner)) {
+            return false;
+        }
+    }
+    return false;
+}
 
+/**
+ * returns whether the mutex was contended, that is not free on the first try
+ */
+static bool mutex_lock(Mutex *mutex) {
+    PerCpu *perCpu = percpu_get(read_cpuid());
+    Thread *currentThread = perCpu->currentThread;
+    if (mutex_try_acquire(mutex, currentThread)) {
+        return false;
+    }
+    if (mutex_spin_on_owner(mutex, currentThread)) {
+        return true;
+    }
+
+    if (currentThread == nullptr || currentThread == perCpu->idleThread) {
+        // nothing that could sleep, like code running before the scheduler, waits for the mutex to be free
+        while (!mutex_try_acquire(mutex, currentThread)) {
+        }
+        return true;
+    }
+
+    mutex->spinLock.operations.acquire(&mutex->spinLock);
     if (atomic_get(&mutex->val) == 0) {
         atomic_set(&mutex->val, 1);
-    } else {
-        uint32_t cpuid = read_cpuid();
-        PerCpu *perCpu = percpu_get(cpuid);
-        Thread *currentThread = perCpu->currentThread;
+        mutex->owner = currentThread;
+        mutex->spinLock.operations.release(&mutex->spinLock);
+        return true;
+    }
+    // can not get the lock, just add to lock wait list, release hands the lock over to us
+    mutex->waitQueue.operations.enqueue(&mutex->waitQueue, &currentThread->threadReadyQueue);
+    currentThread->threadStatus = THREAD_BLOCKED;
+    mutex_inherit_priority(mutex, currentThread);
+    mutex->spinLock.operations.release(&mutex->spinLock);
 
-        DEBUG_ASSERT(currentThread != nullptr);
+    cfsScheduler.operation.block(&cfsScheduler);
+    return true;
+}
 
-        // can not get the lock, just add to lock wait list
-        mutex->waitQueue.operations.enqueue(&mutex->waitQueue, &currentThread->threadReadyQueue);
-        currentThread->threadStatus = THREAD_BLOCKED;
-        // remove from schd list
-        perCpu->rbTree.operations.remove(&perCpu->rbTree, &currentThread->rbNode);
-        // 2. switch to the next thread in scheduler
+void mutex_default_acquire(Mutex *mutex) {
+    if (!lockStatEnabled) {
+        mutex_lock(mutex);
+        return;
+    }
+    CpuNum cpuId = read_cpuid();
+    uint32_t start = read_pmccntr();
+    bool contended = mutex_lock(mutex);
+    lockstat_acquired_sleeping(&mutex->stat, cpuId, start, contended, __builtin_return_address(0));
+}
 
-        cfsScheduler.operation.switchNext(&cfsScheduler);
+/**
+ * the timed variant of mutex_lock, *contended is set like mutex_lock returns it
+ */
+static KernelStatus mutex_lock_timeout(Mutex *mutex, uint32_t timeoutMs, bool *contended) {
+    PerCpu *perCpu = percpu_get(read_cpuid());
+    Thread *currentThread = perCpu->currentThread;
+    *contended = false;
+    if (mutex_try_acquire(mutex, currentThread)) {
+        return OK;
+    }
+    *contended = true;
+    if (timeoutMs == 0) {
+        return TIMEOUT;
     }
+    uint64_t countPerMs = read_cntfrq() / 1000;
+    uint64_t deadline = read_cntvct() + countPerMs * timeoutMs;
+    if (mutex_spin_on_owner(mutex, currentThread)) {
+        return OK;
+    }
+
+    if (currentThread == nullptr || currentThread == perCpu->idleThread) {
+        while (!mutex_try_acquire(mutex, currentThread)) {
+            if (read_cntvct() >= deadline) {
+                return TIMEOUT;
+            }
+        }
+        return OK;
+    }
+    uint64_t now = read_cntvct();
+    if (now >= deadline) {
+        return TIMEOUT;
+    }
+    // the spin above used up part of the timeout, never round the rest down to a wait that is not timed
+    uint32_t remainMs = (uint32_t) ((deadline - now + countPerMs - 1) / countPerMs);
 
+    mutex->spinLock.operations.acquire(&mutex->spinLock);
+    if (atomic_get(&mutex->val) == 0) {
+        atomic_set(&mutex->val, 1);
+        mutex->owner = currentThread;
+        mutex->spinLock.operations.release(&mutex->spinLock);
+        return OK;
+    }
+    mutex->waitQueue.operations.enqueue(&mutex->waitQueue, &currentThread->threadReadyQueue);
+    currentThread->threadStatus = THREAD_BLOCKED;
+    // a waiter that times out leaves the owner boosted, the owner drops the boost when it releases the mutex
+    mutex_inherit_priority(mutex, currentThread);
     mutex->spinLock.operations.release(&mutex->spinLock);
+
+    KernelTimedWait wait;
+    kernel_timed_wait_arm(&wait, &mutex->spinLock, &mutex->waitQueue, currentThread, remainMs);
+    cfsScheduler.operation.block(&cfsScheduler);
+    // release hands the mutex over only to a thread it takes off the wait queue, a timed out one is not on it
+    return kernel_timed_wait_finish(&wait);
+}
+
+KernelStatus mutex_default_acquire_timeout(Mutex *mutex, uint32_t timeoutMs) {
+    if (timeoutMs == KERNEL_TIMER_FOREVER) {
+        mutex->operations.acquire(mutex);
+        return OK;
+    }
+    CpuNum cpuId = read_cpuid();
+    uint32_t start = read_pmccntr();
+    bool contended;
+    KernelStatus status = mutex_lock_timeout(mutex, timeoutMs, &contended);
+    if (status == OK && lockStatEnabled) {
+        lockstat_acquired_sleeping(&mutex->stat, cpuId, start, contended, __builtin_return_address(0));
+    }
+    return status;
 }
 
 void mutex_default_release(Mutex *mutex) {
     mutex->spinLock.operations.acquire(&mutex->spinLock);
 
     if (atomic_get(&mutex->val) == 0) {
+        mutex->spinLock.operations.release(&mutex->spinLock);
         return;
-    } else {
-        KQueueNode *node = mutex->waitQueue.operations.dequeue(&mutex->waitQueue);
-
-        uint32_t cpuid = read_cpuid();
-        PerCpu *perCpu = percpu_get(cpuid);
-        Thread *currentThread = getNode(node, Thread, threadReadyQueue);
-
-        DEBUG_ASSERT(currentThread != nullptr);
+    }
 
-        perCpu->rbTree.operations.insert(&perCpu->rbTree, &currentThread->rbNode);
-        currentThread->threadStatus = THREAD_READY;
+    if (lockStatEnabled) {
+        lockstat_released(&mutex->stat);
+    }
+    Thread *owner = mutex->owner;
+    Thread *waitThread = mutex_dequeue_waiter(mutex);
+    if (waitThread == nullptr) {
+        mutex->owner = nullptr;
         atomic_set(&mutex->val, 0);
-
-        // TODO: maybe should consider virtual runtime.
+    } else {
+        // hand the lock over to the most urgent waiter, val stays 1
+        mutex->owner = waitThread;
+        cfsScheduler.operation.wakeup(&cfsScheduler, waitThread);
     }
+    mutex_restore_priority(owner);
 
     mutex->spinLock.operations.release(&mutex->spinLock);
 }
+
+Mutex *mutex_create(Mutex *mutex) {
+    atomic_create(&mutex->val);
+    mutex->owner = nullptr;
+    spinlock_create(&mutex->spinLock);
+    mutex->stat.name = nullptr;
+    mutex->stat.id = 0;
+    kqueue_create(&mutex->waitQueue);
+    mutex->operations.acquire = (MutexAcquire) mutex_default_acquire;
+    mutex->operations.acquireTimeout = (MutexAcquireTimeout) mutex_default_acquire_timeout;
+    mutex->operations.release = (MutexRelease) mutex_default_release;
+    return mutex;
+}
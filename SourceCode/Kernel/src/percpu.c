@@ -3,35 +3,179 @@
 //
 
 #include "kernel/percpu.h"
+#include "kernel/interrupt.h"
 #include "kernel/kheap.h"
 #include "kernel/log.h"
+#include "kernel/scheduler.h"
+#include "kernel/sched_trace.h"
 #include "kernel/thread.h"
 
 extern Heap kernelHeap;
+extern InterruptManager genericInterruptManager;
 PerCpu *perCpu = nullptr;
+DEFINE_PER_CPU(CpuStatus, cpuStatus);
+
+// after this many periods e^-8 of the old load average is left, it starts over at the current weight
+#define PERCPU_LOAD_AVG_FULL_PERIODS (8 << PERCPU_LOAD_AVG_SHIFT)
+
+static inline uint32_t percpu_thread_weight(Thread *thread) {
+    return priority_to_weight(thread->priority);
+}
 
 KernelStatus percpu_default_insert_thread(PerCpu *perCpu, Thread *thread) {
-    perCpu->rbTree.operations.insert(&perCpu->rbTree, &thread->rbNode);
-    LogWarn("[PerCpu]: insert thread '%s' to cpu '%d'.\n", thread->name, perCpu->cpuId);
-    perCpu->priority += thread->priority;
+    if (thread_is_realtime(thread)) {
+        perCpu->rtQueue.operations.enqueue(&perCpu->rtQueue, thread);
+    } else {
+        perCpu->rbTree.operations.insert(&perCpu->rbTree, &thread->rbNode);
+        perCpu->weight += percpu_thread_weight(thread);
+    }
     thread->currCpu = perCpu->cpuId;
     return OK;
 }
 
 Thread *percpu_default_remove_thread(PerCpu *perCpu, Thread *thread) {
-    RBNode *node = perCpu->rbTree.operations.remove(&perCpu->rbTree, &thread->rbNode);
-    LogWarn("[PerCpu]: remove thread '%s' from cpu '%d'.\n", thread->name, perCpu->cpuId);
-    perCpu->priority -= thread->priority;
+    if (thread_is_realtime(thread)) {
+        perCpu->rtQueue.operations.remove(&perCpu->rtQueue, thread);
+    } else {
+        perCpu->rbTree.operations.remove(&perCpu->rbTree, &thread->rbNode);
+        perCpu->weight -= percpu_thread_weight(thread);
+    }
     thread->lastCpu = perCpu->cpuId;
-    return getNode(node, Thread, rbNode);
+    return thread;
+}
+
+/**
+ * two run queue locks are always taken in cpuId order, so two cpus locking each other's queue can not deadlock
+ */
+void percpu_double_lock(PerCpu *cpu1, PerCpu *cpu2) {
+    if (cpu1 == cpu2) {
+        cpu1->lock.operations.acquire(&cpu1->lock);
+        return;
+    }
+    if (cpu1->cpuId > cpu2->cpuId) {
+        PerCpu *tmp = cpu1;
+        cpu1 = cpu2;
+        cpu2 = tmp;
+    }
+    cpu1->lock.operations.acquire(&cpu1->lock);
+    cpu2->lock.operations.acquire(&cpu2->lock);
+}
+
+void percpu_double_unlock(PerCpu *cpu1, PerCpu *cpu2) {
+    if (cpu1 == cpu2) {
+        cpu1->lock.operations.release(&cpu1->lock);
+        return;
+    }
+    // release in the reverse order, the first lock holds the interrupt state from before both
+    if (cpu1->cpuId > cpu2->cpuId) {
+        PerCpu *tmp = cpu1;
+        cpu1 = cpu2;
+        cpu2 = tmp;
+    }
+    cpu2->lock.operations.release(&cpu2->lock);
+    cpu1->lock.operations.release(&cpu1->lock);
+}
+
+/**
+ * lock a sibling while the own run queue lock is held. a sibling with a lower cpuId has to be locked first,
+ * so the own lock is dropped for a moment. returns whether it was, the caller then has to check its own queue again.
+ */
+static bool percpu_lock_sibling(PerCpu *perCpu, PerCpu *sibling) {
+    if (sibling->cpuId < perCpu->cpuId) {
+        perCpu->lock.operations.release(&perCpu->lock);
+        sibling->lock.operations.acquire(&sibling->lock);
+        perCpu->lock.operations.acquire(&perCpu->lock);
+        return true;
+    }
+    sibling->lock.operations.acquire(&sibling->lock);
+    return false;
+}
+
+/**
+ * move a cfs thread between two locked run queues. vruntimes only compare within one queue, so the thread keeps
+ * its lag behind the minVruntime of the queue it leaves, not its absolute vruntime
+ */
+static void percpu_migrate_thread(PerCpu *from, PerCpu *to, Thread *thread) {
+    from->operations.removeThread(from, thread);
+    int64_t lag = (int64_t) (thread->runtimeVirtualNs - from->minVruntime);
+    if (lag < 0 && (uint64_t) -lag > to->minVruntime) {
+        thread->runtimeVirtualNs = 0;
+    } else {
+        thread->runtimeVirtualNs = to->minVruntime + lag;
+    }
+    to->operations.insertThread(to, thread);
+    sched_trace_record(SCHED_TRACE_MIGRATE, (uint32_t) thread->pid, from->cpuId, to->cpuId);
+}
+
+/**
+ * called with the own run queue lock held
+ */
+Thread *percpu_default_steal_thread(PerCpu *perCpu) {
+    per_cpu(cpuStatus, perCpu->cpuId).stealAttempts++;
+
+    // the running thread stays in its run queue, so a sibling needs at least two threads to give one away
+    PerCpu *busiest = nullptr;
+    uint32_t busiestSize = 1;
+    for (CpuNum cpuId = 0; cpuId < SMP_MAX_CPUS; cpuId++) {
+        PerCpu *sibling = percpu_get(cpuId);
+        if (sibling == perCpu) {
+            continue;
+        }
+        if (sibling->rbTree.size > busiestSize) {
+            busiest = sibling;
+            busiestSize = sibling->rbTree.size;
+        }
+    }
+    if (busiest == nullptr) {
+        return nullptr;
+    }
+
+    // busiest was picked without its lock, the scan below sees its queue as it is now
+    if (percpu_lock_sibling(perCpu, busiest) && (perCpu->rbTree.size > 0 || perCpu->rtQueue.size > 0)) {
+        // a thread was put on the own queue while its lock was dropped, run that one instead of stealing
+        busiest->lock.operations.release(&busiest->lock);
+        return nullptr;
+    }
+
+    // walk from the leftmost node, the first eligible thread is the one lagging furthest behind in vruntime
+    CpuMask cpuMask = cpu_number_to_mask(perCpu->cpuId);
+    Thread *stolenThread = nullptr;
+    RBNode *node = busiest->rbTree.operations.getMin(&busiest->rbTree);
+    for (uint32_t scanned = 0; node != nullptr && scanned < PERCPU_STEAL_SCAN_LIMIT; scanned++) {
+        Thread *thread = getNode(node, Thread, rbNode);
+        if (thread != busiest->currentThread && (thread->cpuAffinity & cpuMask)) {
+            percpu_migrate_thread(busiest, perCpu, thread);
+            per_cpu(cpuStatus, perCpu->cpuId).stealSuccesses++;
+            stolenThread = thread;
+            break;
+        }
+        node = busiest->rbTree.operations.next(&busiest->rbTree, node);
+    }
+
+    busiest->lock.operations.release(&busiest->lock);
+    return stolenThread;
 }
 
 Thread *percpu_default_get_next_thread(PerCpu *perCpu) {
+    Thread *rtThread = perCpu->rtQueue.operations.getHighest(&perCpu->rtQueue);
+    if (rtThread != nullptr) {
+        return rtThread;
+    }
     RBNode *node = perCpu->rbTree.operations.getMin(&perCpu->rbTree);
     if (node == nullptr) {
-        // TODO: migration from other core.
-        LogWarn("[PerCpu]: get min thread null.\n");
-        return perCpu->idleThread;
+        Thread *stolenThread = perCpu->operations.stealThread(perCpu);
+        if (stolenThread != nullptr) {
+            return stolenThread;
+        }
+        // stealing may have dropped the own lock for a moment, look at the own queues again
+        rtThread = perCpu->rtQueue.operations.getHighest(&perCpu->rtQueue);
+        if (rtThread != nullptr) {
+            return rtThread;
+        }
+        node = perCpu->rbTree.operations.getMin(&perCpu->rbTree);
+        if (node == nullptr) {
+            return perCpu->idleThread;
+        }
     }
     Thread *thread = getNode(node, Thread, rbNode);
     if (thread == nullptr) {
@@ -43,46 +187,204 @@ Thread *percpu_default_get_next_thread(PerCpu *perCpu) {
 KernelStatus percpu_default_init(PerCpu *perCpu, CpuNum num, Thread *idleThread) {
     perCpu->idleThread = idleThread;
     perCpu->cpuId = num;
-    perCpu->priority = 0;
-    perCpu->status.idleTime = 0;
+    spinlock_create(&perCpu->lock);
+    lockstat_set_name(&perCpu->lock.stat, "runqueue");
+    perCpu->weight = 0;
+    perCpu->loadAvg = 0;
+    perCpu->loadAvgUpdated = 0;
+    perCpu->balanceTicks = 0;
+    perCpu->sliceStart = 0;
+    perCpu->minVruntime = 0;
+    perCpu->needResched = false;
+    perCpu->rcuNesting = 0;
+    perCpu->rcuDeferredResched = false;
+    CpuStatus *status = per_cpu_ptr(cpuStatus, num);
+    status->idleTime = 0;
+    status->stealAttempts = 0;
+    status->stealSuccesses = 0;
+    status->migrations = 0;
+    status->fpuTraps = 0;
+    status->fpuRestores = 0;
     perCpu->currentThread = nullptr;
+    perCpu->fpuOwner = nullptr;
     perCpu->rbTree.root = nullptr;
     rb_tree_init(&perCpu->rbTree);
+    rt_queue_create(&perCpu->rtQueue);
+    mpsc_queue_create(&perCpu->wakeupInbox);
     perCpu->waitThreadQueue.next = nullptr;
     perCpu->waitThreadQueue.prev = nullptr;
     LogInfo("[PerCpu]: precpu '%d' inited.\n", num);
     return OK;
 }
 
+void percpu_set_ops(PerCpu *cpu) {
+    cpu->operations.init = (PerCpuInit) percpu_default_init;
+    cpu->operations.insertThread = (PerCpuInsertThread) percpu_default_insert_thread;
+    cpu->operations.removeThread = (PerCpuRemoveThread) percpu_default_remove_thread;
+    cpu->operations.getNextThread = (PerCpuGetNextThread) percpu_default_get_next_thread;
+    cpu->operations.stealThread = (PerCpuStealThread) percpu_default_steal_thread;
+}
+
 KernelStatus percpu_create(CpuNum cpuNum) {
     perCpu = (PerCpu *) kernelHeap.operations.calloc(&kernelHeap, cpuNum, sizeof(PerCpu));
     if (perCpu == nullptr) {
         return ERROR;
     }
     for (CpuNum cpuId = 0; cpuId < cpuNum; cpuId++) {
-        perCpu[cpuId].operations.init = (PerCpuInit) percpu_default_init;
-        perCpu[cpuId].operations.insertThread = (PerCpuInsertThread) percpu_default_insert_thread;
-        perCpu[cpuId].operations.removeThread = (PerCpuRemoveThread) percpu_default_remove_thread;
-        perCpu[cpuId].operations.getNextThread = (PerCpuGetNextThread) percpu_default_get_next_thread;
+        percpu_set_ops(&perCpu[cpuId]);
     }
     return OK;
 }
 
 PerCpu *percpu_get(CpuNum cpuNum) { return &perCpu[cpuNum]; }
 
-PerCpu *percpu_min_priority(CpuNum cpuMask) {
-    CpuNum minMaskCPU = 0;
-    for (CpuNum i = 0; i < SMP_MAX_CPUS; i++) {
-        if (cpu_number_to_mask(i) & cpuMask) {
-            minMaskCPU = i;
-            break;
+uint32_t percpu_load(PerCpu *cpu) {
+    // the average lags behind a burst of new threads, the instantaneous weight does not
+    return cpu->weight > cpu->loadAvg ? cpu->weight : cpu->loadAvg;
+}
+
+PerCpu *percpu_min_load(CpuMask cpuMask) {
+    PerCpu *min = nullptr;
+    for (CpuNum cpuId = 0; cpuId < SMP_MAX_CPUS; cpuId++) {
+        if (!(cpu_number_to_mask(cpuId) & cpuMask)) {
+            continue;
         }
-    }
-    PerCpu *min = &perCpu[minMaskCPU];
-    for (CpuNum cpuId = minMaskCPU; cpuId < SMP_MAX_CPUS; cpuId++) {
-        if (perCpu[cpuId].priority < min->priority && (0x1 << cpuId & cpuMask)) {
+        if (min == nullptr || percpu_load(&perCpu[cpuId]) < percpu_load(min)) {
             min = &perCpu[cpuId];
         }
     }
+    if (min == nullptr) {
+        return &perCpu[0];
+    }
     return min;
 }
+
+static bool percpu_is_idle(PerCpu *cpu) {
+    Thread *current = cpu->currentThread;
+    return (current == nullptr || current == cpu->idleThread) && cpu->rbTree.size == 0 && cpu->rtQueue.size == 0;
+}
+
+static bool percpu_is_light(PerCpu *cpu) {
+    // a queued real-time thread would keep a cfs thread off the cpu however light its cfs load is
+    return percpu_is_idle(cpu) || (cpu->rtQueue.size == 0 && percpu_load(cpu) <= PERCPU_WAKEUP_LIGHT_LOAD);
+}
+
+/**
+ * pick the cpu for a woken cfs thread: its last cpu while that is idle or lightly loaded, then the waking cpu on the
+ * same terms, then an idle sibling, then the least loaded allowed cpu. the waking cpu is running and ticking, an idle
+ * sibling has to be kicked out of its stopped tick first. loads are read without locks, a stale one only costs a
+ * worse placement.
+ */
+PerCpu *percpu_select_wakeup_cpu(Thread *thread) {
+    CpuMask cpuMask = thread->cpuAffinity;
+    CpuNum lastCpuId = thread->lastCpu;
+    if (lastCpuId >= SMP_MAX_CPUS || !(cpu_number_to_mask(lastCpuId) & cpuMask)) {
+        return percpu_min_load(cpuMask);
+    }
+
+    PerCpu *last = &perCpu[lastCpuId];
+    if (percpu_is_light(last)) {
+        return last;
+    }
+    CpuNum localCpuId = read_cpuid();
+    if ((cpu_number_to_mask(localCpuId) & cpuMask) && percpu_is_light(&perCpu[localCpuId])) {
+        return &perCpu[localCpuId];
+    }
+    // scan from the last cpu on, so threads woken together do not all pile onto cpu 0
+    for (CpuNum i = 1; i < SMP_MAX_CPUS; i++) {
+        CpuNum cpuId = (lastCpuId + i) % SMP_MAX_CPUS;
+        if ((cpu_number_to_mask(cpuId) & cpuMask) && percpu_is_idle(&perCpu[cpuId])) {
+            return &perCpu[cpuId];
+        }
+    }
+    return percpu_min_load(cpuMask);
+}
+
+/**
+ * move one thread from the busiest to the idlest cpu, if the imbalance between them is large enough.
+ * only threads lighter than half of the imbalance are moved, so a migration never just flips the imbalance.
+ */
+static void percpu_balance(void) {
+    PerCpu *busiest = &perCpu[0];
+    PerCpu *idlest = &perCpu[0];
+    for (CpuNum cpuId = 1; cpuId < SMP_MAX_CPUS; cpuId++) {
+        if (percpu_load(&perCpu[cpuId]) > percpu_load(busiest)) {
+            busiest = &perCpu[cpuId];
+        }
+        if (percpu_load(&perCpu[cpuId]) < percpu_load(idlest)) {
+            idlest = &perCpu[cpuId];
+        }
+    }
+
+    if (busiest == idlest) {
+        return;
+    }
+
+    // the loads were read without any lock, check them again with both queues locked
+    percpu_double_lock(busiest, idlest);
+    uint32_t busiestLoad = percpu_load(busiest);
+    uint32_t idlestLoad = percpu_load(idlest);
+    if (busiestLoad <= idlestLoad || (busiestLoad - idlestLoad) * 100 <= busiestLoad * PERCPU_IMBALANCE_PERCENT) {
+        percpu_double_unlock(busiest, idlest);
+        return;
+    }
+    uint32_t imbalance = busiestLoad - idlestLoad;
+
+    CpuMask cpuMask = cpu_number_to_mask(idlest->cpuId);
+    bool migrated = false;
+    RBNode *node = busiest->rbTree.operations.getMin(&busiest->rbTree);
+    for (uint32_t scanned = 0; node != nullptr && scanned < PERCPU_STEAL_SCAN_LIMIT; scanned++) {
+        Thread *thread = getNode(node, Thread, rbNode);
+        if (thread != busiest->currentThread && (thread->cpuAffinity & cpuMask) &&
+            percpu_thread_weight(thread) * 2 <= imbalance) {
+            percpu_migrate_thread(busiest, idlest, thread);
+            // counted by the cpu running the balancer, the idlest one may be counting its own statistics right now
+            this_cpu_inc(cpuStatus.migrations);
+            migrated = true;
+            break;
+        }
+        node = busiest->rbTree.operations.next(&busiest->rbTree, node);
+    }
+    percpu_double_unlock(busiest, idlest);
+    if (migrated) {
+        // the idlest cpu may be idle with its timer slowed down, it has to pick the thread up now
+        genericInterruptManager.operation.kickCpu(&genericInterruptManager, idlest->cpuId);
+    }
+}
+
+/**
+ * decay the load average once for every whole period since its last update, with the cpu's lock held. the weight
+ * counts as constant since then, a busy cpu ticks at least once a slice
+ */
+static void percpu_update_load_avg(PerCpu *cpu, uint64_t now) {
+    uint64_t period = read_cntfrq() / 1000 * PERCPU_LOAD_AVG_PERIOD_MS;
+    uint64_t periods = (now - cpu->loadAvgUpdated) / period;
+    if (periods == 0) {
+        return;
+    }
+    // the remainder of a period carries over to the next update
+    cpu->loadAvgUpdated += periods * period;
+    if (periods >= PERCPU_LOAD_AVG_FULL_PERIODS) {
+        cpu->loadAvg = cpu->weight;
+        return;
+    }
+    for (uint32_t i = 0; i < (uint32_t) periods; i++) {
+        cpu->loadAvg = (cpu->loadAvg * ((1 << PERCPU_LOAD_AVG_SHIFT) - 1) + cpu->weight) >> PERCPU_LOAD_AVG_SHIFT;
+    }
+}
+
+/**
+ * called from the scheduler tick of the current cpu, which touches only its own load average and tick count
+ */
+void percpu_balance_tick(void) {
+    PerCpu *cpu = &perCpu[read_cpuid()];
+    cpu->lock.operations.acquire(&cpu->lock);
+    percpu_update_load_avg(cpu, read_cntvct());
+    cpu->balanceTicks++;
+    bool balance = cpu->balanceTicks % PERCPU_BALANCE_INTERVAL == 0;
+    cpu->lock.operations.release(&cpu->lock);
+    // percpu_balance takes two run queue locks in cpu order, the own one may not be held
+    if (balance) {
+        percpu_balance();
+    }
+}
@@ -0,0 +1,19 @@
+//
+// Created by XingfengYang on 2021/2/1.
+//
+
+#include "kernel/percpu_var.h"
+
+#define PERCPU_STRINGIFY(x) #x
+#define PERCPU_EXPORT_CPUS(cpus) __asm__(".global __percpu_cpus\n\t.set __percpu_cpus, " PERCPU_STRINGIFY(cpus))
+
+// the linker script lays out one per-cpu area for each cpu, it takes the count from this absolute symbol
+PERCPU_EXPORT_CPUS(SMP_MAX_CPUS);
+
+uint32_t percpu_sum(uint32_t *var) {
+    uint32_t sum = 0;
+    for (CpuNum cpuId = 0; cpuId < SMP_MAX_CPUS; cpuId++) {
+        sum += *(volatile uint32_t *) ((char *) var + percpu_offset(cpuId));
+    }
+    return sum;
+}
@@ -4,6 +4,7 @@
 #include "kernel/rbtree.h"
 #include "kernel/list.h"
 #include "kernel/thread.h"
+#include "libc/stdbool.h"
 
 /**
  * 1. Node is red or black
@@ -13,15 +14,180 @@
  * 5. All paths from any node to each of its leaves contain the same number of black nodes
  **/
 
-RBNode *rbtree_default_get_min(RBTree *tree) {
-    RBNode *tmp = tree->root;
-    if (tmp == nullptr) {
-        return nullptr;
+static inline bool rbtree_is_red(RBNode *node) {
+    return node != nullptr && node->color == NODE_RED;
+}
+
+static inline bool rbtree_is_black(RBNode *node) {
+    return node == nullptr || node->color == NODE_BLACK;
+}
+
+static inline bool rbtree_node_less(RBNode *node1, RBNode *node2) {
+    Thread *node1Thread = getNode(node1, Thread, rbNode);
+    Thread *node2Thread = getNode(node2, Thread, rbNode);
+    return node1Thread->runtimeVirtualNs < node2Thread->runtimeVirtualNs;
+}
+
+static void rbtree_rotate_left(RBTree *tree, RBNode *node) {
+    RBNode *right = node->right;
+    node->right = right->left;
+    if (right->left != nullptr) {
+        right->left->parent = node;
     }
-    while (tmp->left != nullptr) {
-        tmp = tmp->left;
+    right->parent = node->parent;
+    if (node->parent == nullptr) {
+        tree->root = right;
+    } else if (node == node->parent->left) {
+        node->parent->left = right;
+    } else {
+        node->parent->right = right;
+    }
+    right->left = node;
+    node->parent = right;
+}
+
+static void rbtree_rotate_right(RBTree *tree, RBNode *node) {
+    RBNode *left = node->left;
+    node->left = left->right;
+    if (left->right != nullptr) {
+        left->right->parent = node;
+    }
+    left->parent = node->parent;
+    if (node->parent == nullptr) {
+        tree->root = left;
+    } else if (node == node->parent->right) {
+        node->parent->right = left;
+    } else {
+        node->parent->left = left;
+    }
+    left->right = node;
+    node->parent = left;
+}
+
+/**
+ * replace the subtree rooted at node1 with the subtree rooted at node2
+ */
+static void rbtree_transplant(RBTree *tree, RBNode *node1, RBNode *node2) {
+    if (node1->parent == nullptr) {
+        tree->root = node2;
+    } else if (node1 == node1->parent->left) {
+        node1->parent->left = node2;
+    } else {
+        node1->parent->right = node2;
+    }
+    if (node2 != nullptr) {
+        node2->parent = node1->parent;
+    }
+}
+
+static void rbtree_insert_fixup(RBTree *tree, RBNode *node) {
+    RBNode *parent;
+    while ((parent = node->parent) != nullptr && parent->color == NODE_RED) {
+        // parent is red, so it can not be the root, grandparent always exists
+        RBNode *grandparent = parent->parent;
+        if (parent == grandparent->left) {
+            RBNode *uncle = grandparent->right;
+            if (rbtree_is_red(uncle)) {
+                parent->color = NODE_BLACK;
+                uncle->color = NODE_BLACK;
+                grandparent->color = NODE_RED;
+                node = grandparent;
+                continue;
+            }
+            if (node == parent->right) {
+                rbtree_rotate_left(tree, parent);
+                node = parent;
+                parent = node->parent;
+            }
+            parent->color = NODE_BLACK;
+            grandparent->color = NODE_RED;
+            rbtree_rotate_right(tree, grandparent);
+        } else {
+            RBNode *uncle = grandparent->left;
+            if (rbtree_is_red(uncle)) {
+                parent->color = NODE_BLACK;
+                uncle->color = NODE_BLACK;
+                grandparent->color = NODE_RED;
+                node = grandparent;
+                continue;
+            }
+            if (node == parent->left) {
+                rbtree_rotate_right(tree, parent);
+                node = parent;
+                parent = node->parent;
+            }
+            parent->color = NODE_BLACK;
+            grandparent->color = NODE_RED;
+            rbtree_rotate_left(tree, grandparent);
+        }
+    }
+    tree->root->color = NODE_BLACK;
+}
+
+/**
+ * node may be nullptr (a black leaf), so the parent is passed explicitly
+ */
+static void rbtree_remove_fixup(RBTree *tree, RBNode *node, RBNode *parent) {
+    while (node != tree->root && rbtree_is_black(node)) {
+        if (node == parent->left) {
+            RBNode *sibling = parent->right;
+            if (rbtree_is_red(sibling)) {
+                sibling->color = NODE_BLACK;
+                parent->color = NODE_RED;
+                rbtree_rotate_left(tree, parent);
+                sibling = parent->right;
+            }
+            if (rbtree_is_black(sibling->left) && rbtree_is_black(sibling->right)) {
+                sibling->color = NODE_RED;
+                node = parent;
+                parent = node->parent;
+            } else {
+                if (rbtree_is_black(sibling->right)) {
+                    sibling->left->color = NODE_BLACK;
+                    sibling->color = NODE_RED;
+                    rbtree_rotate_right(tree, sibling);
+                    sibling = parent->right;
+                }
+                sibling->color = parent->color;
+                parent->color = NODE_BLACK;
+                sibling->right->color = NODE_BLACK;
+                rbtree_rotate_left(tree, parent);
+                node = tree->root;
+            }
+        } else {
+            RBNode *sibling = parent->left;
+            if (rbtree_is_red(sibling)) {
+                sibling->color = NODE_BLACK;
+                parent->color = NODE_RED;
+                rbtree_rotate_right(tree, parent);
+                sibling = parent->left;
+            }
+            if (rbtree_is_black(sibling->left) && rbtree_is_black(sibling->right)) {
+                sibling->color = NODE_RED;
+                node = parent;
+                parent = node->parent;
+            } else {
+                if (rbtree_is_black(sibling->left)) {
+                    sibling->right->color = NODE_BLACK;
+                    sibling->color = NODE_RED;
+                    rbtree_rotate_left(tree, sibling);
+                    sibling = parent->left;
+                }
+                sibling->color = parent->color;
+                parent->color = NODE_BLACK;
+                sibling->left->color = NODE_BLACK;
+                rbtree_rotate_right(tree, parent);
+                node = tree->root;
+            }
+        }
+    }
+    if (node != nullptr) {
+        node->color = NODE_BLACK;
     }
-    return tmp;
+}
+
+RBNode *rbtree_default_get_min(RBTree *tree) {
+    return tree->leftmost;
 }
 
 RBNode *rbtree_default_get_max(RBTree *tree) {
@@ -35,68 +201,113 @@ RBNode *rbtree_default_get_max(RBTree *tree) {
     return tmp;
 }
 
-RBNode *rbtree_insert(RBNode *node1, RBNode *node2) {
-    Thread *node1Thread = getNode(node1, Thread, rbNode);
-    Thread *node2Thread = getNode(node2, Thread, rbNode);
-
-    if (node2Thread->runtimeVirtualNs < node1Thread->runtimeVirtualNs) {
-        if (node1->left == nullptr) {
-            node1->left = node2;
-            node2->parent = node1;
-            return node2;
-        } else {
-            return rbtree_insert(node1->left, node2);
-        }
-    } else {
-        if (node1->right == nullptr) {
-            node1->right = node2;
-            node2->parent = node1;
-            return node2;
-        } else {
-            return rbtree_insert(node1->right, node2);
+RBNode *rbtree_default_next(RBTree *tree, RBNode *node) {
+    (void) tree;
+    if (node->right != nullptr) {
+        node = node->right;
+        while (node->left != nullptr) {
+            node = node->left;
         }
+        return node;
+    }
+    RBNode *parent = node->parent;
+    while (parent != nullptr && node == parent->right) {
+        node = parent;
+        parent = parent->parent;
     }
+    return parent;
 }
 
 RBNode *rbtree_default_insert(RBTree *tree, RBNode *node) {
-    RBNode *root = tree->root;
+    RBNode *parent = nullptr;
+    RBNode **link = &tree->root;
+    bool leftmost = true;
 
-    if (root == nullptr) {
-        tree->root = node;
-        return node;
+    // equal keys go to the right, so threads with the same vruntime are picked in FIFO order
+    while (*link != nullptr) {
+        parent = *link;
+        if (rbtree_node_less(node, parent)) {
+            link = &parent->left;
+        } else {
+            link = &parent->right;
+            leftmost = false;
+        }
     }
-    return rbtree_insert(root, node);
+
+    node->parent = parent;
+    node->left = nullptr;
+    node->right = nullptr;
+    node->color = NODE_RED;
+    *link = node;
+
+    if (leftmost) {
+        tree->leftmost = node;
+    }
+    tree->size++;
+
+    rbtree_insert_fixup(tree, node);
+    return node;
 }
 
 RBNode *rbtree_default_remove(RBTree *tree, RBNode *node) {
-    RBNode *root = tree->root;
-    RBNode *left = node->left;
-    RBNode *right = node->right;
-    if (node == root) {
-        tree->root = nullptr;
+    RBNode *child;
+    RBNode *parent;
+    NodeColor removedColor = node->color;
+
+    if (tree->leftmost == node) {
+        tree->leftmost = rbtree_default_next(tree, node);
+    }
+
+    if (node->left == nullptr) {
+        child = node->right;
+        parent = node->parent;
+        rbtree_transplant(tree, node, child);
+    } else if (node->right == nullptr) {
+        child = node->left;
+        parent = node->parent;
+        rbtree_transplant(tree, node, child);
     } else {
-        if (node->parent->left == node) {
-            node->parent->left = nullptr;
-        } else if (node->parent->right == node) {
-            node->parent->right = nullptr;
+        // node has two children, replace it with its successor
+        RBNode *successor = node->right;
+        while (successor->left != nullptr) {
+            successor = successor->left;
         }
+        removedColor = successor->color;
+        child = successor->right;
+        if (successor->parent == node) {
+            parent = successor;
+        } else {
+            parent = successor->parent;
+            rbtree_transplant(tree, successor, successor->right);
+            successor->right = node->right;
+            successor->right->parent = successor;
+        }
+        rbtree_transplant(tree, node, successor);
+        successor->left = node->left;
+        successor->left->parent = successor;
+        successor->color = node->color;
     }
 
-    if (left != nullptr) {
-        rbtree_default_insert(tree, left);
-    }
-    if (right != nullptr) {
-        rbtree_default_insert(tree, right);
+    if (removedColor == NODE_BLACK) {
+        rbtree_remove_fixup(tree, child, parent);
     }
+
+    node->parent = nullptr;
     node->left = nullptr;
     node->right = nullptr;
+    node->color = NODE_RED;
+    tree->size--;
     return node;
 }
 
 RBTree *rb_tree_init(RBTree *tree) {
     tree->root = nullptr;
+    tree->leftmost = nullptr;
+    tree->size = 0;
     tree->operations.getMax = (RbTreeGetMaxNode) rbtree_default_get_max;
     tree->operations.getMin = (RbTreeGetMinNode) rbtree_default_get_min;
     tree->operations.insert = (RBTreeInsertNode) rbtree_default_insert;
     tree->operations.remove = (RbTreeRemoveNode) rbtree_default_remove;
+    tree->operations.next = (RbTreeNextNode) rbtree_default_next;
+    return tree;
 }
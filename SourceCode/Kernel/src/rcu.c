@@ -0,0 +1,214 @@
+//
+// Created by XingfengYang on 2021/1/29.
+//
+
+#include "kernel/rcu.h"
+#include "kernel/interrupt.h"
+#include "kernel/list.h"
+#include "kernel/scheduler.h"
+#include "kernel/thread.h"
+
+extern Scheduler cfsScheduler;
+extern InterruptManager genericInterruptManager;
+
+RcuState rcuState;
+
+typedef struct RcuSync {
+    RcuHead head;
+    volatile bool done;
+    Thread *waiter;
+} RcuSync;
+
+void rcu_init(void) {
+    spinlock_create(&rcuState.lock);
+    lockstat_set_name(&rcuState.lock.stat, "rcu");
+    rcuState.pendingCpus = 0;
+    rcuState.gracePeriodRunning = false;
+    rcuState.currentBatch = nullptr;
+    rcuState.nextBatch = nullptr;
+    rcuState.nextTail = &rcuState.nextBatch;
+    rcuState.doneBatch = nullptr;
+    rcuState.status.gracePeriods = 0;
+    rcuState.status.callbacks = 0;
+}
+
+static CpuMask rcu_finish_grace_period(void);
+
+/**
+ * the rcu lock is held. every queued callback waits for this grace period. returns the cpus it waits for,
+ * the caller kicks them once the lock is released
+ */
+static CpuMask rcu_start_grace_period(void) {
+    rcuState.currentBatch = rcuState.nextBatch;
+    rcuState.nextBatch = nullptr;
+    rcuState.nextTail = &rcuState.nextBatch;
+    rcuState.gracePeriodRunning = true;
+
+    asm volatile("dmb" ::: "memory");
+    CpuMask pendingCpus = 0;
+    for (CpuNum cpuId = 0; cpuId < SMP_MAX_CPUS; cpuId++) {
+        PerCpu *cpu = percpu_get(cpuId);
+        // an idle cpu, or one without any thread, reads nothing unless it marked a read-side section
+        if (cpu->rcuNesting == 0 && (cpu->currentThread == nullptr || cpu->currentThread == cpu->idleThread)) {
+            continue;
+        }
+        pendingCpus |= cpu_number_to_mask(cpuId);
+    }
+    rcuState.pendingCpus = pendingCpus;
+    if (pendingCpus == 0) {
+        return rcu_finish_grace_period();
+    }
+    return pendingCpus;
+}
+
+/**
+ * the rcu lock is held. the batch becomes runnable, callbacks queued meanwhile start the next grace period,
+ * whose cpus are returned
+ */
+static CpuMask rcu_finish_grace_period(void) {
+    RcuHead **doneTail = &rcuState.doneBatch;
+    while (*doneTail != nullptr) {
+        doneTail = &(*doneTail)->next;
+    }
+    *doneTail = rcuState.currentBatch;
+    rcuState.currentBatch = nullptr;
+    rcuState.gracePeriodRunning = false;
+    rcuState.status.gracePeriods++;
+    if (rcuState.nextBatch != nullptr) {
+        return rcu_start_grace_period();
+    }
+    return 0;
+}
+
+/**
+ * a cpu running a lone thread has its tick stopped, the kick makes it tick again. rcu_needs_tick then keeps it
+ * ticking until it has reported
+ */
+static void rcu_kick_cpus(CpuMask cpuMask) {
+    for (CpuNum cpuId = 0; cpuId < SMP_MAX_CPUS; cpuId++) {
+        if ((cpuMask & cpu_number_to_mask(cpuId)) != 0) {
+            genericInterruptManager.operation.kickCpu(&genericInterruptManager, cpuId);
+        }
+    }
+}
+
+static void rcu_run_callbacks(void) {
+    if (rcuState.doneBatch == nullptr) {
+        return;
+    }
+    rcuState.lock.operations.acquire(&rcuState.lock);
+    RcuHead *head = rcuState.doneBatch;
+    rcuState.doneBatch = nullptr;
+    rcuState.lock.operations.release(&rcuState.lock);
+
+    // a callback may free the head, take the next one first
+    uint32_t callbacks = 0;
+    while (head != nullptr) {
+        RcuHead *next = head->next;
+        head->func(head);
+        callbacks++;
+        head = next;
+    }
+    rcuState.lock.operations.acquire(&rcuState.lock);
+    rcuState.status.callbacks += callbacks;
+    rcuState.lock.operations.release(&rcuState.lock);
+}
+
+void rcu_quiescent(PerCpu *cpu) {
+    CpuMask cpuMask = cpu_number_to_mask(cpu->cpuId);
+    if (cpu->rcuNesting == 0 && (rcuState.pendingCpus & cpuMask) != 0) {
+        CpuMask kickCpus = 0;
+        rcuState.lock.operations.acquire(&rcuState.lock);
+        if ((rcuState.pendingCpus & cpuMask) != 0) {
+            rcuState.pendingCpus &= ~cpuMask;
+            if (rcuState.pendingCpus == 0) {
+                kickCpus = rcu_finish_grace_period();
+            }
+        }
+        rcuState.lock.operations.release(&rcuState.lock);
+        rcu_kick_cpus(kickCpus);
+    }
+    rcu_run_callbacks();
+}
+
+void rcu_read_unlock_special(PerCpu *cpu) {
+    if (cpu->rcuDeferredResched) {
+        // the slice ended inside the read-side section, the switch was put off until now
+        cpu->rcuDeferredResched = false;
+        cfsScheduler.operation.preempt(&cfsScheduler);
+    }
+    rcu_quiescent(cpu);
+}
+
+bool rcu_needs_tick(PerCpu *cpu) {
+    return (rcuState.pendingCpus & cpu_number_to_mask(cpu->cpuId)) != 0 || rcuState.doneBatch != nullptr;
+}
+
+void call_rcu(RcuHead *head, RcuCallback func) {
+    head->func = func;
+    head->next = nullptr;
+    CpuMask kickCpus = 0;
+    rcuState.lock.operations.acquire(&rcuState.lock);
+    *rcuState.nextTail = head;
+    rcuState.nextTail = &head->next;
+    if (!rcuState.gracePeriodRunning) {
+        kickCpus = rcu_start_grace_period();
+    }
+    rcuState.lock.operations.release(&rcuState.lock);
+    rcu_kick_cpus(kickCpus);
+}
+
+static void rcu_sync_callback(RcuHead *head) {
+    RcuSync *sync = getNode(head, RcuSync, head);
+    Thread *waiter = sync->waiter;
+    sync->done = true;
+    if (waiter != nullptr) {
+        cfsScheduler.operation.wakeup(&cfsScheduler, waiter);
+    }
+}
+
+/**
+ * the calling cpu is outside any read-side section, report it without being switched to another cpu meanwhile
+ */
+static void rcu_quiescent_local(void) {
+    uint32_t interruptEnabled = arch_is_interrupt_enabled();
+    arch_disable_interrupt();
+    rcu_quiescent(percpu_get(read_cpuid()));
+    if (interruptEnabled) {
+        arch_enable_interrupt();
+    }
+}
+
+void synchronize_rcu(void) {
+    if (perCpu == nullptr) {
+        return;
+    }
+    RcuSync sync;
+    sync.done = false;
+    sync.waiter = nullptr;
+
+    uint32_t interruptEnabled = arch_is_interrupt_enabled();
+    arch_disable_interrupt();
+    PerCpu *cpu = percpu_get(read_cpuid());
+    Thread *currentThread = cpu->currentThread;
+    bool canSleep = currentThread != nullptr && currentThread != cpu->idleThread;
+    if (canSleep) {
+        // the callback may wake us before we get to block, block then returns right away
+        sync.waiter = currentThread;
+        currentThread->threadStatus = THREAD_BLOCKED;
+    }
+    call_rcu(&sync.head, rcu_sync_callback);
+    rcu_quiescent(cpu);
+    if (interruptEnabled) {
+        arch_enable_interrupt();
+    }
+
+    if (canSleep) {
+        cfsScheduler.operation.block(&cfsScheduler);
+        return;
+    }
+    // nothing that could sleep, keep reporting our own quiescent states until the others have passed theirs
+    while (!sync.done) {
+        rcu_quiescent_local();
+    }
+}
@@ -0,0 +1,61 @@
+//
+// Created by XingfengYang on 2021/1/18.
+//
+
+#include "kernel/rtqueue.h"
+
+KernelStatus rt_queue_default_enqueue(RtQueue *queue, Thread *thread) {
+    uint32_t level = rt_queue_level(thread);
+    KernelQueue *list = &queue->levels[level];
+    list->operations.enqueue(list, &thread->rtNode);
+    queue->bitmap |= 1u << level;
+    queue->size++;
+    return OK;
+}
+
+KernelStatus rt_queue_default_remove(RtQueue *queue, Thread *thread) {
+    uint32_t level = rt_queue_level(thread);
+    KernelQueue *list = &queue->levels[level];
+    if (list->operations.remove(list, &thread->rtNode) != OK) {
+        return ERROR;
+    }
+    if (list->operations.isEmpty(list)) {
+        queue->bitmap &= ~(1u << level);
+    }
+    queue->size--;
+    return OK;
+}
+
+/**
+ * move a thread behind all other threads of its level
+ */
+KernelStatus rt_queue_default_requeue(RtQueue *queue, Thread *thread) {
+    KernelQueue *list = &queue->levels[rt_queue_level(thread)];
+    if (list->tail == &thread->rtNode) {
+        return OK;
+    }
+    list->operations.remove(list, &thread->rtNode);
+    list->operations.enqueue(list, &thread->rtNode);
+    return OK;
+}
+
+Thread *rt_queue_default_get_highest(RtQueue *queue) {
+    if (queue->bitmap == 0) {
+        return nullptr;
+    }
+    KernelQueue *list = &queue->levels[rt_queue_highest_level(queue->bitmap)];
+    return getNode(list->head, Thread, rtNode);
+}
+
+RtQueue *rt_queue_create(RtQueue *queue) {
+    queue->bitmap = 0;
+    queue->size = 0;
+    for (uint32_t level = 0; level < RT_PRIORITY_LEVELS; level++) {
+        kqueue_create(&queue->levels[level]);
+    }
+    queue->operations.enqueue = (RtQueueEnqueue) rt_queue_default_enqueue;
+    queue->operations.requeue = (RtQueueRequeue) rt_queue_default_requeue;
+    queue->operations.remove = (RtQueueRemove) rt_queue_default_remove;
+    queue->operations.getHighest = (RtQueueGetHighest) rt_queue_default_get_highest;
+    return queue;
+}
@@ -0,0 +1,122 @@
+//
+// Created by XingfengYang on 2021/1/26.
+//
+
+#include "kernel/rwlock.h"
+#include "arm/register.h"
+#include "kernel/assert.h"
+#include "kernel/percpu.h"
+#include "kernel/scheduler.h"
+#include "kernel/thread.h"
+
+extern Scheduler cfsScheduler;
+
+/**
+ * the lock is free and the spin lock is held. a waiting writer goes first, otherwise every waiting reader gets in.
+ */
+static void rwlock_hand_off(RwLock *rwLock) {
+    KQueueNode *node = rwLock->writerQueue.operations.dequeue(&rwLock->writerQueue);
+    if (node != nullptr) {
+        rwLock->writer = true;
+        cfsScheduler.operation.wakeup(&cfsScheduler, getNode(node, Thread, threadReadyQueue));
+        return;
+    }
+    while ((node = rwLock->readerQueue.operations.dequeue(&rwLock->readerQueue)) != nullptr) {
+        rwLock->readers++;
+        cfsScheduler.operation.wakeup(&cfsScheduler, getNode(node, Thread, threadReadyQueue));
+    }
+}
+
+bool rwlock_default_try_acquire_read(RwLock *rwLock) {
+    rwLock->spinLock.operations.acquire(&rwLock->spinLock);
+    // a waiting writer keeps new readers out, a steady stream of readers can not starve it
+    bool acquired = !rwLock->writer && rwLock->writerQueue.size == 0;
+    if (acquired) {
+        rwLock->readers++;
+    }
+    rwLock->spinLock.operations.release(&rwLock->spinLock);
+    return acquired;
+}
+
+bool rwlock_default_try_acquire_write(RwLock *rwLock) {
+    rwLock->spinLock.operations.acquire(&rwLock->spinLock);
+    bool acquired = !rwLock->writer && rwLock->readers == 0;
+    if (acquired) {
+        rwLock->writer = true;
+    }
+    rwLock->spinLock.operations.release(&rwLock->spinLock);
+    return acquired;
+}
+
+/**
+ * the spin lock is held, queue the current thread and sleep until a release hands the lock over. with no thread to
+ * put to sleep, before the scheduler runs or on the idle thread, poll tryAcquire instead like mutex does
+ */
+static void rwlock_wait(RwLock *rwLock, KernelQueue *queue, ThreadStatus status, bool (*tryAcquire)(RwLock *)) {
+    PerCpu *perCpu = percpu_get(read_cpuid());
+    Thread *currentThread = perCpu->currentThread;
+    if (currentThread == nullptr || currentThread == perCpu->idleThread) {
+        rwLock->spinLock.operations.release(&rwLock->spinLock);
+        while (!tryAcquire(rwLock)) {
+        }
+        return;
+    }
+    queue->operations.enqueue(queue, &currentThread->threadReadyQueue);
+    currentThread->threadStatus = status;
+    rwLock->spinLock.operations.release(&rwLock->spinLock);
+
+    cfsScheduler.operation.block(&cfsScheduler);
+}
+
+void rwlock_default_acquire_read(RwLock *rwLock) {
+    rwLock->spinLock.operations.acquire(&rwLock->spinLock);
+    if (!rwLock->writer && rwLock->writerQueue.size == 0) {
+        rwLock->readers++;
+        rwLock->spinLock.operations.release(&rwLock->spinLock);
+        return;
+    }
+    rwlock_wait(rwLock, &rwLock->readerQueue, THREAD_BLOCKED_READ_LOCK, rwlock_default_try_acquire_read);
+}
+
+void rwlock_default_release_read(RwLock *rwLock) {
+    rwLock->spinLock.operations.acquire(&rwLock->spinLock);
+    DEBUG_ASSERT(rwLock->readers > 0);
+    rwLock->readers--;
+    if (rwLock->readers == 0) {
+        rwlock_hand_off(rwLock);
+    }
+    rwLock->spinLock.operations.release(&rwLock->spinLock);
+}
+
+void rwlock_default_acquire_write(RwLock *rwLock) {
+    rwLock->spinLock.operations.acquire(&rwLock->spinLock);
+    if (!rwLock->writer && rwLock->readers == 0) {
+        rwLock->writer = true;
+        rwLock->spinLock.operations.release(&rwLock->spinLock);
+        return;
+    }
+    rwlock_wait(rwLock, &rwLock->writerQueue, THREAD_BLOCKED, rwlock_default_try_acquire_write);
+}
+
+void rwlock_default_release_write(RwLock *rwLock) {
+    rwLock->spinLock.operations.acquire(&rwLock->spinLock);
+    DEBUG_ASSERT(rwLock->writer);
+    rwLock->writer = false;
+    rwlock_hand_off(rwLock);
+    rwLock->spinLock.operations.release(&rwLock->spinLock);
+}
+
+RwLock *rwlock_create(RwLock *rwLock) {
+    rwLock->readers = 0;
+    rwLock->writer = false;
+    spinlock_create(&rwLock->spinLock);
+    kqueue_create(&rwLock->readerQueue);
+    kqueue_create(&rwLock->writerQueue);
+    rwLock->operations.acquireRead = (RwLockAcquireRead) rwlock_default_acquire_read;
+    rwLock->operations.releaseRead = (RwLockReleaseRead) rwlock_default_release_read;
+    rwLock->operations.acquireWrite = (RwLockAcquireWrite) rwlock_default_acquire_write;
+    rwLock->operations.releaseWrite = (RwLockReleaseWrite) rwlock_default_release_write;
+    rwLock->operations.tryAcquireRead = (RwLockTryAcquireRead) rwlock_default_try_acquire_read;
+    rwLock->operations.tryAcquireWrite = (RwLockTryAcquireWrite) rwlock_default_try_acquire_write;
+    return rwLock;
+}
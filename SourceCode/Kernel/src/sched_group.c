@@ -0,0 +1,159 @@
+//
+// Created by XingfengYang on 2021/1/24.
+//
+
+#include "kernel/sched_group.h"
+#include "arm/register.h"
+#include "kernel/log.h"
+#include "kernel/scheduler.h"
+
+extern Scheduler cfsScheduler;
+extern KernelTimerManager kernelTimerManager;
+
+KernelStatus sched_group_default_attach(SchedGroup *group, Thread *thread) {
+    if (thread->schedGroup == group) {
+        return OK;
+    }
+    if (thread->schedGroup != nullptr) {
+        thread->schedGroup->operations.detach(thread->schedGroup, thread);
+    }
+    group->lock.operations.acquire(&group->lock);
+    // a queued thread of a throttled group leaves its run queue when its cpu switches next
+    thread->schedGroup = group;
+    group->memberCount++;
+    group->lock.operations.release(&group->lock);
+    return OK;
+}
+
+KernelStatus sched_group_default_detach(SchedGroup *group, Thread *thread) {
+    if (thread->schedGroup != group) {
+        return ERROR;
+    }
+    group->lock.operations.acquire(&group->lock);
+    // only parked threads are THROTTLED under the group lock, refill changes the status as it dequeues one
+    bool parked = thread->threadStatus == THREAD_THROTTLED;
+    if (parked) {
+        group->throttledThreads.operations.remove(&group->throttledThreads, &thread->threadReadyQueue);
+    }
+    thread->schedGroup = nullptr;
+    group->memberCount--;
+    group->lock.operations.release(&group->lock);
+    if (parked) {
+        cfsScheduler.operation.wakeup(&cfsScheduler, thread);
+    }
+    return OK;
+}
+
+/**
+ * takes effect on the next charge or refill, a throttled group stays throttled for the rest of the period
+ */
+KernelStatus sched_group_default_set_quota(SchedGroup *group, uint32_t quotaUs) {
+    group->lock.operations.acquire(&group->lock);
+    group->quotaNs = (uint64_t) quotaUs * 1000;
+    group->lock.operations.release(&group->lock);
+    return OK;
+}
+
+/**
+ * called by the scheduler with a run queue lock held, returns whether the group is throttled now
+ */
+bool sched_group_default_charge(SchedGroup *group, uint64_t deltaNs) {
+    group->lock.operations.acquire(&group->lock);
+    group->runtimeNs += deltaNs;
+    group->status.usageNs += deltaNs;
+    if (!group->throttled && group->quotaNs != SCHED_GROUP_UNLIMITED && group->runtimeNs >= group->quotaNs) {
+        group->throttled = true;
+        group->throttledAt = read_cntvct();
+        group->status.throttleCount++;
+    }
+    bool throttled = group->throttled;
+    group->lock.operations.release(&group->lock);
+    return throttled;
+}
+
+/**
+ * park a thread that is in no run queue, or that the caller takes out of its run queue under the run queue lock.
+ * fails if the group got refilled in the meantime, then the thread has to stay runnable.
+ */
+KernelStatus sched_group_default_park(SchedGroup *group, Thread *thread) {
+    group->lock.operations.acquire(&group->lock);
+    if (!group->throttled) {
+        group->lock.operations.release(&group->lock);
+        return ERROR;
+    }
+    thread->threadStatus = THREAD_THROTTLED;
+    group->throttledThreads.operations.enqueue(&group->throttledThreads, &thread->threadReadyQueue);
+    group->status.parkCount++;
+    group->lock.operations.release(&group->lock);
+    return OK;
+}
+
+/**
+ * start a new period. the parked threads are woken up one at a time without the group lock,
+ * wakeup takes run queue locks. only the threads parked at the refill are woken, if the group
+ * runs out again meanwhile the woken threads are parked again behind them.
+ */
+void sched_group_default_refill(SchedGroup *group) {
+    group->lock.operations.acquire(&group->lock);
+    group->status.periods++;
+    if (group->throttled) {
+        group->status.throttledNs += scheduler_counter_to_ns(read_cntvct() - group->throttledAt);
+    }
+    group->runtimeNs = 0;
+    group->throttled = false;
+    uint32_t parked = group->throttledThreads.size;
+    group->lock.operations.release(&group->lock);
+
+    for (uint32_t i = 0; i < parked; i++) {
+        group->lock.operations.acquire(&group->lock);
+        KQueueNode *node = group->throttledThreads.operations.dequeue(&group->throttledThreads);
+        Thread *thread = node != nullptr ? getNode(node, Thread, threadReadyQueue) : nullptr;
+        if (thread != nullptr) {
+            // off the queue, detach must not take it out again. still waiting, so the wakeup below claims it
+            thread->threadStatus = THREAD_BLOCKED;
+        }
+        group->lock.operations.release(&group->lock);
+        if (thread == nullptr) {
+            break;
+        }
+        cfsScheduler.operation.wakeup(&cfsScheduler, thread);
+    }
+}
+
+static void sched_group_refill_timer_expired(void *arg) {
+    SchedGroup *group = (SchedGroup *) arg;
+    group->operations.refill(group);
+}
+
+SchedGroup *sched_group_create(SchedGroup *group, uint32_t quotaUs, uint32_t periodMs) {
+    group->quotaNs = (uint64_t) quotaUs * 1000;
+    group->periodMs = periodMs == 0 ? SCHED_GROUP_DEFAULT_PERIOD_MS : periodMs;
+    group->runtimeNs = 0;
+    group->throttled = false;
+    group->throttledAt = 0;
+    group->memberCount = 0;
+    spinlock_create(&group->lock);
+    kqueue_create(&group->throttledThreads);
+
+    group->status.usageNs = 0;
+    group->status.throttledNs = 0;
+    group->status.periods = 0;
+    group->status.throttleCount = 0;
+    group->status.parkCount = 0;
+
+    group->operations.attach = (SchedGroupOperationAttach) sched_group_default_attach;
+    group->operations.detach = (SchedGroupOperationDetach) sched_group_default_detach;
+    group->operations.setQuota = (SchedGroupOperationSetQuota) sched_group_default_set_quota;
+    group->operations.charge = (SchedGroupOperationCharge) sched_group_default_charge;
+    group->operations.park = (SchedGroupOperationPark) sched_group_default_park;
+    group->operations.refill = (SchedGroupOperationRefill) sched_group_default_refill;
+
+    kernel_timer_init(&group->refillTimer, group->periodMs);
+    group->refillTimer.operation.setPeriodic(&group->refillTimer, group->periodMs, sched_group_refill_timer_expired,
+                                             group);
+    if (kernelTimerManager.operation.addTimer(&kernelTimerManager, &group->refillTimer) != OK) {
+        LogError("[SchedGroup]: add refill timer failed.\n");
+        return nullptr;
+    }
+    return group;
+}
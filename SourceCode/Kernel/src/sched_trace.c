@@ -0,0 +1,77 @@
+//
+// Created by XingfengYang on 2021/1/20.
+//
+
+#include "kernel/sched_trace.h"
+#include "arm/interrupt.h"
+#include "arm/register.h"
+
+SchedTraceBuffer schedTraceBuffers[SMP_MAX_CPUS];
+bool schedTraceEnabled = true;
+
+static const char *SCHED_TRACE_EVENT_NAMES[] = {
+        "none",
+        "switch",
+        "wakeup",
+        "migrate",
+        "tick",
+};
+
+void sched_trace_record(SchedTraceEvent event, uint32_t arg0, uint32_t arg1, uint32_t arg2) {
+    if (!schedTraceEnabled) {
+        return;
+    }
+    uint32_t interruptEnabled = arch_is_interrupt_enabled();
+    arch_disable_interrupt();
+
+    SchedTraceBuffer *buffer = &schedTraceBuffers[read_cpuid()];
+    uint32_t head = buffer->head;
+    SchedTraceEntry *entry = &buffer->entries[head & (SCHED_TRACE_ENTRIES - 1)];
+    entry->timestamp = read_cntvct();
+    entry->event = event;
+    entry->arg0 = arg0;
+    entry->arg1 = arg1;
+    entry->arg2 = arg2;
+    // the entry has to be visible before a reader on another cpu can see the new head
+    asm volatile("dmb" ::: "memory");
+    buffer->head = head + 1;
+
+    if (interruptEnabled) {
+        arch_enable_interrupt();
+    }
+}
+
+void sched_trace_enable(bool enable) {
+    schedTraceEnabled = enable;
+}
+
+void sched_trace_reset(void) {
+    for (CpuNum cpuId = 0; cpuId < SMP_MAX_CPUS; cpuId++) {
+        schedTraceBuffers[cpuId].head = 0;
+    }
+}
+
+uint32_t sched_trace_head(CpuNum cpuId) {
+    return schedTraceBuffers[cpuId].head;
+}
+
+bool sched_trace_read(CpuNum cpuId, uint32_t index, SchedTraceEntry *entry) {
+    SchedTraceBuffer *buffer = &schedTraceBuffers[cpuId];
+    // the slot of index is rewritten by the record with sequence number index + SCHED_TRACE_ENTRIES,
+    // which is in progress as soon as head reaches that number
+    if (index >= buffer->head || buffer->head - index >= SCHED_TRACE_ENTRIES) {
+        return false;
+    }
+    asm volatile("dmb" ::: "memory");
+    *entry = buffer->entries[index & (SCHED_TRACE_ENTRIES - 1)];
+    asm volatile("dmb" ::: "memory");
+    // the producer may have wrapped around and rewritten the slot while it was copied
+    return buffer->head - index < SCHED_TRACE_ENTRIES;
+}
+
+const char *sched_trace_event_name(uint32_t event) {
+    if (event > SCHED_TRACE_TICK) {
+        return "unknown";
+    }
+    return SCHED_TRACE_EVENT_NAMES[event];
+}
@@ -3,42 +3,273 @@
 //
 
 #include "arm/interrupt.h"
+#include "kernel/fpu.h"
 #include "kernel/ktimer.h"
 #include "kernel/scheduler.h"
 #include "arm/register.h"
 #include "kernel/interrupt.h"
 #include "kernel/log.h"
 #include "kernel/percpu.h"
-#include "kernel/spinlock.h"
+#include "kernel/rcu.h"
+#include "kernel/sched_group.h"
+#include "kernel/sched_trace.h"
 #include "libc/stdlib.h"
 
 extern InterruptManager genericInterruptManager;
 extern KernelTimerManager kernelTimerManager;
 extern Scheduler cfsScheduler;
+extern PerCpu *perCpu;
 
-uint32_t PRIORITY_2_WEIGHT[40] = {
+uint32_t PRIORITY_2_WEIGHT[PRIORITY_WEIGHT_NUM] = {
         88761, 71755, 56483, 46273, 36291, 29154, 23254, 18705, 14949, 11916,
         9548, 7620, 6100, 4904, 3906, 3121, 2501, 1991, 1586, 1277, 1024,
         820, 655, 526, 423, 335, 272, 215, 172, 137, 110,
         87, 70, 56, 45, 36, 29, 23, 18, 15,
 };
 
-#define PRIORITY_DEFAULT_WEIGHT 1024
+uint32_t PRIORITY_2_WMULT[PRIORITY_WEIGHT_NUM] = {
+        48388, 59856, 76040, 92818, 118348, 147320, 184698, 229616, 287308, 360437,
+        449829, 563644, 704093, 875809, 1099582, 1376151, 1717300, 2157191, 2708050, 3363326, 4194304,
+        5237765, 6557202, 8165337, 10153587, 12820798, 15790321, 19976592, 24970740, 31350126, 39045157,
+        49367440, 61356676, 76695844, 95443717, 119304647, 148102320, 186737708, 238609294, 286331153,
+};
+
+/**
+ * counter ticks are converted to ns as (counter * counterNsMult) >> COUNTER_NS_SHIFT,
+ * so the hot path does not need a 64 bit division
+ */
+#define COUNTER_NS_SHIFT 24
+
+uint64_t counterNsMult = 0;
+
+
+uint64_t scheduler_counter_to_ns(uint64_t counter) {
+    uint32_t frequency = read_cntfrq();
+    if (counterNsMult == 0) {
+        counterNsMult = ((uint64_t) 1000000000 << COUNTER_NS_SHIFT) / frequency;
+    }
+    if (counter < frequency) {
+        return (counter * counterNsMult) >> COUNTER_NS_SHIFT;
+    }
+    // longer than a second, convert whole seconds apart so the multiply can not overflow
+    uint64_t seconds = counter / frequency;
+    return seconds * 1000000000 + (((counter - seconds * frequency) * counterNsMult) >> COUNTER_NS_SHIFT);
+}
+
+uint64_t scheduler_calc_delta_vruntime(uint64_t deltaNs, uint32_t priority) {
+    uint32_t index = priority_to_weight_index(priority);
+    if (PRIORITY_2_WEIGHT[index] == PRIORITY_DEFAULT_WEIGHT) {
+        return deltaNs;
+    }
+    // deltaNs * PRIORITY_DEFAULT_WEIGHT / weight, as a multiply by the inverse weight and a shift
+    uint64_t fact = (uint64_t) PRIORITY_DEFAULT_WEIGHT * PRIORITY_2_WMULT[index];
+    uint32_t shift = PRIORITY_WMULT_SHIFT;
+    while (fact >> 32) {
+        fact >>= 1;
+        shift--;
+    }
+    // multiply the two 32 bit halves separately, deltaNs * fact may not fit in 64 bits
+    uint64_t high = (deltaNs >> 32) * fact;
+    uint64_t low = (deltaNs & 0xFFFFFFFF) * fact;
+    return (high << (32 - shift)) + (low >> shift);
+}
+
+/**
+ * a real-time thread keeps its place in its level, so a preempted FIFO thread runs again first.
+ * a round robin thread goes behind the others of its level once its slice is used up.
+ */
+static void scheduler_update_rt_runtime(PerCpu *perCpu, Thread *thread, uint64_t deltaNs) {
+    if (!thread_is_runnable(thread)) {
+        perCpu->operations.removeThread(perCpu, thread);
+        thread->rtSliceUsedNs = 0;
+        return;
+    }
+    if (thread->schedPolicy == SCHED_RR) {
+        thread->rtSliceUsedNs += deltaNs;
+        if (thread->rtSliceUsedNs >= (uint64_t) SCHED_RR_TIMESLICE_MS * 1000000) {
+            perCpu->rtQueue.operations.requeue(&perCpu->rtQueue, thread);
+            thread->rtSliceUsedNs = 0;
+        }
+    }
+}
+
+void scheduler_update_runtime(PerCpu *perCpu, Thread *thread, uint64_t now) {
+    uint64_t deltaNs = scheduler_counter_to_ns(now - perCpu->sliceStart);
+    thread->runtimeNs += deltaNs;
+    if (thread->schedGroup != nullptr) {
+        thread->schedGroup->operations.charge(thread->schedGroup, deltaNs);
+    }
+    if (thread_is_realtime(thread)) {
+        scheduler_update_rt_runtime(perCpu, thread, deltaNs);
+        return;
+    }
+    // vruntime is the run queue key, so the thread has to leave the queue to change it
+    perCpu->operations.removeThread(perCpu, thread);
+    thread->runtimeVirtualNs += scheduler_calc_delta_vruntime(deltaNs, thread->priority);
+    // a thread that blocked stays out of the run queue until it is woken up
+    if (thread_is_runnable(thread)) {
+        perCpu->operations.insertThread(perCpu, thread);
+    }
+}
+
+bool scheduler_wakeup_should_preempt(Thread *currentThread, Thread *thread) {
+    // real-time threads preempt every cfs thread and lower real-time levels, but never an equal level
+    if (thread_is_realtime(currentThread)) {
+        return thread_is_realtime(thread) && rt_queue_level(thread) > rt_queue_level(currentThread);
+    }
+    if (thread_is_realtime(thread)) {
+        return true;
+    }
+    if (thread->runtimeVirtualNs >= currentThread->runtimeVirtualNs) {
+        return false;
+    }
+    uint64_t granularity = scheduler_calc_delta_vruntime(SCHED_WAKEUP_GRANULARITY_NS, thread->priority);
+    return currentThread->runtimeVirtualNs - thread->runtimeVirtualNs > granularity;
+}
+
+uint32_t scheduler_slice_ms(PerCpu *perCpu, Thread *thread) {
+    if (perCpu->weight == 0) {
+        return SCHED_LATENCY_MS;
+    }
+    uint32_t slice = SCHED_LATENCY_MS * priority_to_weight(thread->priority) / perCpu->weight;
+    return slice < SCHED_MIN_GRANULARITY_MS ? SCHED_MIN_GRANULARITY_MS : slice;
+}
+
+static uint32_t scheduler_rt_next_event(PerCpu *perCpu, Thread *thread) {
+    Thread *highest = perCpu->rtQueue.operations.getHighest(&perCpu->rtQueue);
+    if (highest != thread && rt_queue_level(highest) > rt_queue_level(thread)) {
+        return 0;
+    }
+    // FIFO runs until it blocks or yields, RR alone in its level has nobody to hand the cpu to
+    KernelQueue *level = &perCpu->rtQueue.levels[rt_queue_level(thread)];
+    if (thread->schedPolicy == SCHED_FIFO || level->size <= 1) {
+        return TICK_NO_EVENT;
+    }
+    uint64_t usedNs = thread->rtSliceUsedNs + scheduler_counter_to_ns(read_cntvct() - perCpu->sliceStart);
+    uint32_t usedMs = (uint32_t) (usedNs / 1000000);
+    return usedMs >= SCHED_RR_TIMESLICE_MS ? 0 : SCHED_RR_TIMESLICE_MS - usedMs;
+}
+
+static uint32_t scheduler_slice_next_event(PerCpu *perCpu) {
+    if (perCpu->needResched) {
+        return 0;
+    }
+    Thread *thread = perCpu->currentThread;
+    if (thread == nullptr || thread == perCpu->idleThread) {
+        if (perCpu->rbTree.size > 0 || perCpu->rtQueue.size > 0) {
+            return 0;
+        }
+        // nothing to run, the idle switch only looks for a thread to steal
+        uint32_t idleMs = (uint32_t) ((read_cntvct() - perCpu->sliceStart) / (read_cntfrq() / 1000));
+        return idleMs >= SCHED_IDLE_TICK_MS ? 0 : SCHED_IDLE_TICK_MS - idleMs;
+    }
+    if (thread_is_realtime(thread)) {
+        return scheduler_rt_next_event(perCpu, thread);
+    }
+    if (perCpu->rtQueue.size > 0) {
+        // a queued real-time thread never waits for the end of a cfs slice
+        return 0;
+    }
+    if (perCpu->rbTree.size <= 1) {
+        // the running thread is alone, there is nobody to preempt it for
+        return TICK_NO_EVENT;
+    }
+    uint32_t elapsedMs = (uint32_t) ((read_cntvct() - perCpu->sliceStart) / (read_cntfrq() / 1000));
+    uint32_t slice = scheduler_slice_ms(perCpu, thread);
+    return elapsedMs >= slice ? 0 : slice - elapsedMs;
+}
 
-extern void cpu_switch_mm(uint32_t pageTable);
+/**
+ * time until the thread's group has used up its quota, if this cpu alone keeps running it.
+ * other cpus running the same group may use it up sooner, they throttle it on their own switch.
+ */
+static uint32_t scheduler_group_next_event(PerCpu *perCpu, Thread *thread) {
+    SchedGroup *group = thread->schedGroup;
+    if (group->quotaNs == SCHED_GROUP_UNLIMITED) {
+        return TICK_NO_EVENT;
+    }
+    if (group->throttled) {
+        return 0;
+    }
+    uint64_t usedNs = group->runtimeNs + scheduler_counter_to_ns(read_cntvct() - perCpu->sliceStart);
+    if (usedNs >= group->quotaNs) {
+        return 0;
+    }
+    // round up, a switch with less than the quota used would not throttle the group and come back right away
+    return (uint32_t) ((group->quotaNs - usedNs + 999999) / 1000000);
+}
 
+uint32_t scheduler_next_event(PerCpu *perCpu) {
+    uint32_t nextEvent = scheduler_slice_next_event(perCpu);
+    Thread *thread = perCpu->currentThread;
+    if (nextEvent == 0 || thread == nullptr || thread->schedGroup == nullptr) {
+        return nextEvent;
+    }
+    uint32_t groupEvent = scheduler_group_next_event(perCpu, thread);
+    return groupEvent < nextEvent ? groupEvent : nextEvent;
+}
 
-#define TIMER_TICK_MS 50
+uint32_t tick_next_event(void) {
+    PerCpu *perCpu = percpu_get(read_cpuid());
+    if (!perCpu->wakeupInbox.operations.isEmpty(&perCpu->wakeupInbox)) {
+        return 0;
+    }
+    if (perCpu->rcuDeferredResched) {
+        // the switch waits for the end of the read-side section, not for the timer
+        return TICK_NO_EVENT;
+    }
+    uint32_t nextEvent = scheduler_next_event(perCpu);
+    if (rcu_needs_tick(perCpu) && nextEvent > RCU_TICK_MS) {
+        return RCU_TICK_MS;
+    }
+    return nextEvent;
+}
 
 void tick() {
-    LogInfo("[Schd]: tick.\n");
-    cfsScheduler.operation.switchNext(&cfsScheduler);
+    PerCpu *perCpu = percpu_get(read_cpuid());
+    if (!perCpu->wakeupInbox.operations.isEmpty(&perCpu->wakeupInbox)) {
+        perCpu->lock.operations.acquire(&perCpu->lock);
+        scheduler_drain_wakeups(perCpu);
+        perCpu->lock.operations.release(&perCpu->lock);
+    }
+    rcu_quiescent(perCpu);
+    percpu_balance_tick();
+    uint32_t nextEvent = scheduler_next_event(perCpu);
+    sched_trace_record(SCHED_TRACE_TICK, nextEvent, 0, 0);
+    // the timer also fires for kernel timers, only switch when the slice is really over
+    if (nextEvent == 0) {
+        if (rcu_read_lock_held(perCpu)) {
+            perCpu->rcuDeferredResched = true;
+            return;
+        }
+        cfsScheduler.operation.switchNext(&cfsScheduler);
+    }
 }
 
-SpinLock spinlock = SpinLockCreate();
+/**
+ * kernel threads only use the global kernel mappings, they run on whatever address space the cpu has loaded
+ */
+void schd_switch_mm(Thread *prevThread, Thread *thread) {
+    if (thread->operations.isKernelThread(thread)) {
+        return;
+    }
+    VirtualMemory *virtualMemory = &thread->memoryStruct.virtualMemory;
+    VirtualMemory *prevVirtualMemory = prevThread != nullptr ? &prevThread->memoryStruct.virtualMemory : nullptr;
+    virtualMemory->operations.contextSwitch(prevVirtualMemory, virtualMemory);
+}
 
-void schd_switch_mm(Thread *thread) {
-    cpu_switch_mm((uint32_t) thread->memoryStruct.virtualMemory.pageTable);
+/**
+ * take a queued thread of a throttled group off this cpu, the run queue lock is held.
+ * returns false if the group got refilled meanwhile and the thread stays queued.
+ */
+static bool scheduler_throttle_thread(PerCpu *perCpu, Thread *thread) {
+    SchedGroup *group = thread->schedGroup;
+    if (group->operations.park(group, thread) != OK) {
+        return false;
+    }
+    // a refill waking the thread up again waits for this run queue lock, it is gone from the queue by then
+    perCpu->operations.removeThread(perCpu, thread);
+    return true;
 }
 
 KernelStatus scheduler_default_operation_init(struct Scheduler *scheduler) {
@@ -57,49 +288,284 @@ KernelStatus scheduler_default_operation_init(struct Scheduler *scheduler) {
     return OK;
 }
 
+/**
+ * importance of what a cpu runs right now, idle below cfs below every real-time level
+ */
+static inline uint32_t scheduler_cpu_rank(PerCpu *perCpu) {
+    Thread *currentThread = perCpu->currentThread;
+    if (currentThread == nullptr || currentThread == perCpu->idleThread) {
+        return 0;
+    }
+    if (!thread_is_realtime(currentThread)) {
+        return 1;
+    }
+    return 2 + rt_queue_level(currentThread);
+}
+
+/**
+ * a real-time thread goes to the allowed cpu running the least important thread. the local cpu wins ties,
+ * it is the only one that can be made to switch right away, remote cpus wait for their own timer.
+ */
+static PerCpu *scheduler_select_cpu(Thread *thread) {
+    if (!thread_is_realtime(thread)) {
+        return percpu_select_wakeup_cpu(thread);
+    }
+    CpuNum localCpuId = read_cpuid();
+    PerCpu *best = nullptr;
+    uint32_t bestRank = 0;
+    for (CpuNum i = 0; i < SMP_MAX_CPUS; i++) {
+        CpuNum cpuId = (localCpuId + i) % SMP_MAX_CPUS;
+        if (!(cpu_number_to_mask(cpuId) & thread->cpuAffinity)) {
+            continue;
+        }
+        PerCpu *cpu = percpu_get(cpuId);
+        uint32_t rank = scheduler_cpu_rank(cpu);
+        if (best == nullptr || rank < bestRank) {
+            best = cpu;
+            bestRank = rank;
+        }
+    }
+    return best == nullptr ? percpu_get(0) : best;
+}
+
 KernelStatus scheduler_default_operation_add_thread(struct Scheduler *scheduler, Thread *thread, uint32_t priority) {
     thread->priority = priority;
-    PerCpu *perCpu = percpu_min_priority(thread->cpuAffinity);
+    PerCpu *perCpu = scheduler_select_cpu(thread);
+    perCpu->lock.operations.acquire(&perCpu->lock);
     KernelStatus threadAddStatus = perCpu->operations.insertThread(perCpu, thread);
+    perCpu->lock.operations.release(&perCpu->lock);
     if (threadAddStatus != OK) {
         LogError("[Scheduler] thread %s add to scheduler failed.\n", thread->name);
         return ERROR;
     }
+    // the timer of the target may be stopped or programmed past the new thread's turn
+    genericInterruptManager.operation.kickCpu(&genericInterruptManager, perCpu->cpuId);
     return OK;
 }
 
 KernelStatus scheduler_default_operation_schedule(struct Scheduler *scheduler) {
     tick_init(&scheduler->schedulerTick, tick, "scheduler tick");
+    scheduler->schedulerTick.nextEvent = tick_next_event;
     genericInterruptManager.operation.registerTick(&genericInterruptManager, &scheduler->schedulerTick);
     LogInfo("[Scheduler]: Schd started.\n");
     genericInterruptManager.operation.enableInterrupt(&genericInterruptManager);
     return OK;
 }
 
+/**
+ * the caller has set a waiting status on the current thread and put it on some wait queue.
+ * threads are only switched on the timer interrupt, so ask for an immediate one and wait for it,
+ * switchNext takes the thread off the run queue. returns once the thread has been woken up and runs again.
+ */
 KernelStatus scheduler_default_operation_block(struct Scheduler *scheduler) {
-// TODO:
+    uint32_t interruptEnabled = arch_is_interrupt_enabled();
+    arch_disable_interrupt();
+
+    PerCpu *perCpu = percpu_get(read_cpuid());
+    Thread *thread = perCpu->currentThread;
+    if (thread == nullptr || thread == perCpu->idleThread) {
+        LogError("[Scheduler]: can not block the idle thread.\n");
+        if (interruptEnabled) {
+            arch_enable_interrupt();
+        }
+        return ERROR;
+    }
+    // wakeup checks and sets the status under this lock while the thread is still current here
+    perCpu->lock.operations.acquire(&perCpu->lock);
+    if (thread_is_runnable(thread)) {
+        // woken up before it got switched out, keep running
+        thread->threadStatus = THREAD_RUNNING;
+        perCpu->lock.operations.release(&perCpu->lock);
+        if (interruptEnabled) {
+            arch_enable_interrupt();
+        }
+        return OK;
+    }
+    perCpu->lock.operations.release(&perCpu->lock);
+    scheduler->operation.preempt(scheduler);
+
+    // the interrupt asked for is pending already, switchNext switches to another thread in it and this thread
+    // carries on from there once it is woken up and picked again. interrupts are masked around the check so the
+    // interrupt can not slip in between the check and the wfi, wfi wakes up for a masked one as well
+    while (*(volatile ThreadStatus *) &thread->threadStatus != THREAD_RUNNING) {
+        asm volatile("wfi");
+        arch_enable_interrupt();
+        arch_disable_interrupt();
+    }
+    if (interruptEnabled) {
+        arch_enable_interrupt();
+    }
+    return OK;
 }
 
+/**
+ * give up the rest of the slice, the thread goes behind every other queued thread
+ */
 KernelStatus scheduler_default_operation_yield(struct Scheduler *scheduler) {
-// TODO:
+    uint32_t interruptEnabled = arch_is_interrupt_enabled();
+    arch_disable_interrupt();
+
+    PerCpu *perCpu = percpu_get(read_cpuid());
+    Thread *thread = perCpu->currentThread;
+    bool preempt = false;
+    perCpu->lock.operations.acquire(&perCpu->lock);
+    if (thread != nullptr && thread_is_realtime(thread)) {
+        // behind the other threads of the same level, lower levels still do not get to run
+        perCpu->rtQueue.operations.requeue(&perCpu->rtQueue, thread);
+        thread->rtSliceUsedNs = 0;
+        preempt = true;
+    } else if (thread != nullptr && thread != perCpu->idleThread && perCpu->rbTree.size > 1) {
+        RBNode *maxNode = perCpu->rbTree.operations.getMax(&perCpu->rbTree);
+        uint64_t maxVruntime = getNode(maxNode, Thread, rbNode)->runtimeVirtualNs;
+        if (thread->runtimeVirtualNs < maxVruntime) {
+            perCpu->operations.removeThread(perCpu, thread);
+            thread->runtimeVirtualNs = maxVruntime;
+            perCpu->operations.insertThread(perCpu, thread);
+        }
+        preempt = true;
+    }
+    perCpu->lock.operations.release(&perCpu->lock);
+    if (preempt) {
+        scheduler->operation.preempt(scheduler);
+    }
+
+    if (interruptEnabled) {
+        arch_enable_interrupt();
+    }
+    return OK;
 }
 
+/**
+ * switch away from the current thread on the next timer interrupt, which is programmed to fire right away
+ */
 KernelStatus scheduler_default_operation_preempt(struct Scheduler *scheduler) {
-    // TODO:
+    PerCpu *perCpu = percpu_get(read_cpuid());
+    perCpu->needResched = true;
+    genericInterruptManager.operation.programTick(&genericInterruptManager);
+    return OK;
+}
+
+/**
+ * put a woken thread into the run queue of perCpu, whose lock is held
+ */
+static void scheduler_enqueue_woken(PerCpu *perCpu, Thread *thread) {
+    if (!thread_is_realtime(thread)) {
+        // a long sleeper gets at most half a latency period of credit,
+        // instead of starving the others with its old vruntime
+        uint64_t sleeperCredit = (uint64_t) SCHED_LATENCY_MS * 1000000 / 2;
+        uint64_t minVruntime = perCpu->minVruntime > sleeperCredit ? perCpu->minVruntime - sleeperCredit : 0;
+        if (thread->runtimeVirtualNs < minVruntime) {
+            thread->runtimeVirtualNs = minVruntime;
+        }
+    }
+    thread->threadStatus = THREAD_READY;
+    perCpu->operations.insertThread(perCpu, thread);
+
+    Thread *currentThread = perCpu->currentThread;
+    if (currentThread == nullptr || currentThread == perCpu->idleThread ||
+        scheduler_wakeup_should_preempt(currentThread, thread)) {
+        perCpu->needResched = true;
+    }
+    sched_trace_record(SCHED_TRACE_WAKEUP, (uint32_t) thread->pid, perCpu->cpuId, perCpu->needResched);
+}
+
+void scheduler_drain_wakeups(PerCpu *perCpu) {
+    KQueueNode *node;
+    while ((node = perCpu->wakeupInbox.operations.dequeue(&perCpu->wakeupInbox)) != nullptr) {
+        scheduler_enqueue_woken(perCpu, getNode(node, Thread, threadReadyQueue));
+    }
+}
+
+/**
+ * move a waiting thread to THREAD_WAKING, false if it is runnable or another wakeup got it first
+ */
+static bool scheduler_claim_wakeup(Thread *thread) {
+    thread->wakeupLock.operations.acquire(&thread->wakeupLock);
+    bool claimed = !thread_is_runnable(thread) && thread->threadStatus != THREAD_WAKING;
+    if (claimed) {
+        thread->threadStatus = THREAD_WAKING;
+    }
+    thread->wakeupLock.operations.release(&thread->wakeupLock);
+    return claimed;
+}
+
+KernelStatus scheduler_default_operation_wakeup(struct Scheduler *scheduler, Thread *thread) {
+    uint32_t interruptEnabled = arch_is_interrupt_enabled();
+    arch_disable_interrupt();
+
+    if (!scheduler_claim_wakeup(thread)) {
+        if (interruptEnabled) {
+            arch_enable_interrupt();
+        }
+        return OK;
+    }
+    if (thread->currCpu != INVALID_CPU) {
+        PerCpu *currCpu = percpu_get(thread->currCpu);
+        currCpu->lock.operations.acquire(&currCpu->lock);
+        if (currCpu->currentThread == thread) {
+            // it has not been switched out yet, so it is still in its run queue and block() will just return
+            thread->threadStatus = THREAD_READY;
+            currCpu->lock.operations.release(&currCpu->lock);
+            if (interruptEnabled) {
+                arch_enable_interrupt();
+            }
+            return OK;
+        }
+        currCpu->lock.operations.release(&currCpu->lock);
+    }
+    if (sched_group_is_throttled(thread) && thread->schedGroup->operations.park(thread->schedGroup, thread) == OK) {
+        // it becomes runnable again on the group's next refill
+        if (interruptEnabled) {
+            arch_enable_interrupt();
+        }
+        return OK;
+    }
+
+    PerCpu *perCpu = scheduler_select_cpu(thread);
+    if (perCpu->cpuId != read_cpuid()) {
+        // post it to the inbox instead of taking that cpu's run queue lock, the kick interrupts the target even
+        // with its timer stopped and it moves the thread to its run queue on that tick
+        thread->currCpu = perCpu->cpuId;
+        perCpu->wakeupInbox.operations.enqueue(&perCpu->wakeupInbox, &thread->threadReadyQueue);
+        genericInterruptManager.operation.kickCpu(&genericInterruptManager, perCpu->cpuId);
+        if (interruptEnabled) {
+            arch_enable_interrupt();
+        }
+        return OK;
+    }
+    perCpu->lock.operations.acquire(&perCpu->lock);
+    scheduler_enqueue_woken(perCpu, thread);
+    perCpu->lock.operations.release(&perCpu->lock);
+    genericInterruptManager.operation.programTick(&genericInterruptManager);
+
+    if (interruptEnabled) {
+        arch_enable_interrupt();
+    }
+    return OK;
+}
+
+/**
+ * the thread running on this cpu, nullptr until the scheduler is up
+ */
+static inline Thread *scheduler_local_current_thread() {
+    if (perCpu == nullptr) {
+        return nullptr;
+    }
+    return percpu_get(read_cpuid())->currentThread;
 }
 
 uint32_t get_curr_stack(uint32_t sp) {
-    if (nullptr != cfsScheduler.currentThread) {
-        LogInfo("[Scheduler] switch to %s\n", cfsScheduler.currentThread->name);
-        return cfsScheduler.currentThread->stack.top;
+    Thread *currentThread = scheduler_local_current_thread();
+    if (nullptr != currentThread) {
+        return currentThread->stack.top;
     }
     return sp;
 }
 
 void set_curr_stack(uint32_t sp) {
-    if (nullptr != cfsScheduler.currentThread) {
-        LogInfo("[Scheduler] switch from %s\n", cfsScheduler.currentThread->name);
-        cfsScheduler.currentThread->stack.top = sp;
+    Thread *currentThread = scheduler_local_current_thread();
+    if (nullptr != currentThread) {
+        currentThread->stack.top = sp;
     }
 }
 
@@ -108,33 +574,94 @@ KernelStatus scheduler_default_operation_switch_to(struct Scheduler *scheduler,
         LogWarn("[Scheduler]: cant switch to nullptr thread.\n");
         return ERROR;
     }
-    LogInfo("[Scheduler]: switch to: %s.\n", thread->name);
 
-    // save current thread
-    scheduler->prevThread = scheduler->currentThread;
-    scheduler->currentThread = thread;
-    percpu_get(read_cpuid())->currentThread = thread;
+    // the current thread lives in the per cpu data, a scheduler wide field would be written by every cpu
+    PerCpu *perCpu = percpu_get(read_cpuid());
+    Thread *prevThread = perCpu->currentThread;
+    if (prevThread != nullptr && prevThread->threadStatus == THREAD_RUNNING) {
+        prevThread->threadStatus = THREAD_READY;
+    }
+    if (prevThread != thread) {
+        fpu_switch(perCpu);
+    }
+    thread->threadStatus = THREAD_RUNNING;
+    perCpu->currentThread = thread;
     return OK;
 }
 
 KernelStatus scheduler_default_operation_switch_next(struct Scheduler *scheduler) {
-    spinlock.operations.acquire(&spinlock);
-    uint32_t cpuid = read_cpuid();
-    LogWarn("[Schd]: cpuId %d .\n", cpuid);
+    PerCpu *perCpu = percpu_get(read_cpuid());
+    perCpu->lock.operations.acquire(&perCpu->lock);
+    scheduler_drain_wakeups(perCpu);
+    perCpu->needResched = false;
 
-    PerCpu *perCpu = percpu_get(cpuid);
-    Thread *thread = perCpu->operations.getNextThread(perCpu);
+    // charge the outgoing thread for the time it really ran, before picking the next one
+    uint64_t now = read_cntvct();
+    Thread *prevThread = perCpu->currentThread;
+    if (prevThread != nullptr && prevThread != perCpu->idleThread) {
+        scheduler_update_runtime(perCpu, prevThread, now);
+        if (thread_is_runnable(prevThread) && sched_group_is_throttled(prevThread)) {
+            scheduler_throttle_thread(perCpu, prevThread);
+        }
+    }
 
-    thread->runtimeNs += TIMER_TICK_MS;
-    thread->runtimeVirtualNs += (PRIORITY_DEFAULT_WEIGHT / PRIORITY_2_WEIGHT[thread->priority]) * thread->runtimeNs;
+    Thread *thread = perCpu->operations.getNextThread(perCpu);
+    // a group can also be throttled by another cpu, its threads here leave the run queue once they come up
+    while (thread != perCpu->idleThread && sched_group_is_throttled(thread) &&
+           scheduler_throttle_thread(perCpu, thread)) {
+        thread = perCpu->operations.getNextThread(perCpu);
+    }
+    if (thread != perCpu->idleThread && !thread_is_realtime(thread) && thread->runtimeVirtualNs > perCpu->minVruntime) {
+        perCpu->minVruntime = thread->runtimeVirtualNs;
+    }
+    if (thread != prevThread) {
+        sched_trace_record(SCHED_TRACE_SWITCH, prevThread != nullptr ? (uint32_t) prevThread->pid : 0,
+                           (uint32_t) thread->pid, prevThread != nullptr ? prevThread->threadStatus : 0);
+    }
     scheduler->operation.switchTo(scheduler, thread);
+    perCpu->sliceStart = now;
+
+    perCpu->lock.operations.release(&perCpu->lock);
+    // callbacks may wake threads, they run without the run queue lock
+    rcu_quiescent(perCpu);
+    return OK;
+}
 
-    if (thread != perCpu->idleThread) {
-        Thread *removedThread = perCpu->operations.removeThread(perCpu, thread);
-        scheduler->operation.addThread(scheduler, removedThread, removedThread->priority);
+/**
+ * move a thread between cfs and the real-time levels. a queued thread is taken out of its run queue and put back,
+ * so it lands in the right queue, the cpu it is queued on reschedules if the change makes another thread more urgent.
+ */
+KernelStatus scheduler_default_operation_set_policy(struct Scheduler *scheduler, Thread *thread,
+                                                    SchedPolicy schedPolicy, uint32_t priority) {
+    if (schedPolicy > SCHED_RR || priority > HIGHEST_PRIORITY) {
+        LogError("[Scheduler]: invalid policy '%d' priority '%d'.\n", schedPolicy, priority);
+        return ERROR;
+    }
+    uint32_t interruptEnabled = arch_is_interrupt_enabled();
+    arch_disable_interrupt();
+
+    bool queued = thread->currCpu != INVALID_CPU && thread_is_runnable(thread);
+    PerCpu *perCpu = queued ? percpu_get(thread->currCpu) : nullptr;
+    if (queued) {
+        perCpu->lock.operations.acquire(&perCpu->lock);
+        perCpu->operations.removeThread(perCpu, thread);
+    }
+    thread->schedPolicy = schedPolicy;
+    thread->priority = priority;
+    thread->rtSliceUsedNs = 0;
+    if (queued) {
+        if (!thread_is_realtime(thread) && thread->runtimeVirtualNs < perCpu->minVruntime) {
+            thread->runtimeVirtualNs = perCpu->minVruntime;
+        }
+        perCpu->operations.insertThread(perCpu, thread);
+        perCpu->needResched = true;
+        perCpu->lock.operations.release(&perCpu->lock);
+        genericInterruptManager.operation.kickCpu(&genericInterruptManager, perCpu->cpuId);
     }
 
-    spinlock.operations.release(&spinlock);
+    if (interruptEnabled) {
+        arch_enable_interrupt();
+    }
     return OK;
 }
 
@@ -145,7 +672,7 @@ uint32_t scheduler_default_operation_get_current_pid(struct Scheduler *scheduler
 }
 
 Thread *scheduler_default_operation_get_current_thread(struct Scheduler *scheduler) {
-    return scheduler->currentThread;
+    return scheduler_local_current_thread();
 }
 
 Scheduler *scheduler_create(Scheduler *scheduler) {
@@ -155,12 +682,11 @@ Scheduler *scheduler_create(Scheduler *scheduler) {
     scheduler->operation.block = (SchedulerOperationBlock) scheduler_default_operation_block;
     scheduler->operation.yield = (SchedulerOperationYield) scheduler_default_operation_yield;
     scheduler->operation.preempt = (SchedulerOperationPreempt) scheduler_default_operation_preempt;
+    scheduler->operation.wakeup = (SchedulerOperationWakeup) scheduler_default_operation_wakeup;
     scheduler->operation.switchTo = (SchedulerOperationSwitchTo) scheduler_default_operation_switch_to;
     scheduler->operation.switchNext = (SchedulerOperationSwitchNext) scheduler_default_operation_switch_next;
+    scheduler->operation.setPolicy = (SchedulerOperationSetPolicy) scheduler_default_operation_set_policy;
     scheduler->operation.getCurrentPid = (SchedulerOperationGetCurrentPid) scheduler_default_operation_get_current_pid;
     scheduler->operation.getCurrentThread = (SchedulerOperationGetCurrentThread) scheduler_default_operation_get_current_thread;
-
-    scheduler->currentThread = nullptr;
-    scheduler->prevThread = nullptr;
     return scheduler;
 }
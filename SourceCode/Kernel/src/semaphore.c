@@ -3,8 +3,10 @@
 //
 
 #include "kernel/semaphore.h"
+#include "arm/pmu.h"
 #include "arm/register.h"
 #include "kernel/assert.h"
+#include "kernel/ktimer.h"
 #include "kernel/percpu.h"
 #include "kernel/scheduler.h"
 #include "kernel/thread.h"
@@ -14,38 +16,131 @@ extern Scheduler cfsScheduler;
 void semaphore_default_post(Semaphore *semaphore) {
     semaphore->spinLock.operations.acquire(&semaphore->spinLock);
 
-    atomic_inc(&semaphore->count);
     KQueueNode *queueNode = semaphore->waitQueue.operations.dequeue(&semaphore->waitQueue);
-    Thread *releasedThread = getNode(queueNode, Thread, threadReadyQueue);
+    if (queueNode == nullptr) {
+        atomic_inc(&semaphore->count);
+    } else {
+        // pass the count straight to the first waiter
+        Thread *releasedThread = getNode(queueNode, Thread, threadReadyQueue);
+        KernelStatus wakeupStatus = cfsScheduler.operation.wakeup(&cfsScheduler, releasedThread);
+        DEBUG_ASSERT(wakeupStatus == OK);
+    }
 
+    semaphore->spinLock.operations.release(&semaphore->spinLock);
+}
 
-    KernelStatus addToScheduler = cfsScheduler.operation.addThread(&cfsScheduler, releasedThread,
-                                                                   releasedThread->priority);
+/**
+ * returns whether the caller had to sleep for the count
+ */
+static bool semaphore_wait(Semaphore *semaphore) {
+    semaphore->spinLock.operations.acquire(&semaphore->spinLock);
 
-    DEBUG_ASSERT(addToScheduler == OK);
+    if (atomic_get(&semaphore->count) > 0) {
+        atomic_dec(&semaphore->count);
+        semaphore->spinLock.operations.release(&semaphore->spinLock);
+        return false;
+    }
 
+    PerCpu *perCpu = percpu_get(read_cpuid());
+    Thread *currentThread = perCpu->currentThread;
+
+    DEBUG_ASSERT(currentThread != nullptr);
+
+    // can not get the lock, just add to lock wait list
+    semaphore->waitQueue.operations.enqueue(&semaphore->waitQueue, &currentThread->threadReadyQueue);
+    currentThread->threadStatus = THREAD_BLOCKED;
     semaphore->spinLock.operations.release(&semaphore->spinLock);
+
+    cfsScheduler.operation.block(&cfsScheduler);
+    return true;
 }
 
 void semaphore_default_wait(Semaphore *semaphore) {
-    semaphore->spinLock.operations.acquire(&semaphore->spinLock);
+    if (!lockStatEnabled) {
+        semaphore_wait(semaphore);
+        return;
+    }
+    CpuNum cpuId = read_cpuid();
+    uint32_t start = read_pmccntr();
+    bool contended = semaphore_wait(semaphore);
+    lockstat_acquired_sleeping(&semaphore->stat, cpuId, start, contended, __builtin_return_address(0));
+}
 
+/**
+ * wait by polling the count, for callers there is no thread to put to sleep for: before the scheduler runs, or the idle
+ * thread
+ */
+static KernelStatus semaphore_spin_timeout(Semaphore *semaphore, uint32_t timeoutMs) {
+    uint64_t deadline = read_cntvct() + read_cntfrq() / 1000 * timeoutMs;
+    do {
+        semaphore->spinLock.operations.acquire(&semaphore->spinLock);
+        if (atomic_get(&semaphore->count) > 0) {
+            atomic_dec(&semaphore->count);
+            semaphore->spinLock.operations.release(&semaphore->spinLock);
+            return OK;
+        }
+        semaphore->spinLock.operations.release(&semaphore->spinLock);
+    } while (read_cntvct() < deadline);
+    return TIMEOUT;
+}
+
+/**
+ * post passes its count only to a thread it takes off the wait queue, a timed out one is not on it any more
+ */
+static KernelStatus semaphore_wait_timeout(Semaphore *semaphore, uint32_t timeoutMs, bool *contended) {
+    semaphore->spinLock.operations.acquire(&semaphore->spinLock);
+    *contended = false;
     if (atomic_get(&semaphore->count) > 0) {
         atomic_dec(&semaphore->count);
-    } else {
-        uint32_t cpuid = read_cpuid();
-        PerCpu *perCpu = percpu_get(cpuid);
-        Thread *currentThread = perCpu->currentThread;
-
-        DEBUG_ASSERT(currentThread != nullptr);
+        semaphore->spinLock.operations.release(&semaphore->spinLock);
+        return OK;
+    }
+    *contended = true;
+    if (timeoutMs == 0) {
+        semaphore->spinLock.operations.release(&semaphore->spinLock);
+        return TIMEOUT;
+    }
 
-        // can not get the lock, just add to lock wait list
-        semaphore->waitQueue.operations.enqueue(&semaphore->waitQueue, &currentThread->threadReadyQueue);
-        currentThread->threadStatus = THREAD_BLOCKED;
-        // remove from schd list
-        perCpu->rbTree.operations.remove(&perCpu->rbTree, &currentThread->rbNode);
-        // 2. switch to the next thread in scheduler
-        cfsScheduler.operation.switchNext(&cfsScheduler);
+    PerCpu *perCpu = percpu_get(read_cpuid());
+    Thread *currentThread = perCpu->currentThread;
+    if (currentThread == nullptr || currentThread == perCpu->idleThread) {
+        semaphore->spinLock.operations.release(&semaphore->spinLock);
+        return semaphore_spin_timeout(semaphore, timeoutMs);
     }
+
+    semaphore->waitQueue.operations.enqueue(&semaphore->waitQueue, &currentThread->threadReadyQueue);
+    currentThread->threadStatus = THREAD_BLOCKED;
     semaphore->spinLock.operations.release(&semaphore->spinLock);
+
+    KernelTimedWait wait;
+    kernel_timed_wait_arm(&wait, &semaphore->spinLock, &semaphore->waitQueue, currentThread, timeoutMs);
+    cfsScheduler.operation.block(&cfsScheduler);
+    return kernel_timed_wait_finish(&wait);
+}
+
+KernelStatus semaphore_default_wait_timeout(Semaphore *semaphore, uint32_t timeoutMs) {
+    if (timeoutMs == KERNEL_TIMER_FOREVER) {
+        semaphore->operations.wait(semaphore);
+        return OK;
+    }
+    CpuNum cpuId = read_cpuid();
+    uint32_t start = read_pmccntr();
+    bool contended;
+    KernelStatus status = semaphore_wait_timeout(semaphore, timeoutMs, &contended);
+    if (status == OK && lockStatEnabled) {
+        lockstat_acquired_sleeping(&semaphore->stat, cpuId, start, contended, __builtin_return_address(0));
+    }
+    return status;
+}
+
+Semaphore *semaphore_create(Semaphore *semaphore, uint32_t count) {
+    semaphore->count.counter = count;
+    spinlock_create(&semaphore->spinLock);
+    semaphore->stat.name = nullptr;
+    semaphore->stat.id = 0;
+    kqueue_create(&semaphore->waitQueue);
+    semaphore->operations.post = (SemaphorePost) semaphore_default_post;
+    semaphore->operations.wait = (SemaphoreWait) semaphore_default_wait;
+    semaphore->operations.waitTimeout = (SemaphoreWaitTimeout) semaphore_default_wait_timeout;
+    return semaphore;
 }
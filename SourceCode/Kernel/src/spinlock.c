@@ -2,18 +2,91 @@
 // Created by XingfengYang on 2020/7/17.
 //
 #include "kernel/spinlock.h"
+#include "arm/interrupt.h"
+#include "arm/pmu.h"
 
-void spinlock_default_acquire(SpinLock *spinLock) {
-    if (atomic_get(&spinLock->lock) == 0) {
-        atomic_set(&spinLock->lock, 1);
-        asm volatile("cpsid i");
-    } else {
-        asm volatile("WFE");
+/**
+ * draw the next ticket with ldrex/strex and wait until the owner half reaches it, returns whether it had to wait
+ */
+static inline bool spinlock_ticket_lock(SpinLock *spinLock) {
+    uint32_t tmp;
+    uint32_t lockValue;
+    uint32_t newValue;
+    __asm__ __volatile__("@ spinlock_ticket_lock\n\t"
+                         "1:  ldrex    %0, [%3]\n\t"
+                         "    add      %1, %0, %4\n\t"
+                         "    strex    %2, %1, [%3]\n\t"
+                         "    teq      %2, #0\n\t"
+                         "    bne      1b"
+                         : "=&r"(lockValue), "=&r"(newValue), "=&r"(tmp)
+                         : "r"(&spinLock->lock.counter), "I"(1 << SPINLOCK_TICKET_SHIFT)
+                         : "cc");
+    uint16_t ticket = (uint16_t) (lockValue >> SPINLOCK_TICKET_SHIFT);
+    bool contended = (uint16_t) lockValue != ticket;
+    while ((uint16_t) spinLock->lock.counter != ticket) {
+        // woken by the sev of the release that serves the next ticket
+        asm volatile("wfe");
     }
+    asm volatile("dmb" ::: "memory");
+    return contended;
+}
+
+static inline void spinlock_ticket_unlock(SpinLock *spinLock) {
+    asm volatile("dmb" ::: "memory");
+    // only the holder writes the owner half. the store clears the exclusive monitor of a cpu drawing a ticket
+    // at the same time, so its strex fails and it retries with the new owner
+    volatile uint16_t *owner = (volatile uint16_t *) &spinLock->lock.counter;
+    *owner = *owner + 1;
+    asm volatile("dsb");
+    asm volatile("sev");
+}
+
+static inline uint32_t spinlock_lock(SpinLock *spinLock, void *site) {
+    uint32_t interruptEnabled = arch_is_interrupt_enabled();
+    asm volatile("cpsid i");
+    if (!lockStatEnabled) {
+        spinlock_ticket_lock(spinLock);
+        return interruptEnabled;
+    }
+    uint32_t start = read_pmccntr();
+    bool contended = spinlock_ticket_lock(spinLock);
+    lockstat_acquired(&spinLock->stat, start, contended, site);
+    return interruptEnabled;
+}
+
+uint32_t spinlock_default_acquire_irq_save(SpinLock *spinLock) {
+    return spinlock_lock(spinLock, __builtin_return_address(0));
+}
+
+void spinlock_default_release_irq_restore(SpinLock *spinLock, uint32_t interruptEnabled) {
+    if (lockStatEnabled) {
+        lockstat_released(&spinLock->stat);
+    }
+    spinlock_ticket_unlock(spinLock);
+    // locks taken with interrupts already disabled, like the run queue locks, leave them disabled
+    if (interruptEnabled) {
+        asm volatile("cpsie i");
+    }
+}
+
+void spinlock_default_acquire(SpinLock *spinLock) {
+    uint32_t interruptEnabled = spinlock_lock(spinLock, __builtin_return_address(0));
+    spinLock->interruptEnabled = interruptEnabled;
 }
 
 void spinlock_default_release(SpinLock *spinLock) {
-    atomic_set(&spinLock->lock, 0);
-    asm volatile("cpsie i");
-    asm volatile("SEV");
+    // read before the unlock, the next holder overwrites it
+    spinlock_default_release_irq_restore(spinLock, spinLock->interruptEnabled);
+}
+
+SpinLock *spinlock_create(SpinLock *spinLock) {
+    atomic_create(&spinLock->lock);
+    spinLock->interruptEnabled = 0;
+    spinLock->stat.name = nullptr;
+    spinLock->stat.id = 0;
+    spinLock->operations.acquire = (SpinLockAcquire) spinlock_default_acquire;
+    spinLock->operations.release = (SpinLockRelease) spinlock_default_release;
+    spinLock->operations.acquireIrqSave = (SpinLockAcquireIrqSave) spinlock_default_acquire_irq_save;
+    spinLock->operations.releaseIrqRestore = (SpinLockReleaseIrqRestore) spinlock_default_release_irq_restore;
+    return spinLock;
 }
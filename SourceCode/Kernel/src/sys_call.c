@@ -3,6 +3,7 @@
 //
 #include <raspi2/uart.h>
 #include "kernel/sys_call.h"
+#include "kernel/futex.h"
 #include "kernel/scheduler.h"
 #include "kernel/vfs.h"
 
@@ -55,3 +56,32 @@ uint32_t sys_rename(const char *oldname, const char *newname) { return 0; }
 uint32_t sys_mkdir(const char *pathname, uint32_t mode) { return 0; }
 
 uint32_t sys_rmdir(const char *pathname) { return 0; }
+
+uint32_t sys_sched_setscheduler(uint32_t pid, uint32_t policy, uint32_t priority) {
+    Thread *thread = cfsScheduler.operation.getCurrentThread(&cfsScheduler);
+    // there is no pid lookup yet, a thread can only change its own policy, 0 means the caller
+    if (thread == nullptr || (pid != 0 && pid != thread->pid)) {
+        return -1;
+    }
+    if (cfsScheduler.operation.setPolicy(&cfsScheduler, thread, policy, priority) != OK) {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * FUTEX_WAIT sleeps while *uaddr is val and returns 0 once woken, -1 if the value had changed already.
+ * FUTEX_WAKE wakes up to val waiters and returns how many it woke.
+ */
+uint32_t sys_futex(uint32_t *uaddr, uint32_t op, uint32_t val) {
+    if (((uint32_t) uaddr & 0b11) != 0) {
+        return -1;
+    }
+    if (op == FUTEX_WAIT) {
+        return futex_wait(uaddr, val) == OK ? 0 : -1;
+    }
+    if (op == FUTEX_WAKE) {
+        return futex_wake(uaddr, val);
+    }
+    return -1;
+}
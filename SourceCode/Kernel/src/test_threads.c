@@ -138,18 +138,19 @@ _Noreturn uint32_t *window_canvas2D(int args) {
 }
 
 void test_threads_init() {
-    Thread *windowDialogThread = thread_create("Welcome", (ThreadStartRoutine) &window_dialog, 0, 0, sysModeCPSR());
+    Thread *windowDialogThread = thread_create("Welcome", (ThreadStartRoutine) &window_dialog, 0, 0, SCHED_OTHER,
+                                               sysModeCPSR());
     windowDialogThread->cpuAffinity = cpu_number_to_mask(0);
     cfsScheduler.operation.addThread(&cfsScheduler, windowDialogThread, 1);
 
 
-    Thread *windowCanvas2DThread = thread_create("Canvas2D", (ThreadStartRoutine) &window_canvas2D, 0, 0,
+    Thread *windowCanvas2DThread = thread_create("Canvas2D", (ThreadStartRoutine) &window_canvas2D, 0, 0, SCHED_OTHER,
                                                  sysModeCPSR());
     windowCanvas2DThread->cpuAffinity = cpu_number_to_mask(0);
     cfsScheduler.operation.addThread(&cfsScheduler, windowCanvas2DThread, 1);
 
     Thread *windowFileSystemThread = thread_create("FileManager", (ThreadStartRoutine) &window_filesystem, 0, 0,
-                                                   sysModeCPSR());
+                                                   SCHED_OTHER, sysModeCPSR());
     windowFileSystemThread->cpuAffinity = cpu_number_to_mask(0);
     cfsScheduler.operation.addThread(&cfsScheduler, windowFileSystemThread, 1);
 
@@ -159,11 +160,12 @@ void test_threads_init() {
     LogInfo("TestAppSize: %d \n",pEntry->indexNode->fileSize);
     uint32_t *data = (uint32_t *) kernelHeap.operations.alloc(&kernelHeap, pEntry->indexNode->fileSize);
     vfs_kernel_read(&vfs, "/initrd/bin/TestApp", data, pEntry->indexNode->fileSize);
+    pEntry->operations.release(pEntry);
     elf_init(&elf, data);
     elf.operations.dump(&elf);
 
     uint32_t entry = (uint32_t) (elf.data + 32768);
-    Thread *elfThread = thread_create("PICElfTest", (ThreadStartRoutine) entry, 0, 0,
+    Thread *elfThread = thread_create("PICElfTest", (ThreadStartRoutine) entry, 0, 0, SCHED_OTHER,
                                       sysModeCPSR());
     elfThread->cpuAffinity = cpu_number_to_mask(0);
     cfsScheduler.operation.addThread(&cfsScheduler, elfThread, 1);
@@ -12,8 +12,10 @@
 #include "kernel/kobject.h"
 #include "kernel/stack.h"
 #include "kernel/kvector.h"
+#include "kernel/fpu.h"
 #include "kernel/log.h"
 #include "kernel/percpu.h"
+#include "kernel/sched_group.h"
 #include "kernel/vfs_dentry.h"
 #include "libc/stdlib.h"
 #include "arm/register.h"
@@ -29,8 +31,6 @@ extern Scheduler cfsScheduler;
 
 uint32_t pidMap[2048] = {0};
 
-void thread_set_ops(Thread *thread);
-
 uint32_t thread_alloc_pid() {
     for (uint32_t i = 0; i < 2048 / BITS_IN_UINT32; i++) {
         if (pidMap[i] != MAX_UINT_32) {
@@ -60,8 +60,22 @@ KernelStatus thread_default_resume(struct Thread *thread) {
     return OK;
 }
 
-KernelStatus thread_default_sleep(struct Thread *thread, uint32_t deadline) {
-    // TODO:
+/**
+ * sleeping threads sit on no queue, only their timer wakes them up
+ */
+KernelStatus thread_default_sleep(struct Thread *thread, uint32_t timeoutMs) {
+    if (thread != percpu_get(read_cpuid())->currentThread) {
+        LogError("[Thread]: only the current thread can sleep.\n");
+        return ERROR;
+    }
+    if (timeoutMs == 0) {
+        return cfsScheduler.operation.yield(&cfsScheduler);
+    }
+    thread->threadStatus = THREAD_SLEEPING;
+    KernelTimedWait wait;
+    kernel_timed_wait_arm(&wait, nullptr, nullptr, thread, timeoutMs);
+    cfsScheduler.operation.block(&cfsScheduler);
+    kernel_timed_wait_finish(&wait);
     return OK;
 }
 
@@ -70,16 +84,72 @@ KernelStatus thread_default_detach(struct Thread *thread) {
     return OK;
 }
 
-KernelStatus thread_default_join(struct Thread *thread, int *returnCode, uint32_t deadline) {
-    // TODO:
+/**
+ * wait for thread to exit, its return code is stored to returnCode unless that is nullptr
+ */
+KernelStatus thread_default_join(struct Thread *thread, int *returnCode, uint32_t timeoutMs) {
+    Thread *currentThread = percpu_get(read_cpuid())->currentThread;
+    if (thread == currentThread) {
+        LogError("[Thread]: thread '%s' can not join itself.\n", thread->name);
+        return ERROR;
+    }
+    thread->joinLock.operations.acquire(&thread->joinLock);
+    if (thread->threadStatus != THREAD_DEATH) {
+        if (timeoutMs == 0) {
+            thread->joinLock.operations.release(&thread->joinLock);
+            return TIMEOUT;
+        }
+        thread->joinQueue.operations.enqueue(&thread->joinQueue, &currentThread->threadReadyQueue);
+        currentThread->threadStatus = THREAD_BLOCKED;
+        thread->joinLock.operations.release(&thread->joinLock);
+
+        KernelTimedWait wait;
+        kernel_timed_wait_arm(&wait, &thread->joinLock, &thread->joinQueue, currentThread, timeoutMs);
+        cfsScheduler.operation.block(&cfsScheduler);
+        if (kernel_timed_wait_finish(&wait) == TIMEOUT) {
+            return TIMEOUT;
+        }
+    } else {
+        thread->joinLock.operations.release(&thread->joinLock);
+    }
+    if (returnCode != nullptr) {
+        *returnCode = (int) thread->returnCode;
+    }
     return OK;
 }
 
+/**
+ * the thread exits itself, or one that is on no run queue. the joiners are woken up,
+ * a current thread is switched out for good since a dead thread is never runnable again
+ */
 KernelStatus thread_default_exit(struct Thread *thread, uint32_t returnCode) {
-    // TODO:
+    thread->joinLock.operations.acquire(&thread->joinLock);
+    thread->returnCode = returnCode;
+    thread->threadStatus = THREAD_DEATH;
+    while (thread->joinQueue.size != 0) {
+        KQueueNode *node = thread->joinQueue.operations.dequeue(&thread->joinQueue);
+        cfsScheduler.operation.wakeup(&cfsScheduler, getNode(node, Thread, threadReadyQueue));
+    }
+    thread->joinLock.operations.release(&thread->joinLock);
+
+    if (thread == percpu_get(read_cpuid())->currentThread) {
+        cfsScheduler.operation.block(&cfsScheduler);
+    }
     return OK;
 }
 
+uint64_t thread_default_get_runtime_ns(struct Thread *thread) {
+    uint64_t runtimeNs = thread->runtimeNs;
+    if (thread->currCpu != INVALID_CPU) {
+        // the running thread is only charged on switch, add the part of its slice used so far
+        PerCpu *perCpu = percpu_get(thread->currCpu);
+        if (perCpu->currentThread == thread) {
+            runtimeNs += scheduler_counter_to_ns(read_cntvct() - perCpu->sliceStart);
+        }
+    }
+    return runtimeNs;
+}
+
 KernelStatus thread_default_kill(struct Thread *thread) {
     KernelStatus freeStatus = OK;
     // Free stack
@@ -96,6 +166,10 @@ KernelStatus thread_default_kill(struct Thread *thread) {
         LogError("[kVector]: kVector free failed.\n");
         return freeStatus;
     }
+    fpu_release_thread(thread);
+    if (thread->schedGroup != nullptr) {
+        thread->schedGroup->operations.detach(thread->schedGroup, thread);
+    }
     // Free thread structure
     freeStatus = kernelObjectSlab.operations.free(&kernelObjectSlab, KERNEL_OBJECT_THREAD, thread);
     if (freeStatus != OK) {
@@ -126,7 +200,8 @@ uint32_t filestruct_default_openfile(FilesStruct *filesStruct, DirectoryEntry *d
 
 Thread *thread_default_copy(Thread *thread, CloneFlags cloneFlags, uint32_t heapStart) {
     LogInfo("[Thread]: Copy Start.\n");
-    Thread *p = thread_create(thread->name, thread->entry, thread->arg, thread->priority, sysModeCPSR());
+    Thread *p = thread_create(thread->name, thread->entry, thread->arg, thread->priority, thread->schedPolicy,
+                              sysModeCPSR());
     LogInfo("[Thread]: Clone VMM: '%s'.\n", p->name);
     if (p == nullptr) {
         LogError("[Thread]: copy failed: p == nullptr.\n");
@@ -284,7 +359,8 @@ KernelStatus thread_default_execute(struct Thread *thread, struct Elf *elf) {
     // 10. reschedule
 }
 
-Thread *thread_create(const char *name, ThreadStartRoutine entry, void *arg, uint32_t priority, RegisterCPSR cpsr) {
+Thread *thread_create(const char *name, ThreadStartRoutine entry, void *arg, uint32_t priority, SchedPolicy schedPolicy,
+                      RegisterCPSR cpsr) {
     Thread *thread = (Thread *)kernelObjectSlab.operations.alloc(&kernelObjectSlab, KERNEL_OBJECT_THREAD);
     if (thread != nullptr) {
         thread->magic = THREAD_MAGIC;
@@ -308,8 +384,12 @@ Thread *thread_create(const char *name, ThreadStartRoutine entry, void *arg, uin
         }
 
         thread->priority = priority;
+        thread->schedPolicy = schedPolicy;
+        thread->priorityBoosted = false;
         thread->currCpu = INVALID_CPU;
         thread->lastCpu = INVALID_CPU;
+        thread->fpuUsed = false;
+        thread->fpuCpu = INVALID_CPU;
         thread->entry = (ThreadStartRoutine) entry;
 
         thread->runtimeNs = 0;
@@ -317,6 +397,12 @@ Thread *thread_create(const char *name, ThreadStartRoutine entry, void *arg, uin
         thread->startTime = kernelTimerManager.operation.getSysRuntimeMs(&kernelTimerManager);
 
         thread->cpuAffinity = CPU_MASK_ALL;
+        thread->schedGroup = nullptr;
+        thread->futexKey = 0;
+        thread->returnCode = 0;
+        spinlock_create(&thread->joinLock);
+        spinlock_create(&thread->wakeupLock);
+        kqueue_create(&thread->joinQueue);
 
         thread->parentThread = nullptr;
         thread->pid = thread_alloc_pid();
@@ -335,6 +421,10 @@ Thread *thread_create(const char *name, ThreadStartRoutine entry, void *arg, uin
         thread->rbNode.right = nullptr;
         thread->rbNode.color = NODE_RED;
 
+        thread->rtNode.prev = nullptr;
+        thread->rtNode.next = nullptr;
+        thread->rtSliceUsedNs = 0;
+
 //        thread_init_kobject(thread);
 
         LogInfo("[Thread]: thread '%s' created.\n", thread->name);
@@ -355,6 +445,7 @@ void thread_set_ops(Thread *thread) {
     thread->operations.copy = thread_default_copy;
     thread->operations.execute = (ThreadOperationExecute) thread_default_execute;
     thread->operations.isKernelThread = (ThreadOperationIsKernelThread) thread_default_is_kernel_thread;
+    thread->operations.getRuntimeNs = (ThreadOperationGetRuntimeNs) thread_default_get_runtime_ns;
 }
 
 _Noreturn uint32_t *idle_thread_routine(int arg) {
@@ -365,7 +456,7 @@ _Noreturn uint32_t *idle_thread_routine(int arg) {
 
 Thread *thread_create_idle_thread(uint32_t cpuNum) {
     Thread *idleThread = thread_create("IDLE", (ThreadStartRoutine) idle_thread_routine, (void *) cpuNum,
-                                       IDLE_PRIORITY, sysModeCPSR());
+                                       IDLE_PRIORITY, SCHED_OTHER, sysModeCPSR());
     idleThread->cpuAffinity = cpuNum;
     // 2. idle thread
     idleThread->pid = 0;
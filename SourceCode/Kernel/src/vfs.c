@@ -8,6 +8,7 @@
 #include "kernel/kheap.h"
 #include "kernel/log.h"
 #include "kernel/percpu.h"
+#include "kernel/rcu.h"
 #include "kernel/vfs_dentry.h"
 #include "kernel/vfs_inode.h"
 #include "kernel/vfs_super_block.h"
@@ -72,6 +73,8 @@ uint32_t vfs_default_close(struct VFS *vfs, uint32_t fd) {
             &currThread->filesStruct.fileDescriptorTable, fd);
     FileDescriptor *pDescriptor = getNode(pNode, FileDescriptor, node);
     pDescriptor->directoryEntry->indexNode->state = INDEX_NODE_STATE_CLOSED;
+    // the descriptor held the lookup's reference since open
+    pDescriptor->directoryEntry->operations.release(pDescriptor->directoryEntry);
 
     // TODO
     //    kvector_remove_index(&currThread->filesStruct.fileDescriptorTable, fd);
@@ -106,16 +109,20 @@ uint32_t vfs_kernel_read(VFS *vfs, const char *name, char *buf, uint32_t count)
         LogError("[VFS]: file '%s' not found.\n", name);
         return 0;
     }
+    uint32_t readCount = 0;
     switch (directoryEntry->superBlock->type) {
         case FILESYSTEM_EXT2: {
             Ext2FileSystem *ext2FileSystem = getNode(directoryEntry->superBlock, Ext2FileSystem, superblock);
             Ext2IndexNode *ext2Node = (Ext2IndexNode *) directoryEntry->indexNode->indexNodePrivate;
-            return ext2FileSystem->operations.read(ext2FileSystem, ext2Node, buf, count);
+            readCount = ext2FileSystem->operations.read(ext2FileSystem, ext2Node, buf, count);
+            break;
         }
         default:
             LogError("[VFS]: unsupported file system.\n");
-            return 0;
+            break;
     }
+    directoryEntry->operations.release(directoryEntry);
+    return readCount;
 }
 
 char peek(char *src, uint32_t index, uint32_t offset) { return src[index + offset]; }
@@ -134,6 +141,9 @@ DirectoryEntry *vfs_default_lookup(VFS *vfs, const char *name) {
     uint32_t index = 0;
     uint32_t length = strlen(name);
 
+    // the walk takes no lock, entries deleted meanwhile are only freed after rcu_read_unlock.
+    // the result is pinned before unlocking, the caller gives it back with release
+    rcu_read_lock();
     DirectoryEntry *currentDirectory = vfs->fileSystems->rootDirectoryEntry;
 
     while (index <= length) {
@@ -198,23 +208,9 @@ DirectoryEntry *vfs_default_lookup(VFS *vfs, const char *name) {
                     }
                     path[index - bufStart - 1] = '\0';
                     LogWarn("[VFS]: lookup %s \n", path);
-                    ListNode *tmpNode = &(currentDirectory->children->list);
-                    bool isFound = false;
-                    while (tmpNode != nullptr) {
-                        DirectoryEntry *tmpDirectoryEntry = getNode(tmpNode, DirectoryEntry, list);
-                        LogInfo("[VFS]: lookup %s \n", tmpDirectoryEntry->fileName);
-                        if (strcmp(tmpDirectoryEntry->fileName, path)) {
-                            currentDirectory = tmpDirectoryEntry;
-                            isFound = true;
-                            break;
-                        }
-                        if (tmpNode->prev != nullptr) {
-                            tmpNode = tmpNode->prev;
-                        } else {
-                            break;
-                        }
-                    }
-                    if (!isFound) {
+                    DirectoryEntry *child = vfs_directory_entry_find_child(currentDirectory, path);
+                    if (child == nullptr) {
+                        rcu_read_unlock();
                         // not found
                         char path[index];
                         for (uint32_t i = 0; i < index; i++) {
@@ -224,6 +220,7 @@ DirectoryEntry *vfs_default_lookup(VFS *vfs, const char *name) {
                         LogError("[VFS]: lookup %s not found.\n", path);
                         return nullptr;
                     }
+                    currentDirectory = child;
                 } else if (index == length) {
                     lookupState = PATH_LOOKUP_SLASH;// name/
                     char path[index - bufStart];
@@ -232,23 +229,9 @@ DirectoryEntry *vfs_default_lookup(VFS *vfs, const char *name) {
                     }
                     path[index - bufStart] = '\0';
                     LogWarn("[VFS]: lookup %s \n", path);
-                    ListNode *tmpNode = &(currentDirectory->children->list);
-                    bool isFound = false;
-                    while (tmpNode != nullptr) {
-                        DirectoryEntry *tmpDirectoryEntry = getNode(tmpNode, DirectoryEntry, list);
-                        LogInfo("[VFS]: lookup %s \n", tmpDirectoryEntry->fileName);
-                        if (strcmp(tmpDirectoryEntry->fileName, path)) {
-                            currentDirectory = tmpDirectoryEntry;
-                            isFound = true;
-                            break;
-                        }
-                        if (tmpNode->prev != nullptr) {
-                            tmpNode = tmpNode->prev;
-                        } else {
-                            break;
-                        }
-                    }
-                    if (!isFound) {
+                    DirectoryEntry *child = vfs_directory_entry_find_child(currentDirectory, path);
+                    if (child == nullptr) {
+                        rcu_read_unlock();
                         // not found
                         char path[index];
                         for (uint32_t i = 0; i < index; i++) {
@@ -258,6 +241,7 @@ DirectoryEntry *vfs_default_lookup(VFS *vfs, const char *name) {
                         LogError("[VFS]: lookup %s not found.\n", path);
                         return nullptr;
                     }
+                    currentDirectory = child;
                 } else {
                     // illegal path
                 }
@@ -265,6 +249,8 @@ DirectoryEntry *vfs_default_lookup(VFS *vfs, const char *name) {
             }
         }
     }
+    atomic_inc(&currentDirectory->refCount);
+    rcu_read_unlock();
 
     return currentDirectory;
 }
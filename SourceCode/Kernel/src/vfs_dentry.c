@@ -3,6 +3,7 @@
 //
 
 #include "kernel/log.h"
+#include "kernel/rcu.h"
 #include "kernel/vfs_dentry.h"
 #include "kernel/vfs_inode.h"
 #include "kernel/vfs_super_block.h"
@@ -17,9 +18,45 @@ char *vfs_directory_entry_default_get_name(DirectoryEntry *directoryEntry) {
     return directoryEntry->fileName;
 }
 
+static void vfs_directory_entry_put(DirectoryEntry *directory) {
+    if (atomic_dec(&directory->refCount) == 0) {
+        directory->superBlock->operations.destroyDirectoryEntry(directory->superBlock, directory);
+    }
+}
+
+static void vfs_directory_entry_free_rcu(RcuHead *head) {
+    // no lookup can pin it anymore, the last pinned one destroys it in release
+    vfs_directory_entry_put(getNode(head, DirectoryEntry, rcuHead));
+}
+
+/**
+ * unlink the entry from its siblings, it is freed once no lookup can be standing on it anymore
+ */
+static void vfs_directory_entry_unlink(DirectoryEntry *directory) {
+    DirectoryEntry *parent = directory->parent;
+    if (parent == nullptr) {
+        return;
+    }
+    parent->parallelLock.operations.acquire(&parent->parallelLock);
+    ListNode *prev = directory->list.prev;
+    ListNode *next = directory->list.next;
+    if (parent->children == directory) {
+        rcu_assign_pointer(parent->children, prev != nullptr ? getNode(prev, DirectoryEntry, list) : nullptr);
+    }
+    // the entry keeps its own prev, a reader standing on it still walks on to the remaining siblings
+    if (next != nullptr) {
+        rcu_assign_pointer(next->prev, prev);
+    }
+    if (prev != nullptr) {
+        prev->next = next;
+    }
+    parent->parallelLock.operations.release(&parent->parallelLock);
+}
+
 KernelStatus vfs_directory_entry_default_delete(DirectoryEntry *directory) {
     if (directory->indexNode->type == INDEX_NODE_FILE) {
-        directory->superBlock->operations.destroyDirectoryEntry(directory->superBlock, directory);
+        vfs_directory_entry_unlink(directory);
+        call_rcu(&directory->rcuHead, vfs_directory_entry_free_rcu);
     } else {
     }
     // TODO
@@ -27,7 +64,7 @@ KernelStatus vfs_directory_entry_default_delete(DirectoryEntry *directory) {
 }
 
 KernelStatus vfs_directory_entry_default_release(DirectoryEntry *directory) {
-    // TODO
+    vfs_directory_entry_put(directory);
     return OK;
 }
 
@@ -35,8 +72,25 @@ KernelStatus vfs_directory_entry_default_init(DirectoryEntry *directory, Directo
     directory->parent = parent;
     directory->indexNode = inode;
     if (parent != nullptr) {
-        parent->children = directory;
+        // publishes the entry to lookups, its name and sibling link are set before
+        rcu_assign_pointer(parent->children, directory);
     }
     LogInfo("[VFS]: dentry '%s' init\n",directory->fileName);
     return OK;
 }
+
+DirectoryEntry *vfs_directory_entry_find_child(DirectoryEntry *directory, const char *name) {
+    DirectoryEntry *child = rcu_dereference(directory->children);
+    if (child == nullptr) {
+        return nullptr;
+    }
+    ListNode *node = &child->list;
+    while (node != nullptr) {
+        DirectoryEntry *entry = getNode(node, DirectoryEntry, list);
+        if (strcmp(entry->fileName, (char *) name)) {
+            return entry;
+        }
+        node = rcu_dereference(node->prev);
+    }
+    return nullptr;
+}
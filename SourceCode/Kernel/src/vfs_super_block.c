@@ -35,8 +35,9 @@ DirectoryEntry *vfs_super_block_default_create_directory_entry(struct SuperBlock
     directoryEntry->children = nullptr;
     SpinLock parallelLock = SpinLockCreate();
     directoryEntry->parallelLock = parallelLock;
+    // the tree's own reference, dropped once the entry is deleted
     Atomic atomic = {
-            .counter = 0,
+            .counter = 1,
     };
     directoryEntry->refCount = atomic;
     directoryEntry->list.next = nullptr;
@@ -70,8 +71,9 @@ IndexNode *vfs_super_block_default_create_index_node(struct SuperBlock *superBlo
     Mutex mutex = MutexCreate();
     indexNode->mutex = mutex;
 
+    // the tree's own reference, dropped once the entry is deleted
     Atomic atomic = {
-            .counter = 0,
+            .counter = 1,
     };
     indexNode->linkCount = atomic;
     indexNode->readCount = atomic;
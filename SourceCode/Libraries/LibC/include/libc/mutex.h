@@ -0,0 +1,35 @@
+//
+// Created by XingfengYang on 2021/1/28.
+//
+
+#ifndef __LIBC_MUTEX_H__
+#define __LIBC_MUTEX_H__
+
+#include "libc/stdbool.h"
+#include "libc/stdint.h"
+
+#define USER_MUTEX_UNLOCKED 0
+#define USER_MUTEX_LOCKED 1
+// locked, and somebody may sleep in the kernel waiting for it
+#define USER_MUTEX_CONTENDED 2
+
+#define UserMutexCreate() \
+    { .state = USER_MUTEX_UNLOCKED }
+
+/**
+ * a mutex for user threads that only enters the kernel when it is contended.
+ * lock and unlock without contention are a single ldrex/strex each, sleeping and waking go through the futex syscall.
+ */
+typedef struct UserMutex {
+    volatile uint32_t state;
+} UserMutex;
+
+UserMutex *user_mutex_init(UserMutex *mutex);
+
+void user_mutex_lock(UserMutex *mutex);
+
+bool user_mutex_trylock(UserMutex *mutex);
+
+void user_mutex_unlock(UserMutex *mutex);
+
+#endif//__LIBC_MUTEX_H__
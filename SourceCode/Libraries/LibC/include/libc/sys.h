@@ -136,6 +136,15 @@
 #define __SYSCALL_rename 14
 #define __SYSCALL_mkdir 15
 #define __SYSCALL_rmdir 16
+#define __SYSCALL_sched_setscheduler 17
+#define __SYSCALL_futex 18
+
+#define SCHED_OTHER 0
+#define SCHED_FIFO 1
+#define SCHED_RR 2
+
+#define FUTEX_WAIT 0
+#define FUTEX_WAKE 1
 
 int restart_syscall();
 
@@ -170,4 +179,8 @@ int rename(const char *oldname, const char *newname);
 int mkdir(const char *pathname, uint32_t mode);
 
 int rmdir(const char *pathname);
+
+int sched_setscheduler(uint32_t pid, uint32_t policy, uint32_t priority);
+
+int futex(uint32_t *uaddr, uint32_t op, uint32_t val);
 #endif// __LIBRARY_LIBC_H__
@@ -0,0 +1,70 @@
+//
+// Created by XingfengYang on 2021/1/28.
+//
+#include "libc/mutex.h"
+#include "libc/sys.h"
+
+/**
+ * returns the old value, the state is only replaced if it was expected
+ */
+static inline uint32_t user_mutex_cmpxchg(volatile uint32_t *state, uint32_t expected, uint32_t desired) {
+    uint32_t old;
+    uint32_t failed;
+    do {
+        __asm__ volatile("ldrex %0, [%2]\n"
+                         "mov %1, #0\n"
+                         "teq %0, %3\n"
+                         "strexeq %1, %4, [%2]\n"
+                         : "=&r"(old), "=&r"(failed)
+                         : "r"(state), "r"(expected), "r"(desired)
+                         : "cc", "memory");
+    } while (failed);
+    __asm__ volatile("dmb" ::: "memory");
+    return old;
+}
+
+static inline uint32_t user_mutex_xchg(volatile uint32_t *state, uint32_t desired) {
+    uint32_t old;
+    uint32_t failed;
+    __asm__ volatile("dmb" ::: "memory");
+    do {
+        __asm__ volatile("ldrex %0, [%2]\n"
+                         "strex %1, %3, [%2]\n"
+                         : "=&r"(old), "=&r"(failed)
+                         : "r"(state), "r"(desired)
+                         : "memory");
+    } while (failed);
+    __asm__ volatile("dmb" ::: "memory");
+    return old;
+}
+
+UserMutex *user_mutex_init(UserMutex *mutex) {
+    mutex->state = USER_MUTEX_UNLOCKED;
+    return mutex;
+}
+
+bool user_mutex_trylock(UserMutex *mutex) {
+    return user_mutex_cmpxchg(&mutex->state, USER_MUTEX_UNLOCKED, USER_MUTEX_LOCKED) == USER_MUTEX_UNLOCKED;
+}
+
+void user_mutex_lock(UserMutex *mutex) {
+    uint32_t state = user_mutex_cmpxchg(&mutex->state, USER_MUTEX_UNLOCKED, USER_MUTEX_LOCKED);
+    if (state == USER_MUTEX_UNLOCKED) {
+        return;
+    }
+    // from here on the mutex is marked contended, so whoever unlocks it knows to wake us.
+    // the kernel puts us to sleep only if the state is still contended when it takes the futex bucket lock
+    if (state != USER_MUTEX_CONTENDED) {
+        state = user_mutex_xchg(&mutex->state, USER_MUTEX_CONTENDED);
+    }
+    while (state != USER_MUTEX_UNLOCKED) {
+        futex((uint32_t *) &mutex->state, FUTEX_WAIT, USER_MUTEX_CONTENDED);
+        state = user_mutex_xchg(&mutex->state, USER_MUTEX_CONTENDED);
+    }
+}
+
+void user_mutex_unlock(UserMutex *mutex) {
+    if (user_mutex_xchg(&mutex->state, USER_MUTEX_UNLOCKED) == USER_MUTEX_CONTENDED) {
+        futex((uint32_t *) &mutex->state, FUTEX_WAKE, 1);
+    }
+}
@@ -37,3 +37,7 @@ _syscall2(int, rename, const char *, oldname, const char *, newname);
 _syscall2(int, mkdir, const char *, pathname, uint32_t, mode);
 
 _syscall1(int, rmdir, const char *, pathname);
+
+_syscall3(int, sched_setscheduler, uint32_t, pid, uint32_t, policy, uint32_t, priority);
+
+_syscall3(int, futex, uint32_t *, uaddr, uint32_t, op, uint32_t, val);
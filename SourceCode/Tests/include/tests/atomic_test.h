@@ -1,7 +1,16 @@
 //
 // Created by XingfengYang on 2020/7/21.
 //
+
+#ifndef __KERNEL_ATOMIC_TEST_H__
+#define __KERNEL_ATOMIC_TEST_H__
+
+#include "arm/register.h"
 #include "kernel/atomic.h"
+#include "tests/tests_lib.h"
+
+#define ATOMIC_STRESS_ITERATIONS 100000
+#define ATOMIC_MESSAGES 10000
 
 Atomic atomic;
 
@@ -88,3 +97,137 @@ uint32_t should_atomic_sub() {
     val = atomic_get(&atomic6);
     ASSERT_EQ(val, 7);
 }
+
+Atomic atomic7;
+
+void should_atomic_cmpxchg() {
+    atomic_create(&atomic7);
+    atomic_set(&atomic7, 12);
+    ASSERT_EQ(atomic_cmpxchg(&atomic7, 12, 13), 12);
+    ASSERT_EQ(atomic_get(&atomic7), 13);
+    // a stale expected value stores nothing
+    ASSERT_EQ(atomic_cmpxchg(&atomic7, 12, 14), 13);
+    ASSERT_EQ(atomic_get(&atomic7), 13);
+    ASSERT_EQ(atomic_cmpxchg_acquire(&atomic7, 13, 15), 13);
+    ASSERT_EQ(atomic_cmpxchg_release(&atomic7, 15, 16), 15);
+    ASSERT_EQ(atomic_cmpxchg_relaxed(&atomic7, 16, 17), 16);
+    ASSERT_EQ(atomic_get_acquire(&atomic7), 17);
+}
+
+Atomic atomic8;
+
+void should_atomic_fetch_ops() {
+    atomic_create(&atomic8);
+    ASSERT_EQ(atomic_fetch_add(&atomic8, 5), 0);
+    ASSERT_EQ(atomic_fetch_sub_release(&atomic8, 2), 5);
+    ASSERT_EQ(atomic_fetch_or_acquire(&atomic8, 0xF0), 3);
+    ASSERT_EQ(atomic_fetch_and_relaxed(&atomic8, 0x30), 0xF3);
+    ASSERT_EQ(atomic_get(&atomic8), 0x30);
+    ASSERT_EQ(atomic_xchg_acquire(&atomic8, 7), 0x30);
+    atomic_set_release(&atomic8, 9);
+    ASSERT_EQ(atomic_xchg_relaxed(&atomic8, 1), 9);
+}
+
+Atomic64 atomic64;
+
+void should_atomic64_carry_between_words() {
+    atomic64_create(&atomic64);
+    ASSERT_EQ(atomic64_get(&atomic64), 0);
+    atomic64_set(&atomic64, 0xFFFFFFFFull);
+    ASSERT_EQ(atomic64_inc(&atomic64), 0x100000000ull);
+    ASSERT_EQ(atomic64_dec(&atomic64), 0xFFFFFFFFull);
+    ASSERT_EQ(atomic64_fetch_add(&atomic64, 0x100000001ull), 0xFFFFFFFFull);
+    ASSERT_EQ(atomic64_get(&atomic64), 0x200000000ull);
+    // only the high word differs from the counter, nothing is stored
+    ASSERT_EQ(atomic64_cmpxchg(&atomic64, 0x100000000ull, 1), 0x200000000ull);
+    ASSERT_EQ(atomic64_cmpxchg(&atomic64, 0x200000000ull, 1), 0x200000000ull);
+    ASSERT_EQ(atomic64_xchg(&atomic64, 0x300000003ull), 1);
+    ASSERT_EQ(atomic64_sub(&atomic64, 4), 0x2FFFFFFFFull);
+}
+
+Atomic atomicStressCounter;
+Atomic atomicStressCmpxchgCounter;
+Atomic atomicStressMask;
+Atomic64 atomicStressCounter64;
+
+void atomic_test_stress_work() {
+    CpuNum cpuId = read_cpuid();
+    for (uint32_t i = 0; i < ATOMIC_STRESS_ITERATIONS; i++) {
+        atomic_fetch_add_relaxed(&atomicStressCounter, 1);
+        atomic64_inc(&atomicStressCounter64);
+        uint32_t counter = atomic_get(&atomicStressCmpxchgCounter);
+        uint32_t found;
+        while ((found = atomic_cmpxchg(&atomicStressCmpxchgCounter, counter, counter + 1)) != counter) {
+            counter = found;
+        }
+    }
+    atomic_fetch_or(&atomicStressMask, cpu_number_to_mask(cpuId));
+}
+
+/**
+ * every online cpu counts on the same atomics, the 64 bit counter starts just below a carry into the high word
+ */
+void should_atomic_stress() {
+    uint32_t onlineCpus = test_start_secondary_cpus();
+    atomic_create(&atomicStressCounter);
+    atomic_create(&atomicStressCmpxchgCounter);
+    atomic_create(&atomicStressMask);
+    atomic64_set(&atomicStressCounter64, 0xFFFFFFFFull - ATOMIC_STRESS_ITERATIONS);
+    for (CpuNum cpuId = 0; cpuId < SMP_MAX_CPUS; cpuId++) {
+        testWork[cpuId] = cpuId < onlineCpus ? atomic_test_stress_work : nullptr;
+    }
+    uint64_t start = read_cntvct();
+    test_run_round();
+    uint64_t elapsedNs = scheduler_counter_to_ns(read_cntvct() - start);
+    printf("[Atomic Stress]: %d cpus, %d ns per iteration\n", onlineCpus,
+           (uint32_t) (elapsedNs / (ATOMIC_STRESS_ITERATIONS * onlineCpus)));
+
+    ASSERT_EQ(atomic_get(&atomicStressCounter), ATOMIC_STRESS_ITERATIONS * onlineCpus);
+    ASSERT_EQ(atomic_get(&atomicStressCmpxchgCounter), ATOMIC_STRESS_ITERATIONS * onlineCpus);
+    ASSERT_EQ(atomic64_get(&atomicStressCounter64),
+              0xFFFFFFFFull - ATOMIC_STRESS_ITERATIONS + (uint64_t) ATOMIC_STRESS_ITERATIONS * onlineCpus);
+    ASSERT_EQ(atomic_get(&atomicStressMask), (1u << onlineCpus) - 1);
+}
+
+Atomic atomicMessageSequence;
+volatile uint32_t atomicMessagePayload[2];
+volatile uint32_t atomicMessageViolations = 0;
+
+void atomic_test_send_work() {
+    for (uint32_t i = 1; i <= ATOMIC_MESSAGES; i++) {
+        while (atomic_get_acquire(&atomicMessageSequence) != 2 * i - 2) {
+        }
+        atomicMessagePayload[0] = i;
+        atomicMessagePayload[1] = ~i;
+        atomic_set_release(&atomicMessageSequence, 2 * i - 1);
+    }
+}
+
+void atomic_test_receive_work() {
+    for (uint32_t i = 1; i <= ATOMIC_MESSAGES; i++) {
+        while (atomic_get_acquire(&atomicMessageSequence) != 2 * i - 1) {
+        }
+        // the release store made the payload visible before the sequence, the acquire load keeps these reads after it
+        if (atomicMessagePayload[0] != i || atomicMessagePayload[1] != ~i) {
+            atomicMessageViolations++;
+        }
+        atomic_set_release(&atomicMessageSequence, 2 * i);
+    }
+}
+
+void should_atomic_pass_messages() {
+    uint32_t onlineCpus = test_start_secondary_cpus();
+    if (onlineCpus < 2) {
+        printf("[Atomic Message]: needs a second cpu, skipped\n");
+        return;
+    }
+    atomic_create(&atomicMessageSequence);
+    atomicMessageViolations = 0;
+    testWork[0] = atomic_test_receive_work;
+    testWork[1] = atomic_test_send_work;
+    test_run_round();
+    ASSERT_EQ(atomicMessageViolations, 0);
+    ASSERT_EQ(atomic_get(&atomicMessageSequence), 2 * ATOMIC_MESSAGES);
+}
+
+#endif//__KERNEL_ATOMIC_TEST_H__
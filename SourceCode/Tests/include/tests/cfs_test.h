@@ -1,3 +1,661 @@
 //
 // Created by XingfengYang on 2020/7/23.
-//
\ No newline at end of file
+//
+
+#ifndef __KERNEL_CFS_TEST_H__
+#define __KERNEL_CFS_TEST_H__
+
+#include "arm/register.h"
+#include "raspi2/synestia_os_hal.h"
+#include "kernel/percpu.h"
+#include "kernel/rbtree.h"
+#include "kernel/scheduler.h"
+#include "kernel/thread.h"
+#include "tests/tests_lib.h"
+
+#define CFS_BENCHMARK_ROUNDS 16
+#define CFS_SCALING_THREADS 4
+#define CFS_SCALING_SWITCHES 20000
+#define CFS_AFFINITY_WAKEUPS 64
+#define CFS_AFFINITY_WORKING_SET (16 * 1024)
+#define CFS_AFFINITY_STRIDE 32
+#define CFS_AFFINITY_PASSES 4
+#define CFS_WAKEUP_RACE_ROUNDS 1000
+
+RBTree cfsTestTree;
+uint32_t cfsTestSeed = 0x12345678;
+
+uint32_t cfs_test_random() {
+    cfsTestSeed = cfsTestSeed * 1103515245 + 12345;
+    return (cfsTestSeed >> 16) & 0x7FFF;
+}
+
+/**
+ * return the black height of the subtree, or -1 if it breaks any red-black property
+ */
+int32_t cfs_test_check_rbtree(RBNode *node, RBNode *parent) {
+    if (node == nullptr) {
+        return 1;
+    }
+    if (node->parent != parent) {
+        return -1;
+    }
+    if (node->color == NODE_RED) {
+        if ((node->left != nullptr && node->left->color == NODE_RED) ||
+            (node->right != nullptr && node->right->color == NODE_RED)) {
+            return -1;
+        }
+    }
+    Thread *thread = getNode(node, Thread, rbNode);
+    if (node->left != nullptr &&
+        getNode(node->left, Thread, rbNode)->runtimeVirtualNs > thread->runtimeVirtualNs) {
+        return -1;
+    }
+    if (node->right != nullptr &&
+        getNode(node->right, Thread, rbNode)->runtimeVirtualNs < thread->runtimeVirtualNs) {
+        return -1;
+    }
+    int32_t leftHeight = cfs_test_check_rbtree(node->left, node);
+    int32_t rightHeight = cfs_test_check_rbtree(node->right, node);
+    if (leftHeight < 0 || rightHeight < 0 || leftHeight != rightHeight) {
+        return -1;
+    }
+    return leftHeight + (node->color == NODE_BLACK ? 1 : 0);
+}
+
+void cfs_test_fill_tree(uint32_t count) {
+    rb_tree_init(&cfsTestTree);
+    for (uint32_t i = 0; i < count; i++) {
+        testThreads[i].runtimeVirtualNs = cfs_test_random();
+        cfsTestTree.operations.insert(&cfsTestTree, &testThreads[i].rbNode);
+    }
+}
+
+void should_rbtree_insert() {
+    cfs_test_fill_tree(TEST_THREAD_NUM);
+
+    ASSERT_EQ(cfsTestTree.size, TEST_THREAD_NUM);
+    ASSERT_EQ(cfsTestTree.root->color, NODE_BLACK);
+    ASSERT_TRUE(cfs_test_check_rbtree(cfsTestTree.root, nullptr) > 0);
+}
+
+void should_rbtree_get_min() {
+    cfs_test_fill_tree(TEST_THREAD_NUM);
+
+    uint64_t min = testThreads[0].runtimeVirtualNs;
+    for (uint32_t i = 1; i < TEST_THREAD_NUM; i++) {
+        if (testThreads[i].runtimeVirtualNs < min) {
+            min = testThreads[i].runtimeVirtualNs;
+        }
+    }
+    RBNode *node = cfsTestTree.operations.getMin(&cfsTestTree);
+    ASSERT_EQ(getNode(node, Thread, rbNode)->runtimeVirtualNs, min);
+}
+
+void should_rbtree_remove() {
+    cfs_test_fill_tree(TEST_THREAD_NUM);
+
+    // remove every other thread, from the middle of the tree
+    for (uint32_t i = 0; i < TEST_THREAD_NUM; i += 2) {
+        cfsTestTree.operations.remove(&cfsTestTree, &testThreads[i].rbNode);
+    }
+    ASSERT_EQ(cfsTestTree.size, TEST_THREAD_NUM / 2);
+    ASSERT_TRUE(cfs_test_check_rbtree(cfsTestTree.root, nullptr) > 0);
+
+    // then drain it in order through the cached leftmost node
+    uint64_t last = 0;
+    bool ordered = true;
+    RBNode *node = cfsTestTree.operations.getMin(&cfsTestTree);
+    while (node != nullptr) {
+        Thread *thread = getNode(node, Thread, rbNode);
+        if (thread->runtimeVirtualNs < last) {
+            ordered = false;
+        }
+        last = thread->runtimeVirtualNs;
+        cfsTestTree.operations.remove(&cfsTestTree, node);
+        node = cfsTestTree.operations.getMin(&cfsTestTree);
+    }
+    ASSERT_TRUE(ordered);
+    ASSERT_EQ(cfsTestTree.size, 0);
+    ASSERT_EQ(cfsTestTree.root, nullptr);
+}
+
+/**
+ * run queue micro benchmark, simulate what switchNext does on every tick:
+ * pick the min thread, remove it, charge it some runtime and insert it back.
+ */
+void should_cfs_run_queue_benchmark() {
+    for (uint32_t threads = 4; threads <= TEST_THREAD_NUM; threads *= 4) {
+        cfs_test_fill_tree(threads);
+
+        uint32_t operations = threads * CFS_BENCHMARK_ROUNDS;
+        uint64_t start = read_cntvct();
+        for (uint32_t i = 0; i < operations; i++) {
+            RBNode *node = cfsTestTree.operations.getMin(&cfsTestTree);
+            cfsTestTree.operations.remove(&cfsTestTree, node);
+            getNode(node, Thread, rbNode)->runtimeVirtualNs += cfs_test_random();
+            cfsTestTree.operations.insert(&cfsTestTree, node);
+        }
+        uint64_t cost = read_cntvct() - start;
+
+        printf("[CFS Benchmark]: %d threads, %d switches, %d counter ticks, %d ticks/switch (freq %d Hz)\n",
+               threads, operations, (uint32_t) cost, (uint32_t) (cost / operations), read_cntfrq());
+        ASSERT_EQ(cfsTestTree.size, threads);
+        ASSERT_TRUE(cfs_test_check_rbtree(cfsTestTree.root, nullptr) > 0);
+    }
+}
+
+void should_percpu_steal_thread() {
+    test_init_percpu();
+    PerCpu *busy = percpu_get(0);
+    PerCpu *idle = percpu_get(1);
+
+    Thread *running = &testThreads[0];
+    Thread *pinned = &testThreads[1];
+    Thread *lagging = &testThreads[2];
+    Thread *leading = &testThreads[3];
+    test_init_thread(running, 10, CPU_MASK_ALL);
+    test_init_thread(pinned, 20, cpu_number_to_mask(0));
+    test_init_thread(lagging, 30, CPU_MASK_ALL);
+    test_init_thread(leading, 40, CPU_MASK_ALL);
+    busy->operations.insertThread(busy, running);
+    busy->operations.insertThread(busy, pinned);
+    busy->operations.insertThread(busy, lagging);
+    busy->operations.insertThread(busy, leading);
+    busy->currentThread = running;
+    busy->minVruntime = 10;
+    idle->minVruntime = 1000;
+
+    // the running and the pinned thread must stay, the lagging one is the best candidate
+    idle->lock.operations.acquire(&idle->lock);
+    Thread *next = idle->operations.getNextThread(idle);
+    idle->lock.operations.release(&idle->lock);
+    ASSERT_EQ(next, lagging);
+    ASSERT_EQ(lagging->currCpu, 1);
+    // it keeps its lag of 20 behind the minVruntime of the queue it came from
+    ASSERT_EQ(lagging->runtimeVirtualNs, 1020);
+    ASSERT_EQ(busy->rbTree.size, 3);
+    ASSERT_EQ(idle->rbTree.size, 1);
+    ASSERT_EQ(per_cpu(cpuStatus, idle->cpuId).stealAttempts, 1);
+    ASSERT_EQ(per_cpu(cpuStatus, idle->cpuId).stealSuccesses, 1);
+
+    // a thread in the local queue means no stealing at all
+    idle->lock.operations.acquire(&idle->lock);
+    next = idle->operations.getNextThread(idle);
+    idle->lock.operations.release(&idle->lock);
+    ASSERT_EQ(next, lagging);
+    ASSERT_EQ(per_cpu(cpuStatus, idle->cpuId).stealAttempts, 1);
+}
+
+void should_percpu_not_steal_pinned_thread() {
+    test_init_percpu();
+    PerCpu *busy = percpu_get(0);
+    PerCpu *idle = percpu_get(1);
+
+    Thread *running = &testThreads[0];
+    Thread *pinned = &testThreads[1];
+    test_init_thread(running, 10, CPU_MASK_ALL);
+    test_init_thread(pinned, 20, cpu_number_to_mask(0));
+    busy->operations.insertThread(busy, running);
+    busy->operations.insertThread(busy, pinned);
+    busy->currentThread = running;
+
+    idle->lock.operations.acquire(&idle->lock);
+    Thread *next = idle->operations.getNextThread(idle);
+    idle->lock.operations.release(&idle->lock);
+    ASSERT_EQ(next, idle->idleThread);
+    ASSERT_EQ(busy->rbTree.size, 2);
+    ASSERT_EQ(per_cpu(cpuStatus, idle->cpuId).stealAttempts, 1);
+    ASSERT_EQ(per_cpu(cpuStatus, idle->cpuId).stealSuccesses, 0);
+}
+
+void should_percpu_place_on_least_loaded() {
+    test_init_percpu();
+    PerCpu *cpu0 = percpu_get(0);
+    PerCpu *cpu1 = percpu_get(1);
+    for (uint32_t i = 0; i < 3; i++) {
+        test_init_thread(&testThreads[i], i, CPU_MASK_ALL);
+    }
+    cpu0->operations.insertThread(cpu0, &testThreads[0]);
+    cpu0->operations.insertThread(cpu0, &testThreads[1]);
+    cpu1->operations.insertThread(cpu1, &testThreads[2]);
+
+    ASSERT_EQ(percpu_min_load(CPU_MASK_ALL), percpu_get(2));
+    ASSERT_EQ(percpu_min_load(cpu_number_to_mask(0) | cpu_number_to_mask(1)), cpu1);
+    ASSERT_EQ(percpu_min_load(cpu_number_to_mask(0)), cpu0);
+}
+
+void should_percpu_balance_migrate_thread() {
+    test_init_percpu();
+    PerCpu *busy = percpu_get(0);
+    PerCpu *idle = percpu_get(1);
+
+    Thread *running = &testThreads[0];
+    Thread *pinned = &testThreads[1];
+    Thread *lagging = &testThreads[2];
+    Thread *leading = &testThreads[3];
+    test_init_thread(running, 10, CPU_MASK_ALL);
+    test_init_thread(pinned, 20, cpu_number_to_mask(0));
+    test_init_thread(lagging, 30, CPU_MASK_ALL);
+    test_init_thread(leading, 40, CPU_MASK_ALL);
+    busy->operations.insertThread(busy, running);
+    busy->operations.insertThread(busy, pinned);
+    busy->operations.insertThread(busy, lagging);
+    busy->operations.insertThread(busy, leading);
+    busy->currentThread = running;
+    busy->minVruntime = 10;
+    idle->minVruntime = 1000;
+
+    // exactly one balance pass happens in any PERCPU_BALANCE_INTERVAL consecutive ticks
+    for (uint32_t i = 0; i < PERCPU_BALANCE_INTERVAL; i++) {
+        percpu_balance_tick();
+    }
+    ASSERT_EQ(lagging->currCpu, 1);
+    ASSERT_EQ(lagging->runtimeVirtualNs, 1020);
+    ASSERT_EQ(busy->rbTree.size, 3);
+    ASSERT_EQ(idle->rbTree.size, 1);
+    ASSERT_EQ(per_cpu(cpuStatus, read_cpuid()).migrations, 1);
+    ASSERT_TRUE(busy->loadAvg > 0);
+}
+
+void should_percpu_not_balance_small_imbalance() {
+    test_init_percpu();
+    for (CpuNum cpuId = 0; cpuId < SMP_MAX_CPUS; cpuId++) {
+        PerCpu *cpu = percpu_get(cpuId);
+        test_init_thread(&testThreads[cpuId], 10, CPU_MASK_ALL);
+        cpu->operations.insertThread(cpu, &testThreads[cpuId]);
+        cpu->currentThread = &testThreads[cpuId];
+    }
+    PerCpu *cpu0 = percpu_get(0);
+    test_init_thread(&testThreads[SMP_MAX_CPUS], 20, CPU_MASK_ALL);
+    cpu0->operations.insertThread(cpu0, &testThreads[SMP_MAX_CPUS]);
+
+    // moving the extra thread would only move the imbalance to another cpu
+    for (uint32_t i = 0; i < PERCPU_BALANCE_INTERVAL; i++) {
+        percpu_balance_tick();
+    }
+    ASSERT_EQ(cpu0->rbTree.size, 2);
+    ASSERT_EQ(testThreads[SMP_MAX_CPUS].currCpu, 0);
+}
+
+void should_scheduler_counter_to_ns() {
+    uint32_t frequency = read_cntfrq();
+    ASSERT_EQ(scheduler_counter_to_ns(0), 0);
+    ASSERT_TRUE(scheduler_counter_to_ns(frequency / 1000) >= 999000 && scheduler_counter_to_ns(frequency / 1000) <= 1001000);
+    // more than a second goes through the overflow safe path
+    uint64_t tenSeconds = scheduler_counter_to_ns((uint64_t) frequency * 10);
+    ASSERT_TRUE(tenSeconds >= 9999000000ULL && tenSeconds <= 10001000000ULL);
+}
+
+void should_scheduler_calc_delta_vruntime() {
+    uint64_t deltaNs = 10000000;
+    ASSERT_EQ(scheduler_calc_delta_vruntime(deltaNs, DEFAULT_PRIORITY), deltaNs);
+
+    // a heavier thread ages slower, a lighter one faster, and neither truncates to zero
+    uint64_t heavier = scheduler_calc_delta_vruntime(deltaNs, DEFAULT_PRIORITY + 1);
+    uint64_t lighter = scheduler_calc_delta_vruntime(deltaNs, DEFAULT_PRIORITY - 1);
+    ASSERT_TRUE(heavier > 0 && heavier < deltaNs);
+    ASSERT_TRUE(lighter > deltaNs);
+    uint64_t expected = deltaNs * PRIORITY_DEFAULT_WEIGHT / priority_to_weight(DEFAULT_PRIORITY + 1);
+    ASSERT_TRUE(heavier + 1000 >= expected && heavier <= expected + 1000);
+
+    uint64_t highest = scheduler_calc_delta_vruntime(deltaNs, HIGHEST_PRIORITY);
+    ASSERT_TRUE(highest > 0);
+}
+
+void should_scheduler_charge_real_runtime() {
+    test_init_percpu();
+    PerCpu *cpu = percpu_get(0);
+    Thread *running = &testThreads[0];
+    Thread *waiting = &testThreads[1];
+    test_init_thread(running, 0, CPU_MASK_ALL);
+    test_init_thread(waiting, 5000000, CPU_MASK_ALL);
+    running->runtimeNs = 0;
+    running->threadStatus = THREAD_RUNNING;
+    cpu->operations.insertThread(cpu, running);
+    cpu->operations.insertThread(cpu, waiting);
+    cpu->currentThread = running;
+
+    // pretend the thread ran for 10 ms
+    uint64_t now = read_cntvct();
+    cpu->sliceStart = now - read_cntfrq() / 100;
+    scheduler_update_runtime(cpu, running, now);
+
+    ASSERT_TRUE(running->runtimeNs >= 9990000 && running->runtimeNs <= 10010000);
+    ASSERT_EQ(running->runtimeVirtualNs, running->runtimeNs);
+    // it got requeued behind the thread that has been waiting
+    ASSERT_EQ(getNode(cpu->rbTree.operations.getMin(&cpu->rbTree), Thread, rbNode), waiting);
+    ASSERT_EQ(cpu->rbTree.size, 2);
+}
+
+void should_scheduler_wakeup_preempt() {
+    test_init_scheduler();
+    PerCpu *cpu = percpu_get(0);
+    Thread *running = &testThreads[0];
+    Thread *sleeper = &testThreads[1];
+    test_init_thread(running, 50000000, cpu_number_to_mask(0));
+    test_init_thread(sleeper, 0, cpu_number_to_mask(0));
+    running->threadStatus = THREAD_RUNNING;
+    sleeper->threadStatus = THREAD_BLOCKED;
+    cpu->operations.insertThread(cpu, running);
+    cpu->currentThread = running;
+    cpu->sliceStart = read_cntvct();
+    cpu->minVruntime = 40000000;
+
+    uint64_t start = read_cntvct();
+    testScheduler.operation.wakeup(&testScheduler, sleeper);
+    // the timer interrupt is programmed to fire right away
+    ASSERT_TRUE(cpu->needResched);
+    ASSERT_EQ(scheduler_next_event(cpu), 0);
+    testScheduler.operation.switchNext(&testScheduler);
+    uint64_t latencyNs = scheduler_counter_to_ns(read_cntvct() - start);
+
+    printf("[CFS Benchmark]: wakeup to run latency %d ns\n", (uint32_t) latencyNs);
+    ASSERT_EQ(cpu->currentThread, sleeper);
+    ASSERT_EQ(sleeper->threadStatus, THREAD_RUNNING);
+    ASSERT_EQ(running->threadStatus, THREAD_READY);
+    ASSERT_FALSE(cpu->needResched);
+    // the sleeper got limited credit instead of keeping its old vruntime
+    ASSERT_EQ(sleeper->runtimeVirtualNs, 40000000 - SCHED_LATENCY_MS * 1000000 / 2);
+    ASSERT_TRUE(latencyNs < SCHED_MIN_GRANULARITY_MS * 1000000);
+}
+
+void should_scheduler_wakeup_not_preempt_within_granularity() {
+    test_init_scheduler();
+    PerCpu *cpu = percpu_get(0);
+    Thread *running = &testThreads[0];
+    Thread *sleeper = &testThreads[1];
+    test_init_thread(running, 10000000, cpu_number_to_mask(0));
+    test_init_thread(sleeper, 9500000, cpu_number_to_mask(0));
+    running->threadStatus = THREAD_RUNNING;
+    sleeper->threadStatus = THREAD_BLOCKED;
+    cpu->operations.insertThread(cpu, running);
+    cpu->currentThread = running;
+    cpu->sliceStart = read_cntvct();
+
+    testScheduler.operation.wakeup(&testScheduler, sleeper);
+    ASSERT_FALSE(cpu->needResched);
+    ASSERT_EQ(sleeper->threadStatus, THREAD_READY);
+    ASSERT_EQ(cpu->rbTree.size, 2);
+    ASSERT_TRUE(scheduler_next_event(cpu) > 0);
+}
+
+void should_scheduler_wakeup_thread_not_switched_out() {
+    test_init_scheduler();
+    PerCpu *cpu = percpu_get(0);
+    Thread *blocking = &testThreads[0];
+    test_init_thread(blocking, 10, cpu_number_to_mask(0));
+    cpu->operations.insertThread(cpu, blocking);
+    cpu->currentThread = blocking;
+    // it put itself on a wait queue but the switch has not happened yet
+    blocking->threadStatus = THREAD_BLOCKED;
+
+    testScheduler.operation.wakeup(&testScheduler, blocking);
+    ASSERT_EQ(blocking->threadStatus, THREAD_READY);
+    ASSERT_EQ(cpu->rbTree.size, 1);
+
+    // block() now returns right away instead of switching
+    ASSERT_EQ(testScheduler.operation.block(&testScheduler), OK);
+    ASSERT_EQ(blocking->threadStatus, THREAD_RUNNING);
+}
+
+Thread *volatile cfsWakeupRaceThread;
+
+void cfs_test_wakeup_race_work() {
+    testScheduler.operation.wakeup(&testScheduler, cfsWakeupRaceThread);
+}
+
+/**
+ * cpu 0 posts the wakeup to cpu 1's inbox while cpu 1 queues the same thread itself, only one of them may get it
+ */
+void should_scheduler_wake_thread_once() {
+    test_init_scheduler();
+    if (test_start_secondary_cpus() < 2) {
+        printf("[CFS Message]: needs a second cpu, skipped\n");
+        return;
+    }
+    PerCpu *cpu = percpu_get(1);
+    Thread *sleeper = &testThreads[0];
+    test_init_thread(sleeper, 0, cpu_number_to_mask(1));
+    cfsWakeupRaceThread = sleeper;
+
+    uint32_t duplicates = 0;
+    for (uint32_t round = 0; round < CFS_WAKEUP_RACE_ROUNDS; round++) {
+        sleeper->threadStatus = THREAD_BLOCKED;
+        sleeper->currCpu = INVALID_CPU;
+        testWork[0] = cfs_test_wakeup_race_work;
+        testWork[1] = cfs_test_wakeup_race_work;
+        test_run_round();
+
+        cpu->lock.operations.acquire(&cpu->lock);
+        scheduler_drain_wakeups(cpu);
+        bool once = cpu->rbTree.size == 1;
+        cpu->operations.removeThread(cpu, sleeper);
+        cpu->lock.operations.release(&cpu->lock);
+        if (!once) {
+            // queued twice, the run queue is broken now
+            duplicates++;
+            break;
+        }
+    }
+    ASSERT_EQ(duplicates, 0);
+    ASSERT_EQ(sleeper->threadStatus, THREAD_READY);
+}
+
+void should_scheduler_dequeue_blocked_thread_on_switch() {
+    test_init_scheduler();
+    PerCpu *cpu = percpu_get(0);
+    Thread *blocking = &testThreads[0];
+    Thread *other = &testThreads[1];
+    test_init_thread(blocking, 10, cpu_number_to_mask(0));
+    test_init_thread(other, 20, cpu_number_to_mask(0));
+    cpu->operations.insertThread(cpu, blocking);
+    cpu->operations.insertThread(cpu, other);
+    cpu->currentThread = blocking;
+    cpu->sliceStart = read_cntvct();
+    blocking->threadStatus = THREAD_BLOCKED;
+
+    testScheduler.operation.switchNext(&testScheduler);
+    ASSERT_EQ(cpu->currentThread, other);
+    ASSERT_EQ(cpu->rbTree.size, 1);
+    ASSERT_EQ(blocking->threadStatus, THREAD_BLOCKED);
+}
+
+void should_percpu_double_lock_in_cpu_order() {
+    test_init_percpu();
+    PerCpu *cpu0 = percpu_get(0);
+    PerCpu *cpu1 = percpu_get(1);
+
+    // the argument order does not matter, both locks are held afterwards
+    percpu_double_lock(cpu1, cpu0);
+    ASSERT_EQ(atomic_get(&cpu0->lock.lock), 1);
+    ASSERT_EQ(atomic_get(&cpu1->lock.lock), 1);
+    percpu_double_unlock(cpu1, cpu0);
+    ASSERT_EQ(atomic_get(&cpu0->lock.lock), 0);
+    ASSERT_EQ(atomic_get(&cpu1->lock.lock), 0);
+
+    // the same cpu twice takes its lock only once
+    percpu_double_lock(cpu0, cpu0);
+    ASSERT_EQ(atomic_get(&cpu0->lock.lock), 1);
+    percpu_double_unlock(cpu0, cpu0);
+    ASSERT_EQ(atomic_get(&cpu0->lock.lock), 0);
+}
+
+uint64_t cfsScalingElapsed[SMP_MAX_CPUS];
+
+/**
+ * switch between the threads of the local run queue only, with per cpu locks the cpus never wait for each other
+ */
+void cfs_test_switch_loop() {
+    CpuNum cpuId = read_cpuid();
+    uint64_t start = read_cntvct();
+    for (uint32_t i = 0; i < CFS_SCALING_SWITCHES; i++) {
+        testScheduler.operation.switchNext(&testScheduler);
+    }
+    cfsScalingElapsed[cpuId] = read_cntvct() - start;
+}
+
+/**
+ * switchNext throughput on 1, 2 and 4 cpus, each cpu switching over its own run queue.
+ * with the old global scheduler lock the total stayed flat, with per cpu locks it should grow with the cpus.
+ */
+void should_cfs_switch_scaling_benchmark() {
+    test_init_scheduler();
+    uint32_t onlineCpus = test_start_secondary_cpus();
+    printf("[CFS Benchmark]: %d cpus online\n", onlineCpus);
+
+    for (uint32_t cpus = 1; cpus <= onlineCpus; cpus *= 2) {
+        test_init_percpu();
+        for (CpuNum cpuId = 0; cpuId < cpus; cpuId++) {
+            PerCpu *cpu = percpu_get(cpuId);
+            for (uint32_t i = 0; i < CFS_SCALING_THREADS; i++) {
+                Thread *thread = &testThreads[cpuId * CFS_SCALING_THREADS + i];
+                test_init_thread(thread, i, cpu_number_to_mask(cpuId));
+                cpu->operations.insertThread(cpu, thread);
+            }
+            cpu->sliceStart = read_cntvct();
+            testWork[cpuId] = cfs_test_switch_loop;
+        }
+        test_run_round();
+
+        uint32_t switchesPerSecond = 0;
+        for (CpuNum cpuId = 0; cpuId < cpus; cpuId++) {
+            uint32_t elapsedUs = (uint32_t) (scheduler_counter_to_ns(cfsScalingElapsed[cpuId]) / 1000);
+            switchesPerSecond += (uint32_t) ((uint64_t) CFS_SCALING_SWITCHES * 1000000 / (elapsedUs + 1));
+            // every thread stays on its own cpu and keeps its place in the rotation
+            ASSERT_EQ(percpu_get(cpuId)->rbTree.size, CFS_SCALING_THREADS);
+            ASSERT_EQ(per_cpu(cpuStatus, cpuId).stealAttempts, 0);
+        }
+        printf("[CFS Benchmark]: %d cpus, %d switches/sec\n", cpus, switchesPerSecond);
+    }
+}
+
+void should_percpu_wakeup_on_last_cpu() {
+    test_init_percpu();
+    PerCpu *last = percpu_get(2);
+    Thread *sleeper = &testThreads[0];
+    test_init_thread(sleeper, 0, CPU_MASK_ALL);
+    sleeper->lastCpu = 2;
+
+    // idle
+    ASSERT_EQ(percpu_select_wakeup_cpu(sleeper), last);
+
+    // one other default thread is still light
+    Thread *other = &testThreads[1];
+    test_init_thread(other, 0, CPU_MASK_ALL);
+    last->operations.insertThread(last, other);
+    last->currentThread = other;
+    ASSERT_EQ(percpu_select_wakeup_cpu(sleeper), last);
+
+    // two are too many, the waking cpu is idle and takes it
+    Thread *another = &testThreads[2];
+    test_init_thread(another, 0, CPU_MASK_ALL);
+    last->operations.insertThread(last, another);
+    PerCpu *local = percpu_get(read_cpuid());
+    ASSERT_EQ(percpu_select_wakeup_cpu(sleeper), local);
+
+    // the waking cpu is busy as well, the next idle cpu after the last one
+    Thread *localBusy = &testThreads[4];
+    Thread *localOther = &testThreads[5];
+    test_init_thread(localBusy, 0, CPU_MASK_ALL);
+    test_init_thread(localOther, 0, CPU_MASK_ALL);
+    local->operations.insertThread(local, localBusy);
+    local->operations.insertThread(local, localOther);
+    local->currentThread = localBusy;
+    ASSERT_EQ(percpu_select_wakeup_cpu(sleeper), percpu_get(3));
+
+    // no idle cpu left in the mask, the least loaded one
+    Thread *busy = &testThreads[3];
+    test_init_thread(busy, 0, CPU_MASK_ALL);
+    percpu_get(1)->operations.insertThread(percpu_get(1), busy);
+    sleeper->cpuAffinity = cpu_number_to_mask(1) | cpu_number_to_mask(2);
+    ASSERT_EQ(percpu_select_wakeup_cpu(sleeper), percpu_get(1));
+
+    // a last cpu outside the mask is not considered
+    sleeper->cpuAffinity = cpu_number_to_mask(0);
+    ASSERT_EQ(percpu_select_wakeup_cpu(sleeper), percpu_get(0));
+}
+
+uint8_t cfsAffinityWorkingSet[CFS_AFFINITY_WORKING_SET];
+uint64_t cfsAffinityWorkTicks = 0;
+
+/**
+ * the consumer walks its working set once per wakeup, cheap when the set is still in this cpu's cache
+ */
+void cfs_test_consumer_work() {
+    uint64_t start = read_cntvct();
+    for (uint32_t pass = 0; pass < CFS_AFFINITY_PASSES; pass++) {
+        for (uint32_t i = 0; i < CFS_AFFINITY_WORKING_SET; i += CFS_AFFINITY_STRIDE) {
+            cfsAffinityWorkingSet[i]++;
+        }
+    }
+    cfsAffinityWorkTicks += read_cntvct() - start;
+}
+
+/**
+ * a producer on cpu 0 wakes a consumer which runs, walks its working set and blocks again.
+ * the old placement put the consumer on the least loaded cpu, and its own decaying load average pushed it
+ * to another cpu on every wakeup. the new one keeps it on its last cpu.
+ */
+void should_cfs_wakeup_affinity_benchmark() {
+    test_init_scheduler();
+    uint32_t onlineCpus = test_start_secondary_cpus();
+
+    uint32_t bounces[2];
+    for (uint32_t affine = 0; affine < 2; affine++) {
+        test_init_percpu();
+        PerCpu *cpu0 = percpu_get(0);
+        Thread *producer = &testThreads[0];
+        Thread *consumer = &testThreads[1];
+        test_init_thread(producer, 0, CPU_MASK_ALL);
+        test_init_thread(consumer, 0, CPU_MASK_ALL);
+        producer->threadStatus = THREAD_RUNNING;
+        consumer->threadStatus = THREAD_BLOCKED;
+        cpu0->operations.insertThread(cpu0, producer);
+        cpu0->currentThread = producer;
+        cpu0->sliceStart = read_cntvct();
+
+        bounces[affine] = 0;
+        cfsAffinityWorkTicks = 0;
+        CpuNum prevCpuId = INVALID_CPU;
+        for (uint32_t i = 0; i < CFS_AFFINITY_WAKEUPS; i++) {
+            PerCpu *cpu;
+            if (affine) {
+                testScheduler.operation.wakeup(&testScheduler, consumer);
+                cpu = percpu_get(consumer->currCpu);
+                // a wakeup for another cpu waits in its inbox for the kick interrupt, which the test stands in for
+                cpu->lock.operations.acquire(&cpu->lock);
+                scheduler_drain_wakeups(cpu);
+                cpu->lock.operations.release(&cpu->lock);
+            } else {
+                cpu = percpu_min_load(consumer->cpuAffinity);
+                cpu->lock.operations.acquire(&cpu->lock);
+                consumer->threadStatus = THREAD_READY;
+                cpu->operations.insertThread(cpu, consumer);
+                cpu->lock.operations.release(&cpu->lock);
+            }
+            if (prevCpuId != INVALID_CPU && cpu->cpuId != prevCpuId) {
+                bounces[affine]++;
+            }
+            prevCpuId = cpu->cpuId;
+
+            // the consumer runs there for a tick, then blocks on the next empty buffer
+            cpu->currentThread = consumer;
+            consumer->threadStatus = THREAD_RUNNING;
+            percpu_balance_tick();
+            test_run_on_cpu(cpu->cpuId, cfs_test_consumer_work);
+            cpu->lock.operations.acquire(&cpu->lock);
+            consumer->threadStatus = THREAD_BLOCKED;
+            cpu->operations.removeThread(cpu, consumer);
+            cpu->currentThread = cpu->idleThread;
+            cpu->lock.operations.release(&cpu->lock);
+        }
+        uint32_t workNs = (uint32_t) (scheduler_counter_to_ns(cfsAffinityWorkTicks) / CFS_AFFINITY_WAKEUPS);
+        printf("[CFS Benchmark]: %s wakeup, %d cpus online, %d migrations in %d wakeups, %d ns consumer work\n",
+               affine ? "last cpu" : "least loaded", onlineCpus, bounces[affine], CFS_AFFINITY_WAKEUPS, workNs);
+    }
+    ASSERT_EQ(bounces[1], 0);
+    ASSERT_TRUE(bounces[0] > bounces[1]);
+}
+
+#endif//__KERNEL_CFS_TEST_H__
@@ -0,0 +1,138 @@
+//
+// Created by XingfengYang on 2021/1/22.
+//
+
+#ifndef __KERNEL_FPU_TEST_H__
+#define __KERNEL_FPU_TEST_H__
+
+#include "arm/register.h"
+#include "arm/vfp.h"
+#include "kernel/fpu.h"
+#include "tests/tests_lib.h"
+
+#define FPU_BENCHMARK_SWITCHES 10000
+
+/**
+ * the first of these in a slice traps, the trap enables fp and runs it again
+ */
+void fpu_test_write_d0(uint64_t value) {
+    asm volatile("vmov d0, %Q0, %R0"
+                 :
+                 : "r"(value));
+}
+
+uint64_t fpu_test_read_d0() {
+    uint64_t value;
+    asm volatile("vmov %Q0, %R0, d0"
+                 : "=r"(value));
+    return value;
+}
+
+void fpu_test_init_threads(uint32_t count) {
+    test_init_scheduler();
+    for (uint32_t i = 0; i < count; i++) {
+        test_init_thread(&testThreads[i], 0, cpu_number_to_mask(0));
+    }
+}
+
+void fpu_test_release_threads(uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        fpu_release_thread(&testThreads[i]);
+    }
+}
+
+void should_fpu_switch_lazily() {
+    fpu_test_init_threads(3);
+    PerCpu *cpu = percpu_get(0);
+    Thread *first = &testThreads[0];
+    Thread *second = &testThreads[1];
+    Thread *integer = &testThreads[2];
+
+    testScheduler.operation.switchTo(&testScheduler, first);
+    ASSERT_FALSE(vfp_is_enabled());
+    fpu_test_write_d0(0x1111);
+    ASSERT_TRUE(vfp_is_enabled());
+    ASSERT_EQ(cpu->fpuOwner, first);
+    ASSERT_EQ(per_cpu(cpuStatus, cpu->cpuId).fpuTraps, 1);
+
+    testScheduler.operation.switchTo(&testScheduler, second);
+    ASSERT_FALSE(vfp_is_enabled());
+    ASSERT_EQ(first->vfpContext.d[0], 0x1111);
+    fpu_test_write_d0(0x2222);
+    ASSERT_EQ(cpu->fpuOwner, second);
+
+    // a thread without fp instructions never traps
+    testScheduler.operation.switchTo(&testScheduler, integer);
+    testScheduler.operation.switchTo(&testScheduler, first);
+    ASSERT_EQ(per_cpu(cpuStatus, cpu->cpuId).fpuTraps, 2);
+    ASSERT_FALSE(integer->fpuUsed);
+
+    ASSERT_EQ(fpu_test_read_d0(), 0x1111);
+    ASSERT_EQ(per_cpu(cpuStatus, cpu->cpuId).fpuTraps, 3);
+    ASSERT_EQ(per_cpu(cpuStatus, cpu->cpuId).fpuRestores, 3);
+
+    // nobody else used fp in between, the registers are still first's
+    testScheduler.operation.switchTo(&testScheduler, integer);
+    testScheduler.operation.switchTo(&testScheduler, first);
+    ASSERT_EQ(fpu_test_read_d0(), 0x1111);
+    ASSERT_EQ(per_cpu(cpuStatus, cpu->cpuId).fpuTraps, 4);
+    ASSERT_EQ(per_cpu(cpuStatus, cpu->cpuId).fpuRestores, 3);
+
+    fpu_test_release_threads(3);
+}
+
+void should_fpu_keep_state_across_cpus() {
+    fpu_test_init_threads(2);
+    PerCpu *cpu = percpu_get(0);
+    Thread *migrating = &testThreads[0];
+    Thread *other = &testThreads[1];
+
+    testScheduler.operation.switchTo(&testScheduler, migrating);
+    fpu_test_write_d0(0x1111);
+    testScheduler.operation.switchTo(&testScheduler, other);
+
+    // pretend it ran on cpu 1 and left newer state there, this cpu still names it the owner
+    migrating->fpuCpu = 1;
+    migrating->vfpContext.d[0] = 0x3333;
+    testScheduler.operation.switchTo(&testScheduler, migrating);
+    ASSERT_EQ(cpu->fpuOwner, migrating);
+    ASSERT_EQ(fpu_test_read_d0(), 0x3333);
+    ASSERT_EQ(migrating->fpuCpu, 0);
+
+    fpu_test_release_threads(2);
+    ASSERT_FALSE(vfp_is_enabled());
+    ASSERT_EQ(cpu->fpuOwner, nullptr);
+}
+
+/**
+ * switch cost of threads that never touch fp against threads that use it in every slice
+ */
+void should_fpu_switch_benchmark() {
+    fpu_test_init_threads(2);
+    Thread *first = &testThreads[0];
+    Thread *second = &testThreads[1];
+
+    uint64_t start = read_cntvct();
+    for (uint32_t i = 0; i < FPU_BENCHMARK_SWITCHES; i++) {
+        testScheduler.operation.switchTo(&testScheduler, first);
+        testScheduler.operation.switchTo(&testScheduler, second);
+    }
+    uint64_t integerNs = scheduler_counter_to_ns(read_cntvct() - start);
+
+    start = read_cntvct();
+    for (uint32_t i = 0; i < FPU_BENCHMARK_SWITCHES; i++) {
+        testScheduler.operation.switchTo(&testScheduler, first);
+        fpu_test_write_d0(i);
+        testScheduler.operation.switchTo(&testScheduler, second);
+        fpu_test_write_d0(i);
+    }
+    uint64_t fpNs = scheduler_counter_to_ns(read_cntvct() - start);
+
+    printf("[FPU Benchmark]: %d ns per switch without fp, %d ns with fp\n",
+           (uint32_t) (integerNs / (FPU_BENCHMARK_SWITCHES * 2)), (uint32_t) (fpNs / (FPU_BENCHMARK_SWITCHES * 2)));
+    ASSERT_EQ(per_cpu(cpuStatus, 0).fpuTraps, FPU_BENCHMARK_SWITCHES * 2);
+    ASSERT_EQ(first->vfpContext.d[0], FPU_BENCHMARK_SWITCHES - 1);
+    fpu_test_release_threads(2);
+}
+
+#endif//__KERNEL_FPU_TEST_H__
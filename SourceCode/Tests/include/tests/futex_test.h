@@ -0,0 +1,160 @@
+//
+// Created by XingfengYang on 2021/1/28.
+//
+
+#ifndef __KERNEL_FUTEX_TEST_H__
+#define __KERNEL_FUTEX_TEST_H__
+
+#include "arm/register.h"
+#include "kernel/futex.h"
+#include "kernel/mutex.h"
+#include "libc/mutex.h"
+#include "tests/tests_lib.h"
+
+#define FUTEX_BENCHMARK_ROUNDS 100000
+#define FUTEX_CONTENDED_ROUNDS 20000
+
+extern Scheduler cfsScheduler;
+
+uint32_t futexTestWord = 0;
+uint32_t futexTestOtherWord = 0;
+UserMutex futexTestMutex;
+Mutex futexTestKernelMutex;
+volatile uint32_t futexTestCounter = 0;
+
+uint32_t futex_test_is_kernel_thread(Thread *thread) {
+    (void) thread;
+    return 1;
+}
+
+/**
+ * a kernel thread, so the futex key is the address itself and no page table is needed
+ */
+void futex_test_init_thread(Thread *thread) {
+    test_init_thread(thread, 0, cpu_number_to_mask(0));
+    thread->operations.isKernelThread = futex_test_is_kernel_thread;
+}
+
+/**
+ * put the thread on the bucket the way futex_wait leaves it when it goes to sleep
+ */
+void futex_test_enqueue_waiter(Thread *thread, uint32_t *address) {
+    FutexBucket *bucket = futex_bucket((uint32_t) address);
+    thread->futexKey = (uint32_t) address;
+    thread->threadStatus = THREAD_BLOCKED;
+    bucket->waitQueue.operations.enqueue(&bucket->waitQueue, &thread->threadReadyQueue);
+}
+
+void should_futex_not_wait_on_changed_value() {
+    test_init_scheduler();
+    scheduler_create(&cfsScheduler);
+    futex_init();
+    PerCpu *cpu = percpu_get(0);
+    Thread *thread = &testThreads[0];
+    futex_test_init_thread(thread);
+
+    // nothing that could sleep
+    futexTestWord = 1;
+    ASSERT_EQ(futex_wait(&futexTestWord, 1), ERROR);
+
+    thread->threadStatus = THREAD_RUNNING;
+    cpu->currentThread = thread;
+    ASSERT_EQ(futex_wait(&futexTestWord, 0), ERROR);
+    ASSERT_EQ(thread->threadStatus, THREAD_RUNNING);
+    ASSERT_EQ(futex_bucket((uint32_t) &futexTestWord)->waitQueue.size, 0);
+    cpu->currentThread = nullptr;
+}
+
+void should_futex_wake_matching_waiters() {
+    test_init_scheduler();
+    scheduler_create(&cfsScheduler);
+    futex_init();
+    Thread *first = &testThreads[0];
+    Thread *second = &testThreads[1];
+    Thread *third = &testThreads[2];
+    Thread *other = &testThreads[3];
+    futex_test_init_thread(first);
+    futex_test_init_thread(second);
+    futex_test_init_thread(third);
+    futex_test_init_thread(other);
+    futex_test_enqueue_waiter(first, &futexTestWord);
+    futex_test_enqueue_waiter(other, &futexTestOtherWord);
+    futex_test_enqueue_waiter(second, &futexTestWord);
+    futex_test_enqueue_waiter(third, &futexTestWord);
+
+    // waiters of another futex are left alone, even if they share the bucket
+    ASSERT_EQ(futex_wake(&futexTestWord, 2), 2);
+    ASSERT_EQ(first->threadStatus, THREAD_READY);
+    ASSERT_EQ(second->threadStatus, THREAD_READY);
+    ASSERT_EQ(third->threadStatus, THREAD_BLOCKED);
+    ASSERT_EQ(other->threadStatus, THREAD_BLOCKED);
+
+    ASSERT_EQ(futex_wake(&futexTestWord, 2), 1);
+    ASSERT_EQ(third->threadStatus, THREAD_READY);
+    ASSERT_EQ(futex_wake(&futexTestWord, 1), 0);
+    ASSERT_EQ(futex_wake(&futexTestOtherWord, 1), 1);
+    ASSERT_EQ(other->threadStatus, THREAD_READY);
+}
+
+/**
+ * lock and unlock without contention, the user mutex never enters the kernel
+ */
+void should_futex_uncontended_benchmark() {
+    test_init_percpu();
+    user_mutex_init(&futexTestMutex);
+    mutex_create(&futexTestKernelMutex);
+
+    uint64_t start = read_cntvct();
+    for (uint32_t i = 0; i < FUTEX_BENCHMARK_ROUNDS; i++) {
+        user_mutex_lock(&futexTestMutex);
+        user_mutex_unlock(&futexTestMutex);
+    }
+    uint64_t userNs = scheduler_counter_to_ns(read_cntvct() - start);
+
+    start = read_cntvct();
+    for (uint32_t i = 0; i < FUTEX_BENCHMARK_ROUNDS; i++) {
+        futexTestKernelMutex.operations.acquire(&futexTestKernelMutex);
+        futexTestKernelMutex.operations.release(&futexTestKernelMutex);
+    }
+    uint64_t kernelNs = scheduler_counter_to_ns(read_cntvct() - start);
+
+    printf("[Futex Benchmark]: uncontended lock and unlock, user mutex %d ns, kernel mutex %d ns\n",
+           (uint32_t) (userNs / FUTEX_BENCHMARK_ROUNDS), (uint32_t) (kernelNs / FUTEX_BENCHMARK_ROUNDS));
+    ASSERT_EQ(futexTestMutex.state, USER_MUTEX_UNLOCKED);
+}
+
+void futex_test_contended_work() {
+    for (uint32_t i = 0; i < FUTEX_CONTENDED_ROUNDS; i++) {
+        user_mutex_lock(&futexTestMutex);
+        futexTestCounter++;
+        user_mutex_unlock(&futexTestMutex);
+    }
+}
+
+/**
+ * the test cpus run no threads, so a contended lock goes through the futex syscalls but can not sleep,
+ * this measures the kernel entries of the slow path
+ */
+void should_futex_contended_benchmark() {
+    uint32_t onlineCpus = test_start_secondary_cpus();
+    if (onlineCpus < 2) {
+        printf("[Futex Benchmark]: needs a second cpu, skipped\n");
+        return;
+    }
+    test_init_percpu();
+    futex_init();
+    user_mutex_init(&futexTestMutex);
+    futexTestCounter = 0;
+    testWork[0] = futex_test_contended_work;
+    testWork[1] = futex_test_contended_work;
+
+    uint64_t start = read_cntvct();
+    test_run_round();
+    uint64_t elapsedNs = scheduler_counter_to_ns(read_cntvct() - start);
+    printf("[Futex Benchmark]: contended lock and unlock on 2 cpus, %d ns\n",
+           (uint32_t) (elapsedNs / (2 * FUTEX_CONTENDED_ROUNDS)));
+    ASSERT_EQ(futexTestCounter, 2 * FUTEX_CONTENDED_ROUNDS);
+    ASSERT_EQ(futexTestMutex.state, USER_MUTEX_UNLOCKED);
+}
+
+#endif//__KERNEL_FUTEX_TEST_H__
@@ -5,7 +5,13 @@
 #ifndef __KERNEL_KHEAP_TEST_H__
 #define __KERNEL_KHEAP_TEST_H__
 
+#include "arm/register.h"
 #include "kernel/kheap.h"
+#include "kernel/scheduler.h"
+
+#define KHEAP_BENCHMARK_SLOTS 256
+#define KHEAP_BENCHMARK_OPERATIONS 100000
+#define KHEAP_SOAK_OPERATIONS 2000000
 
 extern char _binary_initrd_img_start[];
 extern char _binary_initrd_img_end[];
@@ -116,4 +122,166 @@ void should_kheap_free() {
     ASSERT_EQ(heapFreeStatus, OK);
 }
 
+void should_kheap_reuse_size_class() {
+    KernelStatus heapInitStatus = heap_create(&testHeap, _binary_initrd_img_end, 64 * MB);
+    ASSERT_EQ(heapInitStatus, OK);
+
+    // 20 and 24 bytes share a size class, the freed block is the one handed out again
+    void *first = testHeap.operations.alloc(&testHeap, 24);
+    void *guard = testHeap.operations.alloc(&testHeap, 8);
+    ASSERT_EQ((uint32_t) first % HEAP_ALIGNMENT, 0);
+    ASSERT_EQ(testHeap.operations.free(&testHeap, first), OK);
+    void *second = testHeap.operations.alloc(&testHeap, 20);
+    ASSERT_EQ(second, first);
+
+    // a request above the small sizes takes a block from a bigger bin, not the small one
+    ASSERT_EQ(testHeap.operations.free(&testHeap, second), OK);
+    void *large = testHeap.operations.alloc(&testHeap, 1000);
+    ASSERT_NEQ(large, first);
+    ASSERT_EQ(testHeap.operations.free(&testHeap, large), OK);
+    ASSERT_EQ(testHeap.operations.free(&testHeap, guard), OK);
+    ASSERT_EQ(testHeap.usingListHead, nullptr);
+}
+
+/**
+ * random alloc and free over a fixed set of slots, sizes are mostly small with some bigger ones in between
+ */
+void should_kheap_alloc_free_benchmark() {
+    KernelStatus heapInitStatus = heap_create(&testHeap, _binary_initrd_img_end, 64 * MB);
+    ASSERT_EQ(heapInitStatus, OK);
+
+    void *slots[KHEAP_BENCHMARK_SLOTS];
+    for (uint32_t i = 0; i < KHEAP_BENCHMARK_SLOTS; i++) {
+        slots[i] = nullptr;
+    }
+    uint32_t seed = 1;
+    uint32_t failed = 0;
+    uint64_t start = read_cntvct();
+    for (uint32_t i = 0; i < KHEAP_BENCHMARK_OPERATIONS; i++) {
+        seed = seed * 1103515245 + 12345;
+        uint32_t slot = (seed >> 16) % KHEAP_BENCHMARK_SLOTS;
+        if (slots[slot] != nullptr) {
+            testHeap.operations.free(&testHeap, slots[slot]);
+            slots[slot] = nullptr;
+        } else {
+            uint32_t size = (seed >> 8) % 8 == 0 ? 256 + (seed >> 4) % 4096 : 1 + (seed >> 4) % 128;
+            slots[slot] = testHeap.operations.alloc(&testHeap, size);
+            if (slots[slot] == nullptr) {
+                failed++;
+            }
+        }
+    }
+    uint64_t elapsedNs = scheduler_counter_to_ns(read_cntvct() - start);
+    printf("[KHeap Benchmark]: %d ns per alloc or free\n", (uint32_t) (elapsedNs / KHEAP_BENCHMARK_OPERATIONS));
+
+    for (uint32_t i = 0; i < KHEAP_BENCHMARK_SLOTS; i++) {
+        if (slots[i] != nullptr) {
+            testHeap.operations.free(&testHeap, slots[i]);
+        }
+    }
+    ASSERT_EQ(failed, 0);
+    ASSERT_EQ(testHeap.usingListHead, nullptr);
+}
+
+void should_kheap_coalesce_free_neighbours() {
+    KernelStatus heapInitStatus = heap_create(&testHeap, _binary_initrd_img_end, 64 * MB);
+    ASSERT_EQ(heapInitStatus, OK);
+    uint32_t initialFreeSize = testHeap.freeSize;
+
+    void *first = testHeap.operations.alloc(&testHeap, 64);
+    void *second = testHeap.operations.alloc(&testHeap, 64);
+    void *third = testHeap.operations.alloc(&testHeap, 64);
+    ASSERT_EQ(testHeap.operations.free(&testHeap, first), OK);
+    ASSERT_EQ(testHeap.operations.free(&testHeap, third), OK);
+
+    // the middle block merges with both neighbours, which merged with the rest of the heap already
+    HeapStatistics statistics;
+    heap_statistics(&testHeap, &statistics);
+    ASSERT_NEQ(statistics.fragmentation, 0);
+    ASSERT_EQ(testHeap.operations.free(&testHeap, second), OK);
+    heap_statistics(&testHeap, &statistics);
+    ASSERT_EQ(statistics.freeSize, initialFreeSize);
+    ASSERT_EQ(statistics.largestFreeSize, initialFreeSize);
+    ASSERT_EQ(statistics.fragmentation, 0);
+
+    // a block freed twice is refused, merging it again would corrupt the heap
+    ASSERT_EQ(testHeap.operations.free(&testHeap, second), ERROR);
+}
+
+/**
+ * the counters belong to the heap, a fresh heap starts at 0 whatever the heaps before it allocated
+ */
+void should_kheap_count_per_heap() {
+    KernelStatus heapInitStatus = heap_create(&testHeap, _binary_initrd_img_end, 64 * MB);
+    ASSERT_EQ(heapInitStatus, OK);
+    HeapStatistics statistics;
+    heap_statistics(&testHeap, &statistics);
+    ASSERT_EQ(statistics.allocatedBlockCount, 0);
+    ASSERT_EQ(statistics.allocatedSize, 0);
+
+    void *first = testHeap.operations.alloc(&testHeap, 64);
+    void *second = testHeap.operations.alloc(&testHeap, 128);
+    heap_statistics(&testHeap, &statistics);
+    ASSERT_EQ(statistics.allocatedBlockCount, 2);
+    ASSERT_EQ(statistics.allocatedSize, 64 + 128);
+
+    ASSERT_EQ(testHeap.operations.free(&testHeap, first), OK);
+    heap_statistics(&testHeap, &statistics);
+    ASSERT_EQ(statistics.allocatedBlockCount, 1);
+    ASSERT_EQ(statistics.allocatedSize, 128);
+    ASSERT_EQ(testHeap.operations.free(&testHeap, second), OK);
+}
+
+/**
+ * random alloc and free of random sizes over a long run, without merging the heap ends up in pieces too small
+ * for the bigger sizes. after everything is freed the heap has to be one block again
+ */
+void should_kheap_soak() {
+    KernelStatus heapInitStatus = heap_create(&testHeap, _binary_initrd_img_end, 64 * MB);
+    ASSERT_EQ(heapInitStatus, OK);
+    uint32_t initialFreeSize = testHeap.freeSize;
+
+    void *slots[KHEAP_BENCHMARK_SLOTS];
+    for (uint32_t i = 0; i < KHEAP_BENCHMARK_SLOTS; i++) {
+        slots[i] = nullptr;
+    }
+    uint32_t seed = 7;
+    uint32_t failed = 0;
+    uint32_t worstFragmentation = 0;
+    HeapStatistics statistics;
+    heap_statistics(&testHeap, &statistics);
+    uint32_t mergeCounts = statistics.mergeCounts;
+    for (uint32_t i = 0; i < KHEAP_SOAK_OPERATIONS; i++) {
+        seed = seed * 1103515245 + 12345;
+        uint32_t slot = (seed >> 16) % KHEAP_BENCHMARK_SLOTS;
+        if (slots[slot] != nullptr) {
+            testHeap.operations.free(&testHeap, slots[slot]);
+            slots[slot] = nullptr;
+        } else {
+            uint32_t size = (seed >> 8) % 16 == 0 ? 4096 + (seed >> 4) % (64 * 1024) : 1 + (seed >> 4) % 512;
+            slots[slot] = testHeap.operations.alloc(&testHeap, size);
+            if (slots[slot] == nullptr) {
+                failed++;
+            }
+        }
+        if (i % (KHEAP_SOAK_OPERATIONS / 16) == 0) {
+            heap_statistics(&testHeap, &statistics);
+            worstFragmentation =
+                    statistics.fragmentation > worstFragmentation ? statistics.fragmentation : worstFragmentation;
+        }
+    }
+    for (uint32_t i = 0; i < KHEAP_BENCHMARK_SLOTS; i++) {
+        if (slots[i] != nullptr) {
+            testHeap.operations.free(&testHeap, slots[i]);
+        }
+    }
+    heap_statistics(&testHeap, &statistics);
+    printf("[KHeap Soak]: %d operations, %d merges, worst fragmentation %d%%\n", KHEAP_SOAK_OPERATIONS,
+           statistics.mergeCounts - mergeCounts, worstFragmentation);
+    ASSERT_EQ(failed, 0);
+    ASSERT_EQ(testHeap.usingListHead, nullptr);
+    ASSERT_EQ(statistics.freeSize, initialFreeSize);
+    ASSERT_EQ(statistics.largestFreeSize, initialFreeSize);
+}
+
 #endif//__KERNEL_KHEAP_TEST_H__
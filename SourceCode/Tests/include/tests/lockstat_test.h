@@ -0,0 +1,154 @@
+//
+// Created by XingfengYang on 2021/1/30.
+//
+
+#ifndef __KERNEL_LOCKSTAT_TEST_H__
+#define __KERNEL_LOCKSTAT_TEST_H__
+
+#include "arm/pmu.h"
+#include "arm/register.h"
+#include "kernel/lockstat.h"
+#include "kernel/mutex.h"
+#include "kernel/spinlock.h"
+#include "libc/string.h"
+#include "tests/tests_lib.h"
+
+#define LOCKSTAT_BENCHMARK_ROUNDS 100000
+#define LOCKSTAT_CONTENDED_ROUNDS 10000
+
+SpinLock lockStatTestSpinLock;
+Mutex lockStatTestMutex;
+LockStatKey lockStatTestKeys[3] = {LockStatKeyCreate(), LockStatKeyCreate(), LockStatKeyCreate()};
+// room for every lock, the ones used by the tests only tie with the others on zero contentions
+LockStatSummary lockStatTestSummaries[LOCKSTAT_MAX_LOCKS];
+
+LockStatSummary *lockstat_test_find(LockStatKey *key, uint32_t found) {
+    for (uint32_t i = 0; i < found; i++) {
+        if (lockStatTestSummaries[i].address == (uint32_t) key) {
+            return &lockStatTestSummaries[i];
+        }
+    }
+    return nullptr;
+}
+
+void should_lockstat_record_acquisitions() {
+    test_init_percpu();
+    spinlock_create(&lockStatTestSpinLock);
+    lockstat_set_name(&lockStatTestSpinLock.stat, "test spinlock");
+    mutex_create(&lockStatTestMutex);
+    lockstat_set_name(&lockStatTestMutex.stat, "test mutex");
+    lockstat_reset();
+    lockstat_enable(true);
+    for (uint32_t i = 0; i < 3; i++) {
+        lockStatTestSpinLock.operations.acquire(&lockStatTestSpinLock);
+        lockStatTestSpinLock.operations.release(&lockStatTestSpinLock);
+    }
+    for (uint32_t i = 0; i < 2; i++) {
+        lockStatTestMutex.operations.acquire(&lockStatTestMutex);
+        lockStatTestMutex.operations.release(&lockStatTestMutex);
+    }
+    lockstat_enable(false);
+
+    ASSERT_NEQ(lockStatTestSpinLock.stat.id, 0);
+    ASSERT_NEQ(lockStatTestMutex.stat.id, 0);
+    // the mutex's own spin lock is counted on its own
+    uint32_t found = lockstat_top(lockStatTestSummaries, LOCKSTAT_MAX_LOCKS);
+    LockStatSummary *spinLockSummary = lockstat_test_find(&lockStatTestSpinLock.stat, found);
+    LockStatSummary *mutexSummary = lockstat_test_find(&lockStatTestMutex.stat, found);
+    ASSERT_NEQ(spinLockSummary, nullptr);
+    ASSERT_NEQ(mutexSummary, nullptr);
+    ASSERT_TRUE(strcmp((char *) spinLockSummary->name, "test spinlock"));
+    ASSERT_EQ(spinLockSummary->total.acquisitions, 3);
+    ASSERT_EQ(spinLockSummary->total.contentions, 0);
+    ASSERT_EQ(mutexSummary->total.acquisitions, 2);
+    ASSERT_EQ(mutexSummary->total.contentions, 0);
+}
+
+void should_lockstat_rank_contended_locks() {
+    lockstat_reset();
+    const char *names[3] = {"first", "second", "third"};
+    for (uint32_t i = 0; i < 3; i++) {
+        lockstat_set_name(&lockStatTestKeys[i], names[i]);
+    }
+    uint32_t contentions[3] = {1, 3, 2};
+    for (uint32_t i = 0; i < 3; i++) {
+        for (uint32_t j = 0; j < contentions[i]; j++) {
+            lockstat_acquired(&lockStatTestKeys[i], read_pmccntr(), true, (void *) (0x1000 + i));
+            lockstat_released(&lockStatTestKeys[i]);
+        }
+    }
+
+    ASSERT_EQ(lockstat_top(lockStatTestSummaries, 2), 2);
+    ASSERT_EQ(lockStatTestSummaries[0].address, (uint32_t) &lockStatTestKeys[1]);
+    ASSERT_EQ(lockStatTestSummaries[0].total.contentions, 3);
+    ASSERT_EQ(lockStatTestSummaries[0].total.maxWaitSite, (void *) 0x1001);
+    ASSERT_EQ(lockStatTestSummaries[1].address, (uint32_t) &lockStatTestKeys[2]);
+    ASSERT_EQ(lockStatTestSummaries[1].total.contentions, 2);
+}
+
+extern volatile uint32_t lockStatNextId;
+
+/**
+ * a thread's own locks have no name and are freed with it, they neither use up slots nor get pointed to
+ */
+void should_lockstat_share_slot_for_unnamed_locks() {
+    lockstat_reset();
+    LockStatKey unnamed = LockStatKeyCreate();
+    uint32_t nextId = lockStatNextId;
+    lockstat_acquired(&unnamed, read_pmccntr(), true, (void *) 0x2000);
+    lockstat_released(&unnamed);
+    ASSERT_EQ(unnamed.id, LOCKSTAT_OVERFLOW_ID);
+    ASSERT_EQ(lockStatNextId, nextId);
+
+    uint32_t found = lockstat_top(lockStatTestSummaries, LOCKSTAT_MAX_LOCKS);
+    ASSERT_EQ(found, 1);
+    ASSERT_EQ(lockStatTestSummaries[0].name, nullptr);
+    ASSERT_EQ(lockStatTestSummaries[0].total.contentions, 1);
+}
+
+void lockstat_test_contended_work() {
+    for (uint32_t i = 0; i < LOCKSTAT_CONTENDED_ROUNDS; i++) {
+        lockStatTestSpinLock.operations.acquire(&lockStatTestSpinLock);
+        lockStatTestSpinLock.operations.release(&lockStatTestSpinLock);
+    }
+}
+
+/**
+ * what recording costs an uncontended spin lock, and what it sees when every cpu hammers the same one
+ */
+void should_lockstat_overhead_benchmark() {
+    uint32_t onlineCpus = test_start_secondary_cpus();
+    test_init_percpu();
+    spinlock_create(&lockStatTestSpinLock);
+    lockstat_reset();
+    uint64_t elapsed[2];
+    for (uint32_t enabled = 0; enabled < 2; enabled++) {
+        lockstat_enable(enabled);
+        uint64_t start = read_cntvct();
+        for (uint32_t i = 0; i < LOCKSTAT_BENCHMARK_ROUNDS; i++) {
+            lockStatTestSpinLock.operations.acquire(&lockStatTestSpinLock);
+            lockStatTestSpinLock.operations.release(&lockStatTestSpinLock);
+        }
+        elapsed[enabled] = scheduler_counter_to_ns(read_cntvct() - start);
+    }
+    printf("[LockStat Benchmark]: acquire and release %d ns, %d ns recorded\n",
+           (uint32_t) (elapsed[0] / LOCKSTAT_BENCHMARK_ROUNDS), (uint32_t) (elapsed[1] / LOCKSTAT_BENCHMARK_ROUNDS));
+
+    lockstat_reset();
+    for (CpuNum cpuId = 0; cpuId < SMP_MAX_CPUS; cpuId++) {
+        testWork[cpuId] = cpuId < onlineCpus ? lockstat_test_contended_work : nullptr;
+    }
+    test_run_round();
+    lockstat_enable(false);
+
+    uint32_t found = lockstat_top(lockStatTestSummaries, LOCKSTAT_MAX_LOCKS);
+    LockStatSummary *summary = lockstat_test_find(&lockStatTestSpinLock.stat, found);
+    ASSERT_NEQ(summary, nullptr);
+    printf("[LockStat Benchmark]: %d cpus, %d contended, wait avg %d max %d cycles\n", onlineCpus,
+           summary->total.contentions,
+           summary->total.contentions != 0 ? (uint32_t) (summary->total.waitCycles / summary->total.contentions) : 0,
+           summary->total.maxWaitCycles);
+    ASSERT_EQ(summary->total.acquisitions, LOCKSTAT_CONTENDED_ROUNDS * onlineCpus);
+}
+
+#endif//__KERNEL_LOCKSTAT_TEST_H__
@@ -0,0 +1,207 @@
+//
+// Created by XingfengYang on 2021/1/31.
+//
+
+#ifndef __KERNEL_MPSC_QUEUE_TEST_H__
+#define __KERNEL_MPSC_QUEUE_TEST_H__
+
+#include "arm/register.h"
+#include "kernel/kqueue.h"
+#include "kernel/mpsc_queue.h"
+#include "kernel/spinlock.h"
+#include "raspi2/synestia_os_hal.h"
+#include "tests/tests_lib.h"
+
+#define MPSC_BENCHMARK_NODES 10000
+
+MpscQueue mpscTestQueue;
+KQueueNode mpscTestNodes[SMP_MAX_CPUS][MPSC_BENCHMARK_NODES];
+
+KernelQueue mpscTestLockedQueue;
+SpinLock mpscTestLock;
+volatile bool mpscTestLocked = false;
+uint32_t mpscTestExpected = 0;
+uint32_t mpscTestOrderViolations = 0;
+
+void should_mpsc_queue_keep_fifo_order() {
+    mpsc_queue_create(&mpscTestQueue);
+    ASSERT_TRUE(mpscTestQueue.operations.isEmpty(&mpscTestQueue));
+    ASSERT_EQ(mpscTestQueue.operations.dequeue(&mpscTestQueue), nullptr);
+
+    for (uint32_t round = 0; round < 2; round++) {
+        for (uint32_t i = 0; i < 3; i++) {
+            mpscTestQueue.operations.enqueue(&mpscTestQueue, &mpscTestNodes[0][i]);
+        }
+        ASSERT_FALSE(mpscTestQueue.operations.isEmpty(&mpscTestQueue));
+        for (uint32_t i = 0; i < 3; i++) {
+            ASSERT_EQ(mpscTestQueue.operations.dequeue(&mpscTestQueue), &mpscTestNodes[0][i]);
+        }
+        // the stub went back behind the last node, the queue is reusable
+        ASSERT_EQ(mpscTestQueue.operations.dequeue(&mpscTestQueue), nullptr);
+        ASSERT_TRUE(mpscTestQueue.operations.isEmpty(&mpscTestQueue));
+    }
+}
+
+/**
+ * a producer is interrupted between swapping head and linking the previous head to its node
+ */
+void should_mpsc_queue_wait_for_unlinked_producer() {
+    mpsc_queue_create(&mpscTestQueue);
+    KQueueNode *first = &mpscTestNodes[0][0];
+    KQueueNode *second = &mpscTestNodes[0][1];
+    mpscTestQueue.operations.enqueue(&mpscTestQueue, first);
+    second->next = nullptr;
+    ASSERT_EQ(atomic_xchg(&mpscTestQueue.head, (uint32_t) second), (uint32_t) first);
+
+    ASSERT_EQ(mpscTestQueue.operations.dequeue(&mpscTestQueue), nullptr);
+    ASSERT_FALSE(mpscTestQueue.operations.isEmpty(&mpscTestQueue));
+
+    first->next = second;
+    ASSERT_EQ(mpscTestQueue.operations.dequeue(&mpscTestQueue), first);
+    ASSERT_EQ(mpscTestQueue.operations.dequeue(&mpscTestQueue), second);
+    ASSERT_TRUE(mpscTestQueue.operations.isEmpty(&mpscTestQueue));
+}
+
+void should_scheduler_post_remote_wakeup() {
+    test_init_scheduler();
+    PerCpu *cpu = percpu_get(1);
+    Thread *sleeper = &testThreads[0];
+    test_init_thread(sleeper, 0, cpu_number_to_mask(1));
+    sleeper->threadStatus = THREAD_BLOCKED;
+
+    // cpu 0 wakes a thread that may only run on cpu 1, cpu 1's run queue is not touched
+    ASSERT_EQ(testScheduler.operation.wakeup(&testScheduler, sleeper), OK);
+    ASSERT_EQ(sleeper->threadStatus, THREAD_WAKING);
+    ASSERT_EQ(sleeper->currCpu, 1);
+    ASSERT_EQ(cpu->rbTree.size, 0);
+    ASSERT_FALSE(cpu->wakeupInbox.operations.isEmpty(&cpu->wakeupInbox));
+    // a second wakeup does not post it again
+    ASSERT_EQ(testScheduler.operation.wakeup(&testScheduler, sleeper), OK);
+
+    // what cpu 1 does on the kick interrupt
+    cpu->lock.operations.acquire(&cpu->lock);
+    scheduler_drain_wakeups(cpu);
+    cpu->lock.operations.release(&cpu->lock);
+    ASSERT_EQ(sleeper->threadStatus, THREAD_READY);
+    ASSERT_EQ(cpu->rbTree.size, 1);
+    ASSERT_TRUE(cpu->needResched);
+    ASSERT_TRUE(cpu->wakeupInbox.operations.isEmpty(&cpu->wakeupInbox));
+}
+
+bool mpscTestKicked = false;
+uint32_t mpscTestNextEvent = 0;
+
+void mpsc_queue_test_kicked_work() {
+    CpuNum cpuId = read_cpuid();
+    PerCpu *cpu = percpu_get(cpuId);
+    mpscTestKicked = synestia_cpu_kick_clear();
+    cpu->lock.operations.acquire(&cpu->lock);
+    scheduler_drain_wakeups(cpu);
+    cpu->lock.operations.release(&cpu->lock);
+    mpscTestNextEvent = scheduler_next_event(cpu);
+}
+
+/**
+ * a thread running alone on cpu 1 stopped its timer, only the kick gets the posted wakeup off its inbox
+ */
+void should_scheduler_kick_tickless_wakeup_target() {
+    test_init_scheduler();
+    if (test_start_secondary_cpus() < 2) {
+        printf("[MPSC Message]: needs a second cpu, skipped\n");
+        return;
+    }
+    PerCpu *cpu = percpu_get(1);
+    Thread *runner = &testThreads[0];
+    Thread *sleeper = &testThreads[1];
+    test_init_thread(runner, 0, cpu_number_to_mask(1));
+    test_init_thread(sleeper, 0, cpu_number_to_mask(1));
+    cpu->operations.insertThread(cpu, runner);
+    cpu->currentThread = runner;
+    cpu->sliceStart = read_cntvct();
+    ASSERT_EQ(scheduler_next_event(cpu), TICK_NO_EVENT);
+
+    sleeper->threadStatus = THREAD_BLOCKED;
+    ASSERT_EQ(testScheduler.operation.wakeup(&testScheduler, sleeper), OK);
+    mpscTestKicked = false;
+    test_run_on_cpu(1, mpsc_queue_test_kicked_work);
+    ASSERT_TRUE(mpscTestKicked);
+    ASSERT_EQ(sleeper->threadStatus, THREAD_READY);
+    ASSERT_EQ(cpu->rbTree.size, 2);
+    ASSERT_NEQ(mpscTestNextEvent, TICK_NO_EVENT);
+}
+
+void mpsc_queue_test_produce_work() {
+    CpuNum cpuId = read_cpuid();
+    for (uint32_t i = 0; i < MPSC_BENCHMARK_NODES; i++) {
+        if (mpscTestLocked) {
+            mpscTestLock.operations.acquire(&mpscTestLock);
+            mpscTestLockedQueue.operations.enqueue(&mpscTestLockedQueue, &mpscTestNodes[cpuId][i]);
+            mpscTestLock.operations.release(&mpscTestLock);
+        } else {
+            mpscTestQueue.operations.enqueue(&mpscTestQueue, &mpscTestNodes[cpuId][i]);
+        }
+    }
+}
+
+/**
+ * cpu 0 takes every node the others produce, each producer's nodes have to come out in its order
+ */
+void mpsc_queue_test_consume_work() {
+    uint32_t nextIndex[SMP_MAX_CPUS] = {0};
+    uint32_t received = 0;
+    while (received < mpscTestExpected) {
+        KQueueNode *node;
+        if (mpscTestLocked) {
+            mpscTestLock.operations.acquire(&mpscTestLock);
+            node = mpscTestLockedQueue.operations.dequeue(&mpscTestLockedQueue);
+            mpscTestLock.operations.release(&mpscTestLock);
+        } else {
+            node = mpscTestQueue.operations.dequeue(&mpscTestQueue);
+        }
+        if (node == nullptr) {
+            continue;
+        }
+        uint32_t offset = node - &mpscTestNodes[0][0];
+        uint32_t producer = offset / MPSC_BENCHMARK_NODES;
+        if (offset % MPSC_BENCHMARK_NODES != nextIndex[producer]) {
+            mpscTestOrderViolations++;
+        }
+        nextIndex[producer] = offset % MPSC_BENCHMARK_NODES + 1;
+        received++;
+    }
+}
+
+/**
+ * every cpu but cpu 0 posts nodes to cpu 0 at once, through the lock-free queue and through a spin locked KernelQueue
+ */
+void should_mpsc_queue_throughput_benchmark() {
+    uint32_t onlineCpus = test_start_secondary_cpus();
+    if (onlineCpus < 2) {
+        printf("[MPSC Benchmark]: needs a second cpu, skipped\n");
+        return;
+    }
+    mpsc_queue_create(&mpscTestQueue);
+    kqueue_create(&mpscTestLockedQueue);
+    spinlock_create(&mpscTestLock);
+    mpscTestExpected = MPSC_BENCHMARK_NODES * (onlineCpus - 1);
+    mpscTestOrderViolations = 0;
+
+    uint64_t elapsedNs[2];
+    for (uint32_t locked = 0; locked < 2; locked++) {
+        mpscTestLocked = locked;
+        for (CpuNum cpuId = 0; cpuId < SMP_MAX_CPUS; cpuId++) {
+            testWork[cpuId] = cpuId < onlineCpus ? mpsc_queue_test_produce_work : nullptr;
+        }
+        testWork[0] = mpsc_queue_test_consume_work;
+        uint64_t start = read_cntvct();
+        test_run_round();
+        elapsedNs[locked] = scheduler_counter_to_ns(read_cntvct() - start);
+    }
+    printf("[MPSC Benchmark]: %d producers, %d ns per node lock-free, %d ns per node locked\n", onlineCpus - 1,
+           (uint32_t) (elapsedNs[0] / mpscTestExpected), (uint32_t) (elapsedNs[1] / mpscTestExpected));
+    ASSERT_EQ(mpscTestOrderViolations, 0);
+    ASSERT_TRUE(mpscTestQueue.operations.isEmpty(&mpscTestQueue));
+    ASSERT_EQ(mpscTestLockedQueue.size, 0);
+}
+
+#endif//__KERNEL_MPSC_QUEUE_TEST_H__
@@ -0,0 +1,165 @@
+//
+// Created by XingfengYang on 2021/1/27.
+//
+
+#ifndef __KERNEL_MUTEX_TEST_H__
+#define __KERNEL_MUTEX_TEST_H__
+
+#include "arm/register.h"
+#include "kernel/mutex.h"
+#include "tests/tests_lib.h"
+
+#define MUTEX_BENCHMARK_HAND_OFFS 1000
+// how long the holder keeps the mutex, long enough for the other cpu to be spinning on it
+#define MUTEX_BENCHMARK_HOLD_US 2
+
+extern Scheduler cfsScheduler;
+
+Mutex mutexTest;
+volatile uint32_t mutexTestStep = 0;
+volatile uint64_t mutexTestReleasedAt = 0;
+uint64_t mutexTestHandOffCounter = 0;
+
+void mutex_test_init() {
+    test_init_scheduler();
+    scheduler_create(&cfsScheduler);
+    mutex_create(&mutexTest);
+}
+
+void should_mutex_track_owner() {
+    mutex_test_init();
+    PerCpu *cpu = percpu_get(0);
+    Thread *owner = &testThreads[0];
+    test_init_thread(owner, 0, cpu_number_to_mask(0));
+    owner->threadStatus = THREAD_RUNNING;
+    cpu->currentThread = owner;
+
+    mutexTest.operations.acquire(&mutexTest);
+    ASSERT_EQ(mutexTest.owner, owner);
+    ASSERT_EQ(atomic_get(&mutexTest.val), 1);
+    mutexTest.operations.release(&mutexTest);
+    ASSERT_EQ(mutexTest.owner, nullptr);
+    ASSERT_EQ(atomic_get(&mutexTest.val), 0);
+    cpu->currentThread = nullptr;
+}
+
+void should_mutex_spin_only_on_running_owner() {
+    test_init_percpu();
+    Thread *owner = &testThreads[0];
+    test_init_thread(owner, 0, CPU_MASK_ALL);
+    owner->threadStatus = THREAD_RUNNING;
+    owner->currCpu = 1;
+    percpu_get(1)->currentThread = owner;
+    ASSERT_TRUE(mutex_owner_running(owner));
+
+    // preempted, or on the spinning cpu itself, the owner can not release the mutex while we spin
+    owner->threadStatus = THREAD_READY;
+    ASSERT_FALSE(mutex_owner_running(owner));
+    owner->threadStatus = THREAD_RUNNING;
+    owner->currCpu = 0;
+    ASSERT_FALSE(mutex_owner_running(owner));
+    percpu_get(1)->currentThread = nullptr;
+}
+
+/**
+ * waiters are put on the wait queue the way acquire leaves them when it goes to sleep
+ */
+void should_mutex_inherit_priority() {
+    mutex_test_init();
+    PerCpu *cpu = percpu_get(0);
+    Thread *owner = &testThreads[0];
+    Thread *background = &testThreads[1];
+    Thread *driver = &testThreads[2];
+    test_init_thread(owner, 0, cpu_number_to_mask(0));
+    test_init_thread(background, 0, cpu_number_to_mask(0));
+    test_init_thread(driver, 0, cpu_number_to_mask(0));
+    background->priority = LOW_PRIORITY;
+    driver->schedPolicy = SCHED_FIFO;
+    driver->priority = HIGH_PRIORITY;
+    owner->threadStatus = THREAD_RUNNING;
+    cpu->currentThread = owner;
+    mutexTest.operations.acquire(&mutexTest);
+
+    // a less urgent waiter changes nothing
+    background->threadStatus = THREAD_BLOCKED;
+    mutexTest.waitQueue.operations.enqueue(&mutexTest.waitQueue, &background->threadReadyQueue);
+    mutex_inherit_priority(&mutexTest, background);
+    ASSERT_FALSE(owner->priorityBoosted);
+    ASSERT_EQ(owner->priority, DEFAULT_PRIORITY);
+
+    driver->threadStatus = THREAD_BLOCKED;
+    mutexTest.waitQueue.operations.enqueue(&mutexTest.waitQueue, &driver->threadReadyQueue);
+    mutex_inherit_priority(&mutexTest, driver);
+    ASSERT_TRUE(owner->priorityBoosted);
+    ASSERT_EQ(owner->schedPolicy, SCHED_FIFO);
+    ASSERT_EQ(owner->priority, HIGH_PRIORITY);
+
+    // the real-time waiter queued last gets the mutex first, the owner drops back to its own priority
+    mutexTest.operations.release(&mutexTest);
+    ASSERT_EQ(mutexTest.owner, driver);
+    ASSERT_EQ(driver->threadStatus, THREAD_READY);
+    ASSERT_EQ(background->threadStatus, THREAD_BLOCKED);
+    ASSERT_FALSE(owner->priorityBoosted);
+    ASSERT_EQ(owner->schedPolicy, SCHED_OTHER);
+    ASSERT_EQ(owner->priority, DEFAULT_PRIORITY);
+
+    cpu->currentThread = driver;
+    mutexTest.operations.release(&mutexTest);
+    ASSERT_EQ(mutexTest.owner, background);
+    cpu->currentThread = background;
+    mutexTest.operations.release(&mutexTest);
+    ASSERT_EQ(mutexTest.owner, nullptr);
+    ASSERT_EQ(atomic_get(&mutexTest.val), 0);
+    cpu->currentThread = nullptr;
+}
+
+void mutex_test_holder_work() {
+    uint64_t holdCounter = (uint64_t) read_cntfrq() / 1000000 * MUTEX_BENCHMARK_HOLD_US;
+    for (uint32_t i = 0; i < MUTEX_BENCHMARK_HAND_OFFS; i++) {
+        while (mutexTestStep != 2 * i) {
+        }
+        mutexTest.operations.acquire(&mutexTest);
+        mutexTestStep = 2 * i + 1;
+        uint64_t holdUntil = read_cntvct() + holdCounter;
+        while (read_cntvct() < holdUntil) {
+        }
+        mutexTestReleasedAt = read_cntvct();
+        mutexTest.operations.release(&mutexTest);
+    }
+}
+
+void mutex_test_waiter_work() {
+    mutexTestHandOffCounter = 0;
+    for (uint32_t i = 0; i < MUTEX_BENCHMARK_HAND_OFFS; i++) {
+        while (mutexTestStep != 2 * i + 1) {
+        }
+        mutexTest.operations.acquire(&mutexTest);
+        mutexTestHandOffCounter += read_cntvct() - mutexTestReleasedAt;
+        mutexTest.operations.release(&mutexTest);
+        mutexTestStep = 2 * i + 2;
+    }
+}
+
+/**
+ * time from the release on one cpu until the acquire returns on the other cpu, which spins on the running owner
+ */
+void should_mutex_hand_off_benchmark() {
+    uint32_t onlineCpus = test_start_secondary_cpus();
+    if (onlineCpus < 2) {
+        printf("[Mutex Benchmark]: needs a second cpu, skipped\n");
+        return;
+    }
+    test_init_percpu();
+    mutex_create(&mutexTest);
+    mutexTestStep = 0;
+    testWork[0] = mutex_test_waiter_work;
+    testWork[1] = mutex_test_holder_work;
+    test_run_round();
+
+    uint64_t handOffNs = scheduler_counter_to_ns(mutexTestHandOffCounter) / MUTEX_BENCHMARK_HAND_OFFS;
+    printf("[Mutex Benchmark]: %d ns from release to acquire on another cpu\n", (uint32_t) handOffNs);
+    ASSERT_EQ(mutexTestStep, 2 * MUTEX_BENCHMARK_HAND_OFFS);
+    ASSERT_EQ(atomic_get(&mutexTest.val), 0);
+}
+
+#endif//__KERNEL_MUTEX_TEST_H__
@@ -0,0 +1,87 @@
+//
+// Created by XingfengYang on 2021/2/1.
+//
+
+#ifndef __KERNEL_PERCPU_VAR_TEST_H__
+#define __KERNEL_PERCPU_VAR_TEST_H__
+
+#include "arm/register.h"
+#include "kernel/atomic.h"
+#include "kernel/percpu_var.h"
+#include "tests/tests_lib.h"
+
+#define PERCPU_VAR_TEST_INCREMENTS 100000
+#define PERCPU_VAR_CACHE_LINE 64
+
+DEFINE_PER_CPU(uint32_t, percpuVarTestCounter);
+Atomic percpuVarTestShared;
+Atomic percpuVarTestMisplaced;
+uint64_t percpuVarTestPerCpuNs[SMP_MAX_CPUS];
+uint64_t percpuVarTestSharedNs[SMP_MAX_CPUS];
+
+void should_percpu_var_isolate_cpus() {
+    uint32_t areaSize = (uint32_t) (__percpu_end - __percpu_start);
+    ASSERT_TRUE(areaSize != 0);
+    ASSERT_EQ(areaSize % PERCPU_VAR_CACHE_LINE, 0);
+    ASSERT_EQ((uint32_t) __percpu_start % PERCPU_VAR_CACHE_LINE, 0);
+    ASSERT_EQ(this_cpu_ptr(percpuVarTestCounter), &percpuVarTestCounter);
+
+    for (CpuNum cpuId = 0; cpuId < SMP_MAX_CPUS; cpuId++) {
+        ASSERT_EQ((uint32_t) per_cpu_ptr(percpuVarTestCounter, cpuId) - (uint32_t) &percpuVarTestCounter,
+                  cpuId * areaSize);
+        per_cpu(percpuVarTestCounter, cpuId) = cpuId + 1;
+    }
+    ASSERT_EQ(per_cpu_sum(percpuVarTestCounter), 10);
+    // counting down on another cpu than the one counting up wraps that copy, the sum stays right
+    this_cpu_add(percpuVarTestCounter, -5);
+    ASSERT_EQ(per_cpu(percpuVarTestCounter, 0), (uint32_t) -4);
+    ASSERT_EQ(per_cpu_sum(percpuVarTestCounter), 5);
+}
+
+void percpu_var_test_count_work() {
+    CpuNum cpuId = read_cpuid();
+    if (this_cpu_ptr(percpuVarTestCounter) != per_cpu_ptr(percpuVarTestCounter, cpuId)) {
+        atomic_inc(&percpuVarTestMisplaced);
+    }
+    uint64_t start = read_cntvct();
+    for (uint32_t i = 0; i < PERCPU_VAR_TEST_INCREMENTS; i++) {
+        this_cpu_inc(percpuVarTestCounter);
+    }
+    uint64_t middle = read_cntvct();
+    for (uint32_t i = 0; i < PERCPU_VAR_TEST_INCREMENTS; i++) {
+        atomic_inc(&percpuVarTestShared);
+    }
+    percpuVarTestPerCpuNs[cpuId] = scheduler_counter_to_ns(middle - start);
+    percpuVarTestSharedNs[cpuId] = scheduler_counter_to_ns(read_cntvct() - middle);
+}
+
+/**
+ * every cpu counts into its own copy and into one shared atomic, the per-cpu counter never bounces a line
+ */
+void should_percpu_var_count_benchmark() {
+    uint32_t onlineCpus = test_start_secondary_cpus();
+    atomic_create(&percpuVarTestShared);
+    atomic_create(&percpuVarTestMisplaced);
+    for (CpuNum cpuId = 0; cpuId < SMP_MAX_CPUS; cpuId++) {
+        per_cpu(percpuVarTestCounter, cpuId) = 0;
+        percpuVarTestPerCpuNs[cpuId] = 0;
+        percpuVarTestSharedNs[cpuId] = 0;
+        testWork[cpuId] = cpuId < onlineCpus ? percpu_var_test_count_work : nullptr;
+    }
+    test_run_round();
+
+    uint64_t perCpuNs = 0;
+    uint64_t sharedNs = 0;
+    for (CpuNum cpuId = 0; cpuId < onlineCpus; cpuId++) {
+        perCpuNs += percpuVarTestPerCpuNs[cpuId];
+        sharedNs += percpuVarTestSharedNs[cpuId];
+    }
+    uint32_t increments = PERCPU_VAR_TEST_INCREMENTS * onlineCpus;
+    printf("[PerCpu Benchmark]: %d cpus, per-cpu counter %d ns, shared atomic %d ns per increment\n", onlineCpus,
+           (uint32_t) (perCpuNs / increments), (uint32_t) (sharedNs / increments));
+    ASSERT_EQ(atomic_get(&percpuVarTestMisplaced), 0);
+    ASSERT_EQ(per_cpu_sum(percpuVarTestCounter), increments);
+    ASSERT_EQ(atomic_get(&percpuVarTestShared), increments);
+}
+
+#endif//__KERNEL_PERCPU_VAR_TEST_H__
@@ -0,0 +1,293 @@
+//
+// Created by XingfengYang on 2021/1/29.
+//
+
+#ifndef __KERNEL_RCU_TEST_H__
+#define __KERNEL_RCU_TEST_H__
+
+#include "arm/register.h"
+#include "kernel/atomic.h"
+#include "kernel/rcu.h"
+#include "kernel/vfs.h"
+#include "kernel/vfs_super_block.h"
+#include "libc/string.h"
+#include "raspi2/synestia_os_hal.h"
+#include "tests/tests_lib.h"
+
+#define RCU_STRESS_UPDATES 2000
+#define RCU_TEST_ALIVE 0x600DF00D
+#define RCU_TEST_DEAD 0xDEADDEAD
+
+extern Scheduler cfsScheduler;
+
+typedef struct RcuTestItem {
+    volatile uint32_t magic;
+    volatile uint32_t value;
+} RcuTestItem;
+
+RcuHead rcuTestHeads[3];
+uint32_t rcuTestCallbacks = 0;
+RcuTestItem rcuTestItems[2];
+RcuTestItem *rcuTestCurrent;
+volatile bool rcuTestUpdating = false;
+Atomic rcuTestViolations;
+uint32_t rcuTestReads[SMP_MAX_CPUS];
+uint64_t rcuTestReadCounter[SMP_MAX_CPUS];
+
+SuperBlock rcuTestSuperBlock;
+IndexNode rcuTestIndexNode;
+DirectoryEntry rcuTestParent;
+DirectoryEntry rcuTestEntries[3];
+DirectoryEntry *rcuTestDestroyed = nullptr;
+
+void rcu_test_callback(RcuHead *head) {
+    (void) head;
+    rcuTestCallbacks++;
+}
+
+void should_rcu_wait_for_readers() {
+    test_init_scheduler();
+    scheduler_create(&cfsScheduler);
+    rcu_init();
+    rcuTestCallbacks = 0;
+    PerCpu *cpu = percpu_get(1);
+    Thread *reader = &testThreads[0];
+    test_init_thread(reader, 0, cpu_number_to_mask(1));
+    reader->threadStatus = THREAD_RUNNING;
+    cpu->currentThread = reader;
+    cpu->rcuNesting = 1;
+
+    call_rcu(&rcuTestHeads[0], rcu_test_callback);
+    ASSERT_EQ(rcuState.pendingCpus, cpu_number_to_mask(1));
+    // queued while the grace period runs, they wait for the next one together
+    call_rcu(&rcuTestHeads[1], rcu_test_callback);
+    call_rcu(&rcuTestHeads[2], rcu_test_callback);
+
+    // still inside the read-side section
+    rcu_quiescent(cpu);
+    ASSERT_EQ(rcuTestCallbacks, 0);
+
+    cpu->rcuNesting = 0;
+    rcu_quiescent(cpu);
+    ASSERT_EQ(rcuTestCallbacks, 1);
+    ASSERT_EQ(rcuState.pendingCpus, cpu_number_to_mask(1));
+    rcu_quiescent(cpu);
+    ASSERT_EQ(rcuTestCallbacks, 3);
+    ASSERT_EQ(rcuState.status.gracePeriods, 2);
+    ASSERT_FALSE(rcuState.gracePeriodRunning);
+    cpu->currentThread = nullptr;
+}
+
+bool rcuTestKicked = false;
+uint32_t rcuTestNextEvent = 0;
+
+void rcu_test_kicked_work() {
+    PerCpu *cpu = percpu_get(read_cpuid());
+    rcuTestKicked = synestia_cpu_kick_clear();
+    rcuTestNextEvent = tick_next_event();
+    rcu_quiescent(cpu);
+}
+
+/**
+ * a thread running alone on cpu 1 stopped its timer, the grace period kicks it instead of waiting for a tick
+ */
+void should_rcu_kick_tickless_pending_cpu() {
+    test_init_scheduler();
+    scheduler_create(&cfsScheduler);
+    rcu_init();
+    if (test_start_secondary_cpus() < 2) {
+        printf("[RCU Message]: needs a second cpu, skipped\n");
+        return;
+    }
+    rcuTestCallbacks = 0;
+    PerCpu *cpu = percpu_get(1);
+    Thread *runner = &testThreads[0];
+    test_init_thread(runner, 0, cpu_number_to_mask(1));
+    runner->threadStatus = THREAD_RUNNING;
+    cpu->operations.insertThread(cpu, runner);
+    cpu->currentThread = runner;
+    cpu->sliceStart = read_cntvct();
+    ASSERT_EQ(scheduler_next_event(cpu), TICK_NO_EVENT);
+
+    call_rcu(&rcuTestHeads[0], rcu_test_callback);
+    ASSERT_EQ(rcuState.pendingCpus, cpu_number_to_mask(1));
+    rcuTestKicked = false;
+    test_run_on_cpu(1, rcu_test_kicked_work);
+    ASSERT_TRUE(rcuTestKicked);
+    // pending, it ticks until it has reported
+    ASSERT_TRUE(rcuTestNextEvent <= RCU_TICK_MS);
+    ASSERT_EQ(rcuState.pendingCpus, 0);
+    ASSERT_EQ(rcuTestCallbacks, 1);
+    ASSERT_EQ(rcuState.status.callbacks, 1);
+    cpu->currentThread = nullptr;
+}
+
+void should_rcu_defer_switch_in_read_section() {
+    test_init_scheduler();
+    scheduler_create(&cfsScheduler);
+    rcu_init();
+    PerCpu *cpu = percpu_get(0);
+
+    rcu_read_lock();
+    rcu_read_lock();
+    ASSERT_EQ(cpu->rcuNesting, 2);
+    // what the tick does when the slice ends inside the section
+    cpu->rcuDeferredResched = true;
+    ASSERT_EQ(tick_next_event(), TICK_NO_EVENT);
+
+    rcu_read_unlock();
+    ASSERT_FALSE(cpu->needResched);
+    rcu_read_unlock();
+    ASSERT_EQ(cpu->rcuNesting, 0);
+    ASSERT_FALSE(cpu->rcuDeferredResched);
+    ASSERT_TRUE(cpu->needResched);
+    cpu->needResched = false;
+}
+
+KernelStatus rcu_test_destroy_dentry(SuperBlock *superBlock, DirectoryEntry *dentry) {
+    (void) superBlock;
+    rcuTestDestroyed = dentry;
+    return OK;
+}
+
+void rcu_test_fill_dentries() {
+    test_init_percpu();
+    rcu_init();
+    rcuTestSuperBlock.operations.destroyDirectoryEntry = rcu_test_destroy_dentry;
+    rcuTestSuperBlock.rootDirectoryEntry = &rcuTestParent;
+    rcuTestIndexNode.type = INDEX_NODE_FILE;
+    rcuTestDestroyed = nullptr;
+    rcuTestParent.parent = nullptr;
+    rcuTestParent.children = nullptr;
+    const char *names[3] = {"bin", "etc", "home"};
+    for (uint32_t i = 0; i < 3; i++) {
+        DirectoryEntry *entry = &rcuTestEntries[i];
+        memset((char *) entry->fileName, 0, sizeof(entry->fileName));
+        memcpy(entry->fileName, (char *) names[i], strlen((char *) names[i]));
+        entry->superBlock = &rcuTestSuperBlock;
+        entry->list.prev = nullptr;
+        entry->list.next = nullptr;
+        // the tree's reference, as create_directory_entry hands it out
+        atomic_set(&entry->refCount, 1);
+        if (rcuTestParent.children != nullptr) {
+            klist_append(&rcuTestParent.children->list, &entry->list);
+        }
+        vfs_directory_entry_default_init(entry, &rcuTestParent, &rcuTestIndexNode);
+    }
+}
+
+/**
+ * entries are linked the way ext2 fills a directory, deleted ones stay readable until the grace period is over
+ */
+void should_rcu_find_dentry_child() {
+    rcu_test_fill_dentries();
+
+    rcu_read_lock();
+    ASSERT_EQ(vfs_directory_entry_find_child(&rcuTestParent, "bin"), &rcuTestEntries[0]);
+    ASSERT_EQ(vfs_directory_entry_find_child(&rcuTestParent, "home"), &rcuTestEntries[2]);
+    ASSERT_EQ(vfs_directory_entry_find_child(&rcuTestParent, "usr"), nullptr);
+    rcu_read_unlock();
+
+    vfs_directory_entry_default_delete(&rcuTestEntries[2]);
+    ASSERT_EQ(rcuTestParent.children, &rcuTestEntries[1]);
+    ASSERT_EQ(vfs_directory_entry_find_child(&rcuTestParent, "home"), nullptr);
+    ASSERT_EQ(vfs_directory_entry_find_child(&rcuTestParent, "bin"), &rcuTestEntries[0]);
+    // a reader standing on the deleted entry still gets to its siblings
+    ASSERT_EQ(rcuTestEntries[2].list.prev, &rcuTestEntries[1].list);
+    ASSERT_EQ(rcuTestDestroyed, nullptr);
+    rcu_quiescent(percpu_get(0));
+    ASSERT_EQ(rcuTestDestroyed, &rcuTestEntries[2]);
+}
+
+/**
+ * a lookup result deleted after the lookup returned outlives the grace period until it is released
+ */
+void should_rcu_keep_looked_up_dentry_until_release() {
+    rcu_test_fill_dentries();
+    VFS testVfs;
+    vfs_create(&testVfs);
+    testVfs.fileSystems = &rcuTestSuperBlock;
+
+    DirectoryEntry *home = testVfs.operations.lookup(&testVfs, "/home");
+    ASSERT_EQ(home, &rcuTestEntries[2]);
+    ASSERT_EQ(atomic_get(&home->refCount), 2);
+    ASSERT_EQ(testVfs.operations.lookup(&testVfs, "/usr"), nullptr);
+
+    vfs_directory_entry_default_delete(home);
+    rcu_quiescent(percpu_get(0));
+    ASSERT_EQ(rcuTestDestroyed, nullptr);
+    ASSERT_EQ(atomic_get(&home->refCount), 1);
+
+    vfs_directory_entry_default_release(home);
+    ASSERT_EQ(rcuTestDestroyed, &rcuTestEntries[2]);
+}
+
+void rcu_test_read_work() {
+    CpuNum cpuId = read_cpuid();
+    uint32_t reads = 0;
+    uint64_t start = read_cntvct();
+    while (rcuTestUpdating) {
+        rcu_read_lock();
+        RcuTestItem *item = rcu_dereference(rcuTestCurrent);
+        uint32_t magic = item->magic;
+        uint32_t value = item->value;
+        if (magic != RCU_TEST_ALIVE || item->magic != RCU_TEST_ALIVE || value > RCU_STRESS_UPDATES) {
+            atomic_inc(&rcuTestViolations);
+        }
+        rcu_read_unlock();
+        reads++;
+    }
+    rcuTestReadCounter[cpuId] = read_cntvct() - start;
+    rcuTestReads[cpuId] = reads;
+}
+
+void rcu_test_update_work() {
+    CpuNum cpuId = read_cpuid();
+    uint64_t start = read_cntvct();
+    for (uint32_t i = 1; i <= RCU_STRESS_UPDATES; i++) {
+        RcuTestItem *old = rcuTestCurrent;
+        RcuTestItem *item = old == &rcuTestItems[0] ? &rcuTestItems[1] : &rcuTestItems[0];
+        item->value = i;
+        item->magic = RCU_TEST_ALIVE;
+        rcu_assign_pointer(rcuTestCurrent, item);
+        synchronize_rcu();
+        // nobody can be reading the old item anymore
+        old->magic = RCU_TEST_DEAD;
+    }
+    rcuTestReadCounter[cpuId] = read_cntvct() - start;
+    rcuTestUpdating = false;
+}
+
+/**
+ * cpu 0 keeps replacing the item the other cpus read, and poisons the old one after every grace period
+ */
+void should_rcu_stress() {
+    uint32_t onlineCpus = test_start_secondary_cpus();
+    test_init_percpu();
+    rcu_init();
+    atomic_create(&rcuTestViolations);
+    rcuTestItems[0].magic = RCU_TEST_ALIVE;
+    rcuTestItems[0].value = 0;
+    rcuTestCurrent = &rcuTestItems[0];
+    rcuTestUpdating = true;
+    for (CpuNum cpuId = 0; cpuId < SMP_MAX_CPUS; cpuId++) {
+        rcuTestReads[cpuId] = 0;
+        testWork[cpuId] = cpuId < onlineCpus ? rcu_test_read_work : nullptr;
+    }
+    testWork[0] = rcu_test_update_work;
+    test_run_round();
+
+    printf("[RCU Stress]: %d ns per synchronize_rcu\n",
+           (uint32_t) (scheduler_counter_to_ns(rcuTestReadCounter[0]) / RCU_STRESS_UPDATES));
+    for (CpuNum cpuId = 1; cpuId < onlineCpus; cpuId++) {
+        if (rcuTestReads[cpuId] != 0) {
+            printf("[RCU Stress]: cpu %d, %d reads, %d ns per read\n", cpuId, rcuTestReads[cpuId],
+                   (uint32_t) (scheduler_counter_to_ns(rcuTestReadCounter[cpuId]) / rcuTestReads[cpuId]));
+        }
+    }
+    ASSERT_EQ(atomic_get(&rcuTestViolations), 0);
+    ASSERT_EQ(rcuTestCurrent->value, RCU_STRESS_UPDATES);
+    ASSERT_EQ(rcuState.status.gracePeriods, RCU_STRESS_UPDATES);
+}
+
+#endif//__KERNEL_RCU_TEST_H__
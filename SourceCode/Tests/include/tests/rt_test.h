@@ -0,0 +1,177 @@
+//
+// Created by XingfengYang on 2021/1/18.
+//
+
+#ifndef __KERNEL_RT_TEST_H__
+#define __KERNEL_RT_TEST_H__
+
+#include "arm/register.h"
+#include "kernel/rtqueue.h"
+#include "kernel/scheduler.h"
+#include "tests/tests_lib.h"
+
+#define RT_BENCHMARK_PICKS 10000
+
+RtQueue rtTestQueue;
+
+void rt_test_init_thread(Thread *thread, SchedPolicy schedPolicy, uint32_t priority) {
+    test_init_thread(thread, 0, cpu_number_to_mask(0));
+    thread->schedPolicy = schedPolicy;
+    thread->priority = priority;
+}
+
+void should_rt_queue_pick_highest_level() {
+    rt_queue_create(&rtTestQueue);
+    Thread *low = &testThreads[0];
+    Thread *first = &testThreads[1];
+    Thread *second = &testThreads[2];
+    Thread *middle = &testThreads[3];
+    rt_test_init_thread(low, SCHED_FIFO, 3);
+    rt_test_init_thread(first, SCHED_FIFO, 20);
+    rt_test_init_thread(second, SCHED_FIFO, 20);
+    rt_test_init_thread(middle, SCHED_FIFO, 7);
+    rtTestQueue.operations.enqueue(&rtTestQueue, low);
+    rtTestQueue.operations.enqueue(&rtTestQueue, first);
+    rtTestQueue.operations.enqueue(&rtTestQueue, second);
+    rtTestQueue.operations.enqueue(&rtTestQueue, middle);
+    ASSERT_EQ(rtTestQueue.bitmap, (1u << 3) | (1u << 7) | (1u << 20));
+    ASSERT_EQ(rtTestQueue.size, 4);
+
+    // fifo inside a level
+    ASSERT_EQ(rtTestQueue.operations.getHighest(&rtTestQueue), first);
+    rtTestQueue.operations.requeue(&rtTestQueue, first);
+    ASSERT_EQ(rtTestQueue.operations.getHighest(&rtTestQueue), second);
+
+    rtTestQueue.operations.remove(&rtTestQueue, second);
+    rtTestQueue.operations.remove(&rtTestQueue, first);
+    ASSERT_EQ(rtTestQueue.bitmap, (1u << 3) | (1u << 7));
+    ASSERT_EQ(rtTestQueue.operations.getHighest(&rtTestQueue), middle);
+    rtTestQueue.operations.remove(&rtTestQueue, middle);
+    rtTestQueue.operations.remove(&rtTestQueue, low);
+    ASSERT_EQ(rtTestQueue.bitmap, 0);
+    ASSERT_EQ(rtTestQueue.operations.getHighest(&rtTestQueue), nullptr);
+}
+
+void should_rt_preempt_cfs_on_wakeup() {
+    test_init_scheduler();
+    PerCpu *cpu = percpu_get(0);
+    Thread *running = &testThreads[0];
+    Thread *driver = &testThreads[1];
+    test_init_thread(running, 0, cpu_number_to_mask(0));
+    rt_test_init_thread(driver, SCHED_FIFO, LOW_PRIORITY);
+    running->threadStatus = THREAD_RUNNING;
+    driver->threadStatus = THREAD_BLOCKED;
+    cpu->operations.insertThread(cpu, running);
+    cpu->currentThread = running;
+    cpu->sliceStart = read_cntvct();
+
+    uint64_t start = read_cntvct();
+    testScheduler.operation.wakeup(&testScheduler, driver);
+    ASSERT_TRUE(cpu->needResched);
+    ASSERT_EQ(cpu->weight, PRIORITY_DEFAULT_WEIGHT);
+    testScheduler.operation.switchNext(&testScheduler);
+    uint64_t latencyNs = scheduler_counter_to_ns(read_cntvct() - start);
+
+    printf("[RT Benchmark]: wakeup to run latency %d ns\n", (uint32_t) latencyNs);
+    ASSERT_EQ(cpu->currentThread, driver);
+    // the cfs thread is still queued and no timer is needed while the fifo thread runs
+    ASSERT_EQ(cpu->rbTree.size, 1);
+    ASSERT_EQ(scheduler_next_event(cpu), TICK_NO_EVENT);
+}
+
+void should_rt_fifo_keep_cpu() {
+    test_init_scheduler();
+    PerCpu *cpu = percpu_get(0);
+    Thread *running = &testThreads[0];
+    Thread *waiting = &testThreads[1];
+    rt_test_init_thread(running, SCHED_FIFO, HIGH_PRIORITY);
+    rt_test_init_thread(waiting, SCHED_FIFO, HIGH_PRIORITY);
+    cpu->operations.insertThread(cpu, running);
+    cpu->operations.insertThread(cpu, waiting);
+    testScheduler.operation.switchNext(&testScheduler);
+    ASSERT_EQ(cpu->currentThread, running);
+
+    // a fifo thread is not sliced, even with an equal level thread waiting
+    ASSERT_EQ(scheduler_next_event(cpu), TICK_NO_EVENT);
+    testScheduler.operation.switchNext(&testScheduler);
+    ASSERT_EQ(cpu->currentThread, running);
+
+    // a higher level wakes up, the preempted fifo thread stays at the head of its level
+    Thread *urgent = &testThreads[2];
+    rt_test_init_thread(urgent, SCHED_FIFO, DPC_PRIORITY);
+    urgent->threadStatus = THREAD_BLOCKED;
+    testScheduler.operation.wakeup(&testScheduler, urgent);
+    ASSERT_EQ(scheduler_next_event(cpu), 0);
+    testScheduler.operation.switchNext(&testScheduler);
+    ASSERT_EQ(cpu->currentThread, urgent);
+
+    urgent->threadStatus = THREAD_BLOCKED;
+    testScheduler.operation.switchNext(&testScheduler);
+    ASSERT_EQ(cpu->currentThread, running);
+}
+
+void should_rt_round_robin_after_slice() {
+    test_init_scheduler();
+    PerCpu *cpu = percpu_get(0);
+    Thread *first = &testThreads[0];
+    Thread *second = &testThreads[1];
+    rt_test_init_thread(first, SCHED_RR, HIGH_PRIORITY);
+    rt_test_init_thread(second, SCHED_RR, HIGH_PRIORITY);
+    cpu->operations.insertThread(cpu, first);
+    cpu->operations.insertThread(cpu, second);
+    testScheduler.operation.switchNext(&testScheduler);
+    ASSERT_EQ(cpu->currentThread, first);
+    uint32_t nextEvent = scheduler_next_event(cpu);
+    ASSERT_TRUE(nextEvent > 0 && nextEvent <= SCHED_RR_TIMESLICE_MS);
+
+    // pretend the slice ran out
+    cpu->sliceStart = read_cntvct() - (uint64_t) read_cntfrq() / 1000 * (SCHED_RR_TIMESLICE_MS + 1);
+    ASSERT_EQ(scheduler_next_event(cpu), 0);
+    testScheduler.operation.switchNext(&testScheduler);
+    ASSERT_EQ(cpu->currentThread, second);
+    ASSERT_EQ(first->rtSliceUsedNs, 0);
+}
+
+void should_rt_set_policy_requeue_thread() {
+    test_init_scheduler();
+    PerCpu *cpu = percpu_get(0);
+    Thread *thread = &testThreads[0];
+    test_init_thread(thread, 0, cpu_number_to_mask(0));
+    cpu->operations.insertThread(cpu, thread);
+    ASSERT_EQ(cpu->rbTree.size, 1);
+
+    ASSERT_EQ(testScheduler.operation.setPolicy(&testScheduler, thread, SCHED_RR, HIGH_PRIORITY), OK);
+    ASSERT_EQ(cpu->rbTree.size, 0);
+    ASSERT_EQ(cpu->weight, 0);
+    ASSERT_EQ(cpu->rtQueue.size, 1);
+
+    ASSERT_EQ(testScheduler.operation.setPolicy(&testScheduler, thread, SCHED_OTHER, DEFAULT_PRIORITY), OK);
+    ASSERT_EQ(cpu->rbTree.size, 1);
+    ASSERT_EQ(cpu->rtQueue.size, 0);
+    ASSERT_EQ(testScheduler.operation.setPolicy(&testScheduler, thread, SCHED_FIFO, NUM_PRIORITIES), ERROR);
+}
+
+/**
+ * the pick must not depend on how many real-time threads are queued, compare 1 and 256 ready threads
+ */
+void should_rt_pick_benchmark() {
+    uint32_t counts[2] = {1, TEST_THREAD_NUM};
+    for (uint32_t round = 0; round < 2; round++) {
+        rt_queue_create(&rtTestQueue);
+        for (uint32_t i = 0; i < counts[round]; i++) {
+            rt_test_init_thread(&testThreads[i], SCHED_FIFO, i % RT_PRIORITY_LEVELS);
+            rtTestQueue.operations.enqueue(&rtTestQueue, &testThreads[i]);
+        }
+        uint64_t start = read_cntvct();
+        Thread *picked = nullptr;
+        for (uint32_t i = 0; i < RT_BENCHMARK_PICKS; i++) {
+            picked = rtTestQueue.operations.getHighest(&rtTestQueue);
+        }
+        uint64_t elapsedNs = scheduler_counter_to_ns(read_cntvct() - start);
+        printf("[RT Benchmark]: %d ready threads, %d ns per pick\n", counts[round],
+               (uint32_t) (elapsedNs / RT_BENCHMARK_PICKS));
+        ASSERT_EQ(rt_queue_level(picked), counts[round] == 1 ? 0 : HIGHEST_PRIORITY);
+    }
+}
+
+#endif//__KERNEL_RT_TEST_H__
@@ -0,0 +1,203 @@
+//
+// Created by XingfengYang on 2021/1/26.
+//
+
+#ifndef __KERNEL_RWLOCK_TEST_H__
+#define __KERNEL_RWLOCK_TEST_H__
+
+#include "arm/register.h"
+#include "kernel/atomic.h"
+#include "kernel/rwlock.h"
+#include "kernel/seqlock.h"
+#include "tests/tests_lib.h"
+
+#define RWLOCK_STRESS_ITERATIONS 20000
+// every n-th iteration of a cpu writes, the others read
+#define RWLOCK_STRESS_WRITE_EVERY 8
+#define SEQLOCK_STRESS_WRITES 100000
+
+extern Scheduler cfsScheduler;
+
+RwLock rwlockTestLock;
+Atomic rwlockTestReaders;
+Atomic rwlockTestWriters;
+Atomic rwlockTestViolations;
+// written as a pair under the write lock, a reader must never see them differ
+volatile uint32_t rwlockTestFirst = 0;
+volatile uint32_t rwlockTestSecond = 0;
+
+SeqLock seqlockTest;
+volatile uint64_t seqlockTestValue = 0;
+volatile uint64_t seqlockTestInverse = ~0ull;
+volatile bool seqlockTestWriting = false;
+uint32_t seqlockTestReads[SMP_MAX_CPUS];
+uint32_t seqlockTestRetries[SMP_MAX_CPUS];
+
+void should_rwlock_share_readers_exclude_writer() {
+    rwlock_create(&rwlockTestLock);
+    ASSERT_TRUE(rwlockTestLock.operations.tryAcquireRead(&rwlockTestLock));
+    ASSERT_TRUE(rwlockTestLock.operations.tryAcquireRead(&rwlockTestLock));
+    ASSERT_EQ(rwlockTestLock.readers, 2);
+    ASSERT_FALSE(rwlockTestLock.operations.tryAcquireWrite(&rwlockTestLock));
+    rwlockTestLock.operations.releaseRead(&rwlockTestLock);
+    rwlockTestLock.operations.releaseRead(&rwlockTestLock);
+
+    ASSERT_TRUE(rwlockTestLock.operations.tryAcquireWrite(&rwlockTestLock));
+    ASSERT_FALSE(rwlockTestLock.operations.tryAcquireRead(&rwlockTestLock));
+    ASSERT_FALSE(rwlockTestLock.operations.tryAcquireWrite(&rwlockTestLock));
+    rwlockTestLock.operations.releaseWrite(&rwlockTestLock);
+    ASSERT_FALSE(rwlockTestLock.writer);
+    ASSERT_EQ(rwlockTestLock.readers, 0);
+}
+
+/**
+ * threads are put on the wait queues the way acquireRead and acquireWrite leave them when they go to sleep
+ */
+void should_rwlock_prefer_waiting_writer() {
+    test_init_scheduler();
+    scheduler_create(&cfsScheduler);
+    rwlock_create(&rwlockTestLock);
+    Thread *writer = &testThreads[0];
+    Thread *firstReader = &testThreads[1];
+    Thread *secondReader = &testThreads[2];
+    test_init_thread(writer, 0, cpu_number_to_mask(0));
+    test_init_thread(firstReader, 0, cpu_number_to_mask(0));
+    test_init_thread(secondReader, 0, cpu_number_to_mask(0));
+
+    rwlockTestLock.operations.acquireRead(&rwlockTestLock);
+    writer->threadStatus = THREAD_BLOCKED;
+    rwlockTestLock.writerQueue.operations.enqueue(&rwlockTestLock.writerQueue, &writer->threadReadyQueue);
+    // a waiting writer keeps new readers out
+    ASSERT_FALSE(rwlockTestLock.operations.tryAcquireRead(&rwlockTestLock));
+    firstReader->threadStatus = THREAD_BLOCKED_READ_LOCK;
+    secondReader->threadStatus = THREAD_BLOCKED_READ_LOCK;
+    rwlockTestLock.readerQueue.operations.enqueue(&rwlockTestLock.readerQueue, &firstReader->threadReadyQueue);
+    rwlockTestLock.readerQueue.operations.enqueue(&rwlockTestLock.readerQueue, &secondReader->threadReadyQueue);
+
+    // the last reader hands the lock to the writer only
+    rwlockTestLock.operations.releaseRead(&rwlockTestLock);
+    ASSERT_TRUE(rwlockTestLock.writer);
+    ASSERT_EQ(writer->threadStatus, THREAD_READY);
+    ASSERT_EQ(firstReader->threadStatus, THREAD_BLOCKED_READ_LOCK);
+    ASSERT_EQ(rwlockTestLock.readerQueue.size, 2);
+
+    // the writer lets every waiting reader in at once
+    rwlockTestLock.operations.releaseWrite(&rwlockTestLock);
+    ASSERT_FALSE(rwlockTestLock.writer);
+    ASSERT_EQ(rwlockTestLock.readers, 2);
+    ASSERT_EQ(firstReader->threadStatus, THREAD_READY);
+    ASSERT_EQ(secondReader->threadStatus, THREAD_READY);
+    rwlockTestLock.operations.releaseRead(&rwlockTestLock);
+    rwlockTestLock.operations.releaseRead(&rwlockTestLock);
+    ASSERT_EQ(rwlockTestLock.readers, 0);
+}
+
+void rwlock_test_stress_work() {
+    CpuNum cpuId = read_cpuid();
+    for (uint32_t i = 0; i < RWLOCK_STRESS_ITERATIONS; i++) {
+        if (i % RWLOCK_STRESS_WRITE_EVERY == cpuId) {
+            while (!rwlockTestLock.operations.tryAcquireWrite(&rwlockTestLock)) {
+            }
+            if (atomic_inc(&rwlockTestWriters) != 1 || atomic_get(&rwlockTestReaders) != 0) {
+                atomic_inc(&rwlockTestViolations);
+            }
+            rwlockTestFirst = i;
+            rwlockTestSecond = i;
+            atomic_dec(&rwlockTestWriters);
+            rwlockTestLock.operations.releaseWrite(&rwlockTestLock);
+        } else {
+            while (!rwlockTestLock.operations.tryAcquireRead(&rwlockTestLock)) {
+            }
+            atomic_inc(&rwlockTestReaders);
+            if (atomic_get(&rwlockTestWriters) != 0 || rwlockTestFirst != rwlockTestSecond) {
+                atomic_inc(&rwlockTestViolations);
+            }
+            atomic_dec(&rwlockTestReaders);
+            rwlockTestLock.operations.releaseRead(&rwlockTestLock);
+        }
+    }
+}
+
+void should_rwlock_stress() {
+    uint32_t onlineCpus = test_start_secondary_cpus();
+    rwlock_create(&rwlockTestLock);
+    atomic_create(&rwlockTestReaders);
+    atomic_create(&rwlockTestWriters);
+    atomic_create(&rwlockTestViolations);
+    for (CpuNum cpuId = 0; cpuId < SMP_MAX_CPUS; cpuId++) {
+        testWork[cpuId] = cpuId < onlineCpus ? rwlock_test_stress_work : nullptr;
+    }
+    uint64_t start = read_cntvct();
+    test_run_round();
+    uint64_t elapsedNs = scheduler_counter_to_ns(read_cntvct() - start);
+    printf("[RwLock Stress]: %d cpus, %d ns per acquisition\n", onlineCpus,
+           (uint32_t) (elapsedNs / (RWLOCK_STRESS_ITERATIONS * onlineCpus)));
+    ASSERT_EQ(atomic_get(&rwlockTestViolations), 0);
+    ASSERT_EQ(rwlockTestLock.readers, 0);
+    ASSERT_FALSE(rwlockTestLock.writer);
+}
+
+void seqlock_test_read_work() {
+    CpuNum cpuId = read_cpuid();
+    uint32_t reads = 0;
+    uint32_t retries = 0;
+    while (seqlockTestWriting) {
+        uint64_t value;
+        uint64_t inverse;
+        uint32_t sequence;
+        do {
+            sequence = seqlock_read_begin(&seqlockTest);
+            value = seqlockTestValue;
+            inverse = seqlockTestInverse;
+            retries++;
+        } while (seqlock_read_retry(&seqlockTest, sequence));
+        retries--;
+        reads++;
+        if (value != ~inverse) {
+            atomic_inc(&rwlockTestViolations);
+        }
+    }
+    seqlockTestReads[cpuId] = reads;
+    seqlockTestRetries[cpuId] = retries;
+}
+
+void seqlock_test_write_work() {
+    for (uint32_t i = 1; i <= SEQLOCK_STRESS_WRITES; i++) {
+        seqlock_write_begin(&seqlockTest);
+        // both halves of both words change, a torn read can not pass the check
+        uint64_t value = ((uint64_t) i << 32) | i;
+        seqlockTestValue = value;
+        seqlockTestInverse = ~value;
+        seqlock_write_end(&seqlockTest);
+    }
+    seqlockTestWriting = false;
+}
+
+/**
+ * cpu 0 keeps rewriting a pair of 64 bit values, the other cpus read them without a lock
+ */
+void should_seqlock_stress() {
+    uint32_t onlineCpus = test_start_secondary_cpus();
+    seqlock_create(&seqlockTest);
+    atomic_create(&rwlockTestViolations);
+    seqlockTestValue = 0;
+    seqlockTestInverse = ~0ull;
+    seqlockTestWriting = true;
+    for (CpuNum cpuId = 0; cpuId < SMP_MAX_CPUS; cpuId++) {
+        seqlockTestReads[cpuId] = 0;
+        seqlockTestRetries[cpuId] = 0;
+        testWork[cpuId] = cpuId < onlineCpus ? seqlock_test_read_work : nullptr;
+    }
+    testWork[0] = seqlock_test_write_work;
+    test_run_round();
+
+    for (CpuNum cpuId = 1; cpuId < onlineCpus; cpuId++) {
+        printf("[SeqLock Stress]: cpu %d, %d reads, %d retries\n", cpuId, seqlockTestReads[cpuId],
+               seqlockTestRetries[cpuId]);
+    }
+    ASSERT_EQ(atomic_get(&rwlockTestViolations), 0);
+    ASSERT_EQ(seqlockTest.sequence, SEQLOCK_STRESS_WRITES * 2);
+    ASSERT_EQ(seqlockTestValue, ((uint64_t) SEQLOCK_STRESS_WRITES << 32) | SEQLOCK_STRESS_WRITES);
+}
+
+#endif//__KERNEL_RWLOCK_TEST_H__
@@ -0,0 +1,159 @@
+//
+// Created by XingfengYang on 2021/1/24.
+//
+
+#ifndef __KERNEL_SCHED_GROUP_TEST_H__
+#define __KERNEL_SCHED_GROUP_TEST_H__
+
+#include "arm/register.h"
+#include "kernel/ktimer.h"
+#include "kernel/sched_group.h"
+#include "tests/tests_lib.h"
+
+#define SCHED_GROUP_TEST_QUOTA_US 1000
+#define SCHED_GROUP_TEST_PERIOD_MS 10
+
+extern Scheduler cfsScheduler;
+extern KernelTimerManager kernelTimerManager;
+
+SchedGroup schedTestGroup;
+
+void sched_group_test_init() {
+    test_init_scheduler();
+    // parked threads are woken up through the kernel scheduler
+    scheduler_create(&cfsScheduler);
+    kernel_timer_manager_create(&kernelTimerManager);
+    sched_group_create(&schedTestGroup, SCHED_GROUP_TEST_QUOTA_US, SCHED_GROUP_TEST_PERIOD_MS);
+}
+
+void should_sched_group_throttle_at_quota() {
+    sched_group_test_init();
+    PerCpu *cpu = percpu_get(0);
+    Thread *running = &testThreads[0];
+    Thread *sibling = &testThreads[1];
+    Thread *other = &testThreads[2];
+    test_init_thread(running, 0, cpu_number_to_mask(0));
+    test_init_thread(sibling, 10, cpu_number_to_mask(0));
+    test_init_thread(other, 20, cpu_number_to_mask(0));
+    schedTestGroup.operations.attach(&schedTestGroup, running);
+    schedTestGroup.operations.attach(&schedTestGroup, sibling);
+    cpu->operations.insertThread(cpu, running);
+    cpu->operations.insertThread(cpu, sibling);
+    cpu->operations.insertThread(cpu, other);
+    cpu->currentThread = running;
+    running->threadStatus = THREAD_RUNNING;
+    // the running thread used twice the quota
+    cpu->sliceStart = read_cntvct() - (uint64_t) read_cntfrq() / 1000 * 2;
+
+    testScheduler.operation.switchNext(&testScheduler);
+    // both threads of the group left the run queue, the sibling only when it came up
+    ASSERT_EQ(cpu->currentThread, other);
+    ASSERT_EQ(cpu->rbTree.size, 1);
+    ASSERT_EQ(running->threadStatus, THREAD_THROTTLED);
+    ASSERT_EQ(sibling->threadStatus, THREAD_THROTTLED);
+    ASSERT_TRUE(schedTestGroup.throttled);
+    ASSERT_EQ(schedTestGroup.throttledThreads.size, 2);
+    ASSERT_EQ(schedTestGroup.status.throttleCount, 1);
+    ASSERT_EQ(schedTestGroup.status.parkCount, 2);
+    ASSERT_TRUE(schedTestGroup.status.usageNs >= (uint64_t) SCHED_GROUP_TEST_QUOTA_US * 1000);
+
+    schedTestGroup.operations.refill(&schedTestGroup);
+    ASSERT_FALSE(schedTestGroup.throttled);
+    ASSERT_EQ(schedTestGroup.runtimeNs, 0);
+    ASSERT_EQ(schedTestGroup.throttledThreads.size, 0);
+    ASSERT_EQ(schedTestGroup.status.periods, 1);
+    ASSERT_EQ(running->threadStatus, THREAD_READY);
+    ASSERT_EQ(sibling->threadStatus, THREAD_READY);
+    ASSERT_EQ(cpu->rbTree.size, 3);
+}
+
+void should_sched_group_refill_from_timer() {
+    sched_group_test_init();
+    PerCpu *cpu = percpu_get(0);
+    Thread *sleeper = &testThreads[0];
+    test_init_thread(sleeper, 0, cpu_number_to_mask(0));
+    sleeper->threadStatus = THREAD_BLOCKED;
+    schedTestGroup.operations.attach(&schedTestGroup, sleeper);
+    ASSERT_TRUE(schedTestGroup.operations.charge(&schedTestGroup, (uint64_t) SCHED_GROUP_TEST_QUOTA_US * 1000));
+
+    // a thread of a throttled group that wakes up goes straight to the group
+    testScheduler.operation.wakeup(&testScheduler, sleeper);
+    ASSERT_EQ(sleeper->threadStatus, THREAD_THROTTLED);
+    ASSERT_EQ(cpu->rbTree.size, 0);
+
+    // one period passes
+    kernelTimerManager.lastCounter = read_cntvct() - (uint64_t) read_cntfrq() / 1000 * SCHED_GROUP_TEST_PERIOD_MS;
+    kernelTimerManager.operation.onTick();
+    ASSERT_EQ(schedTestGroup.status.periods, 1);
+    ASSERT_EQ(sleeper->threadStatus, THREAD_READY);
+    ASSERT_EQ(cpu->rbTree.size, 1);
+    // the timer is rearmed for the next period instead of released
+    ASSERT_EQ(kernelTimerManager.timerNodes, &schedTestGroup.refillTimer);
+    ASSERT_TRUE(schedTestGroup.refillTimer.remainTime > 0);
+}
+
+Thread *schedTestDetached = nullptr;
+SchedulerOperationWakeup schedTestWakeup;
+
+/**
+ * the refill has dequeued the thread and dropped the group lock, the thread leaves the group before its wakeup
+ */
+KernelStatus sched_group_test_detach_then_wakeup(Scheduler *scheduler, Thread *thread) {
+    if (schedTestDetached == nullptr) {
+        schedTestDetached = thread;
+        schedTestGroup.operations.detach(&schedTestGroup, thread);
+    }
+    return schedTestWakeup(scheduler, thread);
+}
+
+void should_sched_group_detach_during_refill() {
+    sched_group_test_init();
+    PerCpu *cpu = percpu_get(0);
+    Thread *first = &testThreads[0];
+    Thread *second = &testThreads[1];
+    test_init_thread(first, 0, cpu_number_to_mask(0));
+    test_init_thread(second, 0, cpu_number_to_mask(0));
+    schedTestGroup.operations.attach(&schedTestGroup, first);
+    schedTestGroup.operations.attach(&schedTestGroup, second);
+    ASSERT_TRUE(schedTestGroup.operations.charge(&schedTestGroup, (uint64_t) SCHED_GROUP_TEST_QUOTA_US * 1000));
+    ASSERT_EQ(schedTestGroup.operations.park(&schedTestGroup, first), OK);
+    ASSERT_EQ(schedTestGroup.operations.park(&schedTestGroup, second), OK);
+
+    schedTestDetached = nullptr;
+    schedTestWakeup = cfsScheduler.operation.wakeup;
+    cfsScheduler.operation.wakeup = (SchedulerOperationWakeup) sched_group_test_detach_then_wakeup;
+    schedTestGroup.operations.refill(&schedTestGroup);
+    cfsScheduler.operation.wakeup = schedTestWakeup;
+
+    // the detached thread was not taken off the queue a second time, the other one is still woken up
+    ASSERT_EQ(schedTestDetached, first);
+    ASSERT_EQ(first->schedGroup, nullptr);
+    ASSERT_EQ(schedTestGroup.memberCount, 1);
+    ASSERT_EQ(schedTestGroup.throttledThreads.size, 0);
+    ASSERT_EQ(first->threadStatus, THREAD_READY);
+    ASSERT_EQ(second->threadStatus, THREAD_READY);
+    ASSERT_EQ(cpu->rbTree.size, 2);
+}
+
+void should_sched_group_tick_at_quota_end() {
+    sched_group_test_init();
+    PerCpu *cpu = percpu_get(0);
+    Thread *thread = &testThreads[0];
+    test_init_thread(thread, 0, cpu_number_to_mask(0));
+    cpu->operations.insertThread(cpu, thread);
+    cpu->currentThread = thread;
+    cpu->sliceStart = read_cntvct();
+    // alone on the cpu it would not need a tick at all
+    ASSERT_EQ(scheduler_next_event(cpu), TICK_NO_EVENT);
+
+    schedTestGroup.operations.attach(&schedTestGroup, thread);
+    uint32_t nextEvent = scheduler_next_event(cpu);
+    ASSERT_TRUE(nextEvent > 0 && nextEvent <= SCHED_GROUP_TEST_QUOTA_US / 1000);
+
+    schedTestGroup.operations.detach(&schedTestGroup, thread);
+    ASSERT_EQ(thread->schedGroup, nullptr);
+    ASSERT_EQ(schedTestGroup.memberCount, 0);
+    ASSERT_EQ(scheduler_next_event(cpu), TICK_NO_EVENT);
+}
+
+#endif//__KERNEL_SCHED_GROUP_TEST_H__
@@ -0,0 +1,94 @@
+//
+// Created by XingfengYang on 2021/1/20.
+//
+
+#ifndef __KERNEL_SCHED_TRACE_TEST_H__
+#define __KERNEL_SCHED_TRACE_TEST_H__
+
+#include "arm/register.h"
+#include "kernel/sched_trace.h"
+#include "tests/tests_lib.h"
+
+#define SCHED_TRACE_BENCHMARK_RECORDS 10000
+
+void should_sched_trace_record_events() {
+    sched_trace_reset();
+    sched_trace_record(SCHED_TRACE_WAKEUP, 7, 1, 1);
+    sched_trace_record(SCHED_TRACE_SWITCH, 3, 7, THREAD_READY);
+    sched_trace_record(SCHED_TRACE_TICK, 20, 0, 0);
+    ASSERT_EQ(sched_trace_head(0), 3);
+
+    SchedTraceEntry wakeup;
+    SchedTraceEntry switchEntry;
+    SchedTraceEntry tick;
+    ASSERT_TRUE(sched_trace_read(0, 0, &wakeup));
+    ASSERT_TRUE(sched_trace_read(0, 1, &switchEntry));
+    ASSERT_TRUE(sched_trace_read(0, 2, &tick));
+    ASSERT_EQ(wakeup.event, SCHED_TRACE_WAKEUP);
+    ASSERT_EQ(wakeup.arg0, 7);
+    ASSERT_EQ(switchEntry.event, SCHED_TRACE_SWITCH);
+    ASSERT_EQ(switchEntry.arg1, 7);
+    ASSERT_EQ(tick.arg0, 20);
+    ASSERT_TRUE(wakeup.timestamp <= switchEntry.timestamp && switchEntry.timestamp <= tick.timestamp);
+
+    // not written yet
+    ASSERT_FALSE(sched_trace_read(0, 3, &tick));
+}
+
+void should_sched_trace_drop_overwritten_entries() {
+    sched_trace_reset();
+    for (uint32_t i = 0; i < SCHED_TRACE_ENTRIES + 10; i++) {
+        sched_trace_record(SCHED_TRACE_TICK, i, 0, 0);
+    }
+    uint32_t head = sched_trace_head(0);
+    SchedTraceEntry entry;
+    ASSERT_FALSE(sched_trace_read(0, 0, &entry));
+    ASSERT_FALSE(sched_trace_read(0, head - SCHED_TRACE_ENTRIES, &entry));
+    ASSERT_TRUE(sched_trace_read(0, head - SCHED_TRACE_ENTRIES + 1, &entry));
+    ASSERT_EQ(entry.arg0, head - SCHED_TRACE_ENTRIES + 1);
+    ASSERT_TRUE(sched_trace_read(0, head - 1, &entry));
+    ASSERT_EQ(entry.arg0, head - 1);
+}
+
+void should_sched_trace_record_switch() {
+    test_init_scheduler();
+    PerCpu *cpu = percpu_get(0);
+    Thread *first = &testThreads[0];
+    Thread *second = &testThreads[1];
+    test_init_thread(first, 10, cpu_number_to_mask(0));
+    test_init_thread(second, 20, cpu_number_to_mask(0));
+    first->pid = 11;
+    second->pid = 12;
+    cpu->operations.insertThread(cpu, first);
+    cpu->operations.insertThread(cpu, second);
+    cpu->currentThread = first;
+    first->threadStatus = THREAD_RUNNING;
+    // make the first thread run far ahead, so the second one is picked
+    first->runtimeVirtualNs = 1000000000;
+    cpu->sliceStart = read_cntvct();
+
+    sched_trace_reset();
+    testScheduler.operation.switchNext(&testScheduler);
+    ASSERT_EQ(cpu->currentThread, second);
+    ASSERT_EQ(sched_trace_head(0), 1);
+    SchedTraceEntry entry;
+    ASSERT_TRUE(sched_trace_read(0, 0, &entry));
+    ASSERT_EQ(entry.event, SCHED_TRACE_SWITCH);
+    ASSERT_EQ(entry.arg0, 11);
+    ASSERT_EQ(entry.arg1, 12);
+    ASSERT_EQ(entry.arg2, THREAD_RUNNING);
+}
+
+void should_sched_trace_record_benchmark() {
+    sched_trace_reset();
+    uint64_t start = read_cntvct();
+    for (uint32_t i = 0; i < SCHED_TRACE_BENCHMARK_RECORDS; i++) {
+        sched_trace_record(SCHED_TRACE_TICK, i, 0, 0);
+    }
+    uint64_t elapsedNs = scheduler_counter_to_ns(read_cntvct() - start);
+    printf("[SchedTrace Benchmark]: %d ns per record\n", (uint32_t) (elapsedNs / SCHED_TRACE_BENCHMARK_RECORDS));
+    ASSERT_EQ(sched_trace_head(0), SCHED_TRACE_BENCHMARK_RECORDS);
+    sched_trace_reset();
+}
+
+#endif//__KERNEL_SCHED_TRACE_TEST_H__
@@ -0,0 +1,112 @@
+//
+// Created by XingfengYang on 2021/1/25.
+//
+
+#ifndef __KERNEL_SPINLOCK_TEST_H__
+#define __KERNEL_SPINLOCK_TEST_H__
+
+#include "arm/interrupt.h"
+#include "arm/register.h"
+#include "kernel/spinlock.h"
+#include "tests/tests_lib.h"
+
+#define SPINLOCK_BENCHMARK_MS 20
+
+SpinLock spinlockTestLock = SpinLockCreate();
+SpinLock spinlockTestInnerLock = SpinLockCreate();
+
+volatile uint32_t spinlockTestShared = 0;
+uint32_t spinlockTestAcquisitions[SMP_MAX_CPUS];
+// every cpu starts and stops contending at the same counter values
+volatile uint64_t spinlockTestStart = 0;
+volatile uint64_t spinlockTestEnd = 0;
+
+void should_spinlock_hand_out_tickets_in_order() {
+    spinlock_create(&spinlockTestLock);
+    for (uint32_t i = 0; i < 3; i++) {
+        spinlockTestLock.operations.acquire(&spinlockTestLock);
+        // the next free ticket is one ahead of the one being served
+        ASSERT_EQ(spinlockTestLock.lock.counter, ((i + 1) << SPINLOCK_TICKET_SHIFT) | i);
+        spinlockTestLock.operations.release(&spinlockTestLock);
+    }
+    ASSERT_EQ(spinlockTestLock.lock.counter, (3u << SPINLOCK_TICKET_SHIFT) | 3);
+
+    // the owner half wraps on its own without carrying into the next ticket
+    spinlockTestLock.lock.counter = 0xFFFFFFFF;
+    spinlockTestLock.operations.acquire(&spinlockTestLock);
+    ASSERT_EQ(spinlockTestLock.lock.counter, 0x0000FFFF);
+    spinlockTestLock.operations.release(&spinlockTestLock);
+    ASSERT_EQ(spinlockTestLock.lock.counter, 0);
+}
+
+void should_spinlock_restore_prior_interrupt_mask() {
+    spinlock_create(&spinlockTestLock);
+    spinlock_create(&spinlockTestInnerLock);
+    uint32_t interruptEnabled = arch_is_interrupt_enabled();
+    arch_disable_interrupt();
+
+    // taken with interrupts disabled, they stay disabled after the release
+    uint32_t saved = spinlockTestLock.operations.acquireIrqSave(&spinlockTestLock);
+    ASSERT_EQ(saved, 0);
+    spinlockTestInnerLock.operations.acquire(&spinlockTestInnerLock);
+    ASSERT_EQ(spinlockTestInnerLock.interruptEnabled, 0);
+    spinlockTestInnerLock.operations.release(&spinlockTestInnerLock);
+    ASSERT_EQ(arch_is_interrupt_enabled(), 0);
+    spinlockTestLock.operations.releaseIrqRestore(&spinlockTestLock, saved);
+    ASSERT_EQ(arch_is_interrupt_enabled(), 0);
+
+    if (interruptEnabled) {
+        arch_enable_interrupt();
+    }
+}
+
+void spinlock_test_contend() {
+    CpuNum cpuId = read_cpuid();
+    uint32_t acquisitions = 0;
+    while (read_cntvct() < spinlockTestStart) {
+    }
+    while (read_cntvct() < spinlockTestEnd) {
+        spinlockTestLock.operations.acquire(&spinlockTestLock);
+        // not atomic, only correct if the lock really excludes the other cpus
+        spinlockTestShared++;
+        spinlockTestLock.operations.release(&spinlockTestLock);
+        acquisitions++;
+    }
+    spinlockTestAcquisitions[cpuId] = acquisitions;
+}
+
+/**
+ * every online cpu takes the same lock in a loop for a fixed time, a fair lock gives each about the same share
+ */
+void should_spinlock_contention_benchmark() {
+    uint32_t onlineCpus = test_start_secondary_cpus();
+    spinlock_create(&spinlockTestLock);
+    spinlockTestShared = 0;
+    uint64_t countPerMs = read_cntfrq() / 1000;
+    for (CpuNum cpuId = 0; cpuId < SMP_MAX_CPUS; cpuId++) {
+        spinlockTestAcquisitions[cpuId] = 0;
+        testWork[cpuId] = cpuId < onlineCpus ? spinlock_test_contend : nullptr;
+    }
+    // leave the secondary cpus a moment to wake up before the clock starts
+    spinlockTestStart = read_cntvct() + countPerMs;
+    spinlockTestEnd = spinlockTestStart + countPerMs * SPINLOCK_BENCHMARK_MS;
+    test_run_round();
+
+    uint32_t total = 0;
+    uint32_t min = 0xFFFFFFFF;
+    uint32_t max = 0;
+    for (CpuNum cpuId = 0; cpuId < onlineCpus; cpuId++) {
+        uint32_t acquisitions = spinlockTestAcquisitions[cpuId];
+        printf("[SpinLock Benchmark]: cpu %d, %d acquisitions\n", cpuId, acquisitions);
+        total += acquisitions;
+        min = acquisitions < min ? acquisitions : min;
+        max = acquisitions > max ? acquisitions : max;
+    }
+    printf("[SpinLock Benchmark]: %d cpus, %d acquisitions per second, fairness min/max %d%%\n", onlineCpus,
+           total * (1000 / SPINLOCK_BENCHMARK_MS), max == 0 ? 0 : min * 100 / max);
+    ASSERT_EQ(spinlockTestShared, total);
+    // tickets are served in order, no cpu can be starved
+    ASSERT_TRUE(min > 0);
+}
+
+#endif//__KERNEL_SPINLOCK_TEST_H__
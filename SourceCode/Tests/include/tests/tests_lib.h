@@ -5,8 +5,14 @@
 #ifndef __KERNEL_TEST_H__
 #define __KERNEL_TEST_H__
 
+#include "kernel/percpu.h"
+#include "kernel/scheduler.h"
+#include "kernel/thread.h"
 #include "libc/stdlib.h"
 
+#define TEST_THREAD_NUM 256
+#define TEST_SECONDARY_START_TIMEOUT_MS 100
+
 static uint32_t __test_all_asserts = 0;
 static uint32_t __test_failed_asserts = 0;
 
@@ -51,4 +57,29 @@ void __assert_func_success(const char *file, int line, const char *func, const c
         assert(abs((left) - (right)) < (sill)); \
     } while (0)
 
+/**
+ * work a test hands to a cpu for one round, it reads its cpu with read_cpuid
+ */
+typedef void (*TestWork)(void);
+
+extern Thread testThreads[TEST_THREAD_NUM];
+extern Scheduler testScheduler;
+// what every cpu runs in the current round, nullptr for nothing
+extern TestWork volatile testWork[SMP_MAX_CPUS];
+extern uint32_t testOnlineCpus;
+
+void test_init_percpu(void);
+
+void test_init_scheduler(void);
+
+void test_init_thread(Thread *thread, uint32_t runtimeVirtualNs, CpuMask cpuAffinity);
+
+void test_secondary_main(void);
+
+uint32_t test_start_secondary_cpus(void);
+
+void test_run_round(void);
+
+void test_run_on_cpu(CpuNum cpuId, TestWork work);
+
 #endif//__KERNEL_TEST_H__
@@ -0,0 +1,88 @@
+//
+// Created by XingfengYang on 2020/7/24.
+//
+
+#ifndef __KERNEL_TICK_TEST_H__
+#define __KERNEL_TICK_TEST_H__
+
+#include "arm/register.h"
+#include "kernel/interrupt.h"
+#include "kernel/scheduler.h"
+#include "tests/tests_lib.h"
+
+InterruptManager tickTestManager;
+Tick tickTestTimerTick;
+Tick tickTestIdleTick;
+
+uint32_t tick_test_timer_next_event() {
+    return 30;
+}
+
+uint32_t tick_test_idle_next_event() {
+    return TICK_NO_EVENT;
+}
+
+void tick_test_handler() {
+}
+
+void should_interrupt_manager_next_event() {
+    interrupt_manager_create(&tickTestManager);
+    ASSERT_EQ(tickTestManager.operation.nextEvent(&tickTestManager), TICK_NO_EVENT);
+
+    tick_init(&tickTestIdleTick, tick_test_handler, "idle tick");
+    tickTestIdleTick.nextEvent = tick_test_idle_next_event;
+    tickTestManager.operation.registerTick(&tickTestManager, &tickTestIdleTick);
+    ASSERT_EQ(tickTestManager.operation.nextEvent(&tickTestManager), TICK_NO_EVENT);
+
+    // a tick without nextEvent keeps the old fixed interval
+    tick_init(&tickTestTimerTick, tick_test_handler, "timer tick");
+    tickTestManager.operation.registerTick(&tickTestManager, &tickTestTimerTick);
+    ASSERT_EQ(tickTestManager.operation.nextEvent(&tickTestManager), TICK_DEFAULT_INTERVAL_MS);
+
+    tickTestTimerTick.nextEvent = tick_test_timer_next_event;
+    ASSERT_EQ(tickTestManager.operation.nextEvent(&tickTestManager), 30);
+}
+
+void should_scheduler_slow_tick_when_idle() {
+    test_init_percpu();
+    PerCpu *cpu = percpu_get(0);
+    cpu->currentThread = cpu->idleThread;
+    // an idle cpu only wakes up now and then to steal, until its slow tick is due
+    cpu->sliceStart = read_cntvct();
+    uint32_t nextEvent = scheduler_next_event(cpu);
+    ASSERT_TRUE(nextEvent > 0 && nextEvent <= SCHED_IDLE_TICK_MS);
+    cpu->sliceStart = read_cntvct() - (uint64_t) read_cntfrq() / 1000 * SCHED_IDLE_TICK_MS;
+    ASSERT_EQ(scheduler_next_event(cpu), 0);
+
+    // work arrived on an idle cpu, it should switch right away
+    test_init_thread(&testThreads[0], 10, CPU_MASK_ALL);
+    cpu->operations.insertThread(cpu, &testThreads[0]);
+    ASSERT_EQ(scheduler_next_event(cpu), 0);
+
+    // a thread running alone does not need a tick either
+    cpu->currentThread = &testThreads[0];
+    cpu->sliceStart = read_cntvct();
+    ASSERT_EQ(scheduler_next_event(cpu), TICK_NO_EVENT);
+}
+
+void should_scheduler_tick_at_slice_end() {
+    test_init_percpu();
+    PerCpu *cpu = percpu_get(0);
+    test_init_thread(&testThreads[0], 10, CPU_MASK_ALL);
+    test_init_thread(&testThreads[1], 20, CPU_MASK_ALL);
+    cpu->operations.insertThread(cpu, &testThreads[0]);
+    cpu->operations.insertThread(cpu, &testThreads[1]);
+    cpu->currentThread = &testThreads[0];
+    cpu->sliceStart = read_cntvct();
+
+    // two threads of the same weight share the latency period
+    ASSERT_EQ(scheduler_slice_ms(cpu, &testThreads[0]), SCHED_LATENCY_MS / 2);
+    uint32_t nextEvent = scheduler_next_event(cpu);
+    ASSERT_TRUE(nextEvent > 0 && nextEvent <= SCHED_LATENCY_MS / 2);
+
+    // an expired slice asks for an immediate switch
+    cpu->sliceStart = read_cntvct() - (uint64_t) read_cntfrq();
+    ASSERT_EQ(scheduler_next_event(cpu), 0);
+}
+
+#endif//__KERNEL_TICK_TEST_H__
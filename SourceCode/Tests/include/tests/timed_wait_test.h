@@ -0,0 +1,147 @@
+//
+// Created by XingfengYang on 2021/2/1.
+//
+
+#ifndef __KERNEL_TIMED_WAIT_TEST_H__
+#define __KERNEL_TIMED_WAIT_TEST_H__
+
+#include "arm/register.h"
+#include "kernel/ktimer.h"
+#include "kernel/mutex.h"
+#include "kernel/semaphore.h"
+#include "tests/tests_lib.h"
+
+#define TIMED_WAIT_TEST_TIMEOUT_MS 10
+
+extern Scheduler cfsScheduler;
+extern KernelTimerManager kernelTimerManager;
+
+Mutex timedWaitTestMutex;
+Semaphore timedWaitTestSemaphore;
+
+void timed_wait_test_init() {
+    test_init_scheduler();
+    // timed out threads are woken up through the kernel scheduler
+    scheduler_create(&cfsScheduler);
+    kernel_timer_manager_create(&kernelTimerManager);
+    kernelTimerManager.lastCounter = read_cntvct();
+    mutex_create(&timedWaitTestMutex);
+    semaphore_create(&timedWaitTestSemaphore, 0);
+}
+
+void timed_wait_test_pass_ms(uint32_t ms) {
+    kernelTimerManager.lastCounter -= (uint64_t) read_cntfrq() / 1000 * ms;
+    kernelTimerManager.operation.onTick();
+}
+
+void should_timed_wait_only_try_without_timeout() {
+    timed_wait_test_init();
+    PerCpu *cpu = percpu_get(0);
+    Thread *owner = &testThreads[0];
+    test_init_thread(owner, 0, cpu_number_to_mask(0));
+    owner->threadStatus = THREAD_RUNNING;
+    cpu->currentThread = owner;
+
+    ASSERT_EQ(timedWaitTestMutex.operations.acquireTimeout(&timedWaitTestMutex, 0), OK);
+    ASSERT_EQ(timedWaitTestMutex.owner, owner);
+    ASSERT_EQ(timedWaitTestMutex.operations.acquireTimeout(&timedWaitTestMutex, 0), TIMEOUT);
+    ASSERT_EQ(timedWaitTestMutex.waitQueue.size, 0);
+    timedWaitTestMutex.operations.release(&timedWaitTestMutex);
+
+    timedWaitTestSemaphore.operations.post(&timedWaitTestSemaphore);
+    ASSERT_EQ(timedWaitTestSemaphore.operations.waitTimeout(&timedWaitTestSemaphore, 0), OK);
+    ASSERT_EQ(timedWaitTestSemaphore.operations.waitTimeout(&timedWaitTestSemaphore, 0), TIMEOUT);
+    ASSERT_EQ(atomic_get(&timedWaitTestSemaphore.count), 0);
+    cpu->currentThread = nullptr;
+}
+
+/**
+ * the waiter is put on the wait queue and armed the way acquireTimeout leaves it when it goes to sleep
+ */
+void should_timed_wait_take_waiter_off_queue() {
+    timed_wait_test_init();
+    PerCpu *cpu = percpu_get(0);
+    Thread *owner = &testThreads[0];
+    Thread *waiter = &testThreads[1];
+    test_init_thread(owner, 0, cpu_number_to_mask(0));
+    test_init_thread(waiter, 0, cpu_number_to_mask(0));
+    owner->threadStatus = THREAD_RUNNING;
+    cpu->currentThread = owner;
+    timedWaitTestMutex.operations.acquire(&timedWaitTestMutex);
+
+    waiter->threadStatus = THREAD_BLOCKED;
+    timedWaitTestMutex.waitQueue.operations.enqueue(&timedWaitTestMutex.waitQueue, &waiter->threadReadyQueue);
+    KernelTimedWait wait;
+    kernel_timed_wait_arm(&wait, &timedWaitTestMutex.spinLock, &timedWaitTestMutex.waitQueue, waiter,
+                          TIMED_WAIT_TEST_TIMEOUT_MS);
+    timed_wait_test_pass_ms(TIMED_WAIT_TEST_TIMEOUT_MS / 2);
+    ASSERT_EQ(waiter->threadStatus, THREAD_BLOCKED);
+
+    timed_wait_test_pass_ms(TIMED_WAIT_TEST_TIMEOUT_MS / 2);
+    ASSERT_EQ(waiter->threadStatus, THREAD_READY);
+    ASSERT_EQ(timedWaitTestMutex.waitQueue.size, 0);
+    ASSERT_EQ(kernelTimerManager.timerNodes, nullptr);
+    ASSERT_EQ(kernel_timed_wait_finish(&wait), TIMEOUT);
+
+    // the timed out waiter is not handed the mutex
+    timedWaitTestMutex.operations.release(&timedWaitTestMutex);
+    ASSERT_EQ(timedWaitTestMutex.owner, nullptr);
+    ASSERT_EQ(atomic_get(&timedWaitTestMutex.val), 0);
+    cpu->currentThread = nullptr;
+}
+
+void should_timed_wait_lose_to_post() {
+    timed_wait_test_init();
+    Thread *waiter = &testThreads[0];
+    test_init_thread(waiter, 0, cpu_number_to_mask(0));
+    waiter->threadStatus = THREAD_BLOCKED;
+    timedWaitTestSemaphore.waitQueue.operations.enqueue(&timedWaitTestSemaphore.waitQueue,
+                                                        &waiter->threadReadyQueue);
+    KernelTimedWait wait;
+    kernel_timed_wait_arm(&wait, &timedWaitTestSemaphore.spinLock, &timedWaitTestSemaphore.waitQueue, waiter,
+                          TIMED_WAIT_TEST_TIMEOUT_MS);
+
+    timedWaitTestSemaphore.operations.post(&timedWaitTestSemaphore);
+    ASSERT_EQ(waiter->threadStatus, THREAD_READY);
+    ASSERT_EQ(kernel_timed_wait_finish(&wait), OK);
+    ASSERT_EQ(kernelTimerManager.timerNodes, nullptr);
+
+    // the disarmed timer does not come back
+    timed_wait_test_pass_ms(TIMED_WAIT_TEST_TIMEOUT_MS);
+    ASSERT_FALSE(wait.timedOut);
+    ASSERT_EQ(atomic_get(&timedWaitTestSemaphore.count), 0);
+}
+
+void should_thread_join_exit() {
+    timed_wait_test_init();
+    PerCpu *cpu = percpu_get(0);
+    Thread *joiner = &testThreads[0];
+    Thread *target = &testThreads[1];
+    Thread *other = &testThreads[2];
+    test_init_thread(joiner, 0, cpu_number_to_mask(0));
+    test_init_thread(target, 0, cpu_number_to_mask(0));
+    test_init_thread(other, 0, cpu_number_to_mask(0));
+    thread_set_ops(joiner);
+    thread_set_ops(target);
+    joiner->threadStatus = THREAD_RUNNING;
+    cpu->currentThread = joiner;
+
+    int returnCode = 0;
+    ASSERT_EQ(target->operations.join(target, &returnCode, 0), TIMEOUT);
+    ASSERT_EQ(target->joinQueue.size, 0);
+
+    // a thread left in join the way join leaves it when it goes to sleep
+    other->threadStatus = THREAD_BLOCKED;
+    target->joinQueue.operations.enqueue(&target->joinQueue, &other->threadReadyQueue);
+    target->operations.exit(target, 7);
+    ASSERT_EQ(target->threadStatus, THREAD_DEATH);
+    ASSERT_EQ(other->threadStatus, THREAD_READY);
+    ASSERT_EQ(target->joinQueue.size, 0);
+
+    ASSERT_EQ(target->operations.join(target, &returnCode, 0), OK);
+    ASSERT_EQ(returnCode, 7);
+    ASSERT_EQ(joiner->operations.join(joiner, &returnCode, 0), ERROR);
+    cpu->currentThread = nullptr;
+}
+
+#endif//__KERNEL_TIMED_WAIT_TEST_H__
@@ -0,0 +1,173 @@
+//
+// Created by XingfengYang on 2021/1/24.
+//
+
+#ifndef __KERNEL_VMM_TEST_H__
+#define __KERNEL_VMM_TEST_H__
+
+#include "arm/interrupt.h"
+#include "arm/mmu.h"
+#include "arm/register.h"
+#include "arm/vmm.h"
+#include "kernel/scheduler.h"
+#include "libc/string.h"
+
+#define VMM_TEST_SPACES (VMM_ASID_COUNT + 1)
+#define VMM_BENCHMARK_PAGES 64
+#define VMM_BENCHMARK_SWITCHES 1000
+// attribute 0 of MAIR0: normal memory, inner and outer non cacheable
+#define VMM_TEST_MAIR_NORMAL_NC 0x44
+
+VirtualMemory vmmTestSpaces[VMM_TEST_SPACES];
+
+// two address spaces with the same identity mapping, the working set in 4k pages and everything else in blocks
+PageTableEntry vmmTestL1[2][KERNEL_L1PT_NUMBER] __attribute__((aligned(4096)));
+PageTableEntry vmmTestL2[KERNEL_L2PT_NUMBER] __attribute__((aligned(4096)));
+PageTableEntry vmmTestL3[KERNEL_PTE_NUMBER] __attribute__((aligned(4096)));
+uint8_t vmmTestWorkingSet[VMM_BENCHMARK_PAGES * PAGE_SIZE] __attribute__((aligned(VMM_BENCHMARK_PAGES * PAGE_SIZE)));
+
+void vmm_test_init_spaces(uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        vmm_set_ops(&vmmTestSpaces[i]);
+        vmmTestSpaces[i].pageTable = vmmTestL1[i % 2];
+        vmmTestSpaces[i].asidContext = 0;
+    }
+}
+
+/**
+ * switch cpu 0 through all test address spaces, one asid more than a generation has
+ */
+void should_vmm_asid_rollover() {
+    vmm_test_init_spaces(VMM_TEST_SPACES);
+    uint32_t interruptEnabled = arch_is_interrupt_enabled();
+    arch_disable_interrupt();
+
+    uint32_t rollovers = vmm_asid_rollovers();
+    uint32_t rolloverAt = 0;
+    for (uint32_t i = 0; i < VMM_TEST_SPACES; i++) {
+        VirtualMemory *prev = i > 0 ? &vmmTestSpaces[i - 1] : nullptr;
+        vmmTestSpaces[i].operations.contextSwitch(prev, &vmmTestSpaces[i]);
+        if (rolloverAt == 0 && vmm_asid_rollovers() != rollovers) {
+            rolloverAt = i;
+        }
+    }
+    ASSERT_TRUE(rolloverAt > 1);
+
+    // the space running through the rollover keeps its asid in the new generation
+    VirtualMemory *running = &vmmTestSpaces[rolloverAt - 1];
+    uint32_t runningAsid = vmm_asid(running->asidContext);
+    VirtualMemory *last = &vmmTestSpaces[VMM_TEST_SPACES - 1];
+    running->operations.contextSwitch(last, running);
+    ASSERT_EQ(vmm_asid(running->asidContext), runningAsid);
+    ASSERT_EQ(running->asidContext >> VMM_ASID_BITS, last->asidContext >> VMM_ASID_BITS);
+
+    // no two spaces of the current generation share an asid
+    bool unique = true;
+    for (uint32_t i = 0; i < VMM_TEST_SPACES; i++) {
+        for (uint32_t j = i + 1; j < VMM_TEST_SPACES; j++) {
+            if ((vmmTestSpaces[i].asidContext >> VMM_ASID_BITS) == (last->asidContext >> VMM_ASID_BITS) &&
+                vmmTestSpaces[i].asidContext == vmmTestSpaces[j].asidContext) {
+                unique = false;
+            }
+        }
+        ASSERT_TRUE(vmm_asid(vmmTestSpaces[i].asidContext) != 0);
+    }
+    ASSERT_TRUE(unique);
+
+    if (interruptEnabled) {
+        arch_enable_interrupt();
+    }
+}
+
+void vmm_test_set_entry(PageTableEntry *entry, uint32_t address, bool table) {
+    memset(entry, 0, sizeof(PageTableEntry));
+    entry->valid = 1;
+    entry->table = table;
+    entry->af = 1;
+    // not global, so the entries are tagged with the asid of the space
+    entry->ng = 1;
+    entry->base = address >> VA_OFFSET;
+}
+
+void vmm_test_build_page_tables() {
+    uint32_t workingSet = (uint32_t) vmmTestWorkingSet;
+    uint32_t gigabyte = workingSet >> 30;
+    uint32_t block = (workingSet >> 21) & (KERNEL_L2PT_NUMBER - 1);
+    for (uint32_t space = 0; space < 2; space++) {
+        for (uint32_t i = 0; i < KERNEL_L1PT_NUMBER; i++) {
+            if (i == gigabyte) {
+                vmm_test_set_entry(&vmmTestL1[space][i], (uint32_t) vmmTestL2, true);
+            } else {
+                vmm_test_set_entry(&vmmTestL1[space][i], i << 30, false);
+            }
+        }
+    }
+    for (uint32_t i = 0; i < KERNEL_L2PT_NUMBER; i++) {
+        if (i == block) {
+            vmm_test_set_entry(&vmmTestL2[i], (uint32_t) vmmTestL3, true);
+        } else {
+            vmm_test_set_entry(&vmmTestL2[i], (gigabyte << 30) | (i << 21), false);
+        }
+    }
+    for (uint32_t i = 0; i < KERNEL_PTE_NUMBER; i++) {
+        vmm_test_set_entry(&vmmTestL3[i], (gigabyte << 30) | (block << 21) | (i << 12), true);
+    }
+}
+
+uint32_t vmm_test_touch_working_set() {
+    uint32_t sum = 0;
+    for (uint32_t page = 0; page < VMM_BENCHMARK_PAGES; page++) {
+        sum += *(volatile uint32_t *) &vmmTestWorkingSet[page * PAGE_SIZE];
+    }
+    return sum;
+}
+
+/**
+ * two address spaces take turns touching a working set of 4k pages. without asids every switch flushes the tlb
+ * and each touch refills an entry, with asids both spaces keep their entries.
+ */
+void should_vmm_asid_switch_benchmark() {
+    vmm_test_build_page_tables();
+    vmm_test_init_spaces(2);
+    uint32_t interruptEnabled = arch_is_interrupt_enabled();
+    arch_disable_interrupt();
+
+    uint32_t ttbcr = read_ttbcr();
+    uint32_t mair = read_mair0();
+    write_ttbcr(CONFIG_ARM_LPAE << 31);
+    write_mair0(VMM_TEST_MAIR_NORMAL_NC);
+    write_ttbr0_asid((uint32_t) vmmTestL1[0], 0);
+    tlb_invalidate_all();
+    mmu_enable();
+
+    uint64_t start = read_cntvct();
+    for (uint32_t i = 0; i < VMM_BENCHMARK_SWITCHES; i++) {
+        uint32_t space = i % 2;
+        write_ttbr0_asid((uint32_t) vmmTestL1[space], 0);
+        tlb_invalidate_all();
+        vmm_test_touch_working_set();
+    }
+    uint64_t flushNs = scheduler_counter_to_ns(read_cntvct() - start);
+
+    start = read_cntvct();
+    for (uint32_t i = 0; i < VMM_BENCHMARK_SWITCHES; i++) {
+        uint32_t space = i % 2;
+        vmmTestSpaces[space].operations.contextSwitch(&vmmTestSpaces[1 - space], &vmmTestSpaces[space]);
+        vmm_test_touch_working_set();
+    }
+    uint64_t asidNs = scheduler_counter_to_ns(read_cntvct() - start);
+
+    mmu_disable();
+    write_mair0(mair);
+    write_ttbcr(ttbcr);
+    tlb_invalidate_all();
+    if (interruptEnabled) {
+        arch_enable_interrupt();
+    }
+
+    printf("[VMM Benchmark]: %d pages, %d ns per switch with tlb flush, %d ns with asid\n", VMM_BENCHMARK_PAGES,
+           (uint32_t) (flushNs / VMM_BENCHMARK_SWITCHES), (uint32_t) (asidNs / VMM_BENCHMARK_SWITCHES));
+    ASSERT_TRUE(vmm_asid(vmmTestSpaces[0].asidContext) != vmm_asid(vmmTestSpaces[1].asidContext));
+}
+
+#endif//__KERNEL_VMM_TEST_H__
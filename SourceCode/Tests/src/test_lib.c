@@ -3,6 +3,9 @@
 //
 
 #include "tests/tests_lib.h"
+#include "arm/register.h"
+#include "kernel/interrupt.h"
+#include "raspi2/synestia_os_hal.h"
 
 void __assert_func_failed(const char *file, int line, const char *func, const char *failedexpr) {
     __test_all_asserts++;
@@ -26,3 +29,130 @@ void __assert_func_success(const char *file, int line, const char *func, const c
         printf("└──\033[32mAssertion \"%s\" true \033[0m\n", failedexpr);
     }
 }
+
+extern PerCpu *perCpu;
+extern InterruptManager genericInterruptManager;
+extern void _start(void);
+
+Thread testThreads[TEST_THREAD_NUM];
+Scheduler testScheduler;
+TestWork volatile testWork[SMP_MAX_CPUS];
+uint32_t testOnlineCpus = 0;
+
+static PerCpu testPerCpus[SMP_MAX_CPUS];
+static Thread testIdleThreads[SMP_MAX_CPUS];
+static Atomic testOnline;
+static Atomic testDone;
+static volatile uint32_t testRound = 0;
+
+/**
+ * point the global per cpu array to static test storage, so the run queues can be tested without a heap.
+ * placing a thread kicks its cpu through the interrupt manager, so that is set up too
+ */
+void test_init_percpu(void) {
+    interrupt_manager_create(&genericInterruptManager);
+    perCpu = testPerCpus;
+    for (CpuNum cpuId = 0; cpuId < SMP_MAX_CPUS; cpuId++) {
+        percpu_set_ops(&testPerCpus[cpuId]);
+        testPerCpus[cpuId].operations.init(&testPerCpus[cpuId], cpuId, &testIdleThreads[cpuId]);
+    }
+}
+
+/**
+ * a scheduler over the static test run queues, switchNext stands in for the timer interrupt
+ */
+void test_init_scheduler(void) {
+    scheduler_create(&testScheduler);
+    test_init_percpu();
+}
+
+void test_init_thread(Thread *thread, uint32_t runtimeVirtualNs, CpuMask cpuAffinity) {
+    thread->runtimeVirtualNs = runtimeVirtualNs;
+    thread->cpuAffinity = cpuAffinity;
+    thread->priority = DEFAULT_PRIORITY;
+    thread->schedPolicy = SCHED_OTHER;
+    thread->priorityBoosted = false;
+    thread->rtSliceUsedNs = 0;
+    thread->threadStatus = THREAD_READY;
+    thread->currCpu = INVALID_CPU;
+    thread->lastCpu = INVALID_CPU;
+    thread->fpuUsed = false;
+    thread->fpuCpu = INVALID_CPU;
+    thread->schedGroup = nullptr;
+    thread->futexKey = 0;
+    spinlock_create(&thread->joinLock);
+    spinlock_create(&thread->wakeupLock);
+    kqueue_create(&thread->joinQueue);
+}
+
+/**
+ * secondary cpus wait here for the rounds started by cpu 0, and acknowledge every round whether they had work or not
+ */
+void test_secondary_main(void) {
+    CpuNum cpuId = read_cpuid();
+    uint32_t round = 0;
+    atomic_inc(&testOnline);
+    while (true) {
+        while (testRound == round) {
+            asm volatile("wfe");
+        }
+        round = testRound;
+        asm volatile("dmb" ::: "memory");
+        if (testWork[cpuId] != nullptr) {
+            testWork[cpuId]();
+        }
+        asm volatile("dmb" ::: "memory");
+        atomic_inc(&testDone);
+    }
+}
+
+/**
+ * bring up the secondary cpus once, later calls return the number of cpus that came up the first time
+ */
+uint32_t test_start_secondary_cpus(void) {
+    if (testOnlineCpus != 0) {
+        return testOnlineCpus;
+    }
+    atomic_create(&testOnline);
+    for (CpuNum cpuId = 1; cpuId < SMP_MAX_CPUS; cpuId++) {
+        synestia_cpu_start(cpuId, (uint32_t) _start);
+    }
+    uint64_t deadline = read_cntvct() + (uint64_t) read_cntfrq() / 1000 * TEST_SECONDARY_START_TIMEOUT_MS;
+    while (atomic_get(&testOnline) < SMP_MAX_CPUS - 1 && read_cntvct() < deadline) {
+        // a cpu parked in boot.S may have missed the first event
+        asm volatile("sev");
+    }
+    testOnlineCpus = atomic_get(&testOnline) + 1;
+    return testOnlineCpus;
+}
+
+/**
+ * run testWork on every online cpu, cpu 0 included, and wait until all of them are through
+ */
+void test_run_round(void) {
+    atomic_create(&testDone);
+    asm volatile("dmb" ::: "memory");
+    testRound++;
+    asm volatile("dsb");
+    asm volatile("sev");
+    if (testWork[0] != nullptr) {
+        testWork[0]();
+    }
+    while (atomic_get(&testDone) < testOnlineCpus - 1) {
+    }
+    asm volatile("dmb" ::: "memory");
+    for (CpuNum cpuId = 0; cpuId < SMP_MAX_CPUS; cpuId++) {
+        testWork[cpuId] = nullptr;
+    }
+}
+
+/**
+ * run work on a single cpu, on cpu 0 if that cpu did not come up
+ */
+void test_run_on_cpu(CpuNum cpuId, TestWork work) {
+    if (cpuId >= testOnlineCpus) {
+        cpuId = 0;
+    }
+    testWork[cpuId] = work;
+    test_run_round();
+}
@@ -3,6 +3,7 @@
 //
 
 #include "kernel/kheap.h"
+#include "arm/pmu.h"
 #include "arm/register.h"
 
 #include "tests/tests_lib.h"
@@ -13,7 +14,23 @@
 #include "tests/kvector_test.h"
 
 #include "tests/atomic_test.h"
+#include "tests/cfs_test.h"
+#include "tests/fpu_test.h"
 #include "tests/libmath_test.h"
+#include "tests/lockstat_test.h"
+#include "tests/mpsc_queue_test.h"
+#include "tests/mutex_test.h"
+#include "tests/percpu_var_test.h"
+#include "tests/futex_test.h"
+#include "tests/rcu_test.h"
+#include "tests/rt_test.h"
+#include "tests/rwlock_test.h"
+#include "tests/sched_group_test.h"
+#include "tests/sched_trace_test.h"
+#include "tests/spinlock_test.h"
+#include "tests/tick_test.h"
+#include "tests/timed_wait_test.h"
+#include "tests/vmm_test.h"
 
 extern char _binary_initrd_img_start[];
 extern char _binary_initrd_img_end[];
@@ -22,6 +39,8 @@ extern uint32_t __KERNEL_END;
 extern Heap testHeap;
 
 void kernel_main_tests() {
+    fpu_init();
+    pmu_enable_cycle_counter();
     if (read_cpuid() == 0) {
         heap_create(&testHeap, _binary_initrd_img_end, 64 * MB);
 
@@ -42,6 +61,11 @@ void kernel_main_tests() {
         TEST_CASE("should_kheap_calloc", should_kheap_calloc);
         TEST_CASE("should_kheap_realloc", should_kheap_realloc);
         TEST_CASE("should_kheap_free", should_kheap_free);
+        TEST_CASE("should_kheap_reuse_size_class", should_kheap_reuse_size_class);
+        TEST_CASE("should_kheap_alloc_free_benchmark", should_kheap_alloc_free_benchmark);
+        TEST_CASE("should_kheap_coalesce_free_neighbours", should_kheap_coalesce_free_neighbours);
+        TEST_CASE("should_kheap_count_per_heap", should_kheap_count_per_heap);
+        TEST_CASE("should_kheap_soak", should_kheap_soak);
 
         TEST_CASE("should_kvector_create", should_kvector_create);
         TEST_CASE("should_kvector_resize", should_kvector_resize);
@@ -61,10 +85,112 @@ void kernel_main_tests() {
         TEST_CASE("should_atomic_dec", should_atomic_dec);
         TEST_CASE("should_atomic_sub", should_atomic_sub);
         TEST_CASE("should_atomic_add", should_atomic_add);
+        TEST_CASE("should_atomic_cmpxchg", should_atomic_cmpxchg);
+        TEST_CASE("should_atomic_fetch_ops", should_atomic_fetch_ops);
+        TEST_CASE("should_atomic64_carry_between_words", should_atomic64_carry_between_words);
+        TEST_CASE("should_atomic_stress", should_atomic_stress);
+        TEST_CASE("should_atomic_pass_messages", should_atomic_pass_messages);
+
+        TEST_CASE("should_rbtree_insert", should_rbtree_insert);
+        TEST_CASE("should_rbtree_get_min", should_rbtree_get_min);
+        TEST_CASE("should_rbtree_remove", should_rbtree_remove);
+        TEST_CASE("should_cfs_run_queue_benchmark", should_cfs_run_queue_benchmark);
+        TEST_CASE("should_percpu_steal_thread", should_percpu_steal_thread);
+        TEST_CASE("should_percpu_not_steal_pinned_thread", should_percpu_not_steal_pinned_thread);
+        TEST_CASE("should_percpu_place_on_least_loaded", should_percpu_place_on_least_loaded);
+        TEST_CASE("should_percpu_balance_migrate_thread", should_percpu_balance_migrate_thread);
+        TEST_CASE("should_percpu_not_balance_small_imbalance", should_percpu_not_balance_small_imbalance);
+        TEST_CASE("should_percpu_double_lock_in_cpu_order", should_percpu_double_lock_in_cpu_order);
+        TEST_CASE("should_scheduler_counter_to_ns", should_scheduler_counter_to_ns);
+        TEST_CASE("should_scheduler_calc_delta_vruntime", should_scheduler_calc_delta_vruntime);
+        TEST_CASE("should_scheduler_charge_real_runtime", should_scheduler_charge_real_runtime);
+        TEST_CASE("should_scheduler_wakeup_preempt", should_scheduler_wakeup_preempt);
+        TEST_CASE("should_scheduler_wakeup_not_preempt_within_granularity", should_scheduler_wakeup_not_preempt_within_granularity);
+        TEST_CASE("should_scheduler_wakeup_thread_not_switched_out", should_scheduler_wakeup_thread_not_switched_out);
+        TEST_CASE("should_scheduler_wake_thread_once", should_scheduler_wake_thread_once);
+        TEST_CASE("should_scheduler_dequeue_blocked_thread_on_switch", should_scheduler_dequeue_blocked_thread_on_switch);
+        TEST_CASE("should_cfs_switch_scaling_benchmark", should_cfs_switch_scaling_benchmark);
+        TEST_CASE("should_percpu_wakeup_on_last_cpu", should_percpu_wakeup_on_last_cpu);
+        TEST_CASE("should_cfs_wakeup_affinity_benchmark", should_cfs_wakeup_affinity_benchmark);
+        TEST_CASE("should_scheduler_post_remote_wakeup", should_scheduler_post_remote_wakeup);
+        TEST_CASE("should_scheduler_kick_tickless_wakeup_target", should_scheduler_kick_tickless_wakeup_target);
+
+        TEST_CASE("should_rt_queue_pick_highest_level", should_rt_queue_pick_highest_level);
+        TEST_CASE("should_rt_preempt_cfs_on_wakeup", should_rt_preempt_cfs_on_wakeup);
+        TEST_CASE("should_rt_fifo_keep_cpu", should_rt_fifo_keep_cpu);
+        TEST_CASE("should_rt_round_robin_after_slice", should_rt_round_robin_after_slice);
+        TEST_CASE("should_rt_set_policy_requeue_thread", should_rt_set_policy_requeue_thread);
+        TEST_CASE("should_rt_pick_benchmark", should_rt_pick_benchmark);
+
+        TEST_CASE("should_sched_trace_record_events", should_sched_trace_record_events);
+        TEST_CASE("should_sched_trace_drop_overwritten_entries", should_sched_trace_drop_overwritten_entries);
+        TEST_CASE("should_sched_trace_record_switch", should_sched_trace_record_switch);
+        TEST_CASE("should_sched_trace_record_benchmark", should_sched_trace_record_benchmark);
+
+        TEST_CASE("should_sched_group_throttle_at_quota", should_sched_group_throttle_at_quota);
+        TEST_CASE("should_sched_group_refill_from_timer", should_sched_group_refill_from_timer);
+        TEST_CASE("should_sched_group_detach_during_refill", should_sched_group_detach_during_refill);
+        TEST_CASE("should_sched_group_tick_at_quota_end", should_sched_group_tick_at_quota_end);
+
+        TEST_CASE("should_spinlock_hand_out_tickets_in_order", should_spinlock_hand_out_tickets_in_order);
+        TEST_CASE("should_spinlock_restore_prior_interrupt_mask", should_spinlock_restore_prior_interrupt_mask);
+        TEST_CASE("should_spinlock_contention_benchmark", should_spinlock_contention_benchmark);
+
+        TEST_CASE("should_rwlock_share_readers_exclude_writer", should_rwlock_share_readers_exclude_writer);
+        TEST_CASE("should_rwlock_prefer_waiting_writer", should_rwlock_prefer_waiting_writer);
+        TEST_CASE("should_rwlock_stress", should_rwlock_stress);
+        TEST_CASE("should_seqlock_stress", should_seqlock_stress);
+
+        TEST_CASE("should_mutex_track_owner", should_mutex_track_owner);
+        TEST_CASE("should_mutex_spin_only_on_running_owner", should_mutex_spin_only_on_running_owner);
+        TEST_CASE("should_mutex_inherit_priority", should_mutex_inherit_priority);
+        TEST_CASE("should_mutex_hand_off_benchmark", should_mutex_hand_off_benchmark);
+
+        TEST_CASE("should_futex_not_wait_on_changed_value", should_futex_not_wait_on_changed_value);
+        TEST_CASE("should_futex_wake_matching_waiters", should_futex_wake_matching_waiters);
+        TEST_CASE("should_futex_uncontended_benchmark", should_futex_uncontended_benchmark);
+        TEST_CASE("should_futex_contended_benchmark", should_futex_contended_benchmark);
+
+        TEST_CASE("should_timed_wait_only_try_without_timeout", should_timed_wait_only_try_without_timeout);
+        TEST_CASE("should_timed_wait_take_waiter_off_queue", should_timed_wait_take_waiter_off_queue);
+        TEST_CASE("should_timed_wait_lose_to_post", should_timed_wait_lose_to_post);
+        TEST_CASE("should_thread_join_exit", should_thread_join_exit);
+
+        TEST_CASE("should_rcu_wait_for_readers", should_rcu_wait_for_readers);
+        TEST_CASE("should_rcu_kick_tickless_pending_cpu", should_rcu_kick_tickless_pending_cpu);
+        TEST_CASE("should_rcu_defer_switch_in_read_section", should_rcu_defer_switch_in_read_section);
+        TEST_CASE("should_rcu_find_dentry_child", should_rcu_find_dentry_child);
+        TEST_CASE("should_rcu_keep_looked_up_dentry_until_release", should_rcu_keep_looked_up_dentry_until_release);
+        TEST_CASE("should_rcu_stress", should_rcu_stress);
+
+        TEST_CASE("should_lockstat_record_acquisitions", should_lockstat_record_acquisitions);
+        TEST_CASE("should_lockstat_rank_contended_locks", should_lockstat_rank_contended_locks);
+        TEST_CASE("should_lockstat_share_slot_for_unnamed_locks", should_lockstat_share_slot_for_unnamed_locks);
+        TEST_CASE("should_lockstat_overhead_benchmark", should_lockstat_overhead_benchmark);
+
+        TEST_CASE("should_mpsc_queue_keep_fifo_order", should_mpsc_queue_keep_fifo_order);
+        TEST_CASE("should_mpsc_queue_wait_for_unlinked_producer", should_mpsc_queue_wait_for_unlinked_producer);
+        TEST_CASE("should_mpsc_queue_throughput_benchmark", should_mpsc_queue_throughput_benchmark);
+
+        TEST_CASE("should_percpu_var_isolate_cpus", should_percpu_var_isolate_cpus);
+        TEST_CASE("should_percpu_var_count_benchmark", should_percpu_var_count_benchmark);
+
+        TEST_CASE("should_fpu_switch_lazily", should_fpu_switch_lazily);
+        TEST_CASE("should_fpu_keep_state_across_cpus", should_fpu_keep_state_across_cpus);
+        TEST_CASE("should_fpu_switch_benchmark", should_fpu_switch_benchmark);
+
+        TEST_CASE("should_interrupt_manager_next_event", should_interrupt_manager_next_event);
+        TEST_CASE("should_scheduler_slow_tick_when_idle", should_scheduler_slow_tick_when_idle);
+        TEST_CASE("should_scheduler_tick_at_slice_end", should_scheduler_tick_at_slice_end);
+
+        TEST_CASE("should_vmm_asid_rollover", should_vmm_asid_rollover);
+        TEST_CASE("should_vmm_asid_switch_benchmark", should_vmm_asid_switch_benchmark);
 
         TEST_CASE("should_math_sinf", should_math_sinf);
         TEST_CASE("should_math_cosf", should_math_cosf);
         TEST_CASE("should_math_fmod", should_math_fmod);
         TEST_CASE("should_math_powf", should_math_powf);
+    } else {
+        test_secondary_main();
     }
 }